@@ -58,6 +58,12 @@
 #include <time.h>
 #include <sys/wait.h>
 #include <signal.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #if HAVE_DLFCN_H
 #include <dlfcn.h>
 #endif
@@ -110,6 +116,8 @@ static const char *http_state[] = {
 
 #define SYNC_TIMEOUT (10 * 1000)
 
+#define MAX_WORKER_THREADS 64
+
 typedef struct RTSPActionServerSetup {
     uint32_t ipaddr;
     char transport_option[512];
@@ -137,6 +145,11 @@ typedef struct HTTPContext {
     int64_t data_count;
     /* feed input */
     int feed_fd;
+    AVIOContext *feed_pb;     /* reads a memory mapped feed */
+    int64_t feed_pos;
+    int64_t ring_pos;         /* next packet to read from the feed ring,
+                                 -1 while reading the feed file */
+    int64_t ring_seq;         /* packets in the ring at the sampled write index */
     /* input format handling */
     AVFormatContext *fmt_in;
     int64_t start_time;            /* In milliseconds - this wraps fairly often */
@@ -183,6 +196,12 @@ typedef struct HTTPContext {
     /* RTP/TCP specific */
     struct HTTPContext *rtsp_c;
     uint8_t *packet_buffer, *packet_buffer_ptr, *packet_buffer_end;
+
+    /* worker thread handling */
+    struct HTTPWorker *worker; /* thread owning the connection, NULL for the main thread */
+    struct HTTPContext *worker_next; /* next connection of the same worker */
+    unsigned feed_wakeups;     /* feed counters when we started to wait for the feed */
+    unsigned feed_closures;
 } HTTPContext;
 
 /* each generated stream is described here */
@@ -252,6 +271,17 @@ typedef struct FFStream {
     int64_t feed_max_size;      /* maximum storage size, zero means unlimited */
     int64_t feed_write_index;   /* current write position in feed (it wraps around) */
     int64_t feed_size;          /* current size of feed */
+    unsigned feed_wakeups;      /* incremented for each packet written to the feed */
+    unsigned feed_closures;     /* incremented each time the feeder goes away */
+    int mmap_feed;              /* true if the feed file should be memory mapped */
+    uint8_t *feed_map;          /* mapping of the feed file, NULL if not mapped */
+    int64_t feed_map_size;
+    int64_t feed_file_size;     /* size of the mapped file, never reduced so that
+                                   readers can't touch unbacked pages */
+    struct FeedRing *ring;      /* packets of a mapped feed shared by its connections */
+    AVFormatContext *ring_in;   /* demuxes the feed into the ring */
+    int64_t ring_seq;           /* packets in the ring up to feed_write_index,
+                                   -1 if the ring is not being filled */
     struct FFStream *next_feed;
 } FFStream;
 
@@ -323,6 +353,56 @@ static AVLFG random_state;
 
 static FILE *logfile = NULL;
 
+static int nb_worker_threads;
+
+#if HAVE_PTHREADS
+/* A worker thread sends the data of HTTP streaming connections, once
+ * their reply header has been sent by the main thread. Each worker polls
+ * its own share of the connections. The connections stay in
+ * first_http_ctx; this list and the rest of the server state is protected
+ * by server_lock, which the main thread holds except while in poll(). */
+typedef struct HTTPWorker {
+    pthread_t thread;
+    pthread_mutex_t mutex;  /* protects new_conns */
+    HTTPContext *new_conns; /* handed over by the main thread */
+    HTTPContext *conns;     /* owned by the worker */
+    int nb_conns;
+    int wakeup_pipe[2];
+    int64_t cur_time;       /* clock of the worker, like the global cur_time */
+} HTTPWorker;
+
+static HTTPWorker workers[MAX_WORKER_THREADS];
+static int next_worker;
+static pthread_mutex_t server_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Lock the shared server state when running in a worker thread. */
+static void lock_server(HTTPContext *c)
+{
+#if HAVE_PTHREADS
+    if (c->worker)
+        pthread_mutex_lock(&server_lock);
+#endif
+}
+
+static void unlock_server(HTTPContext *c)
+{
+#if HAVE_PTHREADS
+    if (c->worker)
+        pthread_mutex_unlock(&server_lock);
+#endif
+}
+
+/* Return the time in ms as of the last poll() of the thread handling c. */
+static int64_t get_cur_time(HTTPContext *c)
+{
+#if HAVE_PTHREADS
+    if (c->worker)
+        return c->worker->cur_time;
+#endif
+    return cur_time;
+}
+
 static int64_t ffm_read_write_index(int fd)
 {
     uint8_t buf[8];
@@ -451,15 +531,15 @@ static void log_connection(HTTPContext *c)
              c->protocol, (c->http_error ? c->http_error : 200), c->data_count);
 }
 
-static void update_datarate(DataRateData *drd, int64_t count)
+static void update_datarate(DataRateData *drd, int64_t count, int64_t now)
 {
     if (!drd->time1 && !drd->count1) {
-        drd->time1 = drd->time2 = cur_time;
+        drd->time1 = drd->time2 = now;
         drd->count1 = drd->count2 = count;
-    } else if (cur_time - drd->time2 > 5000) {
+    } else if (now - drd->time2 > 5000) {
         drd->time1 = drd->time2;
         drd->count1 = drd->count2;
-        drd->time2 = cur_time;
+        drd->time2 = now;
         drd->count2 = count;
     }
 }
@@ -620,11 +700,197 @@ static void start_multicast(void)
     }
 }
 
+/* set up the poll entry of a connection according to its state */
+static void add_poll_entry(HTTPContext *c, struct pollfd **poll_entry,
+                           int *delay)
+{
+    struct pollfd *entry = *poll_entry;
+
+    switch(c->state) {
+    case HTTPSTATE_SEND_HEADER:
+    case RTSPSTATE_SEND_REPLY:
+    case RTSPSTATE_SEND_PACKET:
+        c->poll_entry = entry;
+        entry->fd = c->fd;
+        entry->events = POLLOUT;
+        (*poll_entry)++;
+        break;
+    case HTTPSTATE_SEND_DATA_HEADER:
+    case HTTPSTATE_SEND_DATA:
+    case HTTPSTATE_SEND_DATA_TRAILER:
+        if (!c->is_packetized) {
+            /* for TCP, we output as much as we can (may need to put a limit) */
+            c->poll_entry = entry;
+            entry->fd = c->fd;
+            entry->events = POLLOUT;
+            (*poll_entry)++;
+        } else {
+            /* when avserver is doing the timing, we work by
+               looking at which packet need to be sent every
+               10 ms */
+            /* one tick wait XXX: 10 ms assumed */
+            *delay = FFMIN(*delay, 10);
+        }
+        break;
+    case HTTPSTATE_WAIT_REQUEST:
+    case HTTPSTATE_RECEIVE_DATA:
+    case HTTPSTATE_WAIT_FEED:
+    case RTSPSTATE_WAIT_REQUEST:
+        /* need to catch errors */
+        c->poll_entry = entry;
+        entry->fd = c->fd;
+        entry->events = POLLIN;/* Maybe this will work */
+        (*poll_entry)++;
+        break;
+    default:
+        c->poll_entry = NULL;
+        break;
+    }
+}
+
+#if HAVE_PTHREADS
+/* drop all connections of a worker that can't go on serving them */
+static void close_worker_connections(HTTPWorker *w)
+{
+    HTTPContext *c;
+
+    while ((c = w->conns)) {
+        w->conns = c->worker_next;
+        log_connection(c);
+        close_connection(c);
+    }
+    w->nb_conns = 0;
+}
+
+static void *http_worker(void *arg)
+{
+    HTTPWorker *w = arg;
+    struct pollfd *poll_table = NULL, *poll_entry;
+    int poll_table_size = 0, ret, delay;
+    HTTPContext *c, **cp;
+    char buf[64];
+
+    for(;;) {
+        /* take over the connections handed to us by the main thread */
+        pthread_mutex_lock(&w->mutex);
+        while ((c = w->new_conns)) {
+            w->new_conns = c->worker_next;
+            c->worker_next = w->conns;
+            w->conns = c;
+            w->nb_conns++;
+        }
+        pthread_mutex_unlock(&w->mutex);
+
+        if (poll_table_size < w->nb_conns + 1) {
+            poll_table_size = 2 * w->nb_conns + 1;
+            av_free(poll_table);
+            if (!(poll_table = av_malloc(poll_table_size * sizeof(*poll_table)))) {
+                http_log("Impossible to allocate a poll table handling %d connections.\n", w->nb_conns);
+                close_worker_connections(w);
+                poll_table_size = 0;
+                av_usleep(100 * 1000);
+                continue;
+            }
+        }
+        poll_entry = poll_table;
+        poll_entry->fd = w->wakeup_pipe[0];
+        poll_entry->events = POLLIN;
+        poll_entry++;
+
+        delay = 1000;
+        pthread_mutex_lock(&server_lock);
+        for (c = w->conns; c; c = c->worker_next) {
+            /* connections waiting for the feed are woken up through the
+               feed counters, as the main thread doesn't touch them */
+            if (c->state == HTTPSTATE_WAIT_FEED) {
+                if (c->stream->feed->feed_closures != c->feed_closures)
+                    c->state = HTTPSTATE_SEND_DATA_TRAILER;
+                else if (c->stream->feed->feed_wakeups != c->feed_wakeups)
+                    c->state = HTTPSTATE_SEND_DATA;
+            }
+            add_poll_entry(c, &poll_entry, &delay);
+        }
+        pthread_mutex_unlock(&server_lock);
+
+        do {
+            ret = poll(poll_table, poll_entry - poll_table, delay);
+        } while (ret < 0 && (ff_neterrno() == AVERROR(EAGAIN) ||
+                             ff_neterrno() == AVERROR(EINTR)));
+        if (ret < 0) {
+            http_log("poll failed in worker thread: %s\n", strerror(errno));
+            close_worker_connections(w);
+            continue;
+        }
+
+        if (poll_table[0].revents & POLLIN)
+            while (read(w->wakeup_pipe[0], buf, sizeof(buf)) > 0);
+
+        w->cur_time = av_gettime() / 1000;
+
+        for (cp = &w->conns; (c = *cp);) {
+            if (handle_connection(c) < 0) {
+                *cp = c->worker_next;
+                w->nb_conns--;
+                log_connection(c);
+                close_connection(c);
+            } else
+                cp = &c->worker_next;
+        }
+    }
+    return NULL;
+}
+
+static int start_workers(void)
+{
+    int i, ret;
+
+    for (i = 0; i < nb_worker_threads; i++) {
+        HTTPWorker *w = &workers[i];
+        if (pipe(w->wakeup_pipe) < 0) {
+            http_log("Could not create worker pipe: %s\n", strerror(errno));
+            return -1;
+        }
+        fcntl(w->wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(w->wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+        pthread_mutex_init(&w->mutex, NULL);
+        w->cur_time = av_gettime() / 1000;
+        if ((ret = pthread_create(&w->thread, NULL, http_worker, w))) {
+            http_log("Could not create worker thread: %s\n", strerror(ret));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* hand a streaming connection over to the next worker thread */
+static void assign_worker(HTTPContext *c)
+{
+    HTTPWorker *w = &workers[next_worker];
+
+    next_worker = (next_worker + 1) % nb_worker_threads;
+    c->worker = w;
+    pthread_mutex_lock(&w->mutex);
+    c->worker_next = w->new_conns;
+    w->new_conns = c;
+    pthread_mutex_unlock(&w->mutex);
+    if (write(w->wakeup_pipe[1], "", 1) < 0 && errno != EAGAIN)
+        http_log("Could not wake up worker thread: %s\n", strerror(errno));
+}
+
+static void wake_workers(void)
+{
+    int i;
+    for (i = 0; i < nb_worker_threads; i++)
+        if (write(workers[i].wakeup_pipe[1], "", 1) < 0 && errno != EAGAIN)
+            http_log("Could not wake up worker thread: %s\n", strerror(errno));
+}
+#endif
+
 /* main loop of the http server */
 static int http_server(void)
 {
     int server_fd = 0, rtsp_server_fd = 0;
-    int ret, delay, delay1;
+    int ret, delay;
     struct pollfd *poll_table, *poll_entry;
     HTTPContext *c, *c_next;
 
@@ -656,6 +922,12 @@ static int http_server(void)
 
     start_multicast();
 
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&server_lock);
+    if (start_workers() < 0)
+        return -1;
+#endif
+
     for(;;) {
         poll_entry = poll_table;
         if (server_fd) {
@@ -670,63 +942,25 @@ static int http_server(void)
         }
 
         /* wait for events on each HTTP handle */
-        c = first_http_ctx;
         delay = 1000;
-        while (c != NULL) {
-            int fd;
-            fd = c->fd;
-            switch(c->state) {
-            case HTTPSTATE_SEND_HEADER:
-            case RTSPSTATE_SEND_REPLY:
-            case RTSPSTATE_SEND_PACKET:
-                c->poll_entry = poll_entry;
-                poll_entry->fd = fd;
-                poll_entry->events = POLLOUT;
-                poll_entry++;
-                break;
-            case HTTPSTATE_SEND_DATA_HEADER:
-            case HTTPSTATE_SEND_DATA:
-            case HTTPSTATE_SEND_DATA_TRAILER:
-                if (!c->is_packetized) {
-                    /* for TCP, we output as much as we can (may need to put a limit) */
-                    c->poll_entry = poll_entry;
-                    poll_entry->fd = fd;
-                    poll_entry->events = POLLOUT;
-                    poll_entry++;
-                } else {
-                    /* when avserver is doing the timing, we work by
-                       looking at which packet need to be sent every
-                       10 ms */
-                    delay1 = 10; /* one tick wait XXX: 10 ms assumed */
-                    if (delay1 < delay)
-                        delay = delay1;
-                }
-                break;
-            case HTTPSTATE_WAIT_REQUEST:
-            case HTTPSTATE_RECEIVE_DATA:
-            case HTTPSTATE_WAIT_FEED:
-            case RTSPSTATE_WAIT_REQUEST:
-                /* need to catch errors */
-                c->poll_entry = poll_entry;
-                poll_entry->fd = fd;
-                poll_entry->events = POLLIN;/* Maybe this will work */
-                poll_entry++;
-                break;
-            default:
-                c->poll_entry = NULL;
-                break;
-            }
-            c = c->next;
-        }
+        for (c = first_http_ctx; c != NULL; c = c->next)
+            if (!c->worker)
+                add_poll_entry(c, &poll_entry, &delay);
 
         /* wait for an event on one connection. We poll at least every
            second to handle timeouts */
+#if HAVE_PTHREADS
+        pthread_mutex_unlock(&server_lock);
+#endif
         do {
             ret = poll(poll_table, poll_entry - poll_table, delay);
             if (ret < 0 && ff_neterrno() != AVERROR(EAGAIN) &&
                 ff_neterrno() != AVERROR(EINTR))
                 return -1;
         } while (ret < 0);
+#if HAVE_PTHREADS
+        pthread_mutex_lock(&server_lock);
+#endif
 
         cur_time = av_gettime() / 1000;
 
@@ -738,6 +972,8 @@ static int http_server(void)
         /* now handle the events */
         for(c = first_http_ctx; c != NULL; c = c_next) {
             c_next = c->next;
+            if (c->worker)
+                continue;
             if (handle_connection(c) < 0) {
                 /* close and free the connection */
                 log_connection(c);
@@ -849,6 +1085,8 @@ static void close_connection(HTTPContext *c)
     URLContext *h;
     AVStream *st;
 
+    lock_server(c);
+
     /* remove connection from list */
     cp = &first_http_ctx;
     while ((*cp) != NULL) {
@@ -877,6 +1115,10 @@ static void close_connection(HTTPContext *c)
         }
         avformat_close_input(&c->fmt_in);
     }
+    if (c->feed_pb) {
+        av_freep(&c->feed_pb->buffer);
+        av_freep(&c->feed_pb);
+    }
 
     /* free RTP output streams if any */
     nb_streams = 0;
@@ -924,8 +1166,9 @@ static void close_connection(HTTPContext *c)
     av_freep(&c->pb_buffer);
     av_freep(&c->packet_buffer);
     av_free(c->buffer);
-    av_free(c);
     nb_connections--;
+    unlock_server(c);
+    av_free(c);
 }
 
 static int handle_connection(HTTPContext *c)
@@ -936,7 +1179,7 @@ static int handle_connection(HTTPContext *c)
     case HTTPSTATE_WAIT_REQUEST:
     case RTSPSTATE_WAIT_REQUEST:
         /* timeout ? */
-        if ((c->timeout - cur_time) < 0)
+        if ((c->timeout - get_cur_time(c)) < 0)
             return -1;
         if (c->poll_entry->revents & (POLLERR | POLLHUP))
             return -1;
@@ -1003,6 +1246,11 @@ static int handle_connection(HTTPContext *c)
                 /* all the buffer was sent : synchronize to the incoming stream */
                 c->state = HTTPSTATE_SEND_DATA_HEADER;
                 c->buffer_ptr = c->buffer_end = c->buffer;
+#if HAVE_PTHREADS
+                /* the data itself is sent by a worker thread */
+                if (nb_worker_threads && !c->is_packetized && !c->post)
+                    assign_worker(c);
+#endif
             }
         }
         break;
@@ -2140,6 +2388,252 @@ static void compute_status(HTTPContext *c)
     c->buffer_end = c->pb_buffer + len;
 }
 
+static int feed_map_read(void *opaque, uint8_t *buf, int buf_size)
+{
+    HTTPContext *c = opaque;
+    FFStream *feed = c->stream->feed;
+    int64_t size;
+
+    lock_server(c);
+    size = feed->feed_size;
+    unlock_server(c);
+    if (c->feed_pos >= size)
+        return AVERROR_EOF;
+    buf_size = FFMIN(buf_size, size - c->feed_pos);
+    memcpy(buf, feed->feed_map + c->feed_pos, buf_size);
+    c->feed_pos += buf_size;
+    return buf_size;
+}
+
+static int64_t feed_map_seek(void *opaque, int64_t offset, int whence)
+{
+    HTTPContext *c = opaque;
+    FFStream *feed = c->stream->feed;
+    int64_t size;
+
+    lock_server(c);
+    size = feed->feed_size;
+    unlock_server(c);
+    switch (whence) {
+    case AVSEEK_SIZE:
+        return size;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += c->feed_pos;
+        break;
+    case SEEK_END:
+        offset += size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (offset < 0 || offset > size)
+        return AVERROR(EINVAL);
+    c->feed_pos = offset;
+    return offset;
+}
+
+/* The packets of a mapped feed are demuxed once by the main thread as the
+ * feeder sends them, and all connections that have caught up with the
+ * feeder take them from this ring instead of each demuxing the feed file.
+ * Packet data is kept in a circular byte buffer. Before overwriting
+ * anything, the writer moves first_seq past the packets it is about to
+ * destroy; a reader copies a packet out and then checks that it was still
+ * valid. Only the cursors are exchanged under the ring mutex, so neither
+ * side waits for the other while copying packet data. */
+#define FEED_RING_PACKETS  4096
+#define FEED_RING_DATA_SIZE (16 * 1024 * 1024)
+
+typedef struct FeedRingPacket {
+    int64_t pts, dts;
+    int64_t data_pos;           /* position in the data written to the ring */
+    int size, duration, flags, stream_index;
+} FeedRingPacket;
+
+typedef struct FeedRing {
+#if HAVE_PTHREADS
+    pthread_mutex_t mutex;      /* protects first_seq and write_seq */
+#endif
+    FeedRingPacket pkts[FEED_RING_PACKETS];
+    uint8_t *data;
+    int64_t first_seq;          /* oldest packet that is still valid */
+    int64_t write_seq;          /* number of packets written */
+    int64_t data_end;           /* number of data bytes written */
+} FeedRing;
+
+static void ring_lock(FeedRing *r)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&r->mutex);
+#endif
+}
+
+static void ring_unlock(FeedRing *r)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_unlock(&r->mutex);
+#endif
+}
+
+static void feed_ring_write(FeedRing *r, const AVPacket *pkt)
+{
+    FeedRingPacket *p;
+    int offset, len;
+
+    if (pkt->size > FEED_RING_DATA_SIZE / 4) {
+        http_log("Feed packet of %d bytes too large for the ring, dropped\n",
+                 pkt->size);
+        return;
+    }
+
+    ring_lock(r);
+    while (r->first_seq < r->write_seq) {
+        p = &r->pkts[r->first_seq % FEED_RING_PACKETS];
+        if (r->write_seq - r->first_seq < FEED_RING_PACKETS &&
+            p->data_pos >= r->data_end + pkt->size - FEED_RING_DATA_SIZE)
+            break;
+        r->first_seq++;
+    }
+    ring_unlock(r);
+
+    p = &r->pkts[r->write_seq % FEED_RING_PACKETS];
+    p->pts          = pkt->pts;
+    p->dts          = pkt->dts;
+    p->data_pos     = r->data_end;
+    p->size         = pkt->size;
+    p->duration     = pkt->duration;
+    p->flags        = pkt->flags;
+    p->stream_index = pkt->stream_index;
+    offset = r->data_end % FEED_RING_DATA_SIZE;
+    len    = FFMIN(pkt->size, FEED_RING_DATA_SIZE - offset);
+    memcpy(r->data + offset, pkt->data, len);
+    memcpy(r->data, pkt->data + len, pkt->size - len);
+
+    ring_lock(r);
+    r->write_seq++;
+    r->data_end += pkt->size;
+    ring_unlock(r);
+}
+
+/* Read the next packet of the connection from the ring. Packets that have
+ * already been overwritten are skipped. */
+static int feed_ring_read(HTTPContext *c, AVPacket *pkt)
+{
+    FeedRing *r = c->stream->feed->ring;
+    FeedRingPacket p;
+    int64_t first_seq;
+    int offset, len;
+
+    for (;;) {
+        ring_lock(r);
+        if (c->ring_pos >= r->write_seq) {
+            ring_unlock(r);
+            return AVERROR(EAGAIN);
+        }
+        if (c->ring_pos < r->first_seq) {
+            http_log("%s: %"PRId64" feed packets lost by slow client\n",
+                     c->stream->filename, r->first_seq - c->ring_pos);
+            c->ring_pos = r->first_seq;
+        }
+        p = r->pkts[c->ring_pos % FEED_RING_PACKETS];
+        ring_unlock(r);
+
+        if (av_new_packet(pkt, p.size) < 0)
+            return AVERROR(ENOMEM);
+        offset = p.data_pos % FEED_RING_DATA_SIZE;
+        len    = FFMIN(p.size, FEED_RING_DATA_SIZE - offset);
+        memcpy(pkt->data, r->data + offset, len);
+        memcpy(pkt->data + len, r->data, p.size - len);
+
+        ring_lock(r);
+        first_seq = r->first_seq;
+        ring_unlock(r);
+        if (c->ring_pos >= first_seq)
+            break;
+        /* overwritten while we were copying it */
+        av_free_packet(pkt);
+    }
+    pkt->pts          = p.pts;
+    pkt->dts          = p.dts;
+    pkt->duration     = p.duration;
+    pkt->flags        = p.flags;
+    pkt->stream_index = p.stream_index;
+    c->ring_pos++;
+    return 0;
+}
+
+static void feed_ring_stop(FFStream *feed)
+{
+    if (feed->ring_in)
+        avformat_close_input(&feed->ring_in);
+    feed->ring_seq = -1;
+}
+
+/* Open the demuxer filling the ring at the current end of the feed. */
+static int feed_ring_start(FFStream *feed)
+{
+    AVPacket pkt;
+    int ret;
+
+    if (!feed->ring) {
+        if (!(feed->ring = av_mallocz(sizeof(*feed->ring))))
+            return AVERROR(ENOMEM);
+        if (!(feed->ring->data = av_malloc(FEED_RING_DATA_SIZE))) {
+            av_freep(&feed->ring);
+            return AVERROR(ENOMEM);
+        }
+#if HAVE_PTHREADS
+        pthread_mutex_init(&feed->ring->mutex, NULL);
+#endif
+    }
+
+    if ((ret = avformat_open_input(&feed->ring_in, feed->feed_filename,
+                                   av_find_input_format("ffm"), NULL)) < 0) {
+        http_log("Could not open feed '%s' for the packet ring\n",
+                 feed->feed_filename);
+        return ret;
+    }
+    feed->ring_in->flags |= AVFMT_FLAG_GENPTS;
+    ffm_set_write_index(feed->ring_in, feed->feed_write_index, feed->feed_size);
+    av_seek_frame(feed->ring_in, -1, av_gettime(), 0);
+    /* connections get the packets up to here from the feed file */
+    while (!(ret = av_read_frame(feed->ring_in, &pkt)))
+        av_free_packet(&pkt);
+    if (ret != AVERROR(EAGAIN)) {
+        feed_ring_stop(feed);
+        return ret;
+    }
+    feed->ring_seq = feed->ring->write_seq;
+    return 0;
+}
+
+/* Move the packets completed by the last block written to the feed into
+ * the ring. Called by the main thread. */
+static void feed_ring_update(FFStream *feed)
+{
+    AVPacket pkt;
+    int ret;
+
+    if (!feed->ring_in) {
+        feed_ring_start(feed);
+        return;
+    }
+    ffm_set_write_index(feed->ring_in, feed->feed_write_index, feed->feed_size);
+    while (!(ret = av_read_frame(feed->ring_in, &pkt))) {
+        feed_ring_write(feed->ring, &pkt);
+        av_free_packet(&pkt);
+    }
+    if (ret != AVERROR(EAGAIN)) {
+        /* connections keep reading the feed file */
+        http_log("Error demuxing feed '%s' for the packet ring\n",
+                 feed->feed_filename);
+        feed_ring_stop(feed);
+        return;
+    }
+    feed->ring_seq = feed->ring->write_seq;
+}
+
 static int open_input_stream(HTTPContext *c, const char *info)
 {
     char buf[128];
@@ -2171,10 +2665,33 @@ static int open_input_stream(HTTPContext *c, const char *info)
     }
     if (input_filename[0] == '\0')
         return -1;
+    c->ring_pos = -1;
+
+    /* read a mapped feed straight from memory */
+    if (c->stream->feed && c->stream->feed->feed_map) {
+        uint8_t *buffer = av_malloc(FFM_PACKET_SIZE);
+        if (!buffer || !(s = avformat_alloc_context())) {
+            av_free(buffer);
+            return -1;
+        }
+        c->feed_pos = 0;
+        c->feed_pb = avio_alloc_context(buffer, FFM_PACKET_SIZE, 0, c,
+                                        feed_map_read, NULL, feed_map_seek);
+        if (!c->feed_pb) {
+            av_free(buffer);
+            avformat_free_context(s);
+            return -1;
+        }
+        s->pb = c->feed_pb;
+    }
 
     /* open stream */
     if ((ret = avformat_open_input(&s, input_filename, c->stream->ifmt, &c->stream->in_opts)) < 0) {
         http_log("could not open %s: %d\n", input_filename, ret);
+        if (c->feed_pb) {
+            av_freep(&c->feed_pb->buffer);
+            av_freep(&c->feed_pb);
+        }
         return -1;
     }
     s->flags |= AVFMT_FLAG_GENPTS;
@@ -2198,7 +2715,7 @@ static int open_input_stream(HTTPContext *c, const char *info)
     if (c->fmt_in->iformat->read_seek)
         av_seek_frame(c->fmt_in, -1, stream_pos, 0);
     /* set the start time (needed for maxtime and RTP packet timing) */
-    c->start_time = cur_time;
+    c->start_time = get_cur_time(c);
     c->first_pts = AV_NOPTS_VALUE;
     return 0;
 }
@@ -2207,7 +2724,7 @@ static int open_input_stream(HTTPContext *c, const char *info)
 static int64_t get_server_clock(HTTPContext *c)
 {
     /* compute current pts value from system time */
-    return (cur_time - c->start_time) * 1000;
+    return (get_cur_time(c) - c->start_time) * 1000;
 }
 
 /* return the estimated time at which the current packet must be sent
@@ -2235,6 +2752,8 @@ static int http_prepare_data(HTTPContext *c)
     av_freep(&c->pb_buffer);
     switch(c->state) {
     case HTTPSTATE_SEND_DATA_HEADER:
+        /* the codec contexts of the streams are shared by all connections */
+        lock_server(c);
         memset(&c->fmt_ctx, 0, sizeof(c->fmt_ctx));
         av_dict_set(&c->fmt_ctx.metadata, "author"   , c->stream->author   , 0);
         av_dict_set(&c->fmt_ctx.metadata, "comment"  , c->stream->comment  , 0);
@@ -2267,6 +2786,7 @@ static int http_prepare_data(HTTPContext *c)
         /* prepare header and save header data in a stream */
         if (avio_open_dyn_buf(&c->fmt_ctx.pb) < 0) {
             /* XXX: potential leak */
+            unlock_server(c);
             return -1;
         }
         c->fmt_ctx.pb->seekable = 0;
@@ -2278,7 +2798,9 @@ static int http_prepare_data(HTTPContext *c)
          */
         c->fmt_ctx.max_delay = (int)(0.7*AV_TIME_BASE);
 
-        if (avformat_write_header(&c->fmt_ctx, NULL) < 0) {
+        ret = avformat_write_header(&c->fmt_ctx, NULL);
+        unlock_server(c);
+        if (ret < 0) {
             http_log("Error writing output header\n");
             return -1;
         }
@@ -2294,23 +2816,43 @@ static int http_prepare_data(HTTPContext *c)
     case HTTPSTATE_SEND_DATA:
         /* find a new packet */
         /* read a packet from the input stream */
-        if (c->stream->feed)
-            ffm_set_write_index(c->fmt_in,
-                                c->stream->feed->feed_write_index,
-                                c->stream->feed->feed_size);
+        if (c->stream->feed) {
+            int64_t write_index, size;
+            /* Sample the wakeup counters along with the write index, so
+               that packets written after it wake us up if we run out of
+               data below. */
+            lock_server(c);
+            write_index      = c->stream->feed->feed_write_index;
+            size             = c->stream->feed->feed_size;
+            c->ring_seq      = c->stream->feed->ring_seq;
+            c->feed_wakeups  = c->stream->feed->feed_wakeups;
+            c->feed_closures = c->stream->feed->feed_closures;
+            unlock_server(c);
+            if (c->ring_pos < 0)
+                ffm_set_write_index(c->fmt_in, write_index, size);
+        }
 
         if (c->stream->max_time &&
-            c->stream->max_time + c->start_time - cur_time < 0)
+            c->stream->max_time + c->start_time - get_cur_time(c) < 0)
             /* We have timed out */
             c->state = HTTPSTATE_SEND_DATA_TRAILER;
         else {
             AVPacket pkt;
         redo:
-            ret = av_read_frame(c->fmt_in, &pkt);
+            if (c->ring_pos >= 0)
+                ret = feed_ring_read(c, &pkt);
+            else
+                ret = av_read_frame(c->fmt_in, &pkt);
             if (ret < 0) {
                 if (c->stream->feed) {
                     /* if coming from feed, it means we reached the end of the
                        ffm file, so must wait for more data */
+                    /* Having read everything up to the sampled write index,
+                       the following packets are the ones the ring got
+                       after it. */
+                    if (c->ring_pos < 0 && c->ring_seq >= 0 &&
+                        ret == AVERROR(EAGAIN) && !c->fmt_in->packet_buffer)
+                        c->ring_pos = c->ring_seq;
                     c->state = HTTPSTATE_WAIT_FEED;
                     return 1; /* state changed */
                 } else if (ret == AVERROR(EAGAIN)) {
@@ -2318,8 +2860,12 @@ static int http_prepare_data(HTTPContext *c)
                     return 0;
                 } else {
                     if (c->stream->loop) {
+                        /* the status page may look at fmt_in */
+                        lock_server(c);
                         avformat_close_input(&c->fmt_in);
-                        if (open_input_stream(c, "") < 0)
+                        ret = open_input_stream(c, "");
+                        unlock_server(c);
+                        if (ret < 0)
                             goto no_loop;
                         goto redo;
                     } else {
@@ -2333,7 +2879,7 @@ static int http_prepare_data(HTTPContext *c)
                 /* update first pts if needed */
                 if (c->first_pts == AV_NOPTS_VALUE) {
                     c->first_pts = av_rescale_q(pkt.dts, c->fmt_in->streams[pkt.stream_index]->time_base, AV_TIME_BASE_Q);
-                    c->start_time = cur_time;
+                    c->start_time = get_cur_time(c);
                 }
                 /* send it to the appropriate stream */
                 if (c->stream->feed) {
@@ -2421,7 +2967,9 @@ static int http_prepare_data(HTTPContext *c)
                     c->buffer_ptr = c->pb_buffer;
                     c->buffer_end = c->pb_buffer + len;
 
+                    lock_server(c);
                     codec->frame_number++;
+                    unlock_server(c);
                     if (len == 0) {
                         av_free_packet(&pkt);
                         goto redo;
@@ -2491,7 +3039,7 @@ static int http_send_data(HTTPContext *c)
                 }
 
                 c->data_count += len;
-                update_datarate(&c->datarate, c->data_count);
+                update_datarate(&c->datarate, c->data_count, get_cur_time(c));
                 if (c->stream)
                     c->stream->bytes_served += len;
 
@@ -2566,9 +3114,12 @@ static int http_send_data(HTTPContext *c)
                     c->buffer_ptr += len;
 
                 c->data_count += len;
-                update_datarate(&c->datarate, c->data_count);
-                if (c->stream)
+                update_datarate(&c->datarate, c->data_count, get_cur_time(c));
+                if (c->stream) {
+                    lock_server(c);
                     c->stream->bytes_served += len;
+                    unlock_server(c);
+                }
                 break;
             }
         }
@@ -2594,11 +3145,19 @@ static int http_start_receive_data(HTTPContext *c)
         return -1;
     }
     c->feed_fd = fd;
+    feed_ring_stop(c->stream);
 
     if (c->stream->truncate) {
         /* truncate feed file */
         ffm_write_write_index(c->feed_fd, FFM_PACKET_SIZE);
         http_log("Truncating feed file '%s'\n", c->stream->feed_filename);
+        if (c->stream->feed_map) {
+            /* only drop the data logically, clients may still be reading
+               the mapping */
+            c->stream->feed_write_index = FFM_PACKET_SIZE;
+            c->stream->feed_size        = FFM_PACKET_SIZE;
+            goto feed_opened;
+        }
         if (ftruncate(c->feed_fd, FFM_PACKET_SIZE) < 0) {
             http_log("Error truncating feed file: %s\n", strerror(errno));
             return -1;
@@ -2614,6 +3173,7 @@ static int http_start_receive_data(HTTPContext *c)
     c->stream->feed_size = lseek(fd, 0, SEEK_END);
     lseek(fd, 0, SEEK_SET);
 
+feed_opened:
     /* init buffer input */
     c->buffer_ptr = c->buffer;
     c->buffer_end = c->buffer + FFM_PACKET_SIZE;
@@ -2671,7 +3231,7 @@ static int http_receive_data(HTTPContext *c)
             c->chunk_size -= len;
             c->buffer_ptr += len;
             c->data_count += len;
-            update_datarate(&c->datarate, c->data_count);
+            update_datarate(&c->datarate, c->data_count, get_cur_time(c));
         }
     }
 
@@ -2688,11 +3248,26 @@ static int http_receive_data(HTTPContext *c)
         /* a packet has been received : write it in the store, except
            if header */
         if (c->data_count > FFM_PACKET_SIZE) {
-            /* XXX: use llseek or url_seek */
-            lseek(c->feed_fd, feed->feed_write_index, SEEK_SET);
-            if (write(c->feed_fd, c->buffer, FFM_PACKET_SIZE) < 0) {
-                http_log("Error writing to feed file: %s\n", strerror(errno));
-                goto fail;
+            if (feed->feed_map) {
+                /* grow the file first, touching the mapping past its end
+                   would raise SIGBUS */
+                int64_t end = feed->feed_write_index + FFM_PACKET_SIZE;
+                if (end > feed->feed_file_size) {
+                    if (ftruncate(c->feed_fd, end) < 0) {
+                        http_log("Error growing feed file: %s\n", strerror(errno));
+                        goto fail;
+                    }
+                    feed->feed_file_size = end;
+                }
+                memcpy(feed->feed_map + feed->feed_write_index, c->buffer,
+                       FFM_PACKET_SIZE);
+            } else {
+                /* XXX: use llseek or url_seek */
+                lseek(c->feed_fd, feed->feed_write_index, SEEK_SET);
+                if (write(c->feed_fd, c->buffer, FFM_PACKET_SIZE) < 0) {
+                    http_log("Error writing to feed file: %s\n", strerror(errno));
+                    goto fail;
+                }
             }
 
             feed->feed_write_index += FFM_PACKET_SIZE;
@@ -2705,17 +3280,26 @@ static int http_receive_data(HTTPContext *c)
                 feed->feed_write_index = FFM_PACKET_SIZE;
 
             /* write index */
-            if (ffm_write_write_index(c->feed_fd, feed->feed_write_index) < 0) {
+            if (feed->feed_map) {
+                AV_WB64(feed->feed_map + 8, feed->feed_write_index);
+            } else if (ffm_write_write_index(c->feed_fd, feed->feed_write_index) < 0) {
                 http_log("Error writing index to feed file: %s\n", strerror(errno));
                 goto fail;
             }
 
+            if (feed->feed_map)
+                feed_ring_update(feed);
+
             /* wake up any waiting connections */
             for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next) {
-                if (c1->state == HTTPSTATE_WAIT_FEED &&
+                if (c1->state == HTTPSTATE_WAIT_FEED && !c1->worker &&
                     c1->stream->feed == c->stream->feed)
                     c1->state = HTTPSTATE_SEND_DATA;
             }
+            c->stream->feed->feed_wakeups++;
+#if HAVE_PTHREADS
+            wake_workers();
+#endif
         } else {
             /* We have a header in our hands that contains useful data */
             AVFormatContext *s = avformat_alloc_context();
@@ -2766,12 +3350,17 @@ static int http_receive_data(HTTPContext *c)
  fail:
     c->stream->feed_opened = 0;
     close(c->feed_fd);
+    feed_ring_stop(c->stream);
     /* wake up any waiting connections to stop waiting for feed */
     for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next) {
-        if (c1->state == HTTPSTATE_WAIT_FEED &&
+        if (c1->state == HTTPSTATE_WAIT_FEED && !c1->worker &&
             c1->stream->feed == c->stream->feed)
             c1->state = HTTPSTATE_SEND_DATA_TRAILER;
     }
+    c->stream->feed->feed_closures++;
+#if HAVE_PTHREADS
+    wake_workers();
+#endif
     return -1;
 }
 
@@ -3652,6 +4241,32 @@ static void build_file_streams(void)
     }
 }
 
+/* Map the whole storage of the feed, so that the feeder writes packets and
+ * the clients read them without any system call. The file is grown as
+ * packets are written, until the feed wraps around. */
+static void map_feed(FFStream *feed)
+{
+#if HAVE_MMAP
+    int fd, prot = feed->readonly ? PROT_READ : PROT_READ | PROT_WRITE;
+
+    /* the last packet may start right before feed_max_size */
+    feed->feed_map_size = FFMAX(feed->feed_max_size, feed->feed_size) +
+                          FFM_PACKET_SIZE;
+    feed->feed_file_size = feed->feed_size;
+    fd = open(feed->feed_filename, feed->readonly ? O_RDONLY : O_RDWR);
+    if (fd >= 0) {
+        feed->feed_map = mmap(NULL, feed->feed_map_size, prot, MAP_SHARED,
+                              fd, 0);
+        close(fd);
+        if (feed->feed_map != MAP_FAILED)
+            return;
+    }
+    http_log("Could not map feed file '%s', using file I/O: %s\n",
+             feed->feed_filename, strerror(errno));
+#endif
+    feed->feed_map = NULL;
+}
+
 /* compute the needed AVStream for each feed */
 static void build_feed_streams(void)
 {
@@ -3791,6 +4406,9 @@ static void build_feed_streams(void)
             feed->feed_max_size = feed->feed_size;
 
         close(fd);
+
+        if (feed->mmap_feed)
+            map_feed(feed);
     }
 }
 
@@ -4106,6 +4724,15 @@ static int parse_ffconfig(const char *filename)
             } else {
                 nb_max_connections = val;
             }
+        } else if (!av_strcasecmp(cmd, "WorkerThreads")) {
+            get_arg(arg, sizeof(arg), &p);
+            val = atoi(arg);
+            if (val < 0 || val > MAX_WORKER_THREADS) {
+                ERROR("Invalid WorkerThreads: %s\n", arg);
+            } else if (val && !HAVE_PTHREADS) {
+                ERROR("WorkerThreads requires pthreads support\n");
+            } else
+                nb_worker_threads = val;
         } else if (!av_strcasecmp(cmd, "MaxBandwidth")) {
             int64_t llval;
             get_arg(arg, sizeof(arg), &p);
@@ -4141,6 +4768,7 @@ static int parse_ffconfig(const char *filename)
                 snprintf(feed->feed_filename, sizeof(feed->feed_filename),
                          "/tmp/%s.ffm", feed->filename);
                 feed->feed_max_size = 5 * 1024 * 1024;
+                feed->ring_seq = -1;
                 feed->is_feed = 1;
                 feed->feed = feed; /* self feeding :-) */
 
@@ -4190,6 +4818,14 @@ static int parse_ffconfig(const char *filename)
                 get_arg(arg, sizeof(arg), &p);
                 feed->truncate = strtod(arg, NULL);
             }
+        } else if (!av_strcasecmp(cmd, "MemoryMapped")) {
+            if (feed) {
+#if HAVE_MMAP
+                feed->mmap_feed = 1;
+#else
+                ERROR("MemoryMapped requires mmap support\n");
+#endif
+            }
         } else if (!av_strcasecmp(cmd, "FileMaxSize")) {
             if (feed) {
                 char *p1;
@@ -0,0 +1,268 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Check the optimized parametric stereo, DCA LFE FIR and DCA synthesis
+ * filter functions against their C versions.
+ *
+ * Every function is run on the same random input with the CPU features
+ * disabled and enabled, the outputs must be identical. Without optimized
+ * versions for the CPU the C functions are compared with themselves.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "libavutil/cpu.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "aacpsdsp.h"
+#include "dcadsp.h"
+#include "dsputil.h"
+#include "fft.h"
+#include "synth_filter.h"
+
+#undef printf
+
+#define RUNS 16
+
+static AVLFG prng;
+
+static void randomize(float *buf, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        buf[i] = (int)av_lfg_get(&prng) / 2147483648.0f;
+}
+
+static int report(const char *name, int err)
+{
+    printf("%s: %s\n", name, err ? "FAILED" : "OK");
+    return err;
+}
+
+#if CONFIG_AAC_DECODER
+static int check_psdsp(void)
+{
+    static const int ns[3] = { 4, 8, 12 };
+    PSDSPContext ref, opt;
+    LOCAL_ALIGNED_16(float, src0, [PS_QMF_TIME_SLOTS + 16], [2]);
+    LOCAL_ALIGNED_16(float, src1, [PS_QMF_TIME_SLOTS]);
+    LOCAL_ALIGNED_16(float, in,   [13], [2]);
+    LOCAL_ALIGNED_16(float, filt, [12], [8][2]);
+    LOCAL_ALIGNED_16(float, h,    [2], [4]);
+    LOCAL_ALIGNED_16(float, step, [2], [4]);
+    float (*l0)[32][2] = av_malloc(91 * sizeof(*l0));
+    float (*l1)[32][2] = av_malloc(91 * sizeof(*l1));
+    float (*s0)[38][64] = av_malloc(2 * sizeof(*s0));
+    float (*s1)[38][64] = av_malloc(2 * sizeof(*s1));
+    float (*ap0)[PS_QMF_TIME_SLOTS + PS_MAX_AP_DELAY][2] =
+        av_malloc(PS_AP_LINKS * sizeof(*ap0));
+    float (*ap1)[PS_QMF_TIME_SLOTS + PS_MAX_AP_DELAY][2] =
+        av_malloc(PS_AP_LINKS * sizeof(*ap1));
+    float phi[2], q[PS_AP_LINKS][2], gain[PS_QMF_TIME_SLOTS];
+    int err = 0, e, run, i, k;
+
+    if (!l0 || !l1 || !s0 || !s1 || !ap0 || !ap1) {
+        err = 1;
+        goto end;
+    }
+
+    av_set_cpu_flags_mask(0);
+    ff_psdsp_init(&ref);
+    av_set_cpu_flags_mask(-1);
+    ff_psdsp_init(&opt);
+
+    for (e = 0, run = 0; run < RUNS; run++) {
+        randomize(&src0[0][0], 2 * PS_QMF_TIME_SLOTS);
+        randomize(src1, PS_QMF_TIME_SLOTS);
+        ref.mul_pair_single(l0[0], src0, src1, PS_QMF_TIME_SLOTS);
+        opt.mul_pair_single(l1[0], src0, src1, PS_QMF_TIME_SLOTS);
+        e |= memcmp(l0[0], l1[0], PS_QMF_TIME_SLOTS * sizeof(l0[0][0]));
+    }
+    err |= report("ps_mul_pair_single", e);
+
+    for (e = 0, run = 0; run < RUNS; run++) {
+        randomize(&in[0][0], 2 * 13);
+        randomize(&filt[0][0][0], 12 * 8 * 2);
+        for (i = 0; i < 3; i++) {
+            for (k = 1; k <= 32; k += 31) {
+                memset(l0[0], 0, 12 * sizeof(l0[0]));
+                memset(l1[0], 0, 12 * sizeof(l1[0]));
+                ref.hybrid_analysis(l0[0], in, (const float (*)[8][2])filt,
+                                    k, ns[i]);
+                opt.hybrid_analysis(l1[0], in, (const float (*)[8][2])filt,
+                                    k, ns[i]);
+                e |= memcmp(l0[0], l1[0], 12 * sizeof(l0[0]));
+            }
+        }
+    }
+    err |= report("ps_hybrid_analysis", e);
+
+    for (e = 0, run = 0; run < RUNS; run++) {
+        randomize(&s0[0][0][0], 2 * 38 * 64);
+        for (i = 3; i <= 5; i += 2) {
+            memset(l0[0], 0, 91 * sizeof(l0[0]));
+            memset(l1[0], 0, 91 * sizeof(l1[0]));
+            ref.hybrid_analysis_ileave(l0 + 7, s0, i, PS_QMF_TIME_SLOTS);
+            opt.hybrid_analysis_ileave(l1 + 7, s0, i, PS_QMF_TIME_SLOTS);
+            e |= memcmp(l0[0], l1[0], 91 * sizeof(l0[0]));
+        }
+    }
+    err |= report("ps_hybrid_analysis_ileave", e);
+
+    for (e = 0, run = 0; run < RUNS; run++) {
+        randomize(&l0[0][0][0], 91 * 32 * 2);
+        for (i = 3; i <= 5; i += 2) {
+            memset(s0, 0, 2 * sizeof(*s0));
+            memset(s1, 0, 2 * sizeof(*s1));
+            ref.hybrid_synthesis_deint(s0, l0 + 7, i, PS_QMF_TIME_SLOTS);
+            opt.hybrid_synthesis_deint(s1, l0 + 7, i, PS_QMF_TIME_SLOTS);
+            e |= memcmp(s0, s1, 2 * sizeof(*s0));
+        }
+    }
+    err |= report("ps_hybrid_synthesis_deint", e);
+
+    for (e = 0, run = 0; run < RUNS; run++) {
+        randomize(&src0[0][0], 2 * (PS_QMF_TIME_SLOTS + 16));
+        randomize(&ap0[0][0][0], PS_AP_LINKS * 2 * (PS_QMF_TIME_SLOTS + PS_MAX_AP_DELAY));
+        memcpy(ap1, ap0, PS_AP_LINKS * sizeof(*ap0));
+        randomize(phi, 2);
+        randomize(&q[0][0], 2 * PS_AP_LINKS);
+        randomize(gain, PS_QMF_TIME_SLOTS);
+        ref.decorrelate(l0[0], src0, ap0, phi, q, gain, 0.5f, PS_QMF_TIME_SLOTS);
+        opt.decorrelate(l1[0], src0, ap1, phi, q, gain, 0.5f, PS_QMF_TIME_SLOTS);
+        e |= memcmp(l0[0], l1[0], PS_QMF_TIME_SLOTS * sizeof(l0[0][0]));
+        e |= memcmp(ap0, ap1, PS_AP_LINKS * sizeof(*ap0));
+    }
+    err |= report("ps_decorrelate", e);
+
+    for (k = 0; k < 2; k++) {
+        for (e = 0, run = 0; run < RUNS; run++) {
+            randomize(&l0[0][0][0], 4 * PS_QMF_TIME_SLOTS);
+            memcpy(l1[0], l0[0], 2 * PS_QMF_TIME_SLOTS * sizeof(l0[0][0]));
+            randomize(&h[0][0], 8);
+            randomize(&step[0][0], 8);
+            ref.stereo_interpolate[k](l0[0], l0[1], h, step, PS_QMF_TIME_SLOTS);
+            opt.stereo_interpolate[k](l1[0], l1[1], h, step, PS_QMF_TIME_SLOTS);
+            e |= memcmp(l0[0], l1[0], 2 * PS_QMF_TIME_SLOTS * sizeof(l0[0][0]));
+        }
+        err |= report(k ? "ps_stereo_interpolate_ipdopd" :
+                          "ps_stereo_interpolate", e);
+    }
+
+end:
+    av_free(l0);
+    av_free(l1);
+    av_free(s0);
+    av_free(s1);
+    av_free(ap0);
+    av_free(ap1);
+    return err;
+}
+#endif /* CONFIG_AAC_DECODER */
+
+#if CONFIG_DCA_DECODER
+static int check_dcadsp(void)
+{
+    DCADSPContext ref, opt;
+    LOCAL_ALIGNED_16(float, in,    [16]);
+    LOCAL_ALIGNED_16(float, coefs, [256]);
+    LOCAL_ALIGNED_16(float, out0,  [128]);
+    LOCAL_ALIGNED_16(float, out1,  [128]);
+    int e = 0, run, decifactor;
+
+    av_set_cpu_flags_mask(0);
+    ff_dcadsp_init(&ref);
+    av_set_cpu_flags_mask(-1);
+    ff_dcadsp_init(&opt);
+
+    for (run = 0; run < RUNS; run++) {
+        randomize(in, 16);
+        randomize(coefs, 256);
+        for (decifactor = 32; decifactor <= 64; decifactor *= 2) {
+            ref.lfe_fir(out0, in + 15, coefs, decifactor, 0.25f);
+            opt.lfe_fir(out1, in + 15, coefs, decifactor, 0.25f);
+            e |= memcmp(out0, out1, 2 * decifactor * sizeof(*out0));
+        }
+    }
+    return report("dca_lfe_fir", e);
+}
+
+static int check_synth_filter(void)
+{
+    SynthFilterContext ref, opt;
+    FFTContext imdct;
+    LOCAL_ALIGNED_16(float, buf0,  [512]);
+    LOCAL_ALIGNED_16(float, buf1,  [512]);
+    LOCAL_ALIGNED_16(float, buf20, [32]);
+    LOCAL_ALIGNED_16(float, buf21, [32]);
+    LOCAL_ALIGNED_16(float, window, [512]);
+    LOCAL_ALIGNED_16(float, in,    [32]);
+    LOCAL_ALIGNED_16(float, out0,  [32]);
+    LOCAL_ALIGNED_16(float, out1,  [32]);
+    int e = 0, run, off0 = 0, off1 = 0;
+
+    if (ff_mdct_init(&imdct, 6, 1, 1.0) < 0)
+        return report("synth_filter", 1);
+
+    av_set_cpu_flags_mask(0);
+    ff_synth_filter_init(&ref);
+    av_set_cpu_flags_mask(-1);
+    ff_synth_filter_init(&opt);
+
+    memset(buf0, 0, 512 * sizeof(*buf0));
+    memset(buf1, 0, 512 * sizeof(*buf1));
+    memset(buf20, 0, 32 * sizeof(*buf20));
+    memset(buf21, 0, 32 * sizeof(*buf21));
+    randomize(window, 512);
+
+    /* enough runs to wrap around the ring buffer */
+    for (run = 0; run < 2 * RUNS; run++) {
+        randomize(in, 32);
+        ref.synth_filter_float(&imdct, buf0, &off0, buf20, window, out0, in, 0.5f);
+        opt.synth_filter_float(&imdct, buf1, &off1, buf21, window, out1, in, 0.5f);
+        e |= memcmp(out0, out1, 32 * sizeof(*out0));
+        e |= memcmp(buf20, buf21, 32 * sizeof(*buf20));
+        e |= off0 != off1;
+    }
+
+    ff_mdct_end(&imdct);
+    return report("synth_filter", e);
+}
+#endif /* CONFIG_DCA_DECODER */
+
+int main(void)
+{
+    int err = 0;
+
+    av_lfg_init(&prng, 1);
+
+#if CONFIG_AAC_DECODER
+    err |= check_psdsp();
+#endif
+#if CONFIG_DCA_DECODER
+    err |= check_dcadsp();
+    err |= check_synth_filter();
+#endif
+
+    return err;
+}
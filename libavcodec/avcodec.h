@@ -1321,6 +1321,26 @@ typedef struct AVFrame {
      * - decoding: set by get_buffer()
      */
     uint64_t channel_layout;
+
+    /**
+     * Number of packets sent to the decoder after the packet whose decoding
+     * made this frame available, before the frame was returned. This is the
+     * delay added by frame threading. It counts packets, not time: the
+     * latency it adds depends on how fast the packets are fed.
+     * - encoding: unused
+     * - decoding: Set by libavcodec.
+     */
+    int thread_delay;
+
+    /**
+     * Number of frames decoded after this one before it could be output,
+     * to return the frames in display order. Only set by decoders which
+     * reorder frames themselves, currently H.264, MPEG-1/2 and the H.263
+     * based decoders including MPEG-4.
+     * - encoding: unused
+     * - decoding: Set by libavcodec.
+     */
+    int reorder_delay;
 } AVFrame;
 
 struct AVCodecInternal;
@@ -2949,6 +2969,21 @@ typedef struct AVCodecContext {
      * - decoding: unused.
      */
     uint64_t vbv_delay;
+
+    /**
+     * Maximum number of frames the decoder may hold back, -1 for no limit.
+     * When set, frame threading is only used with as many threads as fit
+     * in this delay, and slice threading is used instead when that leaves
+     * less than half of thread_count. What is left of the delay after the
+     * frame threading bounds the frame reordering of the decoders which
+     * support it, currently H.264; frames which need more reordering may
+     * then be output out of order or dropped.
+     * See AVFrame.thread_delay and AVFrame.reorder_delay for the delay of
+     * each frame.
+     * - encoding: unused
+     * - decoding: Set by user before avcodec_open2().
+     */
+    int max_frame_delay;
 } AVCodecContext;
 
 /**
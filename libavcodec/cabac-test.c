@@ -0,0 +1,293 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * CABAC decoder test and bypass decoding benchmark.
+ *
+ * Random bins, then coefficient level escapes as found in H.264 residuals,
+ * are written with a reference encoder and read back with the decoding
+ * functions, the escapes one bin at a time and in batches. The size and a
+ * checksum of each stream and of the decoded values are printed. With -b,
+ * the time per escape is also printed for both ways of decoding them.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/adler32.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "avcodec.h"
+#include "cabac.h"
+#include "cabac_functions.h"
+
+#define COUNT 100000
+#define SIZE  (COUNT * 4)
+
+static void put_cabac_bit(CABACContext *c, int b)
+{
+    put_bits(&c->pb, 1, b);
+    for (; c->outstanding_count; c->outstanding_count--)
+        put_bits(&c->pb, 1, 1 - b);
+}
+
+static void renorm_cabac_encoder(CABACContext *c)
+{
+    while (c->range < 0x100) {
+        if (c->low < 0x100) {
+            put_cabac_bit(c, 0);
+        } else if (c->low < 0x200) {
+            c->outstanding_count++;
+            c->low -= 0x100;
+        } else {
+            put_cabac_bit(c, 1);
+            c->low -= 0x200;
+        }
+        c->range += c->range;
+        c->low   += c->low;
+    }
+}
+
+static void put_cabac(CABACContext *c, uint8_t *state, int bit)
+{
+    int range_lps = ff_h264_lps_range[2 * (c->range & 0xC0) + *state];
+
+    if (bit == (*state & 1)) {
+        c->range -= range_lps;
+        *state    = ff_h264_mlps_state[128 + *state];
+    } else {
+        c->low   += c->range - range_lps;
+        c->range  = range_lps;
+        *state    = ff_h264_mlps_state[127 - *state];
+    }
+    renorm_cabac_encoder(c);
+}
+
+static void put_cabac_bypass(CABACContext *c, int bit)
+{
+    c->low += c->low;
+    if (bit)
+        c->low += c->range;
+    if (c->low < 0x200) {
+        put_cabac_bit(c, 0);
+    } else if (c->low < 0x400) {
+        c->outstanding_count++;
+        c->low -= 0x200;
+    } else {
+        put_cabac_bit(c, 1);
+        c->low -= 0x400;
+    }
+}
+
+static void put_cabac_terminate(CABACContext *c)
+{
+    c->range -= 2;
+    c->low   += c->range;
+    c->range  = 2;
+    renorm_cabac_encoder(c);
+    put_cabac_bit(c, c->low >> 9);
+    put_bits(&c->pb, 2, ((c->low >> 7) & 3) | 1);
+    flush_put_bits(&c->pb);
+}
+
+/* escape of an H.264 coefficient level: k=0 exp-Golomb prefix and suffix */
+static void put_escape(CABACContext *c, int val)
+{
+    int j = av_log2(val + 1), i;
+
+    for (i = 0; i < j; i++)
+        put_cabac_bypass(c, 1);
+    put_cabac_bypass(c, 0);
+    for (i = j - 1; i >= 0; i--)
+        put_cabac_bypass(c, (val + 1) >> i & 1);
+}
+
+static av_noinline int get_escape(CABACContext *c)
+{
+    int j = 0, val = 1;
+
+    while (get_cabac_bypass(c))
+        j++;
+    while (j--)
+        val += val + get_cabac_bypass(c);
+    return val - 1;
+}
+
+static av_noinline int get_escape_batch(CABACContext *c)
+{
+    int j = 0, val = 1;
+
+    while (get_cabac_bypass(c))
+        j++;
+    while (j) {
+        int n = FFMIN(j, CABAC_BYPASS_BATCH);
+        val   = val << n | get_cabac_bypass_bits(c, n);
+        j    -= n;
+    }
+    return val - 1;
+}
+
+static void print_stream(const char *name, CABACContext *c)
+{
+    int size = put_bits_count(&c->pb) >> 3;
+
+    printf("%s: %d bytes, checksum %08lx\n", name, size,
+           av_adler32_update(1, c->pb.buf, size));
+}
+
+static unsigned checksum(const int *val, int count)
+{
+    unsigned sum = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+        sum = sum * 31 + val[i];
+    return sum;
+}
+
+enum { BIN, BYPASS, BYPASS_BITS, BYPASS_SIGN, NB_OPS };
+
+int main(int argc, char **argv)
+{
+    CABACContext c;
+    uint8_t state[10] = { 0 };
+    uint8_t *buf = av_mallocz(SIZE + FF_INPUT_BUFFER_PADDING_SIZE);
+    int *op      = av_malloc(COUNT * sizeof(*op));
+    int *val     = av_malloc(COUNT * sizeof(*val));
+    int bench    = argc > 1 && !strcmp(argv[1], "-b");
+    int i, ret = 0;
+    AVLFG prng;
+
+    if (!buf || !op || !val)
+        return 2;
+
+    ff_init_cabac_states(&c);
+    av_lfg_init(&prng, 1);
+
+    /* random mix of context coded and bypass bins */
+    ff_init_cabac_encoder(&c, buf, SIZE);
+    for (i = 0; i < COUNT; i++) {
+        unsigned r = av_lfg_get(&prng);
+
+        op[i] = r % NB_OPS;
+        switch (op[i]) {
+        case BIN:
+            val[i] = (r >> 8) % 7 < 5;
+            put_cabac(&c, &state[(r >> 4) % 10], val[i]);
+            break;
+        case BYPASS:
+        case BYPASS_SIGN:
+            val[i] = r >> 8 & 1;
+            put_cabac_bypass(&c, val[i]);
+            break;
+        case BYPASS_BITS: {
+            int n = 1 + (r >> 8) % CABAC_BYPASS_BATCH, k;
+            val[i] = n << 8 | (r >> 16 & ((1 << n) - 1));
+            for (k = n - 1; k >= 0; k--)
+                put_cabac_bypass(&c, val[i] >> k & 1);
+            break;
+        }
+        }
+    }
+    put_cabac_terminate(&c);
+    print_stream("bins", &c);
+
+    memset(state, 0, sizeof(state));
+    ff_init_cabac_decoder(&c, buf, SIZE);
+    av_lfg_init(&prng, 1);
+    for (i = 0; i < COUNT; i++) {
+        unsigned r = av_lfg_get(&prng);
+        int v;
+
+        switch (op[i]) {
+        case BIN:
+            v = get_cabac(&c, &state[(r >> 4) % 10]);
+            break;
+        case BYPASS:
+            v = get_cabac_bypass(&c);
+            break;
+        case BYPASS_SIGN:
+            v = get_cabac_bypass_sign(&c, -1) < 0;
+            break;
+        default:
+            v = val[i] >> 8 << 8 | get_cabac_bypass_bits(&c, val[i] >> 8);
+            break;
+        }
+        if (v != val[i]) {
+            printf("mismatch at %d, op %d: %x instead of %x\n",
+                   i, op[i], v, val[i]);
+            ret = 1;
+            break;
+        }
+    }
+    if (!ret && !get_cabac_terminate(&c)) {
+        printf("terminate bin not found\n");
+        ret = 1;
+    }
+    if (!ret)
+        printf("bins: decoded %08x\n", checksum(val, COUNT));
+
+    /* level escapes, both ways */
+    ff_init_cabac_encoder(&c, buf, SIZE);
+    for (i = 0; i < COUNT; i++) {
+        val[i] = av_lfg_get(&prng) & ((2 << av_lfg_get(&prng) % 12) - 1);
+        put_escape(&c, val[i]);
+    }
+    put_cabac_terminate(&c);
+    print_stream("escapes", &c);
+
+    for (i = 0; i < 2 && !ret; i++) {
+        int (*get)(CABACContext *) = i ? get_escape_batch : get_escape;
+        const char *name = i ? "batch" : "bins";
+        int n;
+
+        ff_init_cabac_decoder(&c, buf, SIZE);
+        for (n = 0; n < COUNT; n++)
+            op[n] = get(&c);
+        if (memcmp(op, val, COUNT * sizeof(*op))) {
+            printf("escape mismatch (%s)\n", name);
+            ret = 1;
+        } else {
+            printf("escapes (%s): decoded %08x\n", name, checksum(op, COUNT));
+        }
+    }
+
+    for (i = 0; i < 2 && bench && !ret; i++) {
+        int (*get)(CABACContext *) = i ? get_escape_batch : get_escape;
+        int64_t time = av_gettime();
+        int k, n;
+
+        for (k = 0; k < 100; k++) {
+            ff_init_cabac_decoder(&c, buf, SIZE);
+            for (n = 0; n < COUNT; n++)
+                op[n] = get(&c);
+        }
+        time = av_gettime() - time;
+        printf("escape %-6s %6.2f ns/escape\n", i ? "batch" : "bins",
+               time * 1000.0 / (100 * (double)COUNT));
+    }
+
+    av_free(buf);
+    av_free(op);
+    av_free(val);
+    return ret;
+}
@@ -29,6 +29,7 @@
 
 #include <stdint.h>
 
+#include "libavutil/intmath.h"
 #include "cabac.h"
 #include "config.h"
 
@@ -147,6 +148,37 @@ static av_always_inline int get_cabac_bypass_sign(CABACContext *c, int val){
 }
 #endif
 
+/**
+ * Maximum number of bins get_cabac_bypass_bits() can decode in one call.
+ * low is below range << (CABAC_BITS + 1) < 1 << 26 and must not overflow.
+ */
+#define CABAC_BYPASS_BATCH 5
+
+/**
+ * Decode n bypass bins at once with a single division instead of n
+ * compare and subtract steps.
+ * @param n number of bins, 1 to CABAC_BYPASS_BATCH
+ * @return the bins, the first one in the most significant bit
+ */
+static av_always_inline int get_cabac_bypass_bits(CABACContext *c, int n)
+{
+    int range = c->range << (CABAC_BITS + 1);
+    /* number of shifts until the lowest set bit reaches CABAC_BITS */
+    int left  = CABAC_BITS - ff_ctz(c->low);
+    int val;
+
+    if (n < left) {
+        c->low <<= n;
+    } else {
+        c->low <<= left;
+        refill(c);
+        c->low <<= n - left;
+    }
+    val     = c->low / range;
+    c->low -= val * range;
+    return val;
+}
+
 /**
  *
  * @return the number of bytes read or 0 if no end
@@ -48,4 +48,5 @@ void ff_dcadsp_init(DCADSPContext *s)
 {
     s->lfe_fir = dca_lfe_fir_c;
     if (ARCH_ARM) ff_dcadsp_init_arm(s);
+    if (ARCH_X86) ff_dcadsp_init_x86(s);
 }
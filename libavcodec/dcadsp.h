@@ -26,5 +26,6 @@ typedef struct DCADSPContext {
 
 void ff_dcadsp_init(DCADSPContext *s);
 void ff_dcadsp_init_arm(DCADSPContext *s);
+void ff_dcadsp_init_x86(DCADSPContext *s);
 
 #endif /* AVCODEC_DCADSP_H */
@@ -25,6 +25,8 @@
 //#define TRACE
 //#define DEBUG
 
+#define CACHED_BITSTREAM_READER 1
+
 #include "libavutil/imgutils.h"
 #include "avcodec.h"
 #include "get_bits.h"
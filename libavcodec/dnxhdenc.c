@@ -25,6 +25,7 @@
 
 //#define DEBUG
 #define RC_VARIANCE 1 // use variance or ssd for fast rc
+#define LONG_BITSTREAM_WRITER
 
 #include "libavutil/opt.h"
 #include "avcodec.h"
@@ -384,9 +385,13 @@ static av_always_inline void dnxhd_encode_block(DNXHDEncContext *ctx, DCTELEM *b
         if (slevel) {
             int run_level = i - last_non_zero - 1;
             int rlevel = (slevel<<1)|!!run_level;
-            put_bits(&ctx->m.pb, ctx->vlc_bits[rlevel], ctx->vlc_codes[rlevel]);
-            if (run_level)
-                put_bits(&ctx->m.pb, ctx->run_bits[run_level], ctx->run_codes[run_level]);
+            if (run_level) {
+                int run_bits = ctx->run_bits[run_level];
+                put_bits63(&ctx->m.pb, ctx->vlc_bits[rlevel] + run_bits,
+                           (uint64_t)ctx->vlc_codes[rlevel] << run_bits |
+                           ctx->run_codes[run_level]);
+            } else
+                put_bits(&ctx->m.pb, ctx->vlc_bits[rlevel], ctx->vlc_codes[rlevel]);
             last_non_zero = i;
         }
     }
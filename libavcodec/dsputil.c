@@ -1629,6 +1629,24 @@ static int pix_abs8_xy2_c(void *v, uint8_t *pix1, uint8_t *pix2, int line_size,
     return s;
 }
 
+static void sad16_x4_c(uint8_t *blk1, uint8_t *const blk2[4], int line_size,
+                       int h, int scores[4])
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        scores[i] = pix_abs16_c(NULL, blk1, blk2[i], line_size, h);
+}
+
+static void sad8_x4_c(uint8_t *blk1, uint8_t *const blk2[4], int line_size,
+                      int h, int scores[4])
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        scores[i] = pix_abs8_c(NULL, blk1, blk2[i], line_size, h);
+}
+
 static int nsse16_c(void *v, uint8_t *s1, uint8_t *s2, int stride, int h){
     MpegEncContext *c = v;
     int score1=0;
@@ -2601,6 +2619,8 @@ av_cold void ff_dsputil_init(DSPContext* c, AVCodecContext *avctx)
     c->pix_abs[1][1] = pix_abs8_x2_c;
     c->pix_abs[1][2] = pix_abs8_y2_c;
     c->pix_abs[1][3] = pix_abs8_xy2_c;
+    c->sad_x4[0] = sad16_x4_c;
+    c->sad_x4[1] = sad8_x4_c;
 
     c->put_tpel_pixels_tab[ 0] = put_tpel_pixels_mc00_c;
     c->put_tpel_pixels_tab[ 1] = put_tpel_pixels_mc10_c;
@@ -174,6 +174,12 @@ static void a(uint8_t *block, const uint8_t *pixels, int line_size, int h){\
 // although currently h<4 is not used as functions with width <8 are neither used nor implemented
 typedef int (*me_cmp_func)(void /*MpegEncContext*/ *s, uint8_t *blk1/*align width (8 or 16)*/, uint8_t *blk2/*align 1*/, int line_size, int h)/* __attribute__ ((const))*/;
 
+/**
+ * Compare a block against 4 candidate blocks at once.
+ * scores[i] is what the sad function of the same width returns for blk2[i].
+ */
+typedef void (*me_sad_x4_func)(uint8_t *blk1/*align width (8 or 16)*/, uint8_t *const blk2[4]/*align 1*/, int line_size, int h, int scores[4]);
+
 /**
  * Scantable.
  */
@@ -350,6 +356,12 @@ typedef struct DSPContext {
 
     me_cmp_func pix_abs[2][4];
 
+    /**
+     * SAD of 16 and 8 wide blocks against 4 candidates, for the motion search.
+     * simd only, NULL if there is no faster way than 4 calls to sad[].
+     */
+    me_sad_x4_func sad_x4[2];
+
     /* huffyuv specific */
     void (*add_bytes)(uint8_t *dst/*align 16*/, uint8_t *src/*align 16*/, int w);
     void (*diff_bytes)(uint8_t *dst/*align 16*/, uint8_t *src1/*align 16*/, uint8_t *src2/*align 1*/,int w);
@@ -219,6 +219,8 @@ static void help(void)
            "-d     (I)DCT test\n"
            "-r     (I)RDFT test\n"
            "-i     inverse transform test\n"
+           "-a     test all transforms, forward and inverse, of all sizes\n"
+           "       from 2^4 to 2^b and print a table of the speed test\n"
            "-n b   set the transform size to 2^b\n"
            "-f x   set scale factor for output data of (I)MDCT to x\n"
            );
@@ -229,22 +231,35 @@ enum tf_transform {
     TRANSFORM_MDCT,
     TRANSFORM_RDFT,
     TRANSFORM_DCT,
+    NB_TRANSFORMS
+};
+
+static const char * const transform_names[NB_TRANSFORMS][2] = {
+    [TRANSFORM_FFT]  = { "FFT",     "IFFT"     },
+    [TRANSFORM_MDCT] = { "MDCT",    "IMDCT"    },
+    [TRANSFORM_RDFT] = { "DFT_R2C", "IDFT_C2R" },
+    [TRANSFORM_DCT]  = { "DCT_II",  "DCT_III"  },
 };
 
 #if !HAVE_GETOPT
 #include "compat/getopt.c"
 #endif
 
-int main(int argc, char **argv)
+/**
+ * Check one transform against the reference and optionally time it.
+ * @param speed_time minimum duration of the speed test in microseconds,
+ *                   0 to skip it
+ * @param us         set to the time of one transform in microseconds
+ * @return 0 if the transform is within the error bounds
+ */
+static int run_test(enum tf_transform transform, int do_inverse,
+                    int fft_nbits, double scale, int64_t speed_time,
+                    double *us)
 {
     FFTComplex *tab, *tab1, *tab_ref;
     FFTSample *tab2;
-    int it, i, c;
-    int cpuflags;
-    int do_speed = 0;
+    int it, i;
     int err = 1;
-    enum tf_transform transform = TRANSFORM_FFT;
-    int do_inverse = 0;
     FFTContext s1, *s = &s1;
     FFTContext m1, *m = &m1;
 #if CONFIG_FFT_FLOAT
@@ -252,87 +267,27 @@ int main(int argc, char **argv)
     DCTContext d1, *d = &d1;
     int fft_size_2;
 #endif
-    int fft_nbits, fft_size;
-    double scale = 1.0;
+    int fft_size;
     AVLFG prng;
     av_lfg_init(&prng, 1);
 
-    fft_nbits = 9;
-    for(;;) {
-        c = getopt(argc, argv, "hsimrdn:f:c:");
-        if (c == -1)
-            break;
-        switch(c) {
-        case 'h':
-            help();
-            return 1;
-        case 's':
-            do_speed = 1;
-            break;
-        case 'i':
-            do_inverse = 1;
-            break;
-        case 'm':
-            transform = TRANSFORM_MDCT;
-            break;
-        case 'r':
-            transform = TRANSFORM_RDFT;
-            break;
-        case 'd':
-            transform = TRANSFORM_DCT;
-            break;
-        case 'n':
-            fft_nbits = atoi(optarg);
-            break;
-        case 'f':
-            scale = atof(optarg);
-            break;
-        case 'c':
-            cpuflags = av_parse_cpu_flags(optarg);
-            if (cpuflags < 0)
-                return 1;
-            av_set_cpu_flags_mask(cpuflags);
-            break;
-        }
-    }
-
-    fft_size = 1 << fft_nbits;
-    tab = av_malloc(fft_size * sizeof(FFTComplex));
-    tab1 = av_malloc(fft_size * sizeof(FFTComplex));
-    tab_ref = av_malloc(fft_size * sizeof(FFTComplex));
-    tab2 = av_malloc(fft_size * sizeof(FFTSample));
+    *us = 0;
 
     switch (transform) {
     case TRANSFORM_MDCT:
         av_log(NULL, AV_LOG_INFO,"Scale factor is set to %f\n", scale);
-        if (do_inverse)
-            av_log(NULL, AV_LOG_INFO,"IMDCT");
-        else
-            av_log(NULL, AV_LOG_INFO,"MDCT");
         ff_mdct_init(m, fft_nbits, do_inverse, scale);
         break;
     case TRANSFORM_FFT:
-        if (do_inverse)
-            av_log(NULL, AV_LOG_INFO,"IFFT");
-        else
-            av_log(NULL, AV_LOG_INFO,"FFT");
         ff_fft_init(s, fft_nbits, do_inverse);
         fft_ref_init(fft_nbits, do_inverse);
         break;
 #if CONFIG_FFT_FLOAT
     case TRANSFORM_RDFT:
-        if (do_inverse)
-            av_log(NULL, AV_LOG_INFO,"IDFT_C2R");
-        else
-            av_log(NULL, AV_LOG_INFO,"DFT_R2C");
         ff_rdft_init(r, fft_nbits, do_inverse ? IDFT_C2R : DFT_R2C);
         fft_ref_init(fft_nbits, do_inverse);
         break;
     case TRANSFORM_DCT:
-        if (do_inverse)
-            av_log(NULL, AV_LOG_INFO,"DCT_III");
-        else
-            av_log(NULL, AV_LOG_INFO,"DCT_II");
         ff_dct_init(d, fft_nbits, do_inverse ? DCT_III : DCT_II);
         break;
 #endif
@@ -340,7 +295,15 @@ int main(int argc, char **argv)
         av_log(NULL, AV_LOG_ERROR, "Requested transform not supported\n");
         return 1;
     }
-    av_log(NULL, AV_LOG_INFO," %d test\n", fft_size);
+
+    fft_size = 1 << fft_nbits;
+    av_log(NULL, AV_LOG_INFO,"%s %d test\n",
+           transform_names[transform][do_inverse], fft_size);
+
+    tab = av_malloc(fft_size * sizeof(FFTComplex));
+    tab1 = av_malloc(fft_size * sizeof(FFTComplex));
+    tab_ref = av_malloc(fft_size * sizeof(FFTComplex));
+    tab2 = av_malloc(fft_size * sizeof(FFTSample));
 
     /* generate random data */
 
@@ -421,12 +384,12 @@ int main(int argc, char **argv)
 
     /* do a speed test */
 
-    if (do_speed) {
+    if (speed_time) {
         int64_t time_start, duration;
         int nb_its;
 
         av_log(NULL, AV_LOG_INFO,"Speed test...\n");
-        /* we measure during about 1 seconds */
+        /* we measure during about speed_time microseconds */
         nb_its = 1;
         for(;;) {
             time_start = av_gettime();
@@ -456,12 +419,13 @@ int main(int argc, char **argv)
                 }
             }
             duration = av_gettime() - time_start;
-            if (duration >= 1000000)
+            if (duration >= speed_time)
                 break;
             nb_its *= 2;
         }
+        *us = (double)duration / nb_its;
         av_log(NULL, AV_LOG_INFO,"time: %0.1f us/transform [total time=%0.2f s its=%d]\n",
-               (double)duration / nb_its,
+               *us,
                (double)duration / 1000000.0,
                nb_its);
     }
@@ -487,7 +451,107 @@ int main(int argc, char **argv)
     av_free(tab1);
     av_free(tab2);
     av_free(tab_ref);
-    av_free(exptab);
+    av_freep(&exptab);
+
+    return err;
+}
+
+#define MIN_NBITS 4
+
+int main(int argc, char **argv)
+{
+    int c;
+    int cpuflags;
+    int do_speed = 0;
+    int do_all = 0;
+    int err = 0;
+    enum tf_transform transform = TRANSFORM_FFT;
+    int do_inverse = 0;
+    int fft_nbits;
+    double scale = 1.0;
+    double us;
+
+    fft_nbits = 9;
+    for(;;) {
+        c = getopt(argc, argv, "hsimrdan:f:c:");
+        if (c == -1)
+            break;
+        switch(c) {
+        case 'h':
+            help();
+            return 1;
+        case 's':
+            do_speed = 1;
+            break;
+        case 'i':
+            do_inverse = 1;
+            break;
+        case 'm':
+            transform = TRANSFORM_MDCT;
+            break;
+        case 'r':
+            transform = TRANSFORM_RDFT;
+            break;
+        case 'd':
+            transform = TRANSFORM_DCT;
+            break;
+        case 'a':
+            do_all = 1;
+            break;
+        case 'n':
+            fft_nbits = atoi(optarg);
+            break;
+        case 'f':
+            scale = atof(optarg);
+            break;
+        case 'c':
+            cpuflags = av_parse_cpu_flags(optarg);
+            if (cpuflags < 0)
+                return 1;
+            av_set_cpu_flags_mask(cpuflags);
+            break;
+        }
+    }
+
+    if (!do_all)
+        return run_test(transform, do_inverse, fft_nbits, scale,
+                        do_speed ? 1000000 : 0, &us);
+
+    if (fft_nbits < MIN_NBITS || fft_nbits > 16) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid transform size 2^%d\n", fft_nbits);
+        return 1;
+    }
+
+    {
+        double times[NB_TRANSFORMS][2][17] = { { { 0 } } };
+        int nb_transforms = CONFIG_FFT_FLOAT ? NB_TRANSFORMS : TRANSFORM_RDFT;
+        int nbits;
+
+        /* a shorter speed test, there are up to 8 * 13 of them */
+        for (transform = 0; transform < nb_transforms; transform++)
+            for (do_inverse = 0; do_inverse < 2; do_inverse++)
+                for (nbits = MIN_NBITS; nbits <= fft_nbits; nbits++)
+                    err |= run_test(transform, do_inverse, nbits, scale,
+                                    do_speed ? 100000 : 0,
+                                    &times[transform][do_inverse][nbits]);
+
+        if (do_speed) {
+            av_log(NULL, AV_LOG_INFO, "\nus/transform %8s", "");
+            for (nbits = MIN_NBITS; nbits <= fft_nbits; nbits++)
+                av_log(NULL, AV_LOG_INFO, " %9d", 1 << nbits);
+            av_log(NULL, AV_LOG_INFO, "\n");
+            for (transform = 0; transform < nb_transforms; transform++) {
+                for (do_inverse = 0; do_inverse < 2; do_inverse++) {
+                    av_log(NULL, AV_LOG_INFO, "%-20s",
+                           transform_names[transform][do_inverse]);
+                    for (nbits = MIN_NBITS; nbits <= fft_nbits; nbits++)
+                        av_log(NULL, AV_LOG_INFO, " %9.3f",
+                               times[transform][do_inverse][nbits]);
+                    av_log(NULL, AV_LOG_INFO, "\n");
+                }
+            }
+        }
+    }
 
     return err;
 }
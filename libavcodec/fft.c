@@ -165,6 +165,7 @@ av_cold int ff_fft_init(FFTContext *s, int nbits, int inverse)
 #else
     if (CONFIG_MDCT)  s->mdct_calcw = ff_mdct_calcw_c;
     if (ARCH_ARM)     ff_fft_fixed_init_arm(s);
+    if (ARCH_X86)     ff_fft_fixed_init_x86(s);
 #endif
 
     for(j=4; j<=nbits; j++) {
@@ -139,6 +139,7 @@ void ff_fft_init_x86(FFTContext *s);
 void ff_fft_init_arm(FFTContext *s);
 #else
 void ff_fft_fixed_init_arm(FFTContext *s);
+void ff_fft_fixed_init_x86(FFTContext *s);
 #endif
 
 void ff_fft_end(FFTContext *s);
@@ -0,0 +1,246 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Bitstream reader test and VLC decoding benchmark.
+ *
+ * The decoding functions are built once with the default reader here and
+ * once with CACHED_BITSTREAM_READER in get_bits_cached.c, and a checksum of
+ * what each of them decodes is printed. Run with -b to also compare their
+ * speed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "avcodec.h"
+#include "get_bits.h"
+#include "put_bits.h"
+
+#define VLC_BITS 9
+#define COUNT    (1 << 16)
+
+#ifndef FUNC
+#define FUNC(name) ff_ ## name ## _default
+#define TEST_MAIN
+#endif
+
+/* Each element is an exp-Golomb coded symbol followed by 1 to 16 raw bits,
+ * returned as symbol << 16 | raw bits. */
+
+int FUNC(decode_macros)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                        int *out, int count);
+int FUNC(decode_functions)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                           int *out, int count);
+int FUNC(check_seek)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                     const int *ref, const int *pos, int count);
+int FUNC(skip_past_end)(const uint8_t *buf, int size);
+
+int FUNC(decode_macros)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                        int *out, int count)
+{
+    GetBitContext gb;
+    int i;
+
+    init_get_bits(&gb, buf, size * 8);
+    {
+        OPEN_READER(re, &gb);
+        for (i = 0; i < count; i++) {
+            int sym, n;
+
+            UPDATE_CACHE(re, &gb);
+            GET_VLC(sym, re, &gb, table, VLC_BITS, 2);
+            n      = (sym & 15) + 1;
+            out[i] = sym << 16 | SHOW_UBITS(re, &gb, n);
+            LAST_SKIP_BITS(re, &gb, n);
+        }
+        CLOSE_READER(re, &gb);
+    }
+    return get_bits_count(&gb);
+}
+
+int FUNC(decode_functions)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                           int *out, int count)
+{
+    GetBitContext gb;
+    int i;
+
+    init_get_bits(&gb, buf, size * 8);
+    for (i = 0; i < count; i++) {
+        int sym = get_vlc2(&gb, table, VLC_BITS, 2);
+        out[i]  = sym << 16 | get_bits(&gb, (sym & 15) + 1);
+    }
+    return get_bits_count(&gb);
+}
+
+/**
+ * Jump back and forth between elements with skip_bits_long().
+ * @return the number of mismatches
+ */
+int FUNC(check_seek)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                     const int *ref, const int *pos, int count)
+{
+    GetBitContext gb;
+    int i, err = 0;
+
+    init_get_bits(&gb, buf, size * 8);
+    for (i = 0; i < count; i++) {
+        int j = i * 7919 % count, sym, val;
+
+        skip_bits_long(&gb, pos[j] - get_bits_count(&gb));
+        if (get_bits_count(&gb) != pos[j])
+            err++;
+        sym = get_vlc2(&gb, table, VLC_BITS, 2);
+        val = get_bits(&gb, (sym & 15) + 1);
+        if ((sym << 16 | val) != ref[j])
+            err++;
+    }
+    return err;
+}
+
+/**
+ * Skip past the end of the buffer, from inside and from beyond the cache.
+ * @return the bit position after the skips
+ */
+int FUNC(skip_past_end)(const uint8_t *buf, int size)
+{
+    GetBitContext gb;
+
+    init_get_bits(&gb, buf, size * 8);
+    skip_bits_long(&gb, size * 8 - 3);
+    get_bits(&gb, 1);
+    skip_bits_long(&gb, 20);
+    skip_bits_long(&gb, 100);
+    return get_bits_count(&gb);
+}
+
+#ifdef TEST_MAIN
+
+#undef FUNC
+#define FUNC(name) ff_ ## name ## _cached
+
+int FUNC(decode_macros)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                        int *out, int count);
+int FUNC(decode_functions)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                           int *out, int count);
+int FUNC(check_seek)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                     const int *ref, const int *pos, int count);
+int FUNC(skip_past_end)(const uint8_t *buf, int size);
+
+typedef int (*decode_func)(const uint8_t *buf, int size, VLC_TYPE (*table)[2],
+                           int *out, int count);
+
+static const struct {
+    const char *name;
+    decode_func decode;
+} tests[] = {
+    { "default macros",    ff_decode_macros_default    },
+    { "default functions", ff_decode_functions_default },
+    { "cached macros",     ff_decode_macros_cached     },
+    { "cached functions",  ff_decode_functions_cached  },
+};
+
+#define NB_SYMBOLS 256
+#define SIZE       (COUNT * 5)
+
+int main(int argc, char **argv)
+{
+    uint8_t  lens[NB_SYMBOLS];
+    uint32_t codes[NB_SYMBOLS];
+    int *ref = av_malloc(COUNT * sizeof(*ref));
+    int *pos = av_malloc(COUNT * sizeof(*pos));
+    int *out = av_malloc(COUNT * sizeof(*out));
+    uint8_t *buf = av_mallocz(SIZE + FF_INPUT_BUFFER_PADDING_SIZE);
+    int bench = argc > 1 && !strcmp(argv[1], "-b");
+    int i, t, bits, ret = 0;
+    PutBitContext pb;
+    AVLFG prng;
+    VLC vlc;
+
+    if (!ref || !pos || !out || !buf)
+        return 2;
+
+    for (i = 0; i < NB_SYMBOLS; i++) {
+        lens[i]  = 2 * av_log2(i + 1) + 1;
+        codes[i] = i + 1;
+    }
+    if (init_vlc(&vlc, VLC_BITS, NB_SYMBOLS, lens, 1, 1, codes, 4, 4, 0) < 0)
+        return 2;
+
+    av_lfg_init(&prng, 1);
+    init_put_bits(&pb, buf, SIZE);
+    for (i = 0; i < COUNT; i++) {
+        int sym = av_lfg_get(&prng) & ((2 << av_lfg_get(&prng) % 8) - 1);
+        int n   = (sym & 15) + 1;
+        int val = av_lfg_get(&prng) & ((1 << n) - 1);
+
+        pos[i] = put_bits_count(&pb);
+        ref[i] = sym << 16 | val;
+        put_bits(&pb, lens[sym], codes[sym]);
+        put_bits(&pb, n, val);
+    }
+    bits = put_bits_count(&pb);
+    flush_put_bits(&pb);
+
+    for (t = 0; t < FF_ARRAY_ELEMS(tests); t++) {
+        unsigned checksum = 0;
+        int read;
+
+        memset(out, 0, COUNT * sizeof(*out));
+        read = tests[t].decode(buf, SIZE, vlc.table, out, COUNT);
+        for (i = 0; i < COUNT; i++)
+            checksum = checksum * 31 + out[i];
+        printf("%s: %d bits, checksum %08x\n", tests[t].name, read, checksum);
+        if (read != bits || memcmp(ref, out, COUNT * sizeof(*out))) {
+            printf("%s: decoding mismatch\n", tests[t].name);
+            ret = 1;
+        }
+    }
+    printf("default skip_bits_long: %d errors, %d bits past the end\n",
+           ff_check_seek_default(buf, SIZE, vlc.table, ref, pos, COUNT),
+           ff_skip_past_end_default(buf, 16) - 16 * 8);
+    printf("cached skip_bits_long: %d errors, %d bits past the end\n",
+           ff_check_seek_cached(buf, SIZE, vlc.table, ref, pos, COUNT),
+           ff_skip_past_end_cached(buf, 16) - 16 * 8);
+
+    if (bench && !ret) {
+        for (t = 0; t < FF_ARRAY_ELEMS(tests); t++) {
+            int64_t time = av_gettime();
+            for (i = 0; i < 100; i++)
+                tests[t].decode(buf, SIZE, vlc.table, out, COUNT);
+            time = av_gettime() - time;
+            printf("%-18s %7.2f Mbit/s %6.2f ns/symbol\n", tests[t].name,
+                   100.0 * bits / time, time * 1000.0 / (100.0 * COUNT));
+        }
+    }
+
+    ff_free_vlc(&vlc);
+    av_free(ref);
+    av_free(pos);
+    av_free(out);
+    av_free(buf);
+    return ret;
+}
+
+#endif /* TEST_MAIN */
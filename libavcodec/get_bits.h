@@ -50,8 +50,25 @@
 #define UNCHECKED_BITSTREAM_READER !CONFIG_SAFE_BITSTREAM_READER
 #endif
 
+/*
+ * Cached bitstream reader:
+ * a decoder can "#define CACHED_BITSTREAM_READER 1" before including
+ * this header to keep up to 64 bits in the GetBitContext. The cache is
+ * then refilled 32 bits at a time, and only when less than 32 bits are
+ * left, instead of doing an unaligned 32-bit read on every UPDATE_CACHE.
+ * The API below stays the same, but all files sharing a GetBitContext
+ * must use the same setting and must not access its index directly.
+ */
+#ifndef CACHED_BITSTREAM_READER
+#define CACHED_BITSTREAM_READER 0
+#endif
+
 typedef struct GetBitContext {
     const uint8_t *buffer, *buffer_end;
+#if CACHED_BITSTREAM_READER
+    uint64_t cache;     ///< next bits, MSB first (LSB first for BITSTREAM_READER_LE)
+    unsigned bits_left; ///< number of valid bits in cache
+#endif
     int index;
     int size_in_bits;
 #if !UNCHECKED_BITSTREAM_READER
@@ -89,10 +106,12 @@ typedef struct RL_VLC_ELEM {
  * UPDATE_CACHE(name, gb)
  *   Refill the internal cache from the bitstream.
  *   After this call at least MIN_CACHE_BITS will be available.
+ *   With CACHED_BITSTREAM_READER this only reads from the bitstream when
+ *   less than 32 bits are left in the cache.
  *
  * GET_CACHE(name, gb)
- *   Will output the contents of the internal cache,
- *   next bit is MSB of 32 or 64 bit (FIXME 64bit).
+ *   Will output the next 32 bits of the internal cache,
+ *   next bit is MSB (LSB for BITSTREAM_READER_LE).
  *
  * SHOW_UBITS(name, gb, num)
  *   Will return the next num bits.
@@ -113,16 +132,89 @@ typedef struct RL_VLC_ELEM {
  *
  * LAST_SKIP_BITS(name, gb, num)
  *   Like SKIP_BITS, to be used if next call is UPDATE_CACHE or CLOSE_READER.
+ *   Same as SKIP_BITS with CACHED_BITSTREAM_READER.
  *
  * For examples see get_bits, show_bits, skip_bits, get_vlc.
  */
 
-#ifdef LONG_BITSTREAM_READER
+#if CACHED_BITSTREAM_READER || defined LONG_BITSTREAM_READER
 #   define MIN_CACHE_BITS 32
 #else
 #   define MIN_CACHE_BITS 25
 #endif
 
+#if CACHED_BITSTREAM_READER
+
+#if UNCHECKED_BITSTREAM_READER
+#define OPEN_READER(name, gb)                               \
+    unsigned int name ## _index     = (gb)->index;          \
+    unsigned int name ## _bits_left = (gb)->bits_left;      \
+    uint64_t     name ## _cache     = (gb)->cache
+
+#define HAVE_BITS_REMAINING(name, gb) 1
+#define CAN_REFILL(name, gb) 1
+#else
+#define OPEN_READER(name, gb)                               \
+    unsigned int name ## _index     = (gb)->index;          \
+    unsigned int name ## _bits_left = (gb)->bits_left;      \
+    uint64_t     name ## _cache     = (gb)->cache;          \
+    unsigned int av_unused name ## _size_plus8 = (gb)->size_in_bits_plus8
+
+#define HAVE_BITS_REMAINING(name, gb) \
+    name ## _index - name ## _bits_left < name ## _size_plus8
+/* past the end the cache is filled with zeros */
+#define CAN_REFILL(name, gb) name ## _index < name ## _size_plus8
+#endif
+
+#define CLOSE_READER(name, gb)                  \
+    do {                                        \
+        (gb)->index     = name ## _index;       \
+        (gb)->bits_left = name ## _bits_left;   \
+        (gb)->cache     = name ## _cache;       \
+    } while (0)
+
+#ifdef BITSTREAM_READER_LE
+# define REFILL_CACHE(name, gb) name ## _cache |=                           \
+    (uint64_t) AV_RL32((gb)->buffer + (name ## _index >> 3)) << name ## _bits_left
+# define SKIP_CACHE(name, gb, num) name ## _cache >>= (num)
+#else
+# define REFILL_CACHE(name, gb) name ## _cache |=                           \
+    (uint64_t) AV_RB32((gb)->buffer + (name ## _index >> 3)) << (32 - name ## _bits_left)
+# define SKIP_CACHE(name, gb, num) name ## _cache <<= (num)
+#endif
+
+#define UPDATE_CACHE(name, gb)                  \
+    do {                                        \
+        if (name ## _bits_left < 32) {          \
+            if (CAN_REFILL(name, gb))           \
+                REFILL_CACHE(name, gb);         \
+            name ## _index     += 32;           \
+            name ## _bits_left += 32;           \
+        }                                       \
+    } while (0)
+
+#define SKIP_COUNTER(name, gb, num) name ## _bits_left -= (num)
+
+#define SKIP_BITS(name, gb, num)                \
+    do {                                        \
+        SKIP_CACHE(name, gb, num);              \
+        SKIP_COUNTER(name, gb, num);            \
+    } while (0)
+
+#define LAST_SKIP_BITS(name, gb, num) SKIP_BITS(name, gb, num)
+
+#ifdef BITSTREAM_READER_LE
+#   define GET_CACHE(name, gb) ((uint32_t) name ## _cache)
+#   define SHOW_UBITS(name, gb, num) zero_extend(GET_CACHE(name, gb), num)
+#   define SHOW_SBITS(name, gb, num) sign_extend(GET_CACHE(name, gb), num)
+#else
+#   define GET_CACHE(name, gb) ((uint32_t) (name ## _cache >> 32))
+#   define SHOW_UBITS(name, gb, num) NEG_USR32(GET_CACHE(name, gb), num)
+#   define SHOW_SBITS(name, gb, num) NEG_SSR32(GET_CACHE(name, gb), num)
+#endif
+
+#else /* CACHED_BITSTREAM_READER */
+
 #if UNCHECKED_BITSTREAM_READER
 #define OPEN_READER(name, gb)                   \
     unsigned int name ## _index = (gb)->index;  \
@@ -191,14 +283,40 @@ typedef struct RL_VLC_ELEM {
 
 #define GET_CACHE(name, gb) ((uint32_t) name ## _cache)
 
+#endif /* CACHED_BITSTREAM_READER */
+
 static inline int get_bits_count(const GetBitContext *s)
 {
+#if CACHED_BITSTREAM_READER
+    return s->index - s->bits_left;
+#else
     return s->index;
+#endif
 }
 
+static inline void skip_bits(GetBitContext *s, int n);
+
 static inline void skip_bits_long(GetBitContext *s, int n)
 {
-#if UNCHECKED_BITSTREAM_READER
+#if CACHED_BITSTREAM_READER
+    int pos = get_bits_count(s);
+
+#if !UNCHECKED_BITSTREAM_READER
+    n = av_clip(n, -pos, s->size_in_bits_plus8 - pos);
+#endif
+    if (n >= 0 && n <= s->bits_left) {
+        OPEN_READER(re, s);
+        SKIP_BITS(re, s, n);
+        CLOSE_READER(re, s);
+        return;
+    }
+    pos += n;
+    /* restart the cache at the byte containing the new position */
+    s->index     = pos & ~7;
+    s->bits_left = 0;
+    s->cache     = 0;
+    skip_bits(s, pos & 7);
+#elif UNCHECKED_BITSTREAM_READER
     s->index += n;
 #else
     s->index += av_clip(n, -s->index, s->size_in_bits_plus8 - s->index);
@@ -257,6 +375,10 @@ static inline unsigned int show_bits(GetBitContext *s, int n)
     OPEN_READER(re, s);
     UPDATE_CACHE(re, s);
     tmp = SHOW_UBITS(re, s, n);
+#if CACHED_BITSTREAM_READER
+    /* keep the refilled cache for the following reads */
+    CLOSE_READER(re, s);
+#endif
     return tmp;
 }
 
@@ -270,6 +392,9 @@ static inline void skip_bits(GetBitContext *s, int n)
 
 static inline unsigned int get_bits1(GetBitContext *s)
 {
+#if CACHED_BITSTREAM_READER
+    return get_bits(s, 1);
+#else
     unsigned int index = s->index;
     uint8_t result     = s->buffer[index >> 3];
 #ifdef BITSTREAM_READER_LE
@@ -286,6 +411,7 @@ static inline unsigned int get_bits1(GetBitContext *s)
     s->index = index;
 
     return result;
+#endif
 }
 
 static inline unsigned int show_bits1(GetBitContext *s)
@@ -393,6 +519,10 @@ static inline int init_get_bits(GetBitContext *s, const uint8_t *buffer,
 #endif
     s->buffer_end         = buffer + buffer_size;
     s->index              = 0;
+#if CACHED_BITSTREAM_READER
+    s->cache              = 0;
+    s->bits_left          = 0;
+#endif
 
     return ret;
 }
@@ -507,9 +507,7 @@ static inline void set_ur_golomb_jpegls(PutBitContext *pb, int i, int k, int lim
             put_bits(pb, 31, 0);
             e -= 31;
         }
-        put_bits(pb, e, 1);
-        if(k)
-            put_sbits(pb, k, i);
+        put_bits63(pb, e + k, (uint64_t)1 << k | (i & ((1U << k) - 1)));
     }else{
         while(limit > 31) {
             put_bits(pb, 31, 0);
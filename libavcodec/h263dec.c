@@ -360,6 +360,8 @@ uint64_t time= rdtsc();
         /* special case for last picture */
         if (s->low_delay==0 && s->next_picture_ptr) {
             *pict = s->next_picture_ptr->f;
+            pict->reorder_delay = s->coded_picture_number - 1 -
+                                  pict->coded_picture_number;
             s->next_picture_ptr= NULL;
 
             *got_frame = 1;
@@ -725,6 +727,9 @@ intrax8_decoded:
         *pict = s->current_picture_ptr->f;
     } else if (s->last_picture_ptr != NULL) {
         *pict = s->last_picture_ptr->f;
+        /* the reference was held back while the B-frames were decoded */
+        pict->reorder_delay = s->coded_picture_number - 1 -
+                              pict->coded_picture_number;
     }
 
     if(s->last_picture_ptr || s->low_delay){
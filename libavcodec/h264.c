@@ -45,6 +45,12 @@
 // #undef NDEBUG
 #include <assert.h>
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "w32pthreads.h"
+#endif
+
 const uint16_t ff_h264_mb_sizes[4] = { 256, 384, 512, 768 };
 
 static const uint8_t rem6[QP_MAX_NUM + 1] = {
@@ -1342,6 +1348,33 @@ int ff_h264_frame_start(H264Context *h)
     return 0;
 }
 
+/**
+ * Keep the reordering delay within what AVCodecContext.max_frame_delay
+ * leaves after the frame threading delay.
+ */
+static void limit_reorder_delay(H264Context *h)
+{
+    MpegEncContext *const s = &h->s;
+    int max_delay = s->avctx->max_frame_delay;
+
+    if (max_delay < 0)
+        return;
+    if (s->avctx->active_thread_type & FF_THREAD_FRAME)
+        max_delay -= s->avctx->thread_count - 1;
+    max_delay = FFMAX(max_delay, 0);
+
+    if (s->avctx->has_b_frames > max_delay) {
+        if (!h->reorder_delay_warning) {
+            av_log(s->avctx, AV_LOG_WARNING,
+                   "Reordering needs %d frames of delay, limiting it to %d.\n",
+                   s->avctx->has_b_frames, max_delay);
+            h->reorder_delay_warning = 1;
+        }
+        s->avctx->has_b_frames = max_delay;
+        s->low_delay           = !max_delay;
+    }
+}
+
 /**
  * Run setup operations that must be run after slice header decoding.
  * This includes finding the next displayed frame.
@@ -1455,6 +1488,7 @@ static void decode_postinit(H264Context *h, int setup_finished)
         s->avctx->has_b_frames = MAX_DELAYED_PIC_COUNT - 1;
         s->low_delay           = 0;
     }
+    limit_reorder_delay(h);
 
     pics = 0;
     while (h->delayed_pic[pics])
@@ -1527,6 +1561,7 @@ static void decode_postinit(H264Context *h, int setup_finished)
         s->low_delay = 0;
         s->avctx->has_b_frames++;
     }
+    limit_reorder_delay(h);
 
     if (pics > s->avctx->has_b_frames) {
         out->f.reference &= ~DELAYED_PIC_REF;
@@ -1541,6 +1576,8 @@ static void decode_postinit(H264Context *h, int setup_finished)
     h->last_pocs[MAX_DELAYED_PIC_COUNT - 1] = cur->poc;
     if (!out_of_order && pics > s->avctx->has_b_frames) {
         h->next_output_pic = out;
+        out->f.reorder_delay = s->coded_picture_number - 1 -
+                               out->f.coded_picture_number;
         if (out->mmco_reset) {
             if (out_idx > 0) {
                 h->next_outputed_poc                    = out->poc;
@@ -3591,12 +3628,12 @@ static void predict_field_decoding_flag(H264Context *h)
 }
 
 /**
- * Draw edges and report progress for the last MB row.
+ * Draw edges and report progress for the MB row mb_y.
  */
-static void decode_finish_row(H264Context *h)
+static void report_row(H264Context *h, int mb_y)
 {
     MpegEncContext *const s = &h->s;
-    int top            = 16 * (s->mb_y      >> FIELD_PICTURE);
+    int top            = 16 * (mb_y         >> FIELD_PICTURE);
     int pic_height     = 16 *  s->mb_height >> FIELD_PICTURE;
     int height         =  16      << FRAME_MBAFF;
     int deblock_border = (16 + 4) << FRAME_MBAFF;
@@ -3625,6 +3662,104 @@ static void decode_finish_row(H264Context *h)
                               s->picture_structure == PICT_BOTTOM_FIELD);
 }
 
+/**
+ * Deblocking progress of a slice whose loop filter runs in separate jobs,
+ * as a wavefront behind the decoding. Macroblock positions are counted in
+ * raster order.
+ */
+typedef struct H264Wavefront {
+#if HAVE_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+#endif
+    int *filtered;      ///< number of deblocked macroblocks in each row
+    int start;          ///< position of the first macroblock of the slice
+    int decoded;        ///< number of reconstructed macroblocks, from 0
+    int wait_decoded;   ///< value of decoded a filter job waits for
+    int filter_end;     ///< position the loop filter may run up to
+    int decode_done;    ///< the decoding of the slice has ended
+    int next_row;       ///< next row to be taken by a filter job
+    int reported_row;   ///< next row to pass to report_row()
+} H264Wavefront;
+
+/**
+ * Call report_row() for the rows deblocked so far, or for all the rows
+ * of the slice once its loop filter has finished.
+ */
+static void wavefront_report_rows(H264Context *h, H264Wavefront *wf, int all)
+{
+    MpegEncContext *const s = &h->s;
+    int end;
+
+#if HAVE_THREADS
+    pthread_mutex_lock(&wf->lock);
+#endif
+    if (all)
+        end = wf->filter_end / s->mb_width;
+    else
+        for (end = wf->reported_row; end < s->mb_height; end++)
+            if (wf->filtered[end] < s->mb_width)
+                break;
+#if HAVE_THREADS
+    pthread_mutex_unlock(&wf->lock);
+#endif
+
+    while (wf->reported_row < end)
+        report_row(h, wf->reported_row++);
+}
+
+/**
+ * Draw edges and report progress for the last MB row.
+ */
+static void decode_finish_row(H264Context *h)
+{
+    if (h->wavefront)
+        wavefront_report_rows(h, h->wavefront, 0);
+    else
+        report_row(h, h->s.mb_y);
+}
+
+/**
+ * Deblock the macroblocks start_x to end_x - 1 of the current row, or
+ * hand them over to the filter jobs of the wavefront.
+ */
+static void decode_loop_filter(H264Context *h, int start_x, int end_x)
+{
+    MpegEncContext *const s = &h->s;
+    H264Wavefront *wf       = h->wavefront;
+
+    if (!wf) {
+        loop_filter(h, start_x, end_x);
+        return;
+    }
+
+#if HAVE_THREADS
+    pthread_mutex_lock(&wf->lock);
+    wf->filter_end = s->mb_y * s->mb_width + end_x;
+    pthread_cond_broadcast(&wf->cond);
+    pthread_mutex_unlock(&wf->lock);
+#endif
+    s->mb_x = end_x;
+}
+
+/**
+ * Tell the filter jobs that the current macroblock has been reconstructed.
+ */
+static void decode_report_mb(H264Context *h)
+{
+#if HAVE_THREADS
+    H264Wavefront *wf = h->wavefront;
+
+    pthread_mutex_lock(&wf->lock);
+    wf->decoded = h->s.mb_y * h->s.mb_width + h->s.mb_x + 1;
+    if (wf->decoded >= wf->wait_decoded) {
+        wf->wait_decoded = INT_MAX;
+        pthread_cond_broadcast(&wf->cond);
+    }
+    pthread_mutex_unlock(&wf->lock);
+#endif
+}
+
 static int decode_slice(struct AVCodecContext *avctx, void *arg)
 {
     H264Context *h = *(void **)arg;
@@ -3657,8 +3792,11 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
             int eos;
             // STOP_TIMER("decode_mb_cabac")
 
-            if (ret >= 0)
+            if (ret >= 0) {
                 ff_h264_hl_decode_mb(h);
+                if (h->wavefront)
+                    decode_report_mb(h);
+            }
 
             // FIXME optimal? or let mb_decode decode 16x32 ?
             if (ret >= 0 && FRAME_MBAFF) {
@@ -3677,7 +3815,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
                 ff_er_add_slice(s, s->resync_mb_x, s->resync_mb_y, s->mb_x - 1,
                                 s->mb_y, ER_MB_END & part_mask);
                 if (s->mb_x >= lf_x_start)
-                    loop_filter(h, lf_x_start, s->mb_x + 1);
+                    decode_loop_filter(h, lf_x_start, s->mb_x + 1);
                 return 0;
             }
             if (ret < 0 || h->cabac.bytestream > h->cabac.bytestream_end + 2) {
@@ -3691,7 +3829,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
             }
 
             if (++s->mb_x >= s->mb_width) {
-                loop_filter(h, lf_x_start, s->mb_x);
+                decode_loop_filter(h, lf_x_start, s->mb_x);
                 s->mb_x = lf_x_start = 0;
                 decode_finish_row(h);
                 ++s->mb_y;
@@ -3708,7 +3846,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
                 ff_er_add_slice(s, s->resync_mb_x, s->resync_mb_y, s->mb_x - 1,
                                 s->mb_y, ER_MB_END & part_mask);
                 if (s->mb_x > lf_x_start)
-                    loop_filter(h, lf_x_start, s->mb_x);
+                    decode_loop_filter(h, lf_x_start, s->mb_x);
                 return 0;
             }
         }
@@ -3716,8 +3854,11 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
         for (;;) {
             int ret = ff_h264_decode_mb_cavlc(h);
 
-            if (ret >= 0)
+            if (ret >= 0) {
                 ff_h264_hl_decode_mb(h);
+                if (h->wavefront)
+                    decode_report_mb(h);
+            }
 
             // FIXME optimal? or let mb_decode decode 16x32 ?
             if (ret >= 0 && FRAME_MBAFF) {
@@ -3738,7 +3879,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
             }
 
             if (++s->mb_x >= s->mb_width) {
-                loop_filter(h, lf_x_start, s->mb_x);
+                decode_loop_filter(h, lf_x_start, s->mb_x);
                 s->mb_x = lf_x_start = 0;
                 decode_finish_row(h);
                 ++s->mb_y;
@@ -3775,7 +3916,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
                                     s->mb_x - 1, s->mb_y,
                                     ER_MB_END & part_mask);
                     if (s->mb_x > lf_x_start)
-                        loop_filter(h, lf_x_start, s->mb_x);
+                        decode_loop_filter(h, lf_x_start, s->mb_x);
 
                     return 0;
                 } else {
@@ -3789,6 +3930,184 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
     }
 }
 
+#if HAVE_THREADS
+/* number of macroblocks a filter job deblocks at once while decoding */
+#define WAVEFRONT_BATCH 8
+
+/**
+ * Deblock rows of the current slice as soon as their pixels are no longer
+ * needed unfiltered, until the whole slice is deblocked.
+ */
+static void wavefront_filter_rows(H264Context *h, H264Wavefront *wf)
+{
+    MpegEncContext *const s = &h->s;
+    const int mb_width      = s->mb_width;
+    const int start_y       = wf->start / mb_width;
+
+    pthread_mutex_lock(&wf->lock);
+    while (wf->next_row < s->mb_height) {
+        int mb_y = wf->next_row++;
+        int x    = FFMAX(wf->start - mb_y * mb_width, 0);
+
+        while (x < mb_width) {
+            int end = FFMIN(mb_width, wf->filter_end - mb_y * mb_width);
+
+            /* Deblocking a macroblock changes the last columns of its left
+             * neighbour and the last lines of the macroblock above, so stay
+             * one macroblock behind the filter of the previous row. */
+            if (mb_y > start_y && wf->filtered[mb_y - 1] < mb_width)
+                end = FFMIN(end, wf->filtered[mb_y - 1] - 1);
+            /* The intra prediction of the next row reads the last line of
+             * this one unfiltered, up to one macroblock to the right. */
+            if (!wf->decode_done) {
+                int next = wf->decoded - (mb_y + 1) * mb_width;
+                if (next < mb_width)
+                    end = FFMIN(end, next - 1);
+            }
+
+            /* wait for a batch of macroblocks while the decoding goes on */
+            if (end - x < (wf->decode_done ? 1 : FFMIN(WAVEFRONT_BATCH,
+                                                        mb_width - x))) {
+                if (wf->decode_done && wf->filter_end <= mb_y * mb_width + x)
+                    goto done;
+                if (!wf->decode_done)
+                    wf->wait_decoded = FFMIN(wf->wait_decoded,
+                                             (mb_y + 1) * mb_width +
+                                             FFMIN(x + 1 + WAVEFRONT_BATCH,
+                                                   mb_width));
+                pthread_cond_wait(&wf->cond, &wf->lock);
+                continue;
+            }
+
+            pthread_mutex_unlock(&wf->lock);
+            s->mb_y = mb_y;
+            loop_filter(h, x, end);
+            pthread_mutex_lock(&wf->lock);
+            wf->filtered[mb_y] = x = end;
+            pthread_cond_broadcast(&wf->cond);
+        }
+    }
+done:
+    pthread_mutex_unlock(&wf->lock);
+}
+
+static int decode_slice_wavefront(AVCodecContext *avctx, void *arg)
+{
+    H264Context *h          = *(void **)arg;
+    MpegEncContext *const s = &h->s;
+    H264Wavefront *wf       = h->wavefront;
+    int ret = 0;
+
+    if (h->thread_context[0] == h) {
+        int mb_x, mb_y, mb_xy;
+
+        ret = decode_slice(avctx, arg);
+
+        pthread_mutex_lock(&wf->lock);
+        wf->decode_done = 1;
+        pthread_cond_broadcast(&wf->cond);
+        pthread_mutex_unlock(&wf->lock);
+
+        /* join the filter jobs, keeping the slice end position */
+        mb_x  = s->mb_x;
+        mb_y  = s->mb_y;
+        mb_xy = h->mb_xy;
+        wavefront_filter_rows(h, wf);
+        s->mb_x  = mb_x;
+        s->mb_y  = mb_y;
+        h->mb_xy = mb_xy;
+    } else {
+        wavefront_filter_rows(h, wf);
+    }
+
+    return ret;
+}
+
+/**
+ * Copy the state needed by loop_filter() to a filter job context.
+ */
+static void wavefront_init_context(H264Context *dst, H264Context *src)
+{
+    dst->s.current_picture       = src->s.current_picture;
+    dst->s.linesize              = src->s.linesize;
+    dst->s.uvlinesize            = src->s.uvlinesize;
+    dst->s.picture_structure     = src->s.picture_structure;
+    dst->s.chroma_x_shift        = src->s.chroma_x_shift;
+    dst->s.chroma_y_shift        = src->s.chroma_y_shift;
+    dst->s.qscale                = src->s.qscale;
+    dst->sps                     = src->sps;
+    dst->pps                     = src->pps;
+    dst->h264dsp                 = src->h264dsp;
+    dst->pixel_shift             = src->pixel_shift;
+    dst->b_stride                = src->b_stride;
+    dst->mb_aff_frame            = src->mb_aff_frame;
+    dst->mb_field_decoding_flag  = src->mb_field_decoding_flag;
+    dst->slice_type              = src->slice_type;
+    dst->slice_type_nos          = src->slice_type_nos;
+    dst->deblocking_filter       = src->deblocking_filter;
+    dst->slice_alpha_c0_offset   = src->slice_alpha_c0_offset;
+    dst->slice_beta_offset       = src->slice_beta_offset;
+    dst->qp_thresh               = src->qp_thresh;
+    memcpy(dst->ref2frm, src->ref2frm, sizeof(dst->ref2frm));
+}
+
+/**
+ * Decode a single slice in the master context while the other slice
+ * contexts deblock it row by row behind the reconstruction, so that a
+ * frame made of one slice still makes use of slice threads.
+ *
+ * Each filter job takes the next row and stays one macroblock behind the
+ * row above, so the rows are deblocked in parallel by all the slice
+ * contexts. The reconstruction itself stays with the entropy decoding, as
+ * the intra prediction of each macroblock depends on its reconstructed
+ * neighbours, so the decoding remains the limit and the extra filter jobs
+ * only help where deblocking a row takes longer than decoding it.
+ */
+static int execute_decode_slice_wavefront(H264Context *h)
+{
+    MpegEncContext *const s = &h->s;
+    H264Wavefront wf        = { 0 };
+    const int nb_jobs       = FFMIN(s->slice_context_count, s->mb_height);
+    int i, ret[MAX_THREADS];
+
+    wf.filtered = av_malloc(s->mb_height * sizeof(*wf.filtered));
+    if (!wf.filtered)
+        return decode_slice(s->avctx, &h);
+
+    wf.start        =
+    wf.decoded      =
+    wf.filter_end   = s->mb_y * s->mb_width + s->mb_x;
+    wf.wait_decoded = INT_MAX;
+    wf.next_row     =
+    wf.reported_row = s->mb_y;
+    for (i = s->mb_y; i < s->mb_height; i++)
+        wf.filtered[i] = 0;
+    wf.filtered[s->mb_y] = s->mb_x;
+    pthread_mutex_init(&wf.lock, NULL);
+    pthread_cond_init(&wf.cond, NULL);
+
+    for (i = 0; i < nb_jobs; i++) {
+        H264Context *hx = h->thread_context[i];
+        if (i)
+            wavefront_init_context(hx, h);
+        hx->wavefront = &wf;
+    }
+
+    s->avctx->execute(s->avctx, decode_slice_wavefront, h->thread_context,
+                      ret, nb_jobs, sizeof(void *));
+
+    for (i = 0; i < nb_jobs; i++)
+        h->thread_context[i]->wavefront = NULL;
+    wavefront_report_rows(h, &wf, 1);
+
+    pthread_cond_destroy(&wf.cond);
+    pthread_mutex_destroy(&wf.lock);
+    av_free(wf.filtered);
+
+    return ret[0];
+}
+#endif
+
 /**
  * Call decode_slice() for each context.
  *
@@ -3806,6 +4125,12 @@ static int execute_decode_slices(H264Context *h, int context_count)
         s->avctx->codec->capabilities & CODEC_CAP_HWACCEL_VDPAU)
         return 0;
     if (context_count == 1) {
+#if HAVE_THREADS
+        if (avctx->active_thread_type & FF_THREAD_SLICE &&
+            s->slice_context_count > 1 && h->deblocking_filter &&
+            s->picture_structure == PICT_FRAME && !FRAME_MBAFF)
+            return execute_decode_slice_wavefront(h);
+#endif
         return decode_slice(avctx, &h);
     } else {
         for (i = 1; i < context_count; i++) {
@@ -4178,6 +4503,8 @@ out:
             h->delayed_pic[i] = h->delayed_pic[i + 1];
 
         if (out) {
+            out->f.reorder_delay = s->coded_picture_number - 1 -
+                                   out->f.coded_picture_number;
             *got_frame = 1;
             *pict      = out->f;
         }
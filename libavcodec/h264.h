@@ -527,7 +527,19 @@ typedef struct H264Context {
      */
     int single_decode_warning;
 
+    /**
+     * 1 if the warning about the reordering delay being limited by
+     * AVCodecContext.max_frame_delay has already been displayed.
+     */
+    int reorder_delay_warning;
+
     int last_slice_type;
+
+    /**
+     * Deblocking progress of the slice being decoded while its loop filter
+     * runs in separate jobs, NULL otherwise.
+     */
+    struct H264Wavefront *wavefront;
     /** @} */
 
     /**
@@ -1718,8 +1718,10 @@ decode_cabac_residual_internal(H264Context *h, DCTELEM *block,
                 } \
 \
                 coeff_abs=1; \
-                while( j-- ) { \
-                    coeff_abs += coeff_abs + get_cabac_bypass( CC ); \
+                while( j ) { \
+                    int bits = FFMIN(j, CABAC_BYPASS_BATCH); \
+                    coeff_abs = coeff_abs << bits | get_cabac_bypass_bits( CC, bits ); \
+                    j -= bits; \
                 } \
                 coeff_abs+= 14; \
             } \
@@ -1745,8 +1747,20 @@ decode_cabac_residual_internal(H264Context *h, DCTELEM *block,
 
 }
 
-static void decode_cabac_residual_dc_internal( H264Context *h, DCTELEM *block, int cat, int n, const uint8_t *scantable, int max_coeff ) {
-    decode_cabac_residual_internal(h, block, cat, n, scantable, NULL, max_coeff, 1, 0);
+/* One out-of-line instance per block size, so that max_coeff is a constant
+ * in the significance map and level loops of each of them. */
+static void decode_cabac_residual_dc_internal_4(H264Context *h, DCTELEM *block,
+                                                int cat, int n,
+                                                const uint8_t *scantable)
+{
+    decode_cabac_residual_internal(h, block, cat, n, scantable, NULL, 4, 1, 0);
+}
+
+static void decode_cabac_residual_dc_internal_16(H264Context *h, DCTELEM *block,
+                                                 int cat, int n,
+                                                 const uint8_t *scantable)
+{
+    decode_cabac_residual_internal(h, block, cat, n, scantable, NULL, 16, 1, 0);
 }
 
 static void decode_cabac_residual_dc_internal_422(H264Context *h, DCTELEM *block,
@@ -1756,8 +1770,28 @@ static void decode_cabac_residual_dc_internal_422(H264Context *h, DCTELEM *block
     decode_cabac_residual_internal(h, block, cat, n, scantable, NULL, max_coeff, 1, 1);
 }
 
-static void decode_cabac_residual_nondc_internal( H264Context *h, DCTELEM *block, int cat, int n, const uint8_t *scantable, const uint32_t *qmul, int max_coeff ) {
-    decode_cabac_residual_internal(h, block, cat, n, scantable, qmul, max_coeff, 0, 0);
+static void decode_cabac_residual_nondc_internal_15(H264Context *h, DCTELEM *block,
+                                                    int cat, int n,
+                                                    const uint8_t *scantable,
+                                                    const uint32_t *qmul)
+{
+    decode_cabac_residual_internal(h, block, cat, n, scantable, qmul, 15, 0, 0);
+}
+
+static void decode_cabac_residual_nondc_internal_16(H264Context *h, DCTELEM *block,
+                                                    int cat, int n,
+                                                    const uint8_t *scantable,
+                                                    const uint32_t *qmul)
+{
+    decode_cabac_residual_internal(h, block, cat, n, scantable, qmul, 16, 0, 0);
+}
+
+static void decode_cabac_residual_nondc_internal_64(H264Context *h, DCTELEM *block,
+                                                    int cat, int n,
+                                                    const uint8_t *scantable,
+                                                    const uint32_t *qmul)
+{
+    decode_cabac_residual_internal(h, block, cat, n, scantable, qmul, 64, 0, 0);
 }
 
 /* cat: 0-> DC 16x16  n = 0
@@ -1778,7 +1812,10 @@ static av_always_inline void decode_cabac_residual_dc( H264Context *h, DCTELEM *
         h->non_zero_count_cache[scan8[n]] = 0;
         return;
     }
-    decode_cabac_residual_dc_internal( h, block, cat, n, scantable, max_coeff );
+    if (max_coeff == 4)
+        decode_cabac_residual_dc_internal_4(h, block, cat, n, scantable);
+    else
+        decode_cabac_residual_dc_internal_16(h, block, cat, n, scantable);
 }
 
 static av_always_inline void
@@ -1804,7 +1841,12 @@ static av_always_inline void decode_cabac_residual_nondc( H264Context *h, DCTELE
         }
         return;
     }
-    decode_cabac_residual_nondc_internal( h, block, cat, n, scantable, qmul, max_coeff );
+    if (max_coeff == 15)
+        decode_cabac_residual_nondc_internal_15(h, block, cat, n, scantable, qmul);
+    else if (max_coeff == 16)
+        decode_cabac_residual_nondc_internal_16(h, block, cat, n, scantable, qmul);
+    else
+        decode_cabac_residual_nondc_internal_64(h, block, cat, n, scantable, qmul);
 }
 
 static av_always_inline void decode_cabac_luma_residual( H264Context *h, const uint8_t *scan, const uint8_t *scan8x8, int pixel_shift, int mb_type, int cbp, int p )
@@ -157,7 +157,7 @@ static av_noinline void FUNC(hl_decode_mb)(H264Context *h)
         }
     } else {
         if (IS_INTRA(mb_type)) {
-            if (h->deblocking_filter)
+            if (h->deblocking_filter && !h->wavefront)
                 xchg_mb_border(h, dest_y, dest_cb, dest_cr, linesize,
                                uvlinesize, 1, 0, SIMPLE, PIXEL_SHIFT);
 
@@ -170,7 +170,7 @@ static av_noinline void FUNC(hl_decode_mb)(H264Context *h)
                                       transform_bypass, PIXEL_SHIFT,
                                       block_offset, linesize, dest_y, 0);
 
-            if (h->deblocking_filter)
+            if (h->deblocking_filter && !h->wavefront)
                 xchg_mb_border(h, dest_y, dest_cb, dest_cr, linesize,
                                uvlinesize, 0, 0, SIMPLE, PIXEL_SHIFT);
         } else if (is_h264) {
@@ -346,7 +346,7 @@ static av_noinline void FUNC(hl_decode_mb_444)(H264Context *h)
         }
     } else {
         if (IS_INTRA(mb_type)) {
-            if (h->deblocking_filter)
+            if (h->deblocking_filter && !h->wavefront)
                 xchg_mb_border(h, dest[0], dest[1], dest[2], linesize,
                                linesize, 1, 1, SIMPLE, PIXEL_SHIFT);
 
@@ -355,7 +355,7 @@ static av_noinline void FUNC(hl_decode_mb_444)(H264Context *h)
                                           transform_bypass, PIXEL_SHIFT,
                                           block_offset, linesize, dest[p], p);
 
-            if (h->deblocking_filter)
+            if (h->deblocking_filter && !h->wavefront)
                 xchg_mb_border(h, dest[0], dest[1], dest[2], linesize,
                                linesize, 0, 1, SIMPLE, PIXEL_SHIFT);
         } else {
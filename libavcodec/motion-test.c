@@ -0,0 +1,298 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Motion estimation SAD test and benchmark.
+ *
+ * Without arguments the multi candidate SAD functions of the C and the
+ * optimized DSPContext are checked against the C SAD on random blocks, and
+ * a checksum of their scores is printed. Given a raw yuv420p sequence, a
+ * small diamond search is also run on every 16x16 block of the luma and
+ * the time per frame is reported for each way of computing the candidate
+ * costs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "avcodec.h"
+#include "dsputil.h"
+
+#undef printf
+
+#define WIDTH   64
+#define HEIGHT  64
+#define RANGE   16
+
+static const int8_t dia[4][2] = { { -1, 0 }, { 0, -1 }, { 1, 0 }, { 0, 1 } };
+
+static int check_sad_x4(const char *name, DSPContext *ref, DSPContext *opt)
+{
+    static const int heights[2][2] = { { 16, 8 }, { 8, 4 } };
+    uint8_t *src = av_malloc(WIDTH * HEIGHT);
+    uint8_t *pix = av_malloc(WIDTH * HEIGHT);
+    AVLFG prng;
+    int size, i, j, k, err = 0;
+
+    if (!src || !pix) {
+        av_free(src);
+        av_free(pix);
+        return 1;
+    }
+    av_lfg_init(&prng, 1);
+
+    for (size = 0; size < 2; size++) {
+        unsigned checksum = 0;
+        int w = 16 >> size;
+
+        for (i = 0; i < 1000; i++) {
+            int h = heights[size][i & 1];
+            uint8_t *blk  = src + (av_lfg_get(&prng) % (HEIGHT - h)) * WIDTH +
+                            (av_lfg_get(&prng) % (WIDTH / w)) * w;
+            uint8_t *cand[4];
+            int scores[4];
+
+            for (j = 0; j < WIDTH * HEIGHT; j++) {
+                src[j] = av_lfg_get(&prng);
+                pix[j] = i & 2 ? src[j] ^ (av_lfg_get(&prng) & 7)
+                               : av_lfg_get(&prng);
+            }
+            for (k = 0; k < 4; k++)
+                cand[k] = pix + (av_lfg_get(&prng) % (HEIGHT - h)) * WIDTH +
+                                 av_lfg_get(&prng) % (WIDTH - w);
+
+            opt->sad_x4[size](blk, cand, WIDTH, h, scores);
+
+            for (k = 0; k < 4; k++) {
+                int sad = ref->pix_abs[size][0](NULL, blk, cand[k], WIDTH, h);
+                if (sad != scores[k]) {
+                    printf("%s sad_x4[%d] %dx%d candidate %d: %d instead of %d\n",
+                           name, size, w, h, k, scores[k], sad);
+                    err++;
+                }
+                checksum = checksum * 31 + scores[k];
+            }
+        }
+        printf("%s sad_x4[%d]: %08x\n", name, size, checksum);
+    }
+
+    av_free(src);
+    av_free(pix);
+    return err;
+}
+
+/**
+ * Small diamond search of one 16x16 block, without any mv cost.
+ * @param x4 use sad_x4[0] instead of one call to sad[0] per candidate
+ */
+static void diamond_search(DSPContext *dsp, int x4, uint8_t *src,
+                           uint8_t *ref, int stride, int x, int y,
+                           int width, int height, int mv[2])
+{
+    int xmin = FFMAX(-RANGE, -x), xmax = FFMIN(RANGE, width  - 16 - x);
+    int ymin = FFMAX(-RANGE, -y), ymax = FFMIN(RANGE, height - 16 - y);
+    int mx   = av_clip(mv[0], xmin, xmax);
+    int my   = av_clip(mv[1], ymin, ymax);
+    int dmin = dsp->sad[0](NULL, src, ref + my * stride + mx, stride, 16);
+
+    for (;;) {
+        int bx = mx, by = my, i;
+
+        if (x4) {
+            uint8_t *cand[4];
+            int scores[4];
+
+            for (i = 0; i < 4; i++) {
+                int cx = mx + dia[i][0], cy = my + dia[i][1];
+                if (cx < xmin || cx > xmax || cy < ymin || cy > ymax) {
+                    cx = mx;
+                    cy = my;
+                }
+                cand[i] = ref + cy * stride + cx;
+            }
+            dsp->sad_x4[0](src, cand, stride, 16, scores);
+            for (i = 0; i < 4; i++) {
+                if (scores[i] < dmin) {
+                    dmin = scores[i];
+                    bx   = mx + dia[i][0];
+                    by   = my + dia[i][1];
+                }
+            }
+        } else {
+            for (i = 0; i < 4; i++) {
+                int cx = mx + dia[i][0], cy = my + dia[i][1], d;
+                if (cx < xmin || cx > xmax || cy < ymin || cy > ymax)
+                    continue;
+                d = dsp->sad[0](NULL, src, ref + cy * stride + cx, stride, 16);
+                if (d < dmin) {
+                    dmin = d;
+                    bx   = cx;
+                    by   = cy;
+                }
+            }
+        }
+        if (bx == mx && by == my)
+            break;
+        mx = bx;
+        my = by;
+    }
+    mv[0] = mx;
+    mv[1] = my;
+}
+
+/**
+ * Search all frames against their predecessor.
+ * @return the time spent searching in microseconds
+ */
+static int64_t search_sequence(DSPContext *dsp, int x4, uint8_t *luma,
+                               int width, int height, int frames, int *mvs)
+{
+    int mb_width  = width  >> 4;
+    int mb_height = height >> 4;
+    int64_t start = av_gettime();
+    int n, mb_x, mb_y;
+
+    for (n = 1; n < frames; n++) {
+        uint8_t *cur = luma + n * width * height;
+        uint8_t *ref = cur - width * height;
+        int *mv = mvs + 2 * (n - 1) * mb_width * mb_height;
+
+        for (mb_y = 0; mb_y < mb_height; mb_y++) {
+            for (mb_x = 0; mb_x < mb_width; mb_x++) {
+                int off = 16 * (mb_y * width + mb_x);
+                if (mb_x) {
+                    mv[0] = mv[-2];
+                    mv[1] = mv[-1];
+                } else {
+                    mv[0] = mv[1] = 0;
+                }
+                diamond_search(dsp, x4, cur + off, ref + off, width,
+                               16 * mb_x, 16 * mb_y, width, height, mv);
+                mv += 2;
+            }
+        }
+    }
+    return av_gettime() - start;
+}
+
+static int benchmark(DSPContext *ref, DSPContext *opt, const char *name,
+                     int width, int height, int max_frames)
+{
+    int frame_size = width * height * 3 / 2;
+    int mv_count   = 2 * (width >> 4) * (height >> 4);
+    uint8_t *luma  = NULL, *frame = NULL;
+    int *mvs[3]    = { NULL };
+    int frames     = 0, i, err = 0;
+    FILE *f;
+
+    if (width < 16 || height < 16 || width & 15) {
+        fprintf(stderr, "invalid dimensions %dx%d\n", width, height);
+        return 1;
+    }
+    f = fopen(name, "rb");
+    if (!f) {
+        perror(name);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    frames = FFMIN(ftell(f) / frame_size, max_frames);
+    fseek(f, 0, SEEK_SET);
+    if (frames >= 2) {
+        if (!(frame = av_malloc(frame_size)) ||
+            !(luma  = av_malloc(frames * width * height)))
+            goto fail;
+        for (i = 0; i < frames; i++) {
+            if (fread(frame, frame_size, 1, f) != 1)
+                break;
+            memcpy(luma + i * width * height, frame, width * height);
+        }
+        frames = i;
+    }
+    if (frames < 2) {
+        fprintf(stderr, "%s: need at least 2 frames\n", name);
+        err = 1;
+        goto end;
+    }
+    for (i = 0; i < 3; i++)
+        if (!(mvs[i] = av_malloc((frames - 1) * mv_count * sizeof(*mvs[i]))))
+            goto fail;
+
+    printf("%d frames of %dx%d\n", frames, width, height);
+    for (i = 0; i < 3; i++) {
+        static const char *const names[3] = { "C", "SIMD", "SIMD x4" };
+        DSPContext *dsp = i ? opt : ref;
+        int64_t t;
+
+        t = search_sequence(dsp, i == 2, luma, width, height, frames, mvs[i]);
+        printf("%-8s %8.3f ms/frame\n", names[i], t / 1000.0 / (frames - 1));
+        if (i && memcmp(mvs[0], mvs[i], (frames - 1) * mv_count * sizeof(*mvs[i]))) {
+            printf("%s: motion vectors differ from C\n", names[i]);
+            err++;
+        }
+    }
+
+end:
+    fclose(f);
+    av_free(frame);
+    av_free(luma);
+    for (i = 0; i < 3; i++)
+        av_free(mvs[i]);
+    return err;
+fail:
+    fprintf(stderr, "out of memory\n");
+    err = 1;
+    goto end;
+}
+
+int main(int argc, char **argv)
+{
+    AVCodecContext *avctx = avcodec_alloc_context3(NULL);
+    DSPContext ref, opt;
+    int err;
+
+    if (!avctx)
+        return 1;
+    if (argc != 1 && argc != 4 && argc != 5) {
+        printf("usage: motion-test [file.yuv width height [frames]]\n"
+               "Without arguments the SAD functions are checked against C,\n"
+               "otherwise a diamond search on a raw yuv420p file is timed too.\n");
+        av_free(avctx);
+        return 1;
+    }
+
+    av_set_cpu_flags_mask(0);
+    ff_dsputil_init(&ref, avctx);
+    av_set_cpu_flags_mask(~0);
+    ff_dsputil_init(&opt, avctx);
+
+    err  = check_sad_x4("C",    &ref, &ref);
+    err += check_sad_x4("SIMD", &ref, &opt);
+    if (!err && argc > 1)
+        err = benchmark(&ref, &opt, argv[1], atoi(argv[2]), atoi(argv[3]),
+                        argc > 4 ? atoi(argv[4]) : INT_MAX);
+
+    av_free(avctx);
+    return !!err;
+}
@@ -972,6 +972,19 @@ static inline int check_input_motion(MpegEncContext * s, int mb_x, int mb_y, int
     return d;
 }
 
+/**
+ * Set the penalty factors for the current lambda, as done for each
+ * macroblock by the P- and B-frame searches.
+ */
+void ff_set_me_penalty_factors(MpegEncContext *s)
+{
+    MotionEstContext * const c= &s->me;
+
+    c->penalty_factor    = get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_cmp);
+    c->sub_penalty_factor= get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_sub_cmp);
+    c->mb_penalty_factor = get_penalty_factor(s->lambda, s->lambda2, c->avctx->mb_cmp);
+}
+
 void ff_estimate_p_frame_motion(MpegEncContext * s,
                                 int mb_x, int mb_y)
 {
@@ -991,9 +1004,7 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
     assert(s->linesize == c->stride);
     assert(s->uvlinesize == c->uvstride);
 
-    c->penalty_factor    = get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_cmp);
-    c->sub_penalty_factor= get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_sub_cmp);
-    c->mb_penalty_factor = get_penalty_factor(s->lambda, s->lambda2, c->avctx->mb_cmp);
+    ff_set_me_penalty_factors(s);
     c->current_mv_penalty= c->mv_penalty[s->f_code] + MAX_MV;
 
     get_limits(s, 16*mb_x, 16*mb_y);
@@ -1193,6 +1204,110 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
     s->mb_type[mb_y*s->mb_stride + mb_x]= mb_type;
 }
 
+static inline int coarse_cost(MpegEncContext *s, int d, int x, int y,
+                              int pred_x, int pred_y, int penalty_factor)
+{
+    const int shift= 2 + s->quarter_sample;
+    uint8_t * const mv_penalty= s->me.current_mv_penalty;
+
+    /* a quarter of the penalty, the SAD is over a quarter of the pixels */
+    return d + (((mv_penalty[(x<<shift) - pred_x] +
+                  mv_penalty[(y<<shift) - pred_y]) * penalty_factor) >> 2);
+}
+
+/**
+ * Search the motion of a macroblock on the half resolution pictures and
+ * store it in p_mv_table, where the pre-pass takes it as a predictor.
+ * This catches motion too large for the diamond search around the
+ * predictors to reach.
+ */
+void ff_coarse_estimate_p_frame_motion(MpegEncContext *s, int mb_x, int mb_y)
+{
+    static const int8_t dia[4][2] = { { -1, 0 }, { 0, -1 }, { 1, 0 }, { 0, 1 } };
+    MotionEstContext * const c= &s->me;
+    const int shift= 2 + s->quarter_sample;
+    const int xy= mb_x + mb_y*s->mb_stride;
+    const int stride= c->coarse_stride;
+    const int offset= (ME_COARSE_EDGE + 8*mb_y)*stride + ME_COARSE_EDGE + 8*mb_x;
+    uint8_t * const src= c->coarse[0] + offset;
+    uint8_t * const ref= c->coarse[1] + offset;
+    const int penalty_factor= get_penalty_factor(s->lambda, s->lambda2, FF_CMP_SAD);
+    int cand[4][2], pred_x= 0, pred_y= 0;
+    int xmin, ymin, xmax, ymax, best[2]= { 0, 0 }, dmin= INT_MAX, i, n= 0;
+
+    c->current_mv_penalty= c->mv_penalty[s->f_code] + MAX_MV;
+    get_limits(s, 16*mb_x, 16*mb_y);
+    xmin= -(-c->xmin >> 1);
+    ymin= -(-c->ymin >> 1);
+    xmax= c->xmax >> 1;
+    ymax= c->ymax >> 1;
+
+    cand[n][0]= cand[n][1]= 0;
+    n++;
+    if(mb_x){
+        pred_x= s->p_mv_table[xy - 1][0];
+        pred_y= s->p_mv_table[xy - 1][1];
+        cand[n][0]= pred_x >> shift;
+        cand[n][1]= pred_y >> shift;
+        n++;
+    }
+    if(!s->first_slice_line){
+        cand[n][0]= s->p_mv_table[xy - s->mb_stride][0] >> shift;
+        cand[n][1]= s->p_mv_table[xy - s->mb_stride][1] >> shift;
+        n++;
+    }
+    /* the vector of the previous P-frame, not overwritten yet */
+    cand[n][0]= s->p_mv_table[xy][0] >> shift;
+    cand[n][1]= s->p_mv_table[xy][1] >> shift;
+    n++;
+
+    for(i=0; i<n; i++){
+        const int x= av_clip(cand[i][0], xmin, xmax);
+        const int y= av_clip(cand[i][1], ymin, ymax);
+        int d= s->dsp.sad[1](s, src, ref + x + y*stride, stride, 8);
+
+        d= coarse_cost(s, d, x, y, pred_x, pred_y, penalty_factor);
+        if(d < dmin){
+            dmin= d;
+            best[0]= x;
+            best[1]= y;
+        }
+    }
+
+    for(;;){
+        const int x= best[0];
+        const int y= best[1];
+        uint8_t *blk[4];
+        int scores[4], valid[4], dir= -1;
+
+        for(i=0; i<4; i++){
+            const int nx= x + dia[i][0];
+            const int ny= y + dia[i][1];
+            valid[i]= nx >= xmin && nx <= xmax && ny >= ymin && ny <= ymax;
+            blk[i]= ref + (valid[i] ? nx + ny*stride : x + y*stride);
+        }
+        s->dsp.sad_x4[1](src, blk, stride, 8, scores);
+        for(i=0; i<4; i++){
+            int d;
+            if(!valid[i])
+                continue;
+            d= coarse_cost(s, scores[i], x + dia[i][0], y + dia[i][1],
+                           pred_x, pred_y, penalty_factor);
+            if(d < dmin){
+                dmin= d;
+                dir= i;
+            }
+        }
+        if(dir < 0)
+            break;
+        best[0]= x + dia[dir][0];
+        best[1]= y + dia[dir][1];
+    }
+
+    s->p_mv_table[xy][0]= best[0] << shift;
+    s->p_mv_table[xy][1]= best[1] << shift;
+}
+
 int ff_pre_estimate_p_frame_motion(MpegEncContext * s,
                                     int mb_x, int mb_y)
 {
@@ -1258,9 +1373,7 @@ static int ff_estimate_motion_b(MpegEncContext * s,
     uint8_t * const mv_penalty= c->mv_penalty[f_code] + MAX_MV;
     int mv_scale;
 
-    c->penalty_factor    = get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_cmp);
-    c->sub_penalty_factor= get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_sub_cmp);
-    c->mb_penalty_factor = get_penalty_factor(s->lambda, s->lambda2, c->avctx->mb_cmp);
+    ff_set_me_penalty_factors(s);
     c->current_mv_penalty= mv_penalty;
 
     get_limits(s, 16*mb_x, 16*mb_y);
@@ -414,6 +414,78 @@ if( (y)>(ymax<<(S)) ) printf("%d %d %d %d %d ymax" #v, ymax, (x), (y), s->mb_x,
     const int qpel= flags&FLAG_QPEL;\
     const int shift= 1+qpel;\
 
+/**
+ * Check the 4 neighbours of x, y that are not in the map with one call to
+ * sad_x4, in the order and with the result of CHECK_MV_DIR.
+ */
+static av_always_inline int small_diamond_step_x4(MpegEncContext *s, int *best, int dmin,
+                                       int *next_dir, int src_index, int ref_index,
+                                       int const penalty_factor, int size, int h, int flags)
+{
+    static const int8_t dia[4][2] = { { -1, 0 }, { 0, -1 }, { 1, 0 }, { 0, 1 } };
+    MotionEstContext * const c= &s->me;
+    const int stride= c->stride;
+    uint8_t * const src= c->src[src_index][0];
+    uint8_t * const ref= c->ref[ref_index][0];
+    const int dir= *next_dir;
+    const int x= best[0];
+    const int y= best[1];
+    uint8_t *blk[4];
+    int scores[4];
+    int i, todo= 0;
+    LOAD_COMMON
+    LOAD_COMMON2
+    unsigned map_generation = c->map_generation;
+
+    *next_dir= -1;
+    for(i=0; i<4; i++){
+        const int nx= x + dia[i][0];
+        const int ny= y + dia[i][1];
+        const unsigned key= (ny<<ME_MAP_MV_BITS) + nx + map_generation;
+        const int index= ((ny<<ME_MAP_SHIFT) + nx)&(ME_MAP_SIZE-1);
+
+        blk[i]= NULL;
+        if(dir == (i^2) || nx<xmin || nx>xmax || ny<ymin || ny>ymax ||
+           map[index] == key)
+            continue;
+        blk[i]= ref + nx + ny*stride;
+        todo++;
+    }
+    if(!todo)
+        return dmin;
+
+    if(todo == 1){
+        for(i=0; !blk[i]; i++);
+        scores[i]= s->dsp.sad[size](s, src, blk[i], stride, h);
+    }else{
+        uint8_t *cand[4];
+        for(i=0; i<4; i++)
+            cand[i]= blk[i] ? blk[i] : ref + x + y*stride;
+        s->dsp.sad_x4[size](src, cand, stride, h, scores);
+    }
+
+    for(i=0; i<4; i++){
+        const int nx= x + dia[i][0];
+        const int ny= y + dia[i][1];
+        const int index= ((ny<<ME_MAP_SHIFT) + nx)&(ME_MAP_SIZE-1);
+        int d;
+
+        if(!blk[i])
+            continue;
+        d= scores[i];
+        map[index]= (ny<<ME_MAP_MV_BITS) + nx + map_generation;
+        score_map[index]= d;
+        d += (mv_penalty[(nx<<shift)-pred_x] + mv_penalty[(ny<<shift)-pred_y])*penalty_factor;
+        if(d<dmin){
+            best[0]= nx;
+            best[1]= ny;
+            dmin= d;
+            *next_dir= i;
+        }
+    }
+    return dmin;
+}
+
 static av_always_inline int small_diamond_search(MpegEncContext * s, int *best, int dmin,
                                        int src_index, int ref_index, int const penalty_factor,
                                        int size, int h, int flags)
@@ -421,6 +493,7 @@ static av_always_inline int small_diamond_search(MpegEncContext * s, int *best,
     MotionEstContext * const c= &s->me;
     me_cmp_func cmpf, chroma_cmpf;
     int next_dir=-1;
+    int sad_x4;
     LOAD_COMMON
     LOAD_COMMON2
     unsigned map_generation = c->map_generation;
@@ -428,6 +501,10 @@ static av_always_inline int small_diamond_search(MpegEncContext * s, int *best,
     cmpf= s->dsp.me_cmp[size];
     chroma_cmpf= s->dsp.me_cmp[size+1];
 
+    /* with a plain full pel SAD the neighbours can be tested together */
+    sad_x4= !(flags&(FLAG_CHROMA|FLAG_DIRECT)) && size < 2 &&
+            cmpf == s->dsp.sad[size];
+
     { /* ensure that the best point is in the MAP as h/qpel refinement needs it */
         const unsigned key = (best[1]<<ME_MAP_MV_BITS) + best[0] + map_generation;
         const int index= ((best[1]<<ME_MAP_SHIFT) + best[0])&(ME_MAP_SIZE-1);
@@ -437,6 +514,14 @@ static av_always_inline int small_diamond_search(MpegEncContext * s, int *best,
         }
     }
 
+    if(sad_x4){
+        do{
+            dmin= small_diamond_step_x4(s, best, dmin, &next_dir, src_index, ref_index,
+                                        penalty_factor, size, h, flags);
+        }while(next_dir!=-1);
+        return dmin;
+    }
+
     for(;;){
         int d;
         const int dir= next_dir;
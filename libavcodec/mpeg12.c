@@ -1929,6 +1929,8 @@ static int slice_end(AVCodecContext *avctx, AVFrame *pict)
             /* XXX: use another variable than picture_number */
             if (s->last_picture_ptr != NULL) {
                 *pict = s->last_picture_ptr->f;
+                pict->reorder_delay = s->coded_picture_number - 1 -
+                                      pict->coded_picture_number;
                  ff_print_debug_info(s, pict);
             }
         }
@@ -2437,6 +2439,8 @@ static int mpeg_decode_frame(AVCodecContext *avctx,
         /* special case for last picture */
         if (s2->low_delay == 0 && s2->next_picture_ptr) {
             *picture = s2->next_picture_ptr->f;
+            picture->reorder_delay = s2->coded_picture_number - 1 -
+                                     picture->coded_picture_number;
             s2->next_picture_ptr = NULL;
 
             *got_output = 1;
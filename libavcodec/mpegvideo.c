@@ -703,6 +703,7 @@ void ff_MPV_common_defaults(MpegEncContext *s)
     s->picture_range_end     = MAX_PICTURE_COUNT;
 
     s->slice_context_count   = 1;
+    s->thread_context_count  = 1;
 }
 
 /**
@@ -876,7 +877,7 @@ fail:
  */
 av_cold int ff_MPV_common_init(MpegEncContext *s)
 {
-    int i;
+    int i, nb_contexts;
     int nb_slices = (HAVE_THREADS &&
                      s->avctx->active_thread_type & FF_THREAD_SLICE) ?
                     s->avctx->thread_count : 1;
@@ -906,6 +907,14 @@ av_cold int ff_MPV_common_init(MpegEncContext *s)
         nb_slices = max_slices;
     }
 
+    /* the encoder motion estimation runs on all threads, independently
+     * of the slices */
+    nb_contexts = nb_slices;
+    if (s->encoding && HAVE_THREADS &&
+        s->avctx->active_thread_type & FF_THREAD_SLICE &&
+        s->avctx->thread_count <= MAX_THREADS)
+        nb_contexts = FFMAX(nb_slices, s->avctx->thread_count);
+
     if ((s->width || s->height) &&
         av_image_check_size(s->width, s->height, 0, s->avctx))
         return -1;
@@ -974,19 +983,24 @@ av_cold int ff_MPV_common_init(MpegEncContext *s)
     s->thread_context[0]   = s;
 
     if (s->width && s->height) {
-        if (nb_slices > 1) {
-            for (i = 1; i < nb_slices; i++) {
+        if (nb_contexts > 1) {
+            for (i = 1; i < nb_contexts; i++) {
                 s->thread_context[i] = av_malloc(sizeof(MpegEncContext));
                 memcpy(s->thread_context[i], s, sizeof(MpegEncContext));
             }
 
-            for (i = 0; i < nb_slices; i++) {
+            for (i = 0; i < nb_contexts; i++) {
                 if (init_duplicate_context(s->thread_context[i], s) < 0)
                     goto fail;
+                if (i < nb_slices) {
                     s->thread_context[i]->start_mb_y =
                         (s->mb_height * (i) + nb_slices / 2) / nb_slices;
                     s->thread_context[i]->end_mb_y   =
                         (s->mb_height * (i + 1) + nb_slices / 2) / nb_slices;
+                } else {
+                    s->thread_context[i]->start_mb_y =
+                    s->thread_context[i]->end_mb_y   = 0;
+                }
             }
         } else {
             if (init_duplicate_context(s, s) < 0)
@@ -994,7 +1008,8 @@ av_cold int ff_MPV_common_init(MpegEncContext *s)
             s->start_mb_y = 0;
             s->end_mb_y   = s->mb_height;
         }
-        s->slice_context_count = nb_slices;
+        s->slice_context_count  = nb_slices;
+        s->thread_context_count = nb_contexts;
     }
 
     return 0;
@@ -1065,11 +1080,11 @@ int ff_MPV_common_frame_size_change(MpegEncContext *s)
 {
     int i, err = 0;
 
-    if (s->slice_context_count > 1) {
-        for (i = 0; i < s->slice_context_count; i++) {
+    if (s->thread_context_count > 1) {
+        for (i = 0; i < s->thread_context_count; i++) {
             free_duplicate_context(s->thread_context[i]);
         }
-        for (i = 1; i < s->slice_context_count; i++) {
+        for (i = 1; i < s->thread_context_count; i++) {
             av_freep(&s->thread_context[i]);
         }
     } else
@@ -1102,20 +1117,26 @@ int ff_MPV_common_frame_size_change(MpegEncContext *s)
     s->thread_context[0]   = s;
 
     if (s->width && s->height) {
-        int nb_slices = s->slice_context_count;
-        if (nb_slices > 1) {
-            for (i = 1; i < nb_slices; i++) {
+        int nb_slices   = s->slice_context_count;
+        int nb_contexts = s->thread_context_count;
+        if (nb_contexts > 1) {
+            for (i = 1; i < nb_contexts; i++) {
                 s->thread_context[i] = av_malloc(sizeof(MpegEncContext));
                 memcpy(s->thread_context[i], s, sizeof(MpegEncContext));
             }
 
-            for (i = 0; i < nb_slices; i++) {
+            for (i = 0; i < nb_contexts; i++) {
                 if (init_duplicate_context(s->thread_context[i], s) < 0)
                     goto fail;
+                if (i < nb_slices) {
                     s->thread_context[i]->start_mb_y =
                         (s->mb_height * (i) + nb_slices / 2) / nb_slices;
                     s->thread_context[i]->end_mb_y   =
                         (s->mb_height * (i + 1) + nb_slices / 2) / nb_slices;
+                } else {
+                    s->thread_context[i]->start_mb_y =
+                    s->thread_context[i]->end_mb_y   = 0;
+                }
             }
         } else {
             if (init_duplicate_context(s, s) < 0)
@@ -1137,14 +1158,15 @@ void ff_MPV_common_end(MpegEncContext *s)
 {
     int i;
 
-    if (s->slice_context_count > 1) {
-        for (i = 0; i < s->slice_context_count; i++) {
+    if (s->thread_context_count > 1) {
+        for (i = 0; i < s->thread_context_count; i++) {
             free_duplicate_context(s->thread_context[i]);
         }
-        for (i = 1; i < s->slice_context_count; i++) {
+        for (i = 1; i < s->thread_context_count; i++) {
             av_freep(&s->thread_context[i]);
         }
-        s->slice_context_count = 1;
+        s->slice_context_count  = 1;
+        s->thread_context_count = 1;
     } else free_duplicate_context(s);
 
     av_freep(&s->parse_context.buffer);
@@ -149,6 +149,8 @@ typedef struct Picture{
     int needs_realloc;          ///< Picture needs to be reallocated (eg due to a frame size change)
 } Picture;
 
+#define ME_COARSE_EDGE 16
+
 /**
  * Motion estimation context.
  */
@@ -188,6 +190,8 @@ typedef struct MotionEstContext{
     uint8_t *ref[4][4];
     int stride;
     int uvstride;
+    uint8_t *coarse[2];                ///< half resolution luma of the current and the reference picture, with ME_COARSE_EDGE around
+    int coarse_stride;
     /* temp variables for picture complexity calculation */
     int mc_mb_var_sum_temp;
     int mb_var_sum_temp;
@@ -279,6 +283,10 @@ typedef struct MpegEncContext {
      * reordered pts to be used as dts for the next output frame when there's
      * a delay */
     int64_t reordered_pts;
+    /**
+     * pts of the pictures in input_picture, kept separately as the Picture
+     * of a shared input may be reused before it leaves the delay line */
+    int64_t input_pts[MAX_PICTURE_COUNT];
 
     /** bit output */
     PutBitContext pb;
@@ -287,6 +295,11 @@ typedef struct MpegEncContext {
     int end_mb_y;              ///< end   mb_y of this thread (so current thread should process start_mb_y <= row < end_mb_y)
     struct MpegEncContext *thread_context[MAX_THREADS];
     int slice_context_count;   ///< number of used thread_contexts
+    /**
+     * number of allocated thread_contexts, the encoder has one per thread
+     * for the motion estimation even if there are fewer slices */
+    int thread_context_count;
+    struct MpegRowProgress *me_progress; ///< motion estimation row progress
 
     /**
      * copy of the previous picture structure.
@@ -715,6 +728,9 @@ typedef struct MpegEncContext {
     /* flag to indicate a reinitialization is required, e.g. after
      * a frame size change */
     int context_reinit;
+
+    int lookahead;      ///< number of pictures analysed ahead by the lookahead thread
+    struct MpegLookahead *lookahead_ctx;
 } MpegEncContext;
 
 #define REBASE_PICTURE(pic, new_ctx, old_ctx) (pic ? \
@@ -727,6 +743,7 @@ typedef struct MpegEncContext {
 #define FF_MPV_FLAG_STRICT_GOP   0x0002
 #define FF_MPV_FLAG_QP_RD        0x0004
 #define FF_MPV_FLAG_CBP_RD       0x0008
+#define FF_MPV_FLAG_COARSE_ME    0x0010
 
 #define FF_MPV_OFFSET(x) offsetof(MpegEncContext, x)
 #define FF_MPV_OPT_FLAGS (AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_ENCODING_PARAM)
@@ -736,11 +753,13 @@ typedef struct MpegEncContext {
 { "strict_gop",     "Strictly enforce gop size",             0, AV_OPT_TYPE_CONST, { .i64 = FF_MPV_FLAG_STRICT_GOP }, 0, 0, FF_MPV_OPT_FLAGS, "mpv_flags" },\
 { "qp_rd",          "Use rate distortion optimization for qp selection", 0, AV_OPT_TYPE_CONST, { .i64 = FF_MPV_FLAG_QP_RD },  0, 0, FF_MPV_OPT_FLAGS, "mpv_flags" },\
 { "cbp_rd",         "use rate distortion optimization for CBP",          0, AV_OPT_TYPE_CONST, { .i64 = FF_MPV_FLAG_CBP_RD }, 0, 0, FF_MPV_OPT_FLAGS, "mpv_flags" },\
+{ "coarse_me",      "Search the motion on half resolution pictures before the pre-pass", 0, AV_OPT_TYPE_CONST, { .i64 = FF_MPV_FLAG_COARSE_ME }, 0, 0, FF_MPV_OPT_FLAGS, "mpv_flags" },\
 { "luma_elim_threshold",   "single coefficient elimination threshold for luminance (negative values also consider dc coefficient)",\
                                                                       FF_MPV_OFFSET(luma_elim_threshold), AV_OPT_TYPE_INT, { .i64 = 0 }, INT_MIN, INT_MAX, FF_MPV_OPT_FLAGS },\
 { "chroma_elim_threshold", "single coefficient elimination threshold for chrominance (negative values also consider dc coefficient)",\
                                                                       FF_MPV_OFFSET(chroma_elim_threshold), AV_OPT_TYPE_INT, { .i64 = 0 }, INT_MIN, INT_MAX, FF_MPV_OPT_FLAGS },\
-{ "quantizer_noise_shaping", NULL,                                  FF_MPV_OFFSET(quantizer_noise_shaping), AV_OPT_TYPE_INT, { .i64 = 0 },       0, INT_MAX, FF_MPV_OPT_FLAGS },
+{ "quantizer_noise_shaping", NULL,                                  FF_MPV_OFFSET(quantizer_noise_shaping), AV_OPT_TYPE_INT, { .i64 = 0 },       0, INT_MAX, FF_MPV_OPT_FLAGS },\
+{ "lookahead",      "Number of pictures analysed ahead in a separate thread, for the B-frame and scene cut decisions and the rate control", FF_MPV_OFFSET(lookahead), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, FF_MAX_B_FRAMES, FF_MPV_OPT_FLAGS },
 
 extern const AVOption ff_mpv_generic_options[];
 
@@ -772,6 +791,48 @@ int ff_MPV_encode_end(AVCodecContext *avctx);
 int ff_MPV_encode_picture(AVCodecContext *avctx, AVPacket *pkt,
                           const AVFrame *frame, int *got_packet);
 void ff_MPV_encode_init_x86(MpegEncContext *s);
+
+typedef struct MpegLookahead MpegLookahead;
+
+int ff_mpv_lookahead_init(MpegEncContext *s);
+void ff_mpv_lookahead_end(MpegEncContext *s);
+
+/**
+ * Queue the analysis of a new input picture, blocking only while the job
+ * queue is full.
+ * @param luma the luma plane, which must not change until it is analysed
+ */
+void ff_mpv_lookahead_add(MpegEncContext *s, Picture *pic, const uint8_t *luma);
+
+/**
+ * Wait for the analysis of the given picture and all the ones before it,
+ * after which their results can be read and the pictures modified.
+ */
+void ff_mpv_lookahead_wait(MpegEncContext *s, int number);
+
+/**
+ * @return 1 if the analysed picture starts a new scene
+ */
+int ff_mpv_lookahead_scenecut(MpegEncContext *s, int number);
+
+/**
+ * Get the estimated complexity of the analysed pictures, in display order.
+ * @return the number of pictures written to cost
+ */
+int ff_mpv_lookahead_costs(MpegEncContext *s, int number, int *cost, int max);
+
+/**
+ * Get the best number of B-frames for the pictures following the last
+ * reference.
+ * @return the number of B-frames, or -1 if it could not be estimated
+ */
+int ff_mpv_lookahead_b_frames(MpegEncContext *s, int first, int count);
+
+/**
+ * Set the next reference picture and start the B-frame decision for the
+ * group following it as soon as its pictures are queued.
+ */
+void ff_mpv_lookahead_set_ref(MpegEncContext *s, int ref);
 void ff_MPV_common_init_x86(MpegEncContext *s);
 void ff_MPV_common_init_axp(MpegEncContext *s);
 void ff_MPV_common_init_arm(MpegEncContext *s);
@@ -861,6 +922,8 @@ void ff_fix_long_p_mvs(MpegEncContext * s);
 void ff_fix_long_mvs(MpegEncContext * s, uint8_t *field_select_table, int field_select,
                      int16_t (*mv_table)[2], int f_code, int type, int truncate);
 int ff_init_me(MpegEncContext *s);
+void ff_set_me_penalty_factors(MpegEncContext *s);
+void ff_coarse_estimate_p_frame_motion(MpegEncContext *s, int mb_x, int mb_y);
 int ff_pre_estimate_p_frame_motion(MpegEncContext * s, int mb_x, int mb_y);
 int ff_epzs_motion_search(MpegEncContext * s, int *mx_ptr, int *my_ptr,
                              int P[10][2], int src_index, int ref_index, int16_t (*last_mv)[2],
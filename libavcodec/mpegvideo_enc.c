@@ -47,9 +47,36 @@
 #include "bytestream.h"
 #include <limits.h>
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "w32pthreads.h"
+#endif
+
 //#undef NDEBUG
 //#include <assert.h>
 
+/**
+ * Motion estimation progress of each macroblock row. The rows of a slice
+ * are searched in parallel as a wavefront, each one staying far enough
+ * behind the row it takes its predictors from, so the result is the same
+ * as with a single thread.
+ */
+typedef struct MpegRowProgress {
+#if HAVE_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+#endif
+    int *done;                      ///< macroblocks done in each row
+    int *wait;                      ///< macroblocks awaited in each row
+    int slice_start[MAX_THREADS];
+    int slice_end[MAX_THREADS];
+    int lag;                        ///< distance kept to the previous row
+    int penalty_factor[3];          ///< penalty factors before the pass
+} MpegRowProgress;
+
+static int me_progress_init(MpegEncContext *s);
+static void me_progress_end(MpegEncContext *s);
 static int encode_picture(MpegEncContext *s, int picture_number);
 static int dct_quantize_refine(MpegEncContext *s, DCTELEM *block, int16_t *weight, DCTELEM *orig, int n, int qscale);
 static int sse_mb(MpegEncContext *s);
@@ -578,6 +605,19 @@ av_cold int ff_MPV_encode_init(AVCodecContext *avctx)
         avctx->b_frame_strategy = 0;
     }
 
+    if (s->lookahead) {
+        if (!HAVE_PTHREADS) {
+            av_log(avctx, AV_LOG_WARNING,
+                   "lookahead needs thread support, disabling it\n");
+            s->lookahead = 0;
+        } else if (s->max_b_frames + s->lookahead > FF_MAX_B_FRAMES) {
+            av_log(avctx, AV_LOG_ERROR,
+                   "lookahead too large, at most %d pictures with %d b frames\n",
+                   FF_MAX_B_FRAMES - s->max_b_frames, s->max_b_frames);
+            return -1;
+        }
+    }
+
     i = av_gcd(avctx->time_base.den, avctx->time_base.num);
     if (i > 1) {
         av_log(avctx, AV_LOG_INFO, "removing common factors from framerate\n");
@@ -774,6 +814,7 @@ av_cold int ff_MPV_encode_init(AVCodecContext *avctx)
     }
 
     avctx->has_b_frames = !s->low_delay;
+    avctx->delay       += s->lookahead;
 
     s->encoding = 1;
 
@@ -786,6 +827,20 @@ av_cold int ff_MPV_encode_init(AVCodecContext *avctx)
     if (ff_MPV_common_init(s) < 0)
         return -1;
 
+    if (me_progress_init(s) < 0)
+        return AVERROR(ENOMEM);
+
+    if (s->mpv_flags & FF_MPV_FLAG_COARSE_ME) {
+        int size;
+
+        s->me.coarse_stride = FFALIGN(8 * s->mb_width + 2 * ME_COARSE_EDGE, 16);
+        size = s->me.coarse_stride * (8 * s->mb_height + 2 * ME_COARSE_EDGE);
+        s->me.coarse[0] = av_malloc(size);
+        s->me.coarse[1] = av_malloc(size);
+        if (!s->me.coarse[0] || !s->me.coarse[1])
+            return AVERROR(ENOMEM);
+    }
+
     if (ARCH_X86)
         ff_MPV_encode_init_x86(s);
 
@@ -850,6 +905,9 @@ av_cold int ff_MPV_encode_init(AVCodecContext *avctx)
     if (ff_rate_control_init(s) < 0)
         return -1;
 
+    if (s->lookahead && ff_mpv_lookahead_init(s) < 0)
+        return -1;
+
     return 0;
 }
 
@@ -857,7 +915,11 @@ av_cold int ff_MPV_encode_end(AVCodecContext *avctx)
 {
     MpegEncContext *s = avctx->priv_data;
 
+    ff_mpv_lookahead_end(s);
     ff_rate_control_uninit(s);
+    me_progress_end(s);
+    av_freep(&s->me.coarse[0]);
+    av_freep(&s->me.coarse[1]);
 
     ff_MPV_common_end(s);
     if ((CONFIG_MJPEG_ENCODER || CONFIG_LJPEG_ENCODER) &&
@@ -912,9 +974,11 @@ static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg)
     AVFrame *pic = NULL;
     int64_t pts;
     int i;
-    const int encoding_delay = s->max_b_frames ? s->max_b_frames :
-                                                 (s->low_delay ? 0 : 1);
+    const int encoding_delay = (s->max_b_frames ? s->max_b_frames :
+                                                  (s->low_delay ? 0 : 1)) +
+                               s->lookahead;
     int direct = 1;
+    int offset = 0;
 
     if (pic_arg) {
         pts = pic_arg->pts;
@@ -993,11 +1057,14 @@ static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg)
             pic->data[1] + INPLACE_OFFSET == pic_arg->data[1] &&
             pic->data[2] + INPLACE_OFFSET == pic_arg->data[2]) {
             // empty
+            offset = INPLACE_OFFSET;
         } else {
             int h_chroma_shift, v_chroma_shift;
             av_pix_fmt_get_chroma_sub_sample(s->avctx->pix_fmt,
                                              &h_chroma_shift,
                                              &v_chroma_shift);
+            if (!s->avctx->rc_buffer_size)
+                offset = INPLACE_OFFSET;
 
             for (i = 0; i < 3; i++) {
                 int src_stride = pic_arg->linesize[i];
@@ -1009,8 +1076,7 @@ static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg)
                 uint8_t *src = pic_arg->data[i];
                 uint8_t *dst = pic->data[i];
 
-                if (!s->avctx->rc_buffer_size)
-                    dst += INPLACE_OFFSET;
+                dst += offset;
 
                 if (src_stride == dst_stride)
                     memcpy(dst, src, src_stride * h);
@@ -1028,11 +1094,17 @@ static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg)
     pic->pts = pts; // we set this here to avoid modifiying pic_arg
   }
 
+    if (s->lookahead_ctx && pic)
+        ff_mpv_lookahead_add(s, (Picture *) pic, pic->data[0] + offset);
+
     /* shift buffer entries */
-    for (i = 1; i < MAX_PICTURE_COUNT /*s->encoding_delay + 1*/; i++)
+    for (i = 1; i < MAX_PICTURE_COUNT /*s->encoding_delay + 1*/; i++) {
         s->input_picture[i - 1] = s->input_picture[i];
+        s->input_pts[i - 1]     = s->input_pts[i];
+    }
 
     s->input_picture[encoding_delay] = (Picture*) pic;
+    s->input_pts[encoding_delay]     = pic ? pic->pts : AV_NOPTS_VALUE;
 
     return 0;
 }
@@ -1223,12 +1295,20 @@ static int select_input_picture(MpegEncContext *s)
 
     /* set next picture type & ordering */
     if (s->reordered_input_picture[0] == NULL && s->input_picture[0]) {
+        if (s->lookahead_ctx) {
+            /* the pictures which can be coded next must be analysed */
+            for (i = s->max_b_frames; !s->input_picture[i]; i--)
+                ;
+            ff_mpv_lookahead_wait(s, s->input_picture[i]->f.display_picture_number);
+        }
         if (/*s->picture_in_gop_number >= s->gop_size ||*/
             s->next_picture_ptr == NULL || s->intra_only) {
             s->reordered_input_picture[0] = s->input_picture[0];
             s->reordered_input_picture[0]->f.pict_type = AV_PICTURE_TYPE_I;
             s->reordered_input_picture[0]->f.coded_picture_number =
                 s->coded_picture_number++;
+            if (s->lookahead_ctx)
+                ff_mpv_lookahead_set_ref(s, s->input_picture[0]->f.display_picture_number);
         } else {
             int b_frames;
 
@@ -1269,6 +1349,16 @@ static int select_input_picture(MpegEncContext *s)
                     s->input_picture[i]->f.pict_type =
                         s->rc_context.entry[pict_num].new_pict_type;
                 }
+            } else if (s->lookahead_ctx) {
+                for (i = 0; i < s->max_b_frames + 1; i++) {
+                    Picture *pic = s->input_picture[i];
+
+                    if (!pic)
+                        break;
+                    if (!pic->f.pict_type &&
+                        ff_mpv_lookahead_scenecut(s, pic->f.display_picture_number))
+                        pic->f.pict_type = AV_PICTURE_TYPE_I;
+                }
             }
 
             if (s->avctx->b_frame_strategy == 0) {
@@ -1300,7 +1390,16 @@ static int select_input_picture(MpegEncContext *s)
                     s->input_picture[i]->b_frame_score = 0;
                 }
             } else if (s->avctx->b_frame_strategy == 2) {
-                b_frames = estimate_best_b_count(s);
+                b_frames = -1;
+                if (s->lookahead_ctx) {
+                    for (i = 0; i < s->max_b_frames + 1; i++)
+                        if (!s->input_picture[i])
+                            break;
+                    b_frames = ff_mpv_lookahead_b_frames(s,
+                                   s->input_picture[0]->f.display_picture_number, i);
+                }
+                if (b_frames < 0)
+                    b_frames = estimate_best_b_count(s);
             } else {
                 av_log(s->avctx, AV_LOG_ERROR, "illegal b frame strategy\n");
                 b_frames = 0;
@@ -1339,6 +1438,8 @@ static int select_input_picture(MpegEncContext *s)
                 s->reordered_input_picture[0]->f.pict_type = AV_PICTURE_TYPE_P;
             s->reordered_input_picture[0]->f.coded_picture_number =
                 s->coded_picture_number++;
+            if (s->lookahead_ctx)
+                ff_mpv_lookahead_set_ref(s, s->reordered_input_picture[0]->f.display_picture_number);
             for (i = 0; i < b_frames; i++) {
                 s->reordered_input_picture[i + 1] = s->input_picture[i];
                 s->reordered_input_picture[i + 1]->f.pict_type =
@@ -1592,7 +1693,7 @@ vbv_retry:
                 pkt->dts = pkt->pts - s->dts_delta;
             else
                 pkt->dts = s->reordered_pts;
-            s->reordered_pts = s->input_picture[0]->f.pts;
+            s->reordered_pts = s->input_pts[0];
         } else
             pkt->dts = pkt->pts;
         if (s->current_picture.f.key_frame)
@@ -2255,76 +2356,281 @@ static int sse_mb(MpegEncContext *s){
                +sse(s, s->new_picture.f.data[2] + s->mb_x*8  + s->mb_y*s->uvlinesize*8,s->dest[2], w>>1, h>>1, s->uvlinesize);
 }
 
-static int pre_estimate_motion_thread(AVCodecContext *c, void *arg){
-    MpegEncContext *s= *(void**)arg;
+static av_cold int me_progress_init(MpegEncContext *s)
+{
+#if HAVE_THREADS
+    MpegRowProgress *p;
+    int i;
 
+    if (!(s->avctx->active_thread_type & FF_THREAD_SLICE) ||
+        s->avctx->thread_count <= 1 ||
+        s->avctx->thread_count > s->thread_context_count ||
+        s->avctx->me_threshold)
+        return 0;
+
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return AVERROR(ENOMEM);
+    s->me_progress = p;
+    p->done = av_malloc(s->mb_height * sizeof(*p->done));
+    p->wait = av_malloc(s->mb_height * sizeof(*p->wait));
+    if (!p->done || !p->wait)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < s->slice_context_count; i++) {
+        p->slice_start[i] = s->thread_context[i]->start_mb_y;
+        p->slice_end[i]   = s->thread_context[i]->end_mb_y;
+    }
+    /* the last frame predictors reach last_predictor_count + 1 MBs ahead */
+    p->lag = s->avctx->last_predictor_count + 1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+#endif
+    return 0;
+}
 
-    s->me.pre_pass=1;
-    s->me.dia_size= s->avctx->pre_dia_size;
-    s->first_slice_line=1;
-    for(s->mb_y= s->end_mb_y-1; s->mb_y >= s->start_mb_y; s->mb_y--) {
-        for(s->mb_x=s->mb_width-1; s->mb_x >=0 ;s->mb_x--) {
-            ff_pre_estimate_p_frame_motion(s, s->mb_x, s->mb_y);
-        }
-        s->first_slice_line=0;
+static av_cold void me_progress_end(MpegEncContext *s)
+{
+    MpegRowProgress *p = s->me_progress;
+
+    if (!p)
+        return;
+#if HAVE_THREADS
+    if (p->done && p->wait) {
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->cond);
     }
+#endif
+    av_freep(&p->done);
+    av_freep(&p->wait);
+    av_freep(&s->me_progress);
+}
 
-    s->me.pre_pass=0;
+static void me_report_row(MpegEncContext *s, int mb_y, int n)
+{
+#if HAVE_THREADS
+    MpegRowProgress *p = s->me_progress;
 
-    return 0;
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->done[mb_y] = n;
+    if (p->wait[mb_y] && n >= p->wait[mb_y])
+        pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+#endif
 }
 
-static int estimate_motion_thread(AVCodecContext *c, void *arg){
-    MpegEncContext *s= *(void**)arg;
+/**
+ * Wait until the macroblock row mb_y is done up to n macroblocks past
+ * the current one, counted in the order the row is searched in.
+ */
+static void me_await_row(MpegEncContext *s, int mb_y, int n)
+{
+#if HAVE_THREADS
+    MpegRowProgress *p = s->me_progress;
 
-    ff_check_alignment();
+    if (!p)
+        return;
+    n = FFMIN(n + p->lag, s->mb_width);
+    pthread_mutex_lock(&p->lock);
+    if (p->done[mb_y] < n) {
+        p->wait[mb_y] = n;
+        while (p->done[mb_y] < n)
+            pthread_cond_wait(&p->cond, &p->lock);
+        p->wait[mb_y] = 0;
+    }
+    pthread_mutex_unlock(&p->lock);
+#endif
+}
 
-    s->me.dia_size= s->avctx->dia_size;
-    s->first_slice_line=1;
-    for(s->mb_y= s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
-        s->mb_x=0; //for block init below
-        ff_init_block_index(s);
-        for(s->mb_x=0; s->mb_x < s->mb_width; s->mb_x++) {
-            s->block_index[0]+=2;
-            s->block_index[1]+=2;
-            s->block_index[2]+=2;
-            s->block_index[3]+=2;
-
-            /* compute motion vector & mb_type and store in context */
-            if(s->pict_type==AV_PICTURE_TYPE_B)
-                ff_estimate_b_frame_motion(s, s->mb_x, s->mb_y);
-            else
-                ff_estimate_p_frame_motion(s, s->mb_x, s->mb_y);
-        }
-        s->first_slice_line=0;
+/**
+ * Downscale the luma of the current and the reference picture for the
+ * coarse pass.
+ */
+static void coarse_me_init_picture(MpegEncContext *s)
+{
+    MotionEstContext *c = &s->me;
+    const int stride    = c->coarse_stride;
+    const int offset    = ME_COARSE_EDGE * stride + ME_COARSE_EDGE;
+    const int w         = 8 * s->mb_width;
+    const int h         = 8 * s->mb_height;
+
+    s->dsp.shrink[1](c->coarse[0] + offset, stride,
+                     s->new_picture.f.data[0], s->linesize, w, h);
+    s->dsp.shrink[1](c->coarse[1] + offset, stride,
+                     s->last_picture.f.data[0], s->linesize, w, h);
+    s->dsp.draw_edges(c->coarse[1] + offset, stride, w, h,
+                      ME_COARSE_EDGE, ME_COARSE_EDGE, EDGE_TOP | EDGE_BOTTOM);
+}
+
+static void coarse_estimate_motion_row(MpegEncContext *s, int mb_y)
+{
+    for (s->mb_x = 0; s->mb_x < s->mb_width; s->mb_x++) {
+        if (!s->first_slice_line)
+            me_await_row(s, mb_y - 1, s->mb_x + 1);
+        ff_coarse_estimate_p_frame_motion(s, s->mb_x, mb_y);
+        me_report_row(s, mb_y, s->mb_x + 1);
     }
-    return 0;
 }
 
-static int mb_var_thread(AVCodecContext *c, void *arg){
-    MpegEncContext *s= *(void**)arg;
-    int mb_x, mb_y;
+static void pre_estimate_motion_row(MpegEncContext *s, int mb_y)
+{
+    s->me.pre_pass = 1;
+    s->me.dia_size = s->avctx->pre_dia_size;
+    for (s->mb_x = s->mb_width - 1; s->mb_x >= 0; s->mb_x--) {
+        if (!s->first_slice_line)
+            me_await_row(s, mb_y + 1, s->mb_width - s->mb_x);
+        ff_pre_estimate_p_frame_motion(s, s->mb_x, mb_y);
+        me_report_row(s, mb_y, s->mb_width - s->mb_x);
+    }
+    s->me.pre_pass = 0;
+}
 
-    ff_check_alignment();
+/**
+ * The B-frame search takes its penalty factors from the previous macroblock
+ * it searched in the slice, and before the first one from the previous
+ * picture. Give each row the factors it would get with one thread per slice.
+ */
+static void b_frame_row_penalty(MpegEncContext *s, int mb_y)
+{
+    MpegRowProgress *p = s->me_progress;
+    MotionEstContext *c = &s->me;
+    int mb_x, y, searched = 0;
 
-    for(mb_y=s->start_mb_y; mb_y < s->end_mb_y; mb_y++) {
-        for(mb_x=0; mb_x < s->mb_width; mb_x++) {
-            int xx = mb_x * 16;
-            int yy = mb_y * 16;
-            uint8_t *pix = s->new_picture.f.data[0] + (yy * s->linesize) + xx;
-            int varc;
-            int sum = s->dsp.pix_sum(pix, s->linesize);
+    for (y = s->start_mb_y; y < mb_y && !searched; y++)
+        for (mb_x = 0; mb_x < s->mb_width && !searched; mb_x++)
+            searched = s->codec_id != AV_CODEC_ID_MPEG4 ||
+                       !s->next_picture.f.mbskip_table[y * s->mb_stride + mb_x];
+
+    if (searched) {
+        ff_set_me_penalty_factors(s);
+    } else {
+        c->penalty_factor     = p->penalty_factor[0];
+        c->sub_penalty_factor = p->penalty_factor[1];
+        c->mb_penalty_factor  = p->penalty_factor[2];
+    }
+}
+
+static void estimate_motion_row(MpegEncContext *s, int mb_y)
+{
+    if (s->me_progress && s->pict_type == AV_PICTURE_TYPE_B)
+        b_frame_row_penalty(s, mb_y);
+
+    s->me.dia_size = s->avctx->dia_size;
+    s->mb_x = 0; //for block init below
+    ff_init_block_index(s);
+    for (s->mb_x = 0; s->mb_x < s->mb_width; s->mb_x++) {
+        s->block_index[0] += 2;
+        s->block_index[1] += 2;
+        s->block_index[2] += 2;
+        s->block_index[3] += 2;
+
+        if (!s->first_slice_line)
+            me_await_row(s, mb_y - 1, s->mb_x + 1);
+        /* compute motion vector & mb_type and store in context */
+        if (s->pict_type == AV_PICTURE_TYPE_B)
+            ff_estimate_b_frame_motion(s, s->mb_x, s->mb_y);
+        else
+            ff_estimate_p_frame_motion(s, s->mb_x, s->mb_y);
+        me_report_row(s, mb_y, s->mb_x + 1);
+    }
+}
+
+static void mb_var_row(MpegEncContext *s, int mb_y)
+{
+    int mb_x;
+
+    for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
+        int xx = mb_x * 16;
+        int yy = mb_y * 16;
+        uint8_t *pix = s->new_picture.f.data[0] + (yy * s->linesize) + xx;
+        int varc;
+        int sum = s->dsp.pix_sum(pix, s->linesize);
+
+        varc = (s->dsp.pix_norm1(pix, s->linesize) - (((unsigned)sum*sum)>>8) + 500 + 128)>>8;
 
-            varc = (s->dsp.pix_norm1(pix, s->linesize) - (((unsigned)sum*sum)>>8) + 500 + 128)>>8;
+        s->current_picture.mb_var [s->mb_stride * mb_y + mb_x] = varc;
+        s->current_picture.mb_mean[s->mb_stride * mb_y + mb_x] = (sum+128)>>8;
+        s->me.mb_var_sum_temp    += varc;
+    }
+}
+
+typedef struct MEPass {
+    MpegEncContext *s;
+    void (*row)(MpegEncContext *s, int mb_y);
+    int bottom_up;
+} MEPass;
+
+/**
+ * With row progress tracking a job is one row, run on the context of the
+ * thread that picked it; otherwise it is one slice on its own context.
+ */
+static int me_pass_thread(AVCodecContext *c, void *arg, int jobnr, int threadnr)
+{
+    const MEPass *pass = arg;
+    MpegEncContext *s  = pass->s;
+    MpegRowProgress *p = s->me_progress;
 
-            s->current_picture.mb_var [s->mb_stride * mb_y + mb_x] = varc;
-            s->current_picture.mb_mean[s->mb_stride * mb_y + mb_x] = (sum+128)>>8;
-            s->me.mb_var_sum_temp    += varc;
+    ff_check_alignment();
+
+    if (p) {
+        MpegEncContext *t = s->thread_context[threadnr];
+        int start_mb_y    = t->start_mb_y;
+        int end_mb_y      = t->end_mb_y;
+        int i, mb_y;
+
+        for (i = 0; jobnr >= p->slice_end[i]; i++)
+            ;
+        t->start_mb_y = p->slice_start[i];
+        t->end_mb_y   = p->slice_end[i];
+        if (pass->bottom_up) {
+            mb_y = t->start_mb_y + t->end_mb_y - 1 - jobnr;
+            t->first_slice_line = mb_y == t->end_mb_y - 1;
+        } else {
+            mb_y = jobnr;
+            t->first_slice_line = mb_y == t->start_mb_y;
+        }
+        t->mb_y = mb_y;
+        pass->row(t, mb_y);
+        t->start_mb_y = start_mb_y;
+        t->end_mb_y   = end_mb_y;
+    } else {
+        MpegEncContext *t = s->thread_context[jobnr];
+
+        t->first_slice_line = 1;
+        if (pass->bottom_up) {
+            for (t->mb_y = t->end_mb_y - 1; t->mb_y >= t->start_mb_y; t->mb_y--) {
+                pass->row(t, t->mb_y);
+                t->first_slice_line = 0;
+            }
+        } else {
+            for (t->mb_y = t->start_mb_y; t->mb_y < t->end_mb_y; t->mb_y++) {
+                pass->row(t, t->mb_y);
+                t->first_slice_line = 0;
+            }
         }
     }
     return 0;
 }
 
+static void me_pass(MpegEncContext *s, void (*row)(MpegEncContext *s, int mb_y),
+                    int bottom_up)
+{
+    MEPass pass = { s, row, bottom_up };
+    MpegRowProgress *p = s->me_progress;
+
+    if (p) {
+        memset(p->done, 0, s->mb_height * sizeof(*p->done));
+        memset(p->wait, 0, s->mb_height * sizeof(*p->wait));
+        p->penalty_factor[0] = s->me.penalty_factor;
+        p->penalty_factor[1] = s->me.sub_penalty_factor;
+        p->penalty_factor[2] = s->me.mb_penalty_factor;
+        s->avctx->execute2(s->avctx, me_pass_thread, &pass, NULL, s->mb_height);
+    } else
+        s->avctx->execute2(s->avctx, me_pass_thread, &pass, NULL,
+                           s->slice_context_count);
+}
+
 static void write_slice_end(MpegEncContext *s){
     if(CONFIG_MPEG4_ENCODER && s->codec_id==AV_CODEC_ID_MPEG4){
         if(s->partitioned_frame){
@@ -3149,26 +3455,39 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     }
 
     s->mb_intra=0; //for the rate distortion & bit compare functions
-    for(i=1; i<context_count; i++){
+    if(ff_init_me(s)<0)
+        return -1;
+    if(s->pict_type != AV_PICTURE_TYPE_I){
+        s->lambda = (s->lambda * s->avctx->me_penalty_compensation + 128)>>8;
+        s->lambda2= (s->lambda2* (int64_t)s->avctx->me_penalty_compensation + 128)>>8;
+    }
+    for(i=1; i<s->thread_context_count; i++){
         ret = ff_update_duplicate_context(s->thread_context[i], s);
         if (ret < 0)
             return ret;
     }
 
-    if(ff_init_me(s)<0)
-        return -1;
-
     /* Estimate motion for every MB */
     if(s->pict_type != AV_PICTURE_TYPE_I){
-        s->lambda = (s->lambda * s->avctx->me_penalty_compensation + 128)>>8;
-        s->lambda2= (s->lambda2* (int64_t)s->avctx->me_penalty_compensation + 128)>>8;
         if(s->pict_type != AV_PICTURE_TYPE_B && s->avctx->me_threshold==0){
-            if((s->avctx->pre_me && s->last_non_b_pict_type==AV_PICTURE_TYPE_I) || s->avctx->pre_me==2){
-                s->avctx->execute(s->avctx, pre_estimate_motion_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
+            int coarse = s->mpv_flags & FF_MPV_FLAG_COARSE_ME;
+            if (coarse) {
+                coarse_me_init_picture(s);
+                me_pass(s, coarse_estimate_motion_row, 0);
+            }
+            if((s->avctx->pre_me && s->last_non_b_pict_type==AV_PICTURE_TYPE_I) || s->avctx->pre_me==2 || coarse){
+                me_pass(s, pre_estimate_motion_row, 1);
             }
         }
 
-        s->avctx->execute(s->avctx, estimate_motion_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
+        me_pass(s, estimate_motion_row, 0);
+        /* leave the penalty factors of the first slice for the next picture */
+        if (s->me_progress) {
+            if (s->pict_type == AV_PICTURE_TYPE_B)
+                b_frame_row_penalty(s, s->end_mb_y);
+            else
+                ff_set_me_penalty_factors(s);
+        }
     }else /* if(s->pict_type == AV_PICTURE_TYPE_I) */{
         /* I-Frame */
         for(i=0; i<s->mb_stride*s->mb_height; i++)
@@ -3176,10 +3495,10 @@ static int encode_picture(MpegEncContext *s, int picture_number)
 
         if(!s->fixed_qscale){
             /* finding spatial complexity for I-frame rate control */
-            s->avctx->execute(s->avctx, mb_var_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
+            me_pass(s, mb_var_row, 0);
         }
     }
-    for(i=1; i<context_count; i++){
+    for(i=1; i<s->thread_context_count; i++){
         merge_context_after_me(s, s->thread_context[i]);
     }
     s->current_picture.mc_mb_var_sum= s->current_picture_ptr->mc_mb_var_sum= s->me.mc_mb_var_sum_temp;
@@ -0,0 +1,689 @@
+/*
+ * Lookahead for the mpegvideo encoders
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Lookahead for the mpegvideo encoders.
+ *
+ * A separate thread analyses the input pictures as they are queued, ahead
+ * of the encoder. Each picture is downscaled by 2 and cut into 8x8 blocks,
+ * one per macroblock, whose intra cost (sum of absolute differences from
+ * their mean) and inter cost (SAD after a small diamond search) give a
+ * complexity estimate and the scene cuts. The same costs are used to pick
+ * the number of B-frames between two references, replacing the trial
+ * encodes of b_frame_strategy 2.
+ *
+ * Queueing a picture only blocks when the job queue is full. The encoder
+ * waits for the analysis of a picture when it picks the type of the pictures
+ * before it, lookahead pictures after it was queued, so the thread runs up
+ * to that many pictures ahead. The B-frame decision for the next group is
+ * started as soon as its pictures are analysed.
+ */
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "avcodec.h"
+#include "dsputil.h"
+#include "mpegvideo.h"
+
+#if HAVE_PTHREADS
+
+/** largest group of pictures the B-frame decision looks at, with its reference */
+#define LA_MAX_WINDOW (FF_MAX_B_FRAMES + 2)
+
+/** pictures queued and not analysed yet, at most the whole input queue */
+#define LA_MAX_JOBS (FF_MAX_B_FRAMES + 2)
+
+/** added to the intra cost of a block, for the cost of coding it as intra */
+#define LA_INTRA_BIAS 125
+
+/** a picture is a scene cut when predicting it from the previous one saves
+ *  less than 100 - LA_SCENECUT_PERCENT percent of its intra cost */
+#define LA_SCENECUT_PERCENT 60
+
+/** maximum number of diamond search steps per block */
+#define LA_MAX_STEPS 16
+
+enum DecisionState {
+    DECISION_NONE,
+    DECISION_QUEUED,
+    DECISION_RUNNING,
+    DECISION_DONE,
+};
+
+typedef struct LookaheadFrame {
+    int      number;        ///< display picture number, -1 if the slot is unused
+    uint8_t *data;          ///< luma downscaled by 2
+    int     *intra;         ///< intra cost of each block
+    int      intra_cost;    ///< sum of the intra costs
+    int      cost;          ///< cost of coding the picture from the previous one
+    int      scenecut;
+} LookaheadFrame;
+
+typedef struct AnalysisJob {
+    int            number;
+    const uint8_t *src;
+    int            linesize;
+} AnalysisJob;
+
+struct MpegLookahead {
+    const DSPContext *dsp;
+    int max_b_frames;
+    int detect_scenecuts;
+
+    int width, height;          ///< size of the downscaled pictures, multiples of 8
+    int stride;
+    int mb_width, mb_height;
+    int nb_frames;
+    LookaheadFrame *frames;     ///< ring of analysed pictures, by display number
+
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  job_cond;
+    pthread_cond_t  done_cond;
+    int             abort;
+
+    AnalysisJob jobs[LA_MAX_JOBS];
+    int         job_start;
+    int         nb_jobs;
+    pthread_cond_t job_done_cond;   ///< signalled when a job leaves the queue
+    int         queued;         ///< number of the last queued picture
+    int         analysed;       ///< number of the last analysed picture
+
+    enum DecisionState decision_state;
+    int decision_ref;           ///< reference picture of the decision
+    int decision_first;         ///< first picture of the group
+    int decision_count;         ///< number of pictures in the group
+    int decision;               ///< best number of B-frames, -1 if unknown
+
+    /* only accessed by the encoder thread */
+    int ref;                    ///< last reference picture, -1 if none
+    int pending_ref;            ///< reference whose decision needs more pictures
+    int horizon;                ///< last picture whose analysis can be read
+
+    /* only accessed by the lookahead thread */
+    int16_t (*mv[2])[2];
+    uint8_t *tmp;
+    int p_cost[LA_MAX_WINDOW][LA_MAX_WINDOW];
+    int b_cost[LA_MAX_WINDOW][LA_MAX_WINDOW][LA_MAX_WINDOW];
+};
+
+static int block_sad(MpegLookahead *la, uint8_t *cur, uint8_t *ref,
+                     int x, int y, int mx, int my)
+{
+    return la->dsp->sad[1](NULL, cur, ref + (y + my) * la->stride + x + mx,
+                           la->stride, 8);
+}
+
+static int block_intra(const uint8_t *src, int stride)
+{
+    int x, y, mean, sum = 0;
+
+    for (y = 0; y < 8; y++)
+        for (x = 0; x < 8; x++)
+            sum += src[x + y * stride];
+    mean = (sum + 32) >> 6;
+
+    sum = 0;
+    for (y = 0; y < 8; y++)
+        for (x = 0; x < 8; x++)
+            sum += FFABS(src[x + y * stride] - mean);
+
+    return sum + LA_INTRA_BIAS;
+}
+
+/**
+ * Find the motion vector of the block at (x, y) in ref, starting from the
+ * vectors of the left and top blocks.
+ * @return the SAD of the best match
+ */
+static int motion_search(MpegLookahead *la, uint8_t *cur,
+                         uint8_t *ref, int x, int y,
+                         int16_t (*mv)[2], int mb_xy)
+{
+    static const int8_t dia[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    const int xmin = -x, xmax = la->width  - 8 - x;
+    const int ymin = -y, ymax = la->height - 8 - y;
+    int bx = 0, by = 0;
+    int best = block_sad(la, cur, ref, x, y, 0, 0);
+    int i, step;
+
+    for (i = 0; i < 2; i++) {
+        int pred = i ? mb_xy - la->mb_width : mb_xy - 1;
+        int mx, my, d;
+
+        if (i ? y == 0 : x == 0)
+            continue;
+        mx = av_clip(mv[pred][0], xmin, xmax);
+        my = av_clip(mv[pred][1], ymin, ymax);
+        if ((mx == bx && my == by) || (!mx && !my))
+            continue;
+        d = block_sad(la, cur, ref, x, y, mx, my);
+        if (d < best) {
+            best = d;
+            bx   = mx;
+            by   = my;
+        }
+    }
+
+    for (step = 0; step < LA_MAX_STEPS; step++) {
+        int dir = -1;
+
+        for (i = 0; i < 4; i++) {
+            int mx = bx + dia[i][0];
+            int my = by + dia[i][1];
+            int d;
+
+            if (mx < xmin || mx > xmax || my < ymin || my > ymax)
+                continue;
+            d = block_sad(la, cur, ref, x, y, mx, my);
+            if (d < best) {
+                best = d;
+                dir  = i;
+            }
+        }
+        if (dir < 0)
+            break;
+        bx += dia[dir][0];
+        by += dia[dir][1];
+    }
+
+    mv[mb_xy][0] = bx;
+    mv[mb_xy][1] = by;
+    return best;
+}
+
+/** cost of coding cur as a P-picture referencing ref */
+static int p_frame_cost(MpegLookahead *la, LookaheadFrame *ref,
+                        LookaheadFrame *cur)
+{
+    int mb_x, mb_y, cost = 0;
+
+    for (mb_y = 0; mb_y < la->mb_height; mb_y++) {
+        for (mb_x = 0; mb_x < la->mb_width; mb_x++) {
+            int x = mb_x * 8, y = mb_y * 8;
+            int mb_xy = mb_x + mb_y * la->mb_width;
+            int inter = motion_search(la, cur->data + x + y * la->stride,
+                                      ref->data, x, y, la->mv[0], mb_xy);
+
+            cost += FFMIN(inter, cur->intra[mb_xy]);
+        }
+    }
+    return cost;
+}
+
+/** cost of coding cur as a B-picture between ref0 and ref1 */
+static int b_frame_cost(MpegLookahead *la, LookaheadFrame *ref0,
+                        LookaheadFrame *cur, LookaheadFrame *ref1)
+{
+    const int stride = la->stride;
+    int mb_x, mb_y, cost = 0;
+
+    for (mb_y = 0; mb_y < la->mb_height; mb_y++) {
+        for (mb_x = 0; mb_x < la->mb_width; mb_x++) {
+            int x = mb_x * 8, y = mb_y * 8;
+            int mb_xy = mb_x + mb_y * la->mb_width;
+            uint8_t *src = cur->data + x + y * stride;
+            const uint8_t *p0, *p1;
+            int fwd, bwd, bi, i, j;
+
+            fwd = motion_search(la, src, ref0->data, x, y, la->mv[0], mb_xy);
+            bwd = motion_search(la, src, ref1->data, x, y, la->mv[1], mb_xy);
+
+            p0 = ref0->data + x + la->mv[0][mb_xy][0] +
+                 (y + la->mv[0][mb_xy][1]) * stride;
+            p1 = ref1->data + x + la->mv[1][mb_xy][0] +
+                 (y + la->mv[1][mb_xy][1]) * stride;
+            for (j = 0; j < 8; j++)
+                for (i = 0; i < 8; i++)
+                    la->tmp[i + j * stride] = (p0[i + j * stride] +
+                                               p1[i + j * stride] + 1) >> 1;
+            bi = la->dsp->sad[1](NULL, src, la->tmp, stride, 8);
+
+            cost += FFMIN(FFMIN(fwd, bwd), FFMIN(bi, cur->intra[mb_xy]));
+        }
+    }
+    return cost;
+}
+
+static LookaheadFrame *get_frame(MpegLookahead *la, int number)
+{
+    LookaheadFrame *f;
+
+    if (number < 0)
+        return NULL;
+    f = &la->frames[number % la->nb_frames];
+    return f->number == number ? f : NULL;
+}
+
+static void analyse_picture(MpegLookahead *la, AnalysisJob *job)
+{
+    LookaheadFrame *f    = &la->frames[job->number % la->nb_frames];
+    LookaheadFrame *prev = get_frame(la, job->number - 1);
+    int mb_x, mb_y;
+
+    la->dsp->shrink[1](f->data, la->stride, job->src, job->linesize,
+                       la->width, la->height);
+    f->number = job->number;
+
+    f->intra_cost = 0;
+    for (mb_y = 0; mb_y < la->mb_height; mb_y++) {
+        for (mb_x = 0; mb_x < la->mb_width; mb_x++) {
+            int mb_xy = mb_x + mb_y * la->mb_width;
+
+            f->intra[mb_xy] = block_intra(f->data + 8 * (mb_x + mb_y * la->stride),
+                                          la->stride);
+            f->intra_cost  += f->intra[mb_xy];
+        }
+    }
+
+    if (prev) {
+        f->cost     = p_frame_cost(la, prev, f);
+        f->scenecut = la->detect_scenecuts &&
+                      f->cost * 100LL >= f->intra_cost * (int64_t)LA_SCENECUT_PERCENT;
+    } else {
+        f->cost     = f->intra_cost;
+        f->scenecut = 0;
+    }
+}
+
+static int get_p_cost(MpegLookahead *la, LookaheadFrame **win, int a, int b)
+{
+    if (la->p_cost[a][b] < 0) {
+        if (win[b]->number == win[a]->number + 1)
+            la->p_cost[a][b] = win[b]->cost;
+        else
+            la->p_cost[a][b] = p_frame_cost(la, win[a], win[b]);
+    }
+    return la->p_cost[a][b];
+}
+
+static int get_b_cost(MpegLookahead *la, LookaheadFrame **win,
+                      int a, int b, int c)
+{
+    if (la->b_cost[a][b][c] < 0)
+        la->b_cost[a][b][c] = b_frame_cost(la, win[a], win[b], win[c]);
+    return la->b_cost[a][b][c];
+}
+
+/**
+ * Try all the B-frame counts on the group of pictures, repeating the same
+ * pattern over the whole group like estimate_best_b_count() does.
+ * @return the best number of B-frames, -1 if the pictures are not known
+ */
+static int decide_b_frames(MpegLookahead *la, int ref, int first, int count)
+{
+    LookaheadFrame *win[LA_MAX_WINDOW];
+    int64_t best_cost = INT64_MAX;
+    int best = -1;
+    int i, j;
+
+    if (!(win[0] = get_frame(la, ref)))
+        return -1;
+    for (i = 1; i <= count; i++)
+        if (!(win[i] = get_frame(la, first + i - 1)))
+            return -1;
+
+    memset(la->p_cost, -1, sizeof(la->p_cost));
+    memset(la->b_cost, -1, sizeof(la->b_cost));
+
+    for (j = 0; j < count; j++) {
+        int64_t cost = 0;
+        int last = 0;
+
+        for (i = 1; i <= count; i++) {
+            int k;
+
+            if ((i - 1) % (j + 1) != j && i != count)
+                continue;
+            cost += get_p_cost(la, win, last, i);
+            for (k = last + 1; k < i; k++)
+                cost += get_b_cost(la, win, last, k, i);
+            last = i;
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            best      = j;
+        }
+    }
+    return best;
+}
+
+static void *lookahead_worker(void *arg)
+{
+    MpegLookahead *la = arg;
+
+    pthread_mutex_lock(&la->lock);
+    for (;;) {
+        int decision_ready;
+
+        while (!la->abort && !la->nb_jobs &&
+               la->decision_state != DECISION_QUEUED)
+            pthread_cond_wait(&la->job_cond, &la->lock);
+        if (la->abort)
+            break;
+
+        /* the encoder needs the decision before the pictures queued after
+         * its group, so it goes first once the group is analysed */
+        decision_ready = la->decision_state == DECISION_QUEUED &&
+                         la->analysed >= la->decision_first +
+                                         la->decision_count - 1;
+
+        if (la->nb_jobs && !decision_ready) {
+            AnalysisJob job = la->jobs[la->job_start];
+
+            la->job_start = (la->job_start + 1) % LA_MAX_JOBS;
+            la->nb_jobs--;
+            pthread_cond_signal(&la->job_done_cond);
+            pthread_mutex_unlock(&la->lock);
+
+            analyse_picture(la, &job);
+
+            pthread_mutex_lock(&la->lock);
+            la->analysed = job.number;
+        } else {
+            int ref   = la->decision_ref;
+            int first = la->decision_first;
+            int count = la->decision_count;
+            int decision;
+
+            la->decision_state = DECISION_RUNNING;
+            pthread_mutex_unlock(&la->lock);
+
+            decision = decide_b_frames(la, ref, first, count);
+
+            pthread_mutex_lock(&la->lock);
+            la->decision       = decision;
+            la->decision_state = DECISION_DONE;
+        }
+        pthread_cond_broadcast(&la->done_cond);
+    }
+    pthread_mutex_unlock(&la->lock);
+
+    return NULL;
+}
+
+/* must be called with the lock held */
+static void queue_decision(MpegLookahead *la, int ref, int first, int count)
+{
+    la->decision_ref   = ref;
+    la->decision_first = first;
+    la->decision_count = count;
+    la->decision_state = DECISION_QUEUED;
+    pthread_cond_signal(&la->job_cond);
+}
+
+av_cold int ff_mpv_lookahead_init(MpegEncContext *s)
+{
+    MpegLookahead *la;
+    int i, ret;
+
+    if (!(la = av_mallocz(sizeof(*la))))
+        return AVERROR(ENOMEM);
+
+    la->dsp              = &s->dsp;
+    la->max_b_frames     = s->max_b_frames;
+    la->detect_scenecuts = s->avctx->scenechange_threshold < 1000000000;
+    la->width            = (s->width  >> 1) & ~7;
+    la->height           = (s->height >> 1) & ~7;
+    la->stride           = FFALIGN(la->width, 16);
+    la->mb_width         = la->width  >> 3;
+    la->mb_height        = la->height >> 3;
+    la->queued           =
+    la->analysed         =
+    la->ref              =
+    la->pending_ref      =
+    la->horizon          = -1;
+
+    /* the input queue, the group being decided and the pictures queued
+     * while its decision is pending */
+    la->nb_frames = 2 * s->max_b_frames + s->lookahead + 3;
+    if (!(la->frames = av_mallocz(la->nb_frames * sizeof(*la->frames))))
+        goto fail;
+    for (i = 0; i < la->nb_frames; i++) {
+        LookaheadFrame *f = &la->frames[i];
+
+        f->number = -1;
+        f->data   = av_malloc(la->stride * FFMAX(la->height, 8));
+        f->intra  = av_malloc(FFMAX(la->mb_width * la->mb_height, 1) *
+                              sizeof(*f->intra));
+        if (!f->data || !f->intra)
+            goto fail;
+    }
+    for (i = 0; i < 2; i++)
+        if (!(la->mv[i] = av_malloc(FFMAX(la->mb_width * la->mb_height, 1) *
+                                    sizeof(*la->mv[i]))))
+            goto fail;
+    if (!(la->tmp = av_malloc(la->stride * 8)))
+        goto fail;
+
+    pthread_mutex_init(&la->lock, NULL);
+    pthread_cond_init(&la->job_cond, NULL);
+    pthread_cond_init(&la->done_cond, NULL);
+    pthread_cond_init(&la->job_done_cond, NULL);
+    if ((ret = pthread_create(&la->thread, NULL, lookahead_worker, la))) {
+        av_log(s->avctx, AV_LOG_ERROR, "pthread_create failed: %s\n",
+               strerror(ret));
+        pthread_cond_destroy(&la->job_done_cond);
+        pthread_cond_destroy(&la->done_cond);
+        pthread_cond_destroy(&la->job_cond);
+        pthread_mutex_destroy(&la->lock);
+        ret = AVERROR(ret);
+        goto fail_thread;
+    }
+
+    s->lookahead_ctx = la;
+    return 0;
+
+fail:
+    ret = AVERROR(ENOMEM);
+fail_thread:
+    for (i = 0; la->frames && i < la->nb_frames; i++) {
+        av_free(la->frames[i].data);
+        av_free(la->frames[i].intra);
+    }
+    av_free(la->frames);
+    av_free(la->mv[0]);
+    av_free(la->mv[1]);
+    av_free(la->tmp);
+    av_free(la);
+    return ret;
+}
+
+av_cold void ff_mpv_lookahead_end(MpegEncContext *s)
+{
+    MpegLookahead *la = s->lookahead_ctx;
+    int i;
+
+    if (!la)
+        return;
+
+    pthread_mutex_lock(&la->lock);
+    la->abort = 1;
+    pthread_cond_signal(&la->job_cond);
+    pthread_mutex_unlock(&la->lock);
+    pthread_join(la->thread, NULL);
+
+    pthread_cond_destroy(&la->job_done_cond);
+    pthread_cond_destroy(&la->done_cond);
+    pthread_cond_destroy(&la->job_cond);
+    pthread_mutex_destroy(&la->lock);
+
+    for (i = 0; i < la->nb_frames; i++) {
+        av_free(la->frames[i].data);
+        av_free(la->frames[i].intra);
+    }
+    av_free(la->frames);
+    av_free(la->mv[0]);
+    av_free(la->mv[1]);
+    av_free(la->tmp);
+    av_freep(&s->lookahead_ctx);
+}
+
+void ff_mpv_lookahead_add(MpegEncContext *s, Picture *pic, const uint8_t *luma)
+{
+    MpegLookahead *la = s->lookahead_ctx;
+    AnalysisJob *job;
+
+    pthread_mutex_lock(&la->lock);
+    while (la->nb_jobs == LA_MAX_JOBS)
+        pthread_cond_wait(&la->job_done_cond, &la->lock);
+    job = &la->jobs[(la->job_start + la->nb_jobs++) % LA_MAX_JOBS];
+    job->number   = pic->f.display_picture_number;
+    job->src      = luma;
+    job->linesize = pic->f.linesize[0];
+    la->queued    = job->number;
+
+    if (la->pending_ref >= 0 &&
+        la->queued >= la->pending_ref + la->max_b_frames + 1) {
+        queue_decision(la, la->pending_ref, la->pending_ref + 1,
+                       la->max_b_frames + 1);
+        la->pending_ref = -1;
+    }
+    pthread_cond_signal(&la->job_cond);
+    pthread_mutex_unlock(&la->lock);
+}
+
+void ff_mpv_lookahead_wait(MpegEncContext *s, int number)
+{
+    MpegLookahead *la = s->lookahead_ctx;
+
+    if (number <= la->horizon)
+        return;
+
+    pthread_mutex_lock(&la->lock);
+    while (la->analysed < number)
+        pthread_cond_wait(&la->done_cond, &la->lock);
+    pthread_mutex_unlock(&la->lock);
+
+    la->horizon = number;
+}
+
+int ff_mpv_lookahead_scenecut(MpegEncContext *s, int number)
+{
+    MpegLookahead *la = s->lookahead_ctx;
+    LookaheadFrame *f = number <= la->horizon ? get_frame(la, number) : NULL;
+
+    return f && f->scenecut;
+}
+
+int ff_mpv_lookahead_costs(MpegEncContext *s, int number, int *cost, int max)
+{
+    MpegLookahead *la = s->lookahead_ctx;
+    int n;
+
+    for (n = 0; n < max && number + n <= la->horizon; n++) {
+        LookaheadFrame *f = get_frame(la, number + n);
+        if (!f)
+            break;
+        cost[n] = f->cost;
+    }
+    return n;
+}
+
+int ff_mpv_lookahead_b_frames(MpegEncContext *s, int first, int count)
+{
+    MpegLookahead *la = s->lookahead_ctx;
+    int ret;
+
+    pthread_mutex_lock(&la->lock);
+    la->pending_ref = -1;
+    if (la->decision_state == DECISION_NONE ||
+        la->decision_ref   != la->ref       ||
+        la->decision_first != first         ||
+        la->decision_count != count) {
+        /* the prefetched decision was for another group */
+        while (la->decision_state == DECISION_RUNNING)
+            pthread_cond_wait(&la->done_cond, &la->lock);
+        queue_decision(la, la->ref, first, count);
+    }
+    while (la->decision_state != DECISION_DONE)
+        pthread_cond_wait(&la->done_cond, &la->lock);
+    ret = la->decision;
+    la->decision_state = DECISION_NONE;
+    pthread_mutex_unlock(&la->lock);
+
+    return ret;
+}
+
+void ff_mpv_lookahead_set_ref(MpegEncContext *s, int ref)
+{
+    MpegLookahead *la = s->lookahead_ctx;
+
+    la->ref = ref;
+    if (!la->max_b_frames || s->avctx->b_frame_strategy != 2)
+        return;
+
+    pthread_mutex_lock(&la->lock);
+    while (la->decision_state == DECISION_RUNNING)
+        pthread_cond_wait(&la->done_cond, &la->lock);
+    la->decision_state = DECISION_NONE;
+    if (la->queued >= ref + la->max_b_frames + 1)
+        queue_decision(la, ref, ref + 1, la->max_b_frames + 1);
+    else
+        la->pending_ref = ref;
+    pthread_mutex_unlock(&la->lock);
+}
+
+#else /* HAVE_PTHREADS */
+
+int ff_mpv_lookahead_init(MpegEncContext *s)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_mpv_lookahead_end(MpegEncContext *s)
+{
+}
+
+void ff_mpv_lookahead_add(MpegEncContext *s, Picture *pic, const uint8_t *luma)
+{
+}
+
+void ff_mpv_lookahead_wait(MpegEncContext *s, int number)
+{
+}
+
+int ff_mpv_lookahead_scenecut(MpegEncContext *s, int number)
+{
+    return 0;
+}
+
+int ff_mpv_lookahead_costs(MpegEncContext *s, int number, int *cost, int max)
+{
+    return 0;
+}
+
+int ff_mpv_lookahead_b_frames(MpegEncContext *s, int first, int count)
+{
+    return -1;
+}
+
+void ff_mpv_lookahead_set_ref(MpegEncContext *s, int ref)
+{
+}
+
+#endif /* HAVE_PTHREADS */
@@ -20,6 +20,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define LONG_BITSTREAM_WRITER
+
 #include "libavutil/opt.h"
 #include "avcodec.h"
 #include "put_bits.h"
@@ -298,16 +300,12 @@ static inline void encode_vlc_codeword(PutBitContext *pb, unsigned codebook, int
         val -= switch_val - (1 << exp_order);
         exponent = av_log2(val);
 
-        put_bits(pb, exponent - exp_order + switch_bits, 0);
-        put_bits(pb, exponent + 1, val);
+        put_bits63(pb, 2 * exponent - exp_order + switch_bits + 1, val);
     } else {
         exponent = val >> rice_order;
 
-        if (exponent)
-            put_bits(pb, exponent, 0);
-        put_bits(pb, 1, 1);
-        if (rice_order)
-            put_sbits(pb, rice_order, val);
+        put_bits(pb, exponent + 1 + rice_order,
+                 1 << rice_order | (val & ((1 << rice_order) - 1)));
     }
 }
 
@@ -105,6 +105,7 @@ typedef struct PerThreadContext {
 
     AVFrame frame;                  ///< Output frame (for decoding) or input (for encoding).
     int     got_frame;              ///< The output of got_picture_ptr from the last avcodec_decode_video() call.
+    int64_t packet_number;          ///< Number of packets submitted before avpkt.
     int     result;                 ///< The result of the last codec decode/encode() call.
 
     enum {
@@ -144,6 +145,7 @@ typedef struct FrameThreadContext {
 
     int next_decoding;             ///< The next context to submit a packet to.
     int next_finished;             ///< The next context to return output from.
+    int64_t nb_packets;            ///< Number of packets submitted so far.
 
     int delaying;                  /**<
                                     * Set for the first N packets, where N is the number of threads.
@@ -191,6 +193,23 @@ static int get_logical_cpus(AVCodecContext *avctx)
     return nb_cpus;
 }
 
+/**
+ * Pick the number of threads when the user left thread_count at 0.
+ * @return the thread count
+ */
+static int set_auto_thread_count(AVCodecContext *avctx)
+{
+    if (!avctx->thread_count) {
+        int nb_cpus = get_logical_cpus(avctx);
+        // use number of cores + 1 as thread count if there is more than one
+        if (nb_cpus > 1)
+            avctx->thread_count = FFMIN(nb_cpus + 1, MAX_AUTO_THREADS);
+        else
+            avctx->thread_count = 1;
+    }
+    return avctx->thread_count;
+}
+
 
 static void* attribute_align_arg worker(void *v)
 {
@@ -294,16 +313,7 @@ static int thread_init(AVCodecContext *avctx)
 {
     int i;
     ThreadContext *c;
-    int thread_count = avctx->thread_count;
-
-    if (!thread_count) {
-        int nb_cpus = get_logical_cpus(avctx);
-        // use number of cores + 1 as thread count if there is more than one
-        if (nb_cpus > 1)
-            thread_count = avctx->thread_count = FFMIN(nb_cpus + 1, MAX_AUTO_THREADS);
-        else
-            thread_count = avctx->thread_count = 1;
-    }
+    int thread_count = set_auto_thread_count(avctx);
 
     if (thread_count <= 1) {
         avctx->active_thread_type = 0;
@@ -602,6 +612,7 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
     if (err) return err;
     err = submit_packet(p, avpkt);
     if (err) return err;
+    p->packet_number = fctx->nb_packets++;
 
     /*
      * If we're still receiving the initial packets, don't return a frame.
@@ -635,6 +646,7 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
         *picture = p->frame;
         *got_picture_ptr = p->got_frame;
         picture->pkt_dts = p->avpkt.dts;
+        picture->thread_delay = fctx->nb_packets - 1 - p->packet_number;
 
         /*
          * A later call with avkpt->size == 0 may loop over all threads,
@@ -780,21 +792,12 @@ static void frame_thread_free(AVCodecContext *avctx, int thread_count)
 
 static int frame_thread_init(AVCodecContext *avctx)
 {
-    int thread_count = avctx->thread_count;
+    int thread_count = set_auto_thread_count(avctx);
     const AVCodec *codec = avctx->codec;
     AVCodecContext *src = avctx;
     FrameThreadContext *fctx;
     int i, err = 0;
 
-    if (!thread_count) {
-        int nb_cpus = get_logical_cpus(avctx);
-        // use number of cores + 1 as thread count if there is more than one
-        if (nb_cpus > 1)
-            thread_count = avctx->thread_count = FFMIN(nb_cpus + 1, MAX_AUTO_THREADS);
-        else
-            thread_count = avctx->thread_count = 1;
-    }
-
     if (thread_count <= 1) {
         avctx->active_thread_type = 0;
         return 0;
@@ -995,6 +998,39 @@ void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f)
     memset(f->data, 0, sizeof(f->data));
 }
 
+/**
+ * Choose between frame and slice threading for a decoder which may hold
+ * back at most max_frame_delay frames. Frame threading with n threads
+ * delays the output by n - 1 frames, slice threading does not delay it.
+ * Frame threading scales better, as slice threading depends on the number
+ * of slices per frame, so it is kept as long as it can use at least half
+ * of the threads.
+ */
+static void validate_frame_delay(AVCodecContext *avctx,
+                                 int frame_threading_supported)
+{
+    int slice_threading_supported = avctx->codec->capabilities & CODEC_CAP_SLICE_THREADS &&
+                                    avctx->thread_type & FF_THREAD_SLICE;
+    int frame_threads;
+
+    set_auto_thread_count(avctx);
+    frame_threads = FFMIN(avctx->thread_count, avctx->max_frame_delay + 1);
+
+    if (avctx->thread_count == 1) {
+        avctx->active_thread_type = 0;
+    } else if (frame_threading_supported && avctx->thread_type & FF_THREAD_FRAME &&
+               frame_threads > 1 &&
+               (!slice_threading_supported || 2 * frame_threads >= avctx->thread_count)) {
+        avctx->active_thread_type = FF_THREAD_FRAME;
+        avctx->thread_count       = frame_threads;
+    } else if (slice_threading_supported) {
+        avctx->active_thread_type = FF_THREAD_SLICE;
+    } else if (!(avctx->codec->capabilities & CODEC_CAP_AUTO_THREADS)) {
+        avctx->thread_count       = 1;
+        avctx->active_thread_type = 0;
+    }
+}
+
 /**
  * Set the threading algorithms used.
  *
@@ -1012,6 +1048,8 @@ static void validate_thread_parameters(AVCodecContext *avctx)
                                 && !(avctx->flags2 & CODEC_FLAG2_CHUNKS);
     if (avctx->thread_count == 1) {
         avctx->active_thread_type = 0;
+    } else if (av_codec_is_decoder(avctx->codec) && avctx->max_frame_delay >= 0) {
+        validate_frame_delay(avctx, frame_threading_supported);
     } else if (frame_threading_supported && (avctx->thread_type & FF_THREAD_FRAME)) {
         avctx->active_thread_type = FF_THREAD_FRAME;
     } else if (avctx->codec->capabilities & CODEC_CAP_SLICE_THREADS &&
@@ -0,0 +1,168 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Bitstream writer test and benchmark.
+ *
+ * The writing functions are built once with the default writer here and
+ * once with LONG_BITSTREAM_WRITER in put_bits_long.c, and a checksum of
+ * what each of them writes is printed. Run with -b to also compare their
+ * speed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/adler32.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "put_bits.h"
+
+#define COUNT (1 << 16)
+
+#ifndef FUNC
+#define FUNC(name) ff_ ## name ## _default
+#define TEST_MAIN
+#endif
+
+int FUNC(write_codes)(uint8_t *buf, int size, const uint8_t *lens,
+                      const uint32_t *codes, int count);
+int FUNC(write_pairs)(uint8_t *buf, int size, const uint8_t *lens,
+                      const uint32_t *codes, int count);
+
+/**
+ * Write each code with its own put_bits() call.
+ * @return the number of bits written
+ */
+int FUNC(write_codes)(uint8_t *buf, int size, const uint8_t *lens,
+                      const uint32_t *codes, int count)
+{
+    PutBitContext pb;
+    int i, bits;
+
+    init_put_bits(&pb, buf, size);
+    for (i = 0; i < count; i++)
+        put_bits(&pb, lens[i], codes[i]);
+    put_bits32(&pb, 0xdeadbeef);
+    bits = put_bits_count(&pb);
+    flush_put_bits(&pb);
+    return bits;
+}
+
+/**
+ * Write the codes two at a time with put_bits63().
+ */
+int FUNC(write_pairs)(uint8_t *buf, int size, const uint8_t *lens,
+                      const uint32_t *codes, int count)
+{
+    PutBitContext pb;
+    int i, bits;
+
+    init_put_bits(&pb, buf, size);
+    for (i = 0; i < count; i += 2)
+        put_bits63(&pb, lens[i] + lens[i + 1],
+                   (uint64_t)codes[i] << lens[i + 1] | codes[i + 1]);
+    put_bits32(&pb, 0xdeadbeef);
+    bits = put_bits_count(&pb);
+    flush_put_bits(&pb);
+    return bits;
+}
+
+#ifdef TEST_MAIN
+
+#undef FUNC
+#define FUNC(name) ff_ ## name ## _long
+
+int FUNC(write_codes)(uint8_t *buf, int size, const uint8_t *lens,
+                      const uint32_t *codes, int count);
+int FUNC(write_pairs)(uint8_t *buf, int size, const uint8_t *lens,
+                      const uint32_t *codes, int count);
+
+typedef int (*write_func)(uint8_t *buf, int size, const uint8_t *lens,
+                          const uint32_t *codes, int count);
+
+static const struct {
+    const char *name;
+    write_func write;
+} tests[] = {
+    { "default put_bits",   ff_write_codes_default },
+    { "default put_bits63", ff_write_pairs_default },
+    { "long put_bits",      ff_write_codes_long    },
+    { "long put_bits63",    ff_write_pairs_long    },
+};
+
+#define SIZE (COUNT * 4 + 8)
+
+int main(int argc, char **argv)
+{
+    uint8_t  *lens  = av_malloc(COUNT * sizeof(*lens));
+    uint32_t *codes = av_malloc(COUNT * sizeof(*codes));
+    uint8_t  *ref   = av_malloc(SIZE);
+    uint8_t  *out   = av_malloc(SIZE);
+    int bench = argc > 1 && !strcmp(argv[1], "-b");
+    int i, t, bits = 0, ret = 0;
+    AVLFG prng;
+
+    if (!lens || !codes || !ref || !out)
+        return 2;
+
+    av_lfg_init(&prng, 1);
+    for (i = 0; i < COUNT; i++) {
+        lens[i]  = 1 + av_lfg_get(&prng) % (1 + av_lfg_get(&prng) % 31);
+        codes[i] = av_lfg_get(&prng) & ((1U << lens[i]) - 1);
+    }
+
+    for (t = 0; t < FF_ARRAY_ELEMS(tests); t++) {
+        int n;
+
+        memset(out, 0, SIZE);
+        n = tests[t].write(out, SIZE, lens, codes, COUNT);
+        printf("%s: %d bits, checksum %08lx\n", tests[t].name, n,
+               av_adler32_update(1, out, SIZE));
+        if (!t) {
+            bits = n;
+            memcpy(ref, out, SIZE);
+        } else if (n != bits || memcmp(ref, out, SIZE)) {
+            printf("%s: output mismatch\n", tests[t].name);
+            ret = 1;
+        }
+    }
+
+    if (bench && !ret) {
+        for (t = 0; t < FF_ARRAY_ELEMS(tests); t++) {
+            int64_t time = av_gettime();
+            for (i = 0; i < 100; i++)
+                tests[t].write(out, SIZE, lens, codes, COUNT);
+            time = av_gettime() - time;
+            printf("%-19s %7.2f Mbit/s %6.2f ns/code\n", tests[t].name,
+                   100.0 * bits / time, time * 1000.0 / (100.0 * COUNT));
+        }
+    }
+
+    av_free(lens);
+    av_free(codes);
+    av_free(ref);
+    av_free(out);
+    return ret;
+}
+
+#endif /* TEST_MAIN */
@@ -37,8 +37,36 @@
 #include "mathops.h"
 #include "config.h"
 
+/*
+ * Long bitstream writer:
+ * an encoder can "#define LONG_BITSTREAM_WRITER" before including this
+ * header to accumulate up to 64 bits and store them 8 bytes at a time.
+ * put_bits63() then writes up to 63 bits with a single call, so a VLC and
+ * the bits following it can be emitted together. The context layout does
+ * not change, but all files writing to the same PutBitContext must use the
+ * same setting, and avpriv_align_put_bits(), avpriv_put_string() and
+ * avpriv_copy_bits() are not available.
+ */
+#ifdef LONG_BITSTREAM_WRITER
+#   define BUF_BITS 64
+typedef uint64_t BitBuf;
+#   ifdef BITSTREAM_WRITER_LE
+#       define AV_WBUF AV_WL64
+#   else
+#       define AV_WBUF AV_WB64
+#   endif
+#else
+#   define BUF_BITS 32
+typedef uint32_t BitBuf;
+#   ifdef BITSTREAM_WRITER_LE
+#       define AV_WBUF AV_WL32
+#   else
+#       define AV_WBUF AV_WB32
+#   endif
+#endif
+
 typedef struct PutBitContext {
-    uint32_t bit_buf;
+    uint64_t bit_buf;   ///< only the low BUF_BITS bits are used
     int bit_left;
     uint8_t *buf, *buf_ptr, *buf_end;
     int size_in_bits;
@@ -62,7 +90,7 @@ static inline void init_put_bits(PutBitContext *s, uint8_t *buffer,
     s->buf          = buffer;
     s->buf_end      = s->buf + buffer_size;
     s->buf_ptr      = s->buf;
-    s->bit_left     = 32;
+    s->bit_left     = BUF_BITS;
     s->bit_buf      = 0;
 }
 
@@ -71,7 +99,7 @@ static inline void init_put_bits(PutBitContext *s, uint8_t *buffer,
  */
 static inline int put_bits_count(PutBitContext *s)
 {
-    return (s->buf_ptr - s->buf) * 8 + 32 - s->bit_left;
+    return (s->buf_ptr - s->buf) * 8 + BUF_BITS - s->bit_left;
 }
 
 /**
@@ -79,26 +107,28 @@ static inline int put_bits_count(PutBitContext *s)
  */
 static inline void flush_put_bits(PutBitContext *s)
 {
+    BitBuf bit_buf = s->bit_buf;
+
 #ifndef BITSTREAM_WRITER_LE
-    if (s->bit_left < 32)
-        s->bit_buf <<= s->bit_left;
+    if (s->bit_left < BUF_BITS)
+        bit_buf <<= s->bit_left;
 #endif
-    while (s->bit_left < 32) {
+    while (s->bit_left < BUF_BITS) {
         /* XXX: should test end of buffer */
 #ifdef BITSTREAM_WRITER_LE
-        *s->buf_ptr++ = s->bit_buf;
-        s->bit_buf  >>= 8;
+        *s->buf_ptr++ = bit_buf;
+        bit_buf     >>= 8;
 #else
-        *s->buf_ptr++ = s->bit_buf >> 24;
-        s->bit_buf  <<= 8;
+        *s->buf_ptr++ = bit_buf >> (BUF_BITS - 8);
+        bit_buf     <<= 8;
 #endif
         s->bit_left  += 8;
     }
-    s->bit_left = 32;
+    s->bit_left = BUF_BITS;
     s->bit_buf  = 0;
 }
 
-#ifdef BITSTREAM_WRITER_LE
+#if defined(BITSTREAM_WRITER_LE) || defined(LONG_BITSTREAM_WRITER)
 #define avpriv_align_put_bits align_put_bits_unsupported_here
 #define avpriv_put_string ff_put_string_unsupported_here
 #define avpriv_copy_bits avpriv_copy_bits_unsupported_here
@@ -124,28 +154,22 @@ void avpriv_put_string(PutBitContext *pb, const char *string,
 void avpriv_copy_bits(PutBitContext *pb, const uint8_t *src, int length);
 #endif
 
-/**
- * Write up to 31 bits into a bitstream.
- * Use put_bits32 to write 32 bits.
- */
-static inline void put_bits(PutBitContext *s, int n, unsigned int value)
+static av_always_inline void put_bits_buf(PutBitContext *s, int n,
+                                          BitBuf value)
 {
-    unsigned int bit_buf;
+    BitBuf bit_buf;
     int bit_left;
 
-    assert(n <= 31 && value < (1U << n));
-
     bit_buf  = s->bit_buf;
     bit_left = s->bit_left;
 
-    /* XXX: optimize */
 #ifdef BITSTREAM_WRITER_LE
-    bit_buf |= value << (32 - bit_left);
+    bit_buf |= value << (BUF_BITS - bit_left);
     if (n >= bit_left) {
-        AV_WL32(s->buf_ptr, bit_buf);
-        s->buf_ptr += 4;
-        bit_buf     = (bit_left == 32) ? 0 : value >> bit_left;
-        bit_left   += 32;
+        AV_WBUF(s->buf_ptr, bit_buf);
+        s->buf_ptr += BUF_BITS / 8;
+        bit_buf     = (bit_left == BUF_BITS) ? 0 : value >> bit_left;
+        bit_left   += BUF_BITS;
     }
     bit_left -= n;
 #else
@@ -155,9 +179,9 @@ static inline void put_bits(PutBitContext *s, int n, unsigned int value)
     } else {
         bit_buf   <<= bit_left;
         bit_buf    |= value >> (n - bit_left);
-        AV_WB32(s->buf_ptr, bit_buf);
-        s->buf_ptr += 4;
-        bit_left   += 32 - n;
+        AV_WBUF(s->buf_ptr, bit_buf);
+        s->buf_ptr += BUF_BITS / 8;
+        bit_left   += BUF_BITS - n;
         bit_buf     = value;
     }
 #endif
@@ -166,6 +190,43 @@ static inline void put_bits(PutBitContext *s, int n, unsigned int value)
     s->bit_left = bit_left;
 }
 
+/**
+ * Write up to 31 bits into a bitstream.
+ * Use put_bits32 to write 32 bits.
+ */
+static inline void put_bits(PutBitContext *s, int n, unsigned int value)
+{
+    assert(n <= 31 && value < (1U << n));
+
+    put_bits_buf(s, n, value);
+}
+
+/**
+ * Write up to 63 bits into a bitstream.
+ * With LONG_BITSTREAM_WRITER this costs the same as put_bits(), so codes
+ * written back to back can be merged into one call.
+ */
+static inline void put_bits63(PutBitContext *s, int n, uint64_t value)
+{
+    assert(n <= 63 && value < (UINT64_C(1) << n));
+
+#ifdef LONG_BITSTREAM_WRITER
+    put_bits_buf(s, n, value);
+#else
+    if (n < 32) {
+        put_bits_buf(s, n, value);
+    } else {
+#ifdef BITSTREAM_WRITER_LE
+        put_bits_buf(s, 31, value & 0x7fffffff);
+        put_bits_buf(s, n - 31, value >> 31);
+#else
+        put_bits_buf(s, n - 31, value >> 31);
+        put_bits_buf(s, 31, value & 0x7fffffff);
+#endif
+    }
+#endif
+}
+
 static inline void put_sbits(PutBitContext *pb, int n, int32_t value)
 {
     assert(n >= 0 && n <= 31);
@@ -178,6 +239,9 @@ static inline void put_sbits(PutBitContext *pb, int n, int32_t value)
  */
 static void av_unused put_bits32(PutBitContext *s, uint32_t value)
 {
+#ifdef LONG_BITSTREAM_WRITER
+    put_bits_buf(s, 32, value);
+#else
     int lo = value & 0xffff;
     int hi = value >> 16;
 #ifdef BITSTREAM_WRITER_LE
@@ -187,6 +251,7 @@ static void av_unused put_bits32(PutBitContext *s, uint32_t value)
     put_bits(s, 16, hi);
     put_bits(s, 16, lo);
 #endif
+#endif
 }
 
 /**
@@ -205,7 +270,7 @@ static inline uint8_t *put_bits_ptr(PutBitContext *s)
 static inline void skip_put_bytes(PutBitContext *s, int n)
 {
     assert((put_bits_count(s) & 7) == 0);
-    assert(s->bit_left == 32);
+    assert(s->bit_left == BUF_BITS);
     s->buf_ptr += n;
 }
 
@@ -217,8 +282,8 @@ static inline void skip_put_bytes(PutBitContext *s, int n)
 static inline void skip_put_bits(PutBitContext *s, int n)
 {
     s->bit_left -= n;
-    s->buf_ptr  -= 4 * (s->bit_left >> 5);
-    s->bit_left &= 31;
+    s->buf_ptr  -= BUF_BITS / 8 * (s->bit_left >> (BUF_BITS == 64 ? 6 : 5));
+    s->bit_left &= BUF_BITS - 1;
 }
 
 /**
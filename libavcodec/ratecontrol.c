@@ -148,6 +148,7 @@ int ff_rate_control_init(MpegEncContext *s)
         rcc->last_qscale_for[i] = FF_QP2LAMBDA * 5;
     }
     rcc->buffer_index = s->avctx->rc_initial_buffer_occupancy;
+    rcc->la_pred.decay = 0.4;
 
     if (s->flags & CODEC_FLAG_PASS2) {
         int i;
@@ -594,6 +595,46 @@ static void update_predictor(Predictor *p, double q, double var, double size)
     p->coeff += new_coeff;
 }
 
+/**
+ * Raise q until the buffer does not underflow over the pictures analysed by
+ * the lookahead, predicting their sizes from their complexity.
+ */
+static double lookahead_vbv_qscale(MpegEncContext *s, RateControlEntry *rce,
+                                   double q, const int *cost, int n)
+{
+    RateControlContext *rcc  = &s->rc_context;
+    const double buffer_size = s->avctx->rc_buffer_size;
+    const double fps         = 1 / av_q2d(s->avctx->time_base);
+    const double max_rate    = s->avctx->rc_max_rate / fps;
+    int qmin, qmax;
+
+    if (!buffer_size || !max_rate || n < 2 || rcc->la_pred.count < 1)
+        return q;
+
+    get_qminmax(&qmin, &qmax, s, rce->new_pict_type);
+
+    while (q < qmax) {
+        double buffer = rcc->buffer_index;
+        int i;
+
+        for (i = 0; i < n; i++) {
+            buffer -= i ? predict_size(&rcc->la_pred, q, cost[i])
+                        : qp2bits(rce, q);
+            if (buffer < 0)
+                break;
+            buffer = FFMIN(buffer + max_rate, buffer_size);
+        }
+        if (i == n)
+            break;
+        q *= 1.1;
+    }
+
+    if (s->avctx->debug & FF_DEBUG_RC)
+        av_log(s->avctx, AV_LOG_DEBUG, "lookahead QP %f over %d pictures\n",
+               q, n);
+    return q;
+}
+
 static void adaptive_quantization(MpegEncContext *s, double q)
 {
     int i;
@@ -740,6 +781,8 @@ float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
     int var;
     const int pict_type = s->pict_type;
     Picture * const pic = &s->current_picture;
+    int la_cost[MAX_PICTURE_COUNT];
+    int la_count = 0;
     emms_c();
 
 #if CONFIG_LIBXVID
@@ -758,8 +801,15 @@ float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
         update_predictor(&rcc->pred[s->last_pict_type],
                          rcc->last_qscale,
                          sqrt(last_var), s->frame_bits);
+        if (s->last_pict_type == AV_PICTURE_TYPE_P && rcc->last_la_cost)
+            update_predictor(&rcc->la_pred, rcc->last_qscale,
+                             rcc->last_la_cost, s->frame_bits);
     }
 
+    if (s->lookahead_ctx)
+        la_count = ff_mpv_lookahead_costs(s, picture_number, la_cost,
+                                          FF_ARRAY_ELEMS(la_cost));
+
     if (s->flags & CODEC_FLAG_PASS2) {
         assert(picture_number >= 0);
         assert(picture_number < rcc->num_entries);
@@ -848,6 +898,7 @@ float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
         }
         assert(q > 0.0);
 
+        q = lookahead_vbv_qscale(s, rce, q, la_cost, la_count);
         q = modify_qscale(s, rce, q, picture_number);
 
         rcc->pass1_wanted_bits += s->bit_rate / fps;
@@ -881,6 +932,7 @@ float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
         rcc->last_qscale        = q;
         rcc->last_mc_mb_var_sum = pic->mc_mb_var_sum;
         rcc->last_mb_var_sum    = pic->mb_var_sum;
+        rcc->last_la_cost       = la_count ? la_cost[0] : 0;
     }
     return q;
 }
@@ -85,6 +85,9 @@ typedef struct RateControlContext{
     float dry_run_qscale;         ///< for xvid rc
     int last_picture_number;      ///< for xvid rc
     AVExpr * rc_eq_eval;
+
+    Predictor la_pred;            ///< predicts P-picture sizes from their lookahead complexity
+    int last_la_cost;             ///< lookahead complexity of the last picture
 }RateControlContext;
 
 struct MpegEncContext;
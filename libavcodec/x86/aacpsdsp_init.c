@@ -0,0 +1,385 @@
+/*
+ * SIMD optimized MPEG-4 Parametric Stereo decoding functions
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86/asm.h"
+#include "libavutil/x86/cpu.h"
+#include "libavcodec/dsputil.h"
+#include "libavcodec/aacpsdsp.h"
+
+#if HAVE_SSE_INLINE
+
+/* size of a row of the all-pass delay lines,
+ * (PS_QMF_TIME_SLOTS + PS_MAX_AP_DELAY) * 2 * sizeof(float) */
+#define AP_STRIDE "296"
+
+/* distance between L[0] and L[1] of L[2][38][64], 38 * 64 * sizeof(float),
+ * the rows of the [][32][2] arrays are 256 bytes apart */
+#define L_STRIDE "9728"
+
+/* The time slots are processed 4 (2 for decorrelate) at a time, the decoder
+ * always passes 32 of them. */
+
+static void ps_mul_pair_single_sse(float (*dst)[2], float (*src0)[2],
+                                   float *src1, int n)
+{
+    x86_reg i = -4 * n;
+
+    __asm__ volatile (
+        "1:                             \n\t"
+        "movups   (%3, %0), %%xmm2      \n\t"
+        "movups   (%2, %0, 2), %%xmm0   \n\t"
+        "movups 16(%2, %0, 2), %%xmm1   \n\t"
+        "movaps      %%xmm2, %%xmm3     \n\t"
+        "unpcklps    %%xmm2, %%xmm2     \n\t"
+        "unpckhps    %%xmm3, %%xmm3     \n\t"
+        "mulps       %%xmm2, %%xmm0     \n\t"
+        "mulps       %%xmm3, %%xmm1     \n\t"
+        "movups      %%xmm0,   (%1, %0, 2) \n\t"
+        "movups      %%xmm1, 16(%1, %0, 2) \n\t"
+        "add            $16, %0         \n\t"
+        "jl              1b             \n\t"
+        : "+r"(i)
+        : "r"(dst + n), "r"(src0 + n), "r"(src1 + n)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",) "memory"
+    );
+}
+
+/* Add tap j of the filters of the 2 outputs to xmm0, off = j * 8 is the
+ * offset of the tap in a filter, sum and diff the offsets of the folded
+ * input. */
+#define HYBRID_TAP(off, sum, diff)              \
+    "movlps   "off"(%0), %%xmm4     \n\t"       \
+    "movhps 64+"off"(%0), %%xmm4    \n\t"       \
+    "movaps      %%xmm4, %%xmm5     \n\t"       \
+    "shufps $0xa0, %%xmm4, %%xmm4   \n\t"       \
+    "shufps $0xf5, %%xmm5, %%xmm5   \n\t"       \
+    "mulps   "sum"(%1), %%xmm4      \n\t"       \
+    "mulps  "diff"(%1), %%xmm5      \n\t"       \
+    "addps       %%xmm5, %%xmm4     \n\t"       \
+    "addps       %%xmm4, %%xmm0     \n\t"
+
+static void ps_hybrid_analysis_sse(float (*out)[2], float (*in)[2],
+                                   const float (*filter)[8][2],
+                                   int stride, int n)
+{
+    /* The middle input, then for each tap the sum of the symmetric inputs
+     * and their difference, with the imaginary part negated, so that every
+     * tap is
+     *   sum += f_re * (in0 + in1) + f_im * [-(in0_im - in1_im), in0_re - in1_re]
+     * which rounds the same as the C version. All of them twice, for the
+     * 2 outputs computed at once. */
+    LOCAL_ALIGNED_16(float, fold, [13], [4]);
+    x86_reg ostride = stride * 8;
+    int i, j;
+
+    fold[0][0] = fold[0][2] = in[6][0];
+    fold[0][1] = fold[0][3] = in[6][1];
+    for (j = 0; j < 6; j++) {
+        fold[2 * j + 1][0] = fold[2 * j + 1][2] =   in[j][0] + in[12 - j][0];
+        fold[2 * j + 1][1] = fold[2 * j + 1][3] =   in[j][1] + in[12 - j][1];
+        fold[2 * j + 2][0] = fold[2 * j + 2][2] = -(in[j][1] - in[12 - j][1]);
+        fold[2 * j + 2][1] = fold[2 * j + 2][3] =   in[j][0] - in[12 - j][0];
+    }
+
+    /* Each lane pair holds one output and the taps are summed in the same
+     * order as in the C version. */
+    for (i = 0; i < n; i += 2) {
+        __asm__ volatile (
+            "movlps     48(%0), %%xmm0      \n\t"
+            "movhps    112(%0), %%xmm0      \n\t"
+            "shufps $0xa0, %%xmm0, %%xmm0   \n\t"
+            "mulps        (%1), %%xmm0      \n\t"
+            HYBRID_TAP( "0",  "16",  "32")
+            HYBRID_TAP( "8",  "48",  "64")
+            HYBRID_TAP("16",  "80",  "96")
+            HYBRID_TAP("24", "112", "128")
+            HYBRID_TAP("32", "144", "160")
+            HYBRID_TAP("40", "176", "192")
+            "movlps      %%xmm0, (%2)       \n\t"
+            "movhps      %%xmm0, (%2, %3)   \n\t"
+            :: "r"(filter[i]), "r"(fold), "r"(out[i * stride]), "r"(ostride)
+            : XMM_CLOBBERS("%xmm0", "%xmm4", "%xmm5",) "memory"
+        );
+    }
+}
+
+static void ps_hybrid_analysis_ileave_sse(float (*out)[32][2],
+                                          float L[2][38][64],
+                                          int i, int len)
+{
+    int j;
+
+    for (; i & 3; i++) {
+        for (j = 0; j < len; j++) {
+            out[i][j][0] = L[0][j][i];
+            out[i][j][1] = L[1][j][i];
+        }
+    }
+    for (; i < 64; i += 4) {
+        for (j = 0; j < len; j++) {
+            __asm__ volatile (
+                "movups          (%1), %%xmm0   \n\t"
+                "movups "L_STRIDE"(%1), %%xmm1   \n\t"
+                "movaps      %%xmm0, %%xmm2     \n\t"
+                "unpcklps    %%xmm1, %%xmm0     \n\t"
+                "unpckhps    %%xmm1, %%xmm2     \n\t"
+                "movlps      %%xmm0,    (%0)    \n\t"
+                "movhps      %%xmm0, 256(%0)    \n\t"
+                "movlps      %%xmm2, 512(%0)    \n\t"
+                "movhps      %%xmm2, 768(%0)    \n\t"
+                :: "r"(&out[i][j][0]), "r"(&L[0][j][i])
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",) "memory"
+            );
+        }
+    }
+}
+
+static void ps_hybrid_synthesis_deint_sse(float out[2][38][64],
+                                          float (*in)[32][2],
+                                          int i, int len)
+{
+    int n;
+
+    for (; i & 3; i++) {
+        for (n = 0; n < len; n++) {
+            out[0][n][i] = in[i][n][0];
+            out[1][n][i] = in[i][n][1];
+        }
+    }
+    for (; i < 64; i += 4) {
+        for (n = 0; n < len; n++) {
+            __asm__ volatile (
+                "movlps         (%1), %%xmm0    \n\t"
+                "movhps      256(%1), %%xmm0    \n\t"
+                "movlps      512(%1), %%xmm1    \n\t"
+                "movhps      768(%1), %%xmm1    \n\t"
+                "movaps      %%xmm0, %%xmm2     \n\t"
+                "shufps $0x88, %%xmm1, %%xmm0   \n\t"
+                "shufps $0xdd, %%xmm1, %%xmm2   \n\t"
+                "movups      %%xmm0,    (%0)    \n\t"
+                "movups      %%xmm2, "L_STRIDE"(%0) \n\t"
+                :: "r"(&out[0][n][i]), "r"(&in[i][n][0])
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",) "memory"
+            );
+        }
+    }
+}
+
+/* Complex multiplication of two time slots by a constant c, with
+ * re = [c_re, c_re, c_re, c_re] and im = [-c_im, c_im, -c_im, c_im]. */
+#define CMUL(x, tmp, re, im)                         \
+    "movaps         "x", "tmp"                  \n\t" \
+    "shufps $0xb1,  "tmp", "tmp"                \n\t" \
+    "mulps          "re", "x"                   \n\t" \
+    "mulps          "im", "tmp"                 \n\t" \
+    "addps          "tmp", "x"                  \n\t"
+
+/* One all-pass link, with the input in xmm0, reading the link delay at rd,
+ * writing the all-pass delay at wr and the coefficients at c. */
+#define AP_LINK(rd, wr, c)                                      \
+    "movups     "rd"(%2), %%xmm1                           \n\t" \
+    CMUL("%%xmm1", "%%xmm2", c"+16(%4)", c"+32(%4)")              \
+    "movaps       %%xmm0, %%xmm3                           \n\t" \
+    "mulps      "c"(%4), %%xmm3                            \n\t" \
+    "subps        %%xmm3, %%xmm1                           \n\t" \
+    "movaps       %%xmm1, %%xmm3                           \n\t" \
+    "mulps      "c"(%4), %%xmm3                            \n\t" \
+    "addps        %%xmm0, %%xmm3                           \n\t" \
+    "movups       %%xmm3, "wr"(%2)                         \n\t" \
+    "movaps       %%xmm1, %%xmm0                           \n\t"
+
+static void ps_decorrelate_sse(float (*out)[2], float (*delay)[2],
+                               float (*ap_delay)[PS_QMF_TIME_SLOTS + PS_MAX_AP_DELAY][2],
+                               const float phi_fract[2], float (*Q_fract)[2],
+                               const float *transient_gain,
+                               float g_decay_slope,
+                               int len)
+{
+    static const float a[] = { 0.65143905753106f,
+                               0.56471812200776f,
+                               0.48954165955695f };
+    /* phi_fract, then a[m] * g_decay_slope and Q_fract[m] for each link */
+    LOCAL_ALIGNED_16(float, cst, [2 + 3 * PS_AP_LINKS], [4]);
+    int m, n;
+
+    for (n = 0; n < 4; n += 2) {
+        cst[0][n] = cst[0][n + 1] = phi_fract[0];
+        cst[1][n] = -phi_fract[1];
+        cst[1][n + 1] = phi_fract[1];
+        for (m = 0; m < PS_AP_LINKS; m++) {
+            cst[2 + 3 * m][n] = cst[2 + 3 * m][n + 1] = a[m] * g_decay_slope;
+            cst[3 + 3 * m][n] = cst[3 + 3 * m][n + 1] = Q_fract[m][0];
+            cst[4 + 3 * m][n] = -Q_fract[m][1];
+            cst[4 + 3 * m][n + 1] = Q_fract[m][1];
+        }
+    }
+
+    /* The all-pass links only read back values written at least 3 slots
+     * earlier, so 2 slots can be filtered at once. */
+    for (n = 0; n < len; n += 2) {
+        __asm__ volatile (
+            "movups        (%1), %%xmm0     \n\t"
+            CMUL("%%xmm0", "%%xmm1", "(%4)", "16(%4)")
+            AP_LINK("16",            "40",              "32")
+            AP_LINK("8+"AP_STRIDE,   "40+"AP_STRIDE,    "80")
+            AP_LINK("2*"AP_STRIDE,   "40+2*"AP_STRIDE,  "128")
+            "movlps        (%3), %%xmm1     \n\t"
+            "unpcklps    %%xmm1, %%xmm1     \n\t"
+            "mulps       %%xmm1, %%xmm0     \n\t"
+            "movups      %%xmm0, (%0)       \n\t"
+            :: "r"(out[n]), "r"(delay[n]), "r"(ap_delay[0][n]),
+               "r"(transient_gain + n), "r"(cst)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",) "memory"
+        );
+    }
+}
+
+static void ps_stereo_interpolate_sse(float (*l)[2], float (*r)[2],
+                                      float h[2][4], float h_step[2][4],
+                                      int len)
+{
+    /* [h0, h0, h1, h1] and [h2, h2, h3, h3], then their steps */
+    LOCAL_ALIGNED_16(float, hv, [4], [4]);
+    int i;
+
+    if (len <= 0)
+        return;
+    for (i = 0; i < 2; i++) {
+        hv[0][i] = h[0][0];      hv[0][i + 2] = h[0][1];
+        hv[1][i] = h[0][2];      hv[1][i + 2] = h[0][3];
+        hv[2][i] = h_step[0][0]; hv[2][i + 2] = h_step[0][1];
+        hv[3][i] = h_step[0][2]; hv[3][i + 2] = h_step[0][3];
+    }
+
+    __asm__ volatile (
+        "movaps        (%3), %%xmm4     \n\t"
+        "movaps      16(%3), %%xmm5     \n\t"
+        "movaps      32(%3), %%xmm6     \n\t"
+        "movaps      48(%3), %%xmm7     \n\t"
+        "1:                             \n\t"
+        "addps       %%xmm6, %%xmm4     \n\t"
+        "addps       %%xmm7, %%xmm5     \n\t"
+        "xorps       %%xmm0, %%xmm0     \n\t"
+        "xorps       %%xmm1, %%xmm1     \n\t"
+        "movlps        (%0), %%xmm0     \n\t"
+        "movlps        (%1), %%xmm1     \n\t"
+        "movlhps     %%xmm0, %%xmm0     \n\t"
+        "movlhps     %%xmm1, %%xmm1     \n\t"
+        "mulps       %%xmm4, %%xmm0     \n\t"
+        "mulps       %%xmm5, %%xmm1     \n\t"
+        "addps       %%xmm1, %%xmm0     \n\t"
+        "movlps      %%xmm0, (%0)       \n\t"
+        "movhps      %%xmm0, (%1)       \n\t"
+        "add             $8, %0         \n\t"
+        "add             $8, %1         \n\t"
+        "sub             $1, %2         \n\t"
+        "jg              1b             \n\t"
+        : "+r"(l), "+r"(r), "+r"(len)
+        : "r"(hv)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm4", "%xmm5",
+                       "%xmm6", "%xmm7",) "memory"
+    );
+}
+
+static void ps_stereo_interpolate_ipdopd_sse(float (*l)[2], float (*r)[2],
+                                             float h[2][4], float h_step[2][4],
+                                             int len)
+{
+    /* [hx0, hx0, hx1, hx1] and [hx2, hx2, hx3, hx3] for both parts, their
+     * steps and the sign mask negating the real parts */
+    LOCAL_ALIGNED_16(float, hv, [9], [4]);
+    int i, j;
+
+    if (len <= 0)
+        return;
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < 2; i++) {
+            hv[2 * j    ][i] = h[j][0];      hv[2 * j    ][i + 2] = h[j][1];
+            hv[2 * j + 1][i] = h[j][2];      hv[2 * j + 1][i + 2] = h[j][3];
+            hv[2 * j + 4][i] = h_step[j][0]; hv[2 * j + 4][i + 2] = h_step[j][1];
+            hv[2 * j + 5][i] = h_step[j][2]; hv[2 * j + 5][i + 2] = h_step[j][3];
+        }
+        hv[8][2 * j] = -0.0f;
+        hv[8][2 * j + 1] = 0.0f;
+    }
+
+    __asm__ volatile (
+        "movaps        (%3), %%xmm4     \n\t" // h0x, real
+        "movaps      16(%3), %%xmm6     \n\t"
+        "movaps      32(%3), %%xmm5     \n\t" // h1x, imaginary
+        "movaps      48(%3), %%xmm7     \n\t"
+        "1:                             \n\t"
+        "addps       64(%3), %%xmm4     \n\t"
+        "addps       80(%3), %%xmm6     \n\t"
+        "addps       96(%3), %%xmm5     \n\t"
+        "addps      112(%3), %%xmm7     \n\t"
+        "xorps       %%xmm0, %%xmm0     \n\t"
+        "xorps       %%xmm1, %%xmm1     \n\t"
+        "movlps        (%0), %%xmm0     \n\t"
+        "movlps        (%1), %%xmm1     \n\t"
+        "movlhps     %%xmm0, %%xmm0     \n\t"
+        "movlhps     %%xmm1, %%xmm1     \n\t"
+        "movaps      %%xmm0, %%xmm2     \n\t"
+        "movaps      %%xmm1, %%xmm3     \n\t"
+        "shufps $0xb1, %%xmm2, %%xmm2   \n\t"
+        "shufps $0xb1, %%xmm3, %%xmm3   \n\t"
+        "xorps      128(%3), %%xmm2     \n\t"
+        "xorps      128(%3), %%xmm3     \n\t"
+        "mulps       %%xmm4, %%xmm0     \n\t"
+        "mulps       %%xmm6, %%xmm1     \n\t"
+        "mulps       %%xmm5, %%xmm2     \n\t"
+        "mulps       %%xmm7, %%xmm3     \n\t"
+        "addps       %%xmm1, %%xmm0     \n\t"
+        "addps       %%xmm2, %%xmm0     \n\t"
+        "addps       %%xmm3, %%xmm0     \n\t"
+        "movlps      %%xmm0, (%0)       \n\t"
+        "movhps      %%xmm0, (%1)       \n\t"
+        "add             $8, %0         \n\t"
+        "add             $8, %1         \n\t"
+        "sub             $1, %2         \n\t"
+        "jg              1b             \n\t"
+        : "+r"(l), "+r"(r), "+r"(len)
+        : "r"(hv)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+}
+#endif /* HAVE_SSE_INLINE */
+
+av_cold void ff_psdsp_init_x86(PSDSPContext *s)
+{
+#if HAVE_SSE_INLINE
+    int mm_flags = av_get_cpu_flags();
+
+    if (INLINE_SSE(mm_flags)) {
+        s->mul_pair_single        = ps_mul_pair_single_sse;
+        s->hybrid_analysis        = ps_hybrid_analysis_sse;
+        s->hybrid_analysis_ileave = ps_hybrid_analysis_ileave_sse;
+        s->hybrid_synthesis_deint = ps_hybrid_synthesis_deint_sse;
+        s->decorrelate            = ps_decorrelate_sse;
+        s->stereo_interpolate[0]  = ps_stereo_interpolate_sse;
+        s->stereo_interpolate[1]  = ps_stereo_interpolate_ipdopd_sse;
+    }
+#endif /* HAVE_SSE_INLINE */
+}
@@ -0,0 +1,166 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86/asm.h"
+#include "libavutil/x86/cpu.h"
+#include "libavcodec/dsputil.h"
+#include "libavcodec/dcadsp.h"
+
+#if HAVE_SSE_INLINE
+
+/* Load 4 rows of 4 coefficients at the offsets r0-r3 from %1 and transpose
+ * them, column c of the rows ends up in xmm0, xmm2, xmm4, xmm5 for
+ * c = 0, 1, 2, 3. */
+#define LOAD_T4(r0, r1, r2, r3)                 \
+    "movups  "r0"(%1), %%xmm0       \n\t"       \
+    "movups  "r1"(%1), %%xmm1       \n\t"       \
+    "movups  "r2"(%1), %%xmm2       \n\t"       \
+    "movups  "r3"(%1), %%xmm3       \n\t"       \
+    "movaps      %%xmm0, %%xmm4     \n\t"       \
+    "unpcklps    %%xmm1, %%xmm0     \n\t"       \
+    "unpckhps    %%xmm1, %%xmm4     \n\t"       \
+    "movaps      %%xmm2, %%xmm5     \n\t"       \
+    "unpcklps    %%xmm3, %%xmm2     \n\t"       \
+    "unpckhps    %%xmm3, %%xmm5     \n\t"       \
+    "movaps      %%xmm0, %%xmm1     \n\t"       \
+    "movlhps     %%xmm2, %%xmm0     \n\t"       \
+    "movhlps     %%xmm1, %%xmm2     \n\t"       \
+    "movaps      %%xmm4, %%xmm1     \n\t"       \
+    "movlhps     %%xmm5, %%xmm4     \n\t"       \
+    "movhlps     %%xmm1, %%xmm5     \n\t"
+
+/* Add the coefficients in c times the input sample at off in v to xmm6. */
+#define MAC(c, off)                             \
+    "movaps  "off"(%2), %%xmm7      \n\t"       \
+    "mulps       %%"c", %%xmm7      \n\t"       \
+    "addps       %%xmm7, %%xmm6     \n\t"
+
+#define OUT4                                    \
+    "mulps    128(%2), %%xmm6       \n\t"       \
+    "movups      %%xmm6, %0         \n\t"
+
+static void dca_lfe_fir_sse(float *out, const float *in, const float *coefs,
+                            int decifactor, float scale)
+{
+    /* the input samples, then the scale, each in all 4 lanes */
+    LOCAL_ALIGNED_16(float, v, [9], [4]);
+    float *out2 = out + decifactor;
+    const float *cf0 = coefs;
+    const float *cf1 = coefs + 256;
+    int taps = 256 / decifactor;
+    int j, k;
+
+    /* One decimated sample generates 2*decifactor interpolated ones. Each
+     * lane computes one of them, 4 of each half at once, and the products
+     * are added in the same order as in the C version. The coefficients
+     * of the 4 outputs are transposed so that each tap is in a column.
+     * The second half reads them backwards, so its rows are loaded in
+     * reverse and its columns are used from the last one. */
+    for (j = 0; j < taps; j++)
+        v[j][0] = v[j][1] = v[j][2] = v[j][3] = in[-j];
+    v[8][0] = v[8][1] = v[8][2] = v[8][3] = scale;
+
+    if (taps == 4) {
+        for (k = 0; k < decifactor; k += 4) {
+            cf1 -= 16;
+            __asm__ volatile (
+                "xorps       %%xmm6, %%xmm6     \n\t"
+                LOAD_T4("0", "16", "32", "48")
+                MAC("xmm0",  "0")
+                MAC("xmm2", "16")
+                MAC("xmm4", "32")
+                MAC("xmm5", "48")
+                OUT4
+                : "=m"(out[k])
+                : "r"(cf0), "r"(v)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                               "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+            );
+            __asm__ volatile (
+                "xorps       %%xmm6, %%xmm6     \n\t"
+                LOAD_T4("48", "32", "16", "0")
+                MAC("xmm5",  "0")
+                MAC("xmm4", "16")
+                MAC("xmm2", "32")
+                MAC("xmm0", "48")
+                OUT4
+                : "=m"(out2[k])
+                : "r"(cf1), "r"(v)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                               "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+            );
+            cf0 += 16;
+        }
+    } else {
+        for (k = 0; k < decifactor; k += 4) {
+            cf1 -= 32;
+            __asm__ volatile (
+                "xorps       %%xmm6, %%xmm6     \n\t"
+                LOAD_T4("0", "32", "64", "96")
+                MAC("xmm0",   "0")
+                MAC("xmm2",  "16")
+                MAC("xmm4",  "32")
+                MAC("xmm5",  "48")
+                LOAD_T4("16", "48", "80", "112")
+                MAC("xmm0",  "64")
+                MAC("xmm2",  "80")
+                MAC("xmm4",  "96")
+                MAC("xmm5", "112")
+                OUT4
+                : "=m"(out[k])
+                : "r"(cf0), "r"(v)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                               "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+            );
+            __asm__ volatile (
+                "xorps       %%xmm6, %%xmm6     \n\t"
+                LOAD_T4("112", "80", "48", "16")
+                MAC("xmm5",   "0")
+                MAC("xmm4",  "16")
+                MAC("xmm2",  "32")
+                MAC("xmm0",  "48")
+                LOAD_T4("96", "64", "32", "0")
+                MAC("xmm5",  "64")
+                MAC("xmm4",  "80")
+                MAC("xmm2",  "96")
+                MAC("xmm0", "112")
+                OUT4
+                : "=m"(out2[k])
+                : "r"(cf1), "r"(v)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                               "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+            );
+            cf0 += 32;
+        }
+    }
+}
+#endif /* HAVE_SSE_INLINE */
+
+av_cold void ff_dcadsp_init_x86(DCADSPContext *s)
+{
+#if HAVE_SSE_INLINE
+    int mm_flags = av_get_cpu_flags();
+
+    if (INLINE_SSE(mm_flags))
+        s->lfe_fir = dca_lfe_fir_sse;
+#endif /* HAVE_SSE_INLINE */
+}
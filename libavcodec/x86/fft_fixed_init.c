@@ -0,0 +1,635 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86/asm.h"
+#include "libavutil/x86/cpu.h"
+
+#define CONFIG_FFT_FLOAT 0
+#include "libavcodec/fft.h"
+#include "libavcodec/fft-internal.h"
+
+#if HAVE_SSE2_INLINE && ARCH_X86_64
+
+/* The split-radix FFT of fft.c with the same permutation and the same
+ * arithmetic: the butterflies are done on 32-bit lanes and the complex
+ * multiplications with pmaddwd, so the output is identical to the C code.
+ * Every value the C code stores in an FFTComplex is truncated to 16 bits
+ * the same way. */
+
+/* pmaddwd factors adding the real and imaginary part of the first element
+ * once more, so that its multiplication by cos(0) = 32767 becomes exact */
+DECLARE_ALIGNED(16, static const int16_t, fix_re)[8] = { 1, 0 };
+DECLARE_ALIGNED(16, static const int16_t, fix_im)[8] = { 0, 1 };
+
+/* the TRANSFORM of fft8 with wre = wim = sqrthalf, for z[5] and z[7] */
+DECLARE_ALIGNED(16, static const int16_t, sqrthalf_re)[8] = {
+     sqrthalf, sqrthalf, sqrthalf, -sqrthalf,
+};
+DECLARE_ALIGNED(16, static const int16_t, sqrthalf_im)[8] = {
+    -sqrthalf, sqrthalf, sqrthalf,  sqrthalf,
+};
+
+/* pack the 32-bit real parts in r and imaginary parts in i to FFTComplex
+ * in r, after a shift right by one */
+#define PACK(r, i)                              \
+    "pslld          $15, "r"            \n\t"   \
+    "psrld          $16, "r"            \n\t"   \
+    "psrad           $1, "i"            \n\t"   \
+    "pslld          $16, "i"            \n\t"   \
+    "por            "i", "r"            \n\t"
+
+/* sign extend the real parts of the FFTComplex in src to dst and the
+ * imaginary parts in src */
+#define UNPACK(src, dst)                        \
+    "movdqa       "src", "dst"          \n\t"   \
+    "pslld          $16, "dst"          \n\t"   \
+    "psrad          $16, "dst"          \n\t"   \
+    "psrad          $16, "src"          \n\t"
+
+/* Build the pmaddwd factors of 4 consecutive TRANSFORMs from %1 = wre and
+ * %2 = wim, which is read backwards:
+ * xmm11 = (wre, wim), xmm12 = (wre, -wim), xmm10 = (-wim, wre),
+ * xmm9  = (wim, wre) */
+#define PASS_FACTORS                                    \
+    "movq          (%1), %%xmm8             \n\t"       \
+    "movq        -6(%2), %%xmm9             \n\t"       \
+    "pshuflw $0x1b, %%xmm9, %%xmm9          \n\t"       \
+    "pxor       %%xmm10, %%xmm10            \n\t"       \
+    "psubw       %%xmm9, %%xmm10            \n\t"       \
+    "movdqa      %%xmm8, %%xmm11            \n\t"       \
+    "punpcklwd   %%xmm9, %%xmm11            \n\t"       \
+    "movdqa      %%xmm8, %%xmm12            \n\t"       \
+    "punpcklwd  %%xmm10, %%xmm12            \n\t"       \
+    "punpcklwd   %%xmm8, %%xmm10            \n\t"       \
+    "punpcklwd   %%xmm8, %%xmm9             \n\t"
+
+/* load z[0], z[o1], z[o2] and z[o3] and do the complex multiplications:
+ * xmm4 = t1, xmm2 = t2, xmm5 = t5, xmm3 = t6, not shifted yet */
+#define PASS_LOAD                                       \
+    "movdqu        (%0), %%xmm0             \n\t"       \
+    "movdqu    (%0, %4), %%xmm1             \n\t"       \
+    "movdqu (%0, %4, 2), %%xmm2             \n\t"       \
+    "movdqu    (%0, %5), %%xmm3             \n\t"       \
+    "movdqa      %%xmm2, %%xmm4             \n\t"       \
+    "movdqa      %%xmm3, %%xmm5             \n\t"       \
+    "pmaddwd    %%xmm11, %%xmm4             \n\t"       \
+    "pmaddwd    %%xmm10, %%xmm2             \n\t"       \
+    "pmaddwd    %%xmm12, %%xmm5             \n\t"       \
+    "pmaddwd     %%xmm9, %%xmm3             \n\t"
+
+/* turn the first TRANSFORM into TRANSFORM_ZERO */
+#define PASS_FIX_FIRST                                  \
+    "movdqu (%0, %4, 2), %%xmm6             \n\t"       \
+    "movdqu    (%0, %5), %%xmm7             \n\t"       \
+    "movdqa      %%xmm6, %%xmm8             \n\t"       \
+    "movdqa      %%xmm7, %%xmm13            \n\t"       \
+    "pmaddwd         %6, %%xmm6             \n\t"       \
+    "pmaddwd         %7, %%xmm8             \n\t"       \
+    "pmaddwd         %6, %%xmm7             \n\t"       \
+    "pmaddwd         %7, %%xmm13            \n\t"       \
+    "paddd       %%xmm6, %%xmm4             \n\t"       \
+    "paddd       %%xmm8, %%xmm2             \n\t"       \
+    "paddd       %%xmm7, %%xmm5             \n\t"       \
+    "paddd      %%xmm13, %%xmm3             \n\t"
+
+#define PASS_BUTTERFLIES                                \
+    "psrad          $15, %%xmm4             \n\t"       \
+    "psrad          $15, %%xmm2             \n\t"       \
+    "psrad          $15, %%xmm5             \n\t"       \
+    "psrad          $15, %%xmm3             \n\t"       \
+    "movdqa      %%xmm5, %%xmm6             \n\t"       \
+    "psubd       %%xmm4, %%xmm6             \n\t"       \
+    "paddd       %%xmm4, %%xmm5             \n\t"       \
+    "psrad           $1, %%xmm6             \n\t" /* t3 */ \
+    "psrad           $1, %%xmm5             \n\t" /* t5 */ \
+    "movdqa      %%xmm2, %%xmm4             \n\t"       \
+    "psubd       %%xmm3, %%xmm4             \n\t"       \
+    "paddd       %%xmm3, %%xmm2             \n\t"       \
+    "psrad           $1, %%xmm4             \n\t" /* t4 */ \
+    "psrad           $1, %%xmm2             \n\t" /* t6 */ \
+    UNPACK("%%xmm0", "%%xmm3")                          \
+    UNPACK("%%xmm1", "%%xmm7")                          \
+    "movdqa      %%xmm3, %%xmm8             \n\t"       \
+    "psubd       %%xmm5, %%xmm8             \n\t"       \
+    "paddd       %%xmm5, %%xmm3             \n\t"       \
+    "movdqa      %%xmm0, %%xmm5             \n\t"       \
+    "psubd       %%xmm2, %%xmm5             \n\t"       \
+    "paddd       %%xmm2, %%xmm0             \n\t"       \
+    "movdqa      %%xmm7, %%xmm2             \n\t"       \
+    "psubd       %%xmm4, %%xmm2             \n\t"       \
+    "paddd       %%xmm4, %%xmm7             \n\t"       \
+    "movdqa      %%xmm1, %%xmm4             \n\t"       \
+    "psubd       %%xmm6, %%xmm4             \n\t"       \
+    "paddd       %%xmm6, %%xmm1             \n\t"       \
+    PACK("%%xmm3", "%%xmm0")                            \
+    PACK("%%xmm7", "%%xmm1")                            \
+    PACK("%%xmm8", "%%xmm5")                            \
+    PACK("%%xmm2", "%%xmm4")                            \
+    "movdqu      %%xmm3,    (%0)            \n\t"       \
+    "movdqu      %%xmm7,    (%0, %4)        \n\t"       \
+    "movdqu      %%xmm8,    (%0, %4, 2)     \n\t"       \
+    "movdqu      %%xmm2,    (%0, %5)        \n\t"
+
+/* z[0...8n-1], w[1...2n-1], 4 TRANSFORMs at a time */
+static void pass_sse2(FFTComplex *z, const FFTSample *wre, unsigned int n)
+{
+    const FFTSample *wim = wre + 2 * n;
+    x86_reg o1 = 8 * n, o3 = 24 * n, i = n >> 1;
+
+    __asm__ volatile (
+        PASS_FACTORS
+        PASS_LOAD
+        PASS_FIX_FIRST
+        PASS_BUTTERFLIES
+        "jmp             2f                 \n\t"
+        "1:                                 \n\t"
+        PASS_FACTORS
+        PASS_LOAD
+        PASS_BUTTERFLIES
+        "2:                                 \n\t"
+        "add            $16, %0             \n\t"
+        "add             $8, %1             \n\t"
+        "sub             $8, %2             \n\t"
+        "sub             $1, %3             \n\t"
+        "jg              1b                 \n\t"
+        : "+r"(z), "+r"(wre), "+r"(wim), "+r"(i)
+        : "r"(o1), "r"(o3), "m"(*fix_re), "m"(*fix_im)
+        : XMM_CLOBBERS("%xmm0",  "%xmm1",  "%xmm2",  "%xmm3",
+                       "%xmm4",  "%xmm5",  "%xmm6",  "%xmm7",
+                       "%xmm8",  "%xmm9",  "%xmm10", "%xmm11",
+                       "%xmm12", "%xmm13",) "memory"
+    );
+}
+
+/* fft4 on the 4 rows of 4 FFTComplex in xmm0-3, xmm1 is only transformed
+ * by fft8, the other rows are returned in xmm1, xmm2 and xmm0 */
+#define FFT4                                            \
+    "movdqa      %%xmm0, %%xmm4             \n\t"       \
+    "punpckldq   %%xmm1, %%xmm4             \n\t"       \
+    "punpckhdq   %%xmm1, %%xmm0             \n\t"       \
+    "movdqa      %%xmm2, %%xmm5             \n\t"       \
+    "punpckldq   %%xmm3, %%xmm5             \n\t"       \
+    "punpckhdq   %%xmm3, %%xmm2             \n\t"       \
+    "movdqa      %%xmm4, %%xmm1             \n\t"       \
+    "punpcklqdq  %%xmm5, %%xmm1             \n\t"       \
+    "punpckhqdq  %%xmm5, %%xmm4             \n\t"       \
+    "movdqa      %%xmm0, %%xmm3             \n\t"       \
+    "punpcklqdq  %%xmm2, %%xmm3             \n\t"       \
+    "punpckhqdq  %%xmm2, %%xmm0             \n\t"       \
+    UNPACK("%%xmm1", "%%xmm2")                          \
+    UNPACK("%%xmm4", "%%xmm5")                          \
+    UNPACK("%%xmm3", "%%xmm6")                          \
+    UNPACK("%%xmm0", "%%xmm7")                          \
+    "movdqa      %%xmm2, %%xmm8             \n\t"       \
+    "paddd       %%xmm5, %%xmm8             \n\t"       \
+    "psubd       %%xmm5, %%xmm2             \n\t"       \
+    "movdqa      %%xmm1, %%xmm9             \n\t"       \
+    "paddd       %%xmm4, %%xmm9             \n\t"       \
+    "psubd       %%xmm4, %%xmm1             \n\t"       \
+    "movdqa      %%xmm7, %%xmm10            \n\t"       \
+    "paddd       %%xmm6, %%xmm10            \n\t"       \
+    "psubd       %%xmm6, %%xmm7             \n\t"       \
+    "movdqa      %%xmm3, %%xmm11            \n\t"       \
+    "paddd       %%xmm0, %%xmm11            \n\t"       \
+    "psubd       %%xmm0, %%xmm3             \n\t"       \
+    "psrad           $1, %%xmm8             \n\t" /* t1 */ \
+    "psrad           $1, %%xmm2             \n\t" /* t3 */ \
+    "psrad           $1, %%xmm9             \n\t" /* t2 */ \
+    "psrad           $1, %%xmm1             \n\t" /* t4 */ \
+    "psrad           $1, %%xmm10            \n\t" /* t6 */ \
+    "psrad           $1, %%xmm7             \n\t" /* t8 */ \
+    "psrad           $1, %%xmm11            \n\t" /* t5 */ \
+    "psrad           $1, %%xmm3             \n\t" /* t7 */ \
+    "movdqa      %%xmm8, %%xmm0             \n\t"       \
+    "paddd      %%xmm10, %%xmm0             \n\t"       \
+    "psubd      %%xmm10, %%xmm8             \n\t"       \
+    "movdqa      %%xmm9, %%xmm4             \n\t"       \
+    "paddd      %%xmm11, %%xmm4             \n\t"       \
+    "psubd      %%xmm11, %%xmm9             \n\t"       \
+    "movdqa      %%xmm2, %%xmm5             \n\t"       \
+    "paddd       %%xmm3, %%xmm5             \n\t"       \
+    "psubd       %%xmm3, %%xmm2             \n\t"       \
+    "movdqa      %%xmm1, %%xmm6             \n\t"       \
+    "paddd       %%xmm7, %%xmm6             \n\t"       \
+    "psubd       %%xmm7, %%xmm1             \n\t"       \
+    PACK("%%xmm0", "%%xmm4")                            \
+    PACK("%%xmm5", "%%xmm6")                            \
+    PACK("%%xmm8", "%%xmm9")                            \
+    PACK("%%xmm2", "%%xmm1")                            \
+    "movdqa      %%xmm0, %%xmm1             \n\t"       \
+    "punpckldq   %%xmm5, %%xmm1             \n\t"       \
+    "punpckhdq   %%xmm5, %%xmm0             \n\t"       \
+    "movdqa      %%xmm8, %%xmm3             \n\t"       \
+    "punpckldq   %%xmm2, %%xmm3             \n\t"       \
+    "punpckhdq   %%xmm2, %%xmm8             \n\t"       \
+    "movdqa      %%xmm0, %%xmm2             \n\t"       \
+    "punpcklqdq  %%xmm3, %%xmm1             \n\t"       \
+    "punpcklqdq  %%xmm8, %%xmm2             \n\t"       \
+    "punpckhqdq  %%xmm8, %%xmm0             \n\t"
+
+/* the rest of fft8 on z[0..3] in xmm1, after fft4, and on the untransformed
+ * z[4..7] in xmm15, the two rows are returned in xmm4 and xmm5.
+ * The two BUTTERFLIES are done side by side with
+ * (t1, t5) for z[4] and z[6] from the sums, and for z[5] and z[7] from
+ * the products with sqrthalf. */
+#define FFT8_END                                        \
+    "pshufd $0x88, %%xmm15, %%xmm4          \n\t"       \
+    "pshufd $0xdd, %%xmm15, %%xmm5          \n\t"       \
+    UNPACK("%%xmm4", "%%xmm6")                          \
+    UNPACK("%%xmm5", "%%xmm7")                          \
+    "movdqa      %%xmm6, %%xmm8             \n\t"       \
+    "paddd       %%xmm7, %%xmm8             \n\t"       \
+    "psubd       %%xmm7, %%xmm6             \n\t"       \
+    "movdqa      %%xmm4, %%xmm9             \n\t"       \
+    "paddd       %%xmm5, %%xmm9             \n\t"       \
+    "psubd       %%xmm5, %%xmm4             \n\t"       \
+    "psrad           $1, %%xmm8             \n\t"       \
+    "psrad           $1, %%xmm9             \n\t"       \
+    PACK("%%xmm6", "%%xmm4")                            \
+    "movdqa      %%xmm6, %%xmm7             \n\t"       \
+    "pmaddwd         %1, %%xmm6             \n\t"       \
+    "pmaddwd         %2, %%xmm7             \n\t"       \
+    "psrad          $15, %%xmm6             \n\t"       \
+    "psrad          $15, %%xmm7             \n\t"       \
+    "punpckldq   %%xmm6, %%xmm8             \n\t" /* t1 t1 t5 t5 */ \
+    "punpckldq   %%xmm7, %%xmm9             \n\t" /* t2 t2 t6 t6 */ \
+    "pshufd $0x4e, %%xmm8, %%xmm4           \n\t"       \
+    "pshufd $0x4e, %%xmm9, %%xmm5           \n\t"       \
+    "movdqa      %%xmm4, %%xmm6             \n\t"       \
+    "paddd       %%xmm8, %%xmm6             \n\t"       \
+    "psubd       %%xmm8, %%xmm4             \n\t"       \
+    "movdqa      %%xmm9, %%xmm7             \n\t"       \
+    "paddd       %%xmm5, %%xmm7             \n\t"       \
+    "psubd       %%xmm5, %%xmm9             \n\t"       \
+    "punpcklqdq  %%xmm9, %%xmm6             \n\t" /* t5 t5 t4 t4 */ \
+    "punpcklqdq  %%xmm4, %%xmm7             \n\t" /* t6 t6 t3 t3 */ \
+    "psrad           $1, %%xmm6             \n\t"       \
+    "psrad           $1, %%xmm7             \n\t"       \
+    UNPACK("%%xmm1", "%%xmm4")                          \
+    "movdqa      %%xmm4, %%xmm5             \n\t"       \
+    "paddd       %%xmm6, %%xmm4             \n\t"       \
+    "psubd       %%xmm6, %%xmm5             \n\t"       \
+    "movdqa      %%xmm1, %%xmm8             \n\t"       \
+    "paddd       %%xmm7, %%xmm1             \n\t"       \
+    "psubd       %%xmm7, %%xmm8             \n\t"       \
+    PACK("%%xmm4", "%%xmm1")                            \
+    PACK("%%xmm5", "%%xmm8")
+
+static void fft8_sse2(FFTComplex *z)
+{
+    __asm__ volatile (
+        "movdqu        (%0), %%xmm0         \n\t"
+        "movdqu      16(%0), %%xmm15        \n\t"
+        "movdqa      %%xmm0, %%xmm2         \n\t"
+        "movdqa     %%xmm15, %%xmm1         \n\t"
+        "movdqa     %%xmm15, %%xmm3         \n\t"
+        FFT4
+        FFT8_END
+        "movdqu      %%xmm4,   (%0)         \n\t"
+        "movdqu      %%xmm5, 16(%0)         \n\t"
+        :: "r"(z), "m"(*sqrthalf_re), "m"(*sqrthalf_im)
+        : XMM_CLOBBERS("%xmm0",  "%xmm1",  "%xmm2",  "%xmm3",
+                       "%xmm4",  "%xmm5",  "%xmm6",  "%xmm7",
+                       "%xmm8",  "%xmm9",  "%xmm10", "%xmm11",
+                       "%xmm15",) "memory"
+    );
+}
+
+static void fft16_sse2(FFTComplex *z)
+{
+    __asm__ volatile (
+        "movdqu        (%0), %%xmm0         \n\t"
+        "movdqu      16(%0), %%xmm1         \n\t"
+        "movdqu      32(%0), %%xmm2         \n\t"
+        "movdqu      48(%0), %%xmm3         \n\t"
+        "movdqa      %%xmm1, %%xmm15        \n\t"
+        FFT4
+        "movdqu      %%xmm2, 32(%0)         \n\t"
+        "movdqu      %%xmm0, 48(%0)         \n\t"
+        FFT8_END
+        "movdqu      %%xmm4,   (%0)         \n\t"
+        "movdqu      %%xmm5, 16(%0)         \n\t"
+        :: "r"(z), "m"(*sqrthalf_re), "m"(*sqrthalf_im)
+        : XMM_CLOBBERS("%xmm0",  "%xmm1",  "%xmm2",  "%xmm3",
+                       "%xmm4",  "%xmm5",  "%xmm6",  "%xmm7",
+                       "%xmm8",  "%xmm9",  "%xmm10", "%xmm11",
+                       "%xmm15",) "memory"
+    );
+    pass_sse2(z, FFT_NAME(ff_cos_16), 2);
+}
+
+#define DECL_FFT(n, n2, n4)                                     \
+static void fft ## n ## _sse2(FFTComplex *z)                    \
+{                                                               \
+    fft ## n2 ## _sse2(z);                                      \
+    fft ## n4 ## _sse2(z + n4 * 2);                             \
+    fft ## n4 ## _sse2(z + n4 * 3);                             \
+    pass_sse2(z, FFT_NAME(ff_cos_ ## n), n4 / 2);               \
+}
+
+DECL_FFT(32, 16, 8)
+DECL_FFT(64, 32, 16)
+DECL_FFT(128, 64, 32)
+DECL_FFT(256, 128, 64)
+DECL_FFT(512, 256, 128)
+DECL_FFT(1024, 512, 256)
+DECL_FFT(2048, 1024, 512)
+DECL_FFT(4096, 2048, 1024)
+DECL_FFT(8192, 4096, 2048)
+DECL_FFT(16384, 8192, 4096)
+DECL_FFT(32768, 16384, 8192)
+DECL_FFT(65536, 32768, 16384)
+
+static void (* const fft_dispatch_sse2[])(FFTComplex *) = {
+    fft16_sse2,    fft32_sse2,    fft64_sse2,    fft128_sse2,
+    fft256_sse2,   fft512_sse2,   fft1024_sse2,  fft2048_sse2,
+    fft4096_sse2,  fft8192_sse2,  fft16384_sse2, fft32768_sse2,
+    fft65536_sse2,
+};
+
+static void fft_fixed_calc_sse2(FFTContext *s, FFTComplex *z)
+{
+    fft_dispatch_sse2[s->nbits - 4](z);
+}
+
+#if CONFIG_MDCT
+
+DECLARE_ALIGNED(16, static const int32_t, dw_32768)[4] = {
+    32768, 32768, 32768, 32768,
+};
+
+/* sign extended even and reversed odd samples of 8 at ptr */
+#define LOAD_EVEN(ptr, dst)                             \
+    "movdqu      "ptr", "dst"               \n\t"       \
+    "pslld          $16, "dst"              \n\t"       \
+    "psrad          $16, "dst"              \n\t"
+
+#define LOAD_ODD_REV(ptr, dst)                          \
+    "movdqu      "ptr", "dst"               \n\t"       \
+    "psrad          $16, "dst"              \n\t"       \
+    "pshufd $0x1b, "dst", "dst"             \n\t"
+
+/* dst = (-a - b) >> 1 */
+#define NEG_SUM(a, b, dst)                              \
+    "pxor        "dst", "dst"               \n\t"       \
+    "psubd         "a", "dst"               \n\t"       \
+    "psubd         "b", "dst"               \n\t"       \
+    "psrad           $1, "dst"              \n\t"
+
+/* a = (a - b) >> 1 */
+#define DIFF(a, b)                                      \
+    "psubd         "b", "a"                 \n\t"       \
+    "psrad           $1, "a"                \n\t"
+
+/* CMUL of (re, im) in xmm2 and xmm3 with (-tcos, tsin) at %2 and %3, the
+ * result is stored to %1. re and im may be 32768, which does not fit in
+ * the 16 bits of pmaddwd, so those are multiplied as -32768 and corrected
+ * with the products of the lanes where they are. */
+#define PREROT_CMUL                                     \
+    "movq          (%2), %%xmm4             \n\t"       \
+    "movq          (%3), %%xmm5             \n\t"       \
+    "pxor        %%xmm6, %%xmm6             \n\t"       \
+    "pxor        %%xmm7, %%xmm7             \n\t"       \
+    "psubw       %%xmm4, %%xmm6             \n\t"       \
+    "psubw       %%xmm5, %%xmm7             \n\t"       \
+    "punpcklwd   %%xmm7, %%xmm6             \n\t" /* (-tcos, -tsin) */ \
+    "punpcklwd   %%xmm4, %%xmm7             \n\t"       \
+    "pxor        %%xmm4, %%xmm4             \n\t"       \
+    "psubw       %%xmm7, %%xmm4             \n\t" /* ( tsin, -tcos) */ \
+    "movdqa      %%xmm2, %%xmm0             \n\t"       \
+    "movdqa      %%xmm3, %%xmm1             \n\t"       \
+    "pslld          $16, %%xmm0             \n\t"       \
+    "psrld          $16, %%xmm0             \n\t"       \
+    "pslld          $16, %%xmm1             \n\t"       \
+    "por         %%xmm1, %%xmm0             \n\t"       \
+    "pcmpeqd         %4, %%xmm2             \n\t"       \
+    "pcmpeqd         %4, %%xmm3             \n\t"       \
+    "psrld          $16, %%xmm2             \n\t"       \
+    "pslld          $16, %%xmm3             \n\t"       \
+    "por         %%xmm3, %%xmm2             \n\t"       \
+    "movdqa      %%xmm0, %%xmm1             \n\t"       \
+    "movdqa      %%xmm2, %%xmm3             \n\t"       \
+    "pmaddwd     %%xmm6, %%xmm0             \n\t"       \
+    "pmaddwd     %%xmm4, %%xmm1             \n\t"       \
+    "pmaddwd     %%xmm6, %%xmm2             \n\t"       \
+    "pmaddwd     %%xmm4, %%xmm3             \n\t"       \
+    "pslld          $16, %%xmm2             \n\t"       \
+    "pslld          $16, %%xmm3             \n\t"       \
+    "psubd       %%xmm2, %%xmm0             \n\t"       \
+    "psubd       %%xmm3, %%xmm1             \n\t"       \
+    "psrad          $15, %%xmm0             \n\t"       \
+    "psrad          $15, %%xmm1             \n\t"       \
+    "pslld          $16, %%xmm0             \n\t"       \
+    "psrld          $16, %%xmm0             \n\t"       \
+    "pslld          $16, %%xmm1             \n\t"       \
+    "por         %%xmm1, %%xmm0             \n\t"       \
+    "movdqa      %%xmm0, (%1)               \n\t"
+
+static void mdct_prerot_sse2(FFTContext *s, FFTComplex *x,
+                             const FFTSample *input)
+{
+    DECLARE_ALIGNED(16, FFTComplex, tmp)[8];
+    const uint16_t *revtab = s->revtab;
+    const FFTSample *tcos = s->tcos;
+    const FFTSample *tsin = s->tsin;
+    const FFTSample *in1, *in2;
+    int n  = 1 << s->mdct_bits;
+    int n2 = n >> 1, n4 = n >> 2, n8 = n >> 3, n3 = 3 * n4;
+    int i, k;
+
+    for (i = 0; i < n8; i += 4) {
+        /* re = (-in[n3 + 2i] - in[n3 - 1 - 2i]) >> 1,
+         * im = (-in[n4 + 2i] + in[n4 - 1 - 2i]) >> 1 */
+        in1 = input + 2 * i;
+        in2 = input - 2 * i;
+        __asm__ volatile (
+            LOAD_EVEN("%5", "%%xmm0")
+            LOAD_ODD_REV("%6", "%%xmm1")
+            NEG_SUM("%%xmm0", "%%xmm1", "%%xmm2")
+            LOAD_EVEN("%7", "%%xmm0")
+            LOAD_ODD_REV("%8", "%%xmm3")
+            DIFF("%%xmm3", "%%xmm0")
+            PREROT_CMUL
+            :: "r"(tmp), "r"(tmp), "r"(tcos + i), "r"(tsin + i),
+               "m"(*dw_32768), "m"(in1[n3]), "m"(in2[n3 - 8]),
+               "m"(in1[n4]), "m"(in2[n4 - 8])
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+        /* re = ( in[2i] - in[n2 - 1 - 2i]) >> 1,
+         * im = (-in[n2 + 2i] - in[n - 1 - 2i]) >> 1 */
+        __asm__ volatile (
+            LOAD_EVEN("%5", "%%xmm2")
+            LOAD_ODD_REV("%6", "%%xmm0")
+            DIFF("%%xmm2", "%%xmm0")
+            LOAD_EVEN("%7", "%%xmm0")
+            LOAD_ODD_REV("%8", "%%xmm1")
+            NEG_SUM("%%xmm0", "%%xmm1", "%%xmm3")
+            PREROT_CMUL
+            :: "r"(tmp), "r"(tmp + 4), "r"(tcos + n8 + i),
+               "r"(tsin + n8 + i), "m"(*dw_32768), "m"(in1[0]),
+               "m"(in2[n2 - 8]), "m"(in1[n2]), "m"(in2[n - 8])
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+        for (k = 0; k < 4; k++) {
+            x[revtab[i + k]]      = tmp[k];
+            x[revtab[n8 + i + k]] = tmp[k + 4];
+        }
+    }
+}
+
+/* CMUL/CMULL of x[n8 - i - 1 - k] and x[n8 + i + k], k = 0..3, in %0 and %1
+ * with (-tsin, -tcos) from %2-%5: xmm0 = r0, xmm1 = i0, xmm2 = r1,
+ * xmm3 = i1, not shifted */
+#define POSTROT_CMUL                                    \
+    "movdqu        (%0), %%xmm0             \n\t"       \
+    "movdqu        (%1), %%xmm2             \n\t"       \
+    "pshufd $0x1b, %%xmm0, %%xmm0           \n\t"       \
+    "movq          (%2), %%xmm4             \n\t"       \
+    "movq          (%3), %%xmm5             \n\t"       \
+    "movq          (%4), %%xmm6             \n\t"       \
+    "movq          (%5), %%xmm7             \n\t"       \
+    "pshuflw $0x1b, %%xmm4, %%xmm4          \n\t"       \
+    "pshuflw $0x1b, %%xmm5, %%xmm5          \n\t"       \
+    "pxor        %%xmm8, %%xmm8             \n\t"       \
+    "pxor        %%xmm9, %%xmm9             \n\t"       \
+    "psubw       %%xmm5, %%xmm8             \n\t"       \
+    "psubw       %%xmm7, %%xmm9             \n\t"       \
+    "punpcklwd   %%xmm4, %%xmm5             \n\t" /* ( tsin,  tcos) */ \
+    "punpcklwd   %%xmm6, %%xmm7             \n\t"       \
+    "pxor       %%xmm10, %%xmm10            \n\t"       \
+    "pxor       %%xmm11, %%xmm11            \n\t"       \
+    "psubw       %%xmm5, %%xmm10            \n\t" /* (-tsin, -tcos) */ \
+    "psubw       %%xmm7, %%xmm11            \n\t"       \
+    "punpcklwd   %%xmm4, %%xmm8             \n\t" /* (-tsin,  tcos) */ \
+    "punpcklwd   %%xmm6, %%xmm9             \n\t"       \
+    "pshuflw $0xb1, %%xmm10, %%xmm10        \n\t"       \
+    "pshuflw $0xb1, %%xmm11, %%xmm11        \n\t"       \
+    "pshufhw $0xb1, %%xmm10, %%xmm10        \n\t" /* (-tcos, -tsin) */ \
+    "pshufhw $0xb1, %%xmm11, %%xmm11        \n\t"       \
+    "movdqa      %%xmm0, %%xmm3             \n\t"       \
+    "movdqa      %%xmm2, %%xmm1             \n\t"       \
+    "pmaddwd     %%xmm8, %%xmm3             \n\t"       \
+    "pmaddwd    %%xmm10, %%xmm0             \n\t"       \
+    "pmaddwd     %%xmm9, %%xmm1             \n\t"       \
+    "pmaddwd    %%xmm11, %%xmm2             \n\t"
+
+static void mdct_calc_sse2(FFTContext *s, FFTSample *out,
+                           const FFTSample *input)
+{
+    FFTComplex *x = (FFTComplex *)out;
+    const FFTSample *tcos = s->tcos;
+    const FFTSample *tsin = s->tsin;
+    int n8 = 1 << s->mdct_bits >> 3;
+    int i;
+
+    mdct_prerot_sse2(s, x, input);
+    s->fft_calc(s, x);
+
+    for (i = 0; i < n8; i += 4) {
+        __asm__ volatile (
+            POSTROT_CMUL
+            "psrad          $15, %%xmm0         \n\t"
+            "psrad          $15, %%xmm1         \n\t"
+            "psrad          $15, %%xmm2         \n\t"
+            "psrad          $15, %%xmm3         \n\t"
+            "pslld          $16, %%xmm0         \n\t"
+            "psrld          $16, %%xmm0         \n\t"
+            "pslld          $16, %%xmm1         \n\t"
+            "por         %%xmm1, %%xmm0         \n\t"
+            "pslld          $16, %%xmm2         \n\t"
+            "psrld          $16, %%xmm2         \n\t"
+            "pslld          $16, %%xmm3         \n\t"
+            "por         %%xmm3, %%xmm2         \n\t"
+            "pshufd $0x1b, %%xmm0, %%xmm0       \n\t"
+            "movdqu      %%xmm0, (%0)           \n\t"
+            "movdqu      %%xmm2, (%1)           \n\t"
+            :: "r"(x + n8 - i - 4), "r"(x + n8 + i),
+               "r"(tcos + n8 - i - 4), "r"(tsin + n8 - i - 4),
+               "r"(tcos + n8 + i), "r"(tsin + n8 + i)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",  "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6",  "%xmm7",
+                           "%xmm8", "%xmm9", "%xmm10", "%xmm11",) "memory"
+        );
+    }
+}
+
+static void mdct_calcw_sse2(FFTContext *s, FFTDouble *out,
+                            const FFTSample *input)
+{
+    FFTComplex *x = s->tmp_buf;
+    FFTDComplex *o = (FFTDComplex *)out;
+    const FFTSample *tcos = s->tcos;
+    const FFTSample *tsin = s->tsin;
+    int n8 = 1 << s->mdct_bits >> 3;
+    int i;
+
+    mdct_prerot_sse2(s, x, input);
+    s->fft_calc(s, x);
+
+    for (i = 0; i < n8; i += 4) {
+        __asm__ volatile (
+            POSTROT_CMUL
+            "pshufd $0x1b, %%xmm0, %%xmm0       \n\t"
+            "pshufd $0x1b, %%xmm1, %%xmm1       \n\t"
+            "movdqa      %%xmm0, %%xmm4         \n\t"
+            "movdqa      %%xmm2, %%xmm5         \n\t"
+            "punpckldq   %%xmm1, %%xmm0         \n\t"
+            "punpckhdq   %%xmm1, %%xmm4         \n\t"
+            "punpckldq   %%xmm3, %%xmm2         \n\t"
+            "punpckhdq   %%xmm3, %%xmm5         \n\t"
+            "movdqu      %%xmm0,   (%6)         \n\t"
+            "movdqu      %%xmm4, 16(%6)         \n\t"
+            "movdqu      %%xmm2,   (%7)         \n\t"
+            "movdqu      %%xmm5, 16(%7)         \n\t"
+            :: "r"(x + n8 - i - 4), "r"(x + n8 + i),
+               "r"(tcos + n8 - i - 4), "r"(tsin + n8 - i - 4),
+               "r"(tcos + n8 + i), "r"(tsin + n8 + i),
+               "r"(o + n8 - i - 4), "r"(o + n8 + i)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",  "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6",  "%xmm7",
+                           "%xmm8", "%xmm9", "%xmm10", "%xmm11",) "memory"
+        );
+    }
+}
+
+#endif /* CONFIG_MDCT */
+
+#endif /* HAVE_SSE2_INLINE && ARCH_X86_64 */
+
+av_cold void ff_fft_fixed_init_x86(FFTContext *s)
+{
+#if HAVE_SSE2_INLINE && ARCH_X86_64
+    int cpu_flags = av_get_cpu_flags();
+
+    if (INLINE_SSE2(cpu_flags) && s->nbits >= 4) {
+        s->fft_calc = fft_fixed_calc_sse2;
+#if CONFIG_MDCT
+        if (!s->inverse) {
+            s->mdct_calc  = mdct_calc_sse2;
+            s->mdct_calcw = mdct_calcw_sse2;
+        }
+#endif
+    }
+#endif /* HAVE_SSE2_INLINE && ARCH_X86_64 */
+}
@@ -16,12 +16,177 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
 #include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86/asm.h"
 #include "libavutil/x86/cpu.h"
 #include "libavcodec/dsputil.h"
 #include "libavcodec/dct.h"
 #include "fft.h"
 
+#if HAVE_AVX2_INLINE && ARCH_X86_64 && CONFIG_MDCT
+
+/* The loads below split 8 complex values into the real and the imaginary
+ * parts with vshufps, which leaves them in the order 0 1 4 5 2 3 6 7.
+ * The rotation factors are loaded in the same order with vpermpd and
+ * vunpck[lh]ps of two such vectors gives back the complex values in order.
+ * In that order, reversing the 8 values is reversing the lanes. */
+
+DECLARE_ALIGNED(32, static const uint32_t, sign_mask)[8] = {
+    0x80000000, 0x80000000, 0x80000000, 0x80000000,
+    0x80000000, 0x80000000, 0x80000000, 0x80000000,
+};
+DECLARE_ALIGNED(32, static const uint32_t, perm_rev)[8] = {
+    7, 6, 5, 4, 3, 2, 1, 0,
+};
+
+/* in[2k] and in[15 - 2k], k = 0..7, of the 16 samples at ptr,
+ * the reversal uses the indexes in ymm7 */
+#define LOAD_EVEN(ptr, dst)                             \
+    "vmovups          "ptr", "dst"              \n\t"   \
+    "vshufps $0x88, 32"ptr", "dst", "dst"       \n\t"
+
+#define LOAD_ODD_REV(ptr, dst)                          \
+    "vmovups          "ptr", "dst"              \n\t"   \
+    "vshufps $0xdd, 32"ptr", "dst", "dst"       \n\t"   \
+    "vpermps      "dst", %%ymm7, "dst"          \n\t"
+
+/* CMUL of (re, im) in ymm0 and ymm1 with (-tcos, tsin) at %1 and %2,
+ * ymm6 holds the sign mask. The 8 results are stored to %0. */
+#define PREROT_CMUL                                     \
+    "vpermpd $0xd8,    (%1), %%ymm2             \n\t"   \
+    "vpermpd $0xd8,    (%2), %%ymm3             \n\t"   \
+    "vxorps      %%ymm6, %%ymm2, %%ymm2         \n\t"   \
+    "vmulps      %%ymm2, %%ymm0, %%ymm4         \n\t"   \
+    "vmulps      %%ymm3, %%ymm1, %%ymm5         \n\t"   \
+    "vsubps      %%ymm5, %%ymm4, %%ymm4         \n\t"   \
+    "vmulps      %%ymm3, %%ymm0, %%ymm0         \n\t"   \
+    "vmulps      %%ymm2, %%ymm1, %%ymm1         \n\t"   \
+    "vaddps      %%ymm1, %%ymm0, %%ymm0         \n\t"   \
+    "vunpcklps   %%ymm0, %%ymm4, %%ymm1         \n\t"   \
+    "vunpckhps   %%ymm0, %%ymm4, %%ymm4         \n\t"   \
+    "vmovups     %%ymm1,   (%0)                 \n\t"   \
+    "vmovups     %%ymm4, 32(%0)                 \n\t"   \
+    "vzeroupper                                 \n\t"
+
+/* CMUL of the 8 complex values at ptr with (-tsin, -tcos) at ts and tc:
+ * p = re * -tsin - im * -tcos, q = re * -tcos + im * -tsin.
+ * Uses ymm0 and ymm1 as temporaries, ymm6 holds the sign mask. */
+#define POSTROT_CMUL(ptr, tc, ts, p, q, t0, t1)         \
+    "vmovups       "ptr", %%ymm0                \n\t"   \
+    "vmovups     32"ptr", %%ymm1                \n\t"   \
+    "vshufps $0xdd, %%ymm1, %%ymm0, "q"         \n\t"   \
+    "vshufps $0x88, %%ymm1, %%ymm0, "p"         \n\t"   \
+    "vpermpd $0xd8,  "tc", "t0"                 \n\t"   \
+    "vpermpd $0xd8,  "ts", "t1"                 \n\t"   \
+    "vxorps      %%ymm6, "t0", "t0"             \n\t"   \
+    "vxorps      %%ymm6, "t1", "t1"             \n\t"   \
+    "vmulps        "t1", "p", %%ymm0            \n\t"   \
+    "vmulps        "t0", "q", %%ymm1            \n\t"   \
+    "vmulps        "t0", "p", "p"               \n\t"   \
+    "vmulps        "t1", "q", "q"               \n\t"   \
+    "vaddps         "q", "p", "q"               \n\t"   \
+    "vsubps      %%ymm1, %%ymm0, "p"            \n\t"
+
+static void mdct_calc_avx2(FFTContext *s, FFTSample *out,
+                           const FFTSample *input)
+{
+    DECLARE_ALIGNED(32, FFTComplex, tmp)[16];
+    FFTComplex *x = (FFTComplex *)out;
+    const uint16_t *revtab = s->revtab;
+    const FFTSample *tcos = s->tcos;
+    const FFTSample *tsin = s->tsin;
+    const FFTSample *in1, *in2;
+    int n  = 1 << s->mdct_bits;
+    int n2 = n >> 1, n4 = n >> 2, n8 = n >> 3, n3 = 3 * n4;
+    int i, k;
+
+    for (i = 0; i < n8; i += 8) {
+        /* re = -in[n3 + 2i] - in[n3 - 1 - 2i],
+         * im = -in[n4 + 2i] + in[n4 - 1 - 2i] */
+        in1 = input + 2 * i;
+        in2 = input - 2 * i;
+        __asm__ volatile (
+            "vmovaps         %4, %%ymm7         \n\t"
+            "vmovaps         %3, %%ymm6         \n\t"
+            LOAD_EVEN("(%5)", "%%ymm0")
+            LOAD_ODD_REV("(%6)", "%%ymm1")
+            "vxorps      %%ymm6, %%ymm0, %%ymm0 \n\t"
+            "vsubps      %%ymm1, %%ymm0, %%ymm0 \n\t"
+            LOAD_EVEN("(%7)", "%%ymm1")
+            LOAD_ODD_REV("(%8)", "%%ymm2")
+            "vsubps      %%ymm1, %%ymm2, %%ymm1 \n\t"
+            PREROT_CMUL
+            :: "r"(tmp), "r"(tcos + i), "r"(tsin + i),
+               "m"(*sign_mask), "m"(*perm_rev),
+               "r"(in1 + n3), "r"(in2 + n3 - 16),
+               "r"(in1 + n4), "r"(in2 + n4 - 16)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+        /* re =  in[2i] - in[n2 - 1 - 2i],
+         * im = -in[n2 + 2i] - in[n - 1 - 2i] */
+        __asm__ volatile (
+            "vmovaps         %4, %%ymm7         \n\t"
+            "vmovaps         %3, %%ymm6         \n\t"
+            LOAD_EVEN("(%5)", "%%ymm0")
+            LOAD_ODD_REV("(%6)", "%%ymm1")
+            "vsubps      %%ymm1, %%ymm0, %%ymm0 \n\t"
+            LOAD_EVEN("(%7)", "%%ymm1")
+            LOAD_ODD_REV("(%8)", "%%ymm2")
+            "vxorps      %%ymm6, %%ymm1, %%ymm1 \n\t"
+            "vsubps      %%ymm2, %%ymm1, %%ymm1 \n\t"
+            PREROT_CMUL
+            :: "r"(tmp + 8), "r"(tcos + n8 + i), "r"(tsin + n8 + i),
+               "m"(*sign_mask), "m"(*perm_rev),
+               "r"(in1), "r"(in2 + n2 - 16),
+               "r"(in1 + n2), "r"(in2 + n - 16)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+        for (k = 0; k < 8; k++) {
+            x[revtab[i + k]]      = tmp[k];
+            x[revtab[n8 + i + k]] = tmp[k + 8];
+        }
+    }
+
+    s->fft_calc(s, x);
+
+    /* x[n8 - i - 1 - k] = (q of itself, p of x[n8 + i + k]) and
+     * x[n8 + i + k]     = (q of itself, p of x[n8 - i - 1 - k]) */
+    for (i = 0; i < n8; i += 8) {
+        __asm__ volatile (
+            "vmovaps         %6, %%ymm6         \n\t"
+            "vmovaps         %7, %%ymm7         \n\t"
+            POSTROT_CMUL("(%0)", "(%2)", "(%3)",
+                         "%%ymm2", "%%ymm3", "%%ymm4", "%%ymm5")
+            POSTROT_CMUL("(%1)", "(%4)", "(%5)",
+                         "%%ymm8", "%%ymm9", "%%ymm4", "%%ymm5")
+            "vpermps     %%ymm2, %%ymm7, %%ymm2 \n\t"
+            "vpermps     %%ymm8, %%ymm7, %%ymm8 \n\t"
+            "vunpcklps   %%ymm8, %%ymm3, %%ymm0 \n\t"
+            "vunpckhps   %%ymm8, %%ymm3, %%ymm1 \n\t"
+            "vunpcklps   %%ymm2, %%ymm9, %%ymm4 \n\t"
+            "vunpckhps   %%ymm2, %%ymm9, %%ymm5 \n\t"
+            "vmovups     %%ymm0,   (%0)         \n\t"
+            "vmovups     %%ymm1, 32(%0)         \n\t"
+            "vmovups     %%ymm4,   (%1)         \n\t"
+            "vmovups     %%ymm5, 32(%1)         \n\t"
+            "vzeroupper                         \n\t"
+            :: "r"(x + n8 - i - 8), "r"(x + n8 + i),
+               "r"(tcos + n8 - i - 8), "r"(tsin + n8 - i - 8),
+               "r"(tcos + n8 + i), "r"(tsin + n8 + i),
+               "m"(*sign_mask), "m"(*perm_rev)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",
+                           "%xmm8", "%xmm9",) "memory"
+        );
+    }
+}
+
+#endif /* HAVE_AVX2_INLINE && ARCH_X86_64 && CONFIG_MDCT */
+
 av_cold void ff_fft_init_x86(FFTContext *s)
 {
     int has_vectors = av_get_cpu_flags();
@@ -53,6 +218,12 @@ av_cold void ff_fft_init_x86(FFTContext *s)
         s->fft_calc        = ff_fft_calc_avx;
         s->fft_permutation = FF_FFT_PERM_AVX;
     }
+#if HAVE_AVX2_INLINE && ARCH_X86_64 && CONFIG_MDCT
+    if (INLINE_AVX2(has_vectors) && s->nbits >= 4 && !s->inverse) {
+        /* AVX2 for Haswell, the rotations around whichever FFT is set */
+        s->mdct_calc       = mdct_calc_avx2;
+    }
+#endif
 }
 
 #if CONFIG_DCT
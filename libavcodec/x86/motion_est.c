@@ -121,6 +121,118 @@ static int sad16_sse2(void *v, uint8_t *blk2, uint8_t *blk1, int stride, int h)
     return ret;
 }
 
+#if HAVE_7REGS
+/* sum the two halves of the 4 accumulators and store them as 4 ints */
+#define SAD_X4_STORE(out)\
+        "movhlps %%xmm4, %%xmm0         \n\t"\
+        "movhlps %%xmm5, %%xmm1         \n\t"\
+        "movhlps %%xmm6, %%xmm2         \n\t"\
+        "movhlps %%xmm7, %%xmm3         \n\t"\
+        "paddw   %%xmm0, %%xmm4         \n\t"\
+        "paddw   %%xmm1, %%xmm5         \n\t"\
+        "paddw   %%xmm2, %%xmm6         \n\t"\
+        "paddw   %%xmm3, %%xmm7         \n\t"\
+        "punpckldq  %%xmm5, %%xmm4      \n\t"\
+        "punpckldq  %%xmm7, %%xmm6      \n\t"\
+        "punpcklqdq %%xmm6, %%xmm4      \n\t"\
+        "movdqa  %%xmm4, "#out"         \n\t"
+
+static void sad16_x4_sse2(uint8_t *blk1, uint8_t *const blk2[4],
+                          int stride, int h, int scores[4])
+{
+    DECLARE_ALIGNED(16, int, res)[4];
+    uint8_t *r0 = blk2[0], *r1 = blk2[1], *r2 = blk2[2], *r3 = blk2[3];
+
+    __asm__ volatile(
+        "pxor %%xmm4, %%xmm4            \n\t"
+        "pxor %%xmm5, %%xmm5            \n\t"
+        "pxor %%xmm6, %%xmm6            \n\t"
+        "pxor %%xmm7, %%xmm7            \n\t"
+        ".p2align 4                     \n\t"
+        "1:                             \n\t"
+        "movdqa (%2), %%xmm0            \n\t"
+        "movdqu (%3), %%xmm1            \n\t"
+        "movdqu (%4), %%xmm2            \n\t"
+        "movdqu (%5), %%xmm3            \n\t"
+        "psadbw %%xmm0, %%xmm1          \n\t"
+        "psadbw %%xmm0, %%xmm2          \n\t"
+        "psadbw %%xmm0, %%xmm3          \n\t"
+        "paddw  %%xmm1, %%xmm4          \n\t"
+        "paddw  %%xmm2, %%xmm5          \n\t"
+        "paddw  %%xmm3, %%xmm6          \n\t"
+        "movdqu (%6), %%xmm1            \n\t"
+        "psadbw %%xmm0, %%xmm1          \n\t"
+        "paddw  %%xmm1, %%xmm7          \n\t"
+        "add %7, %2                     \n\t"
+        "add %7, %3                     \n\t"
+        "add %7, %4                     \n\t"
+        "add %7, %5                     \n\t"
+        "add %7, %6                     \n\t"
+        "sub $1, %1                     \n\t"
+        " jg 1b                         \n\t"
+        SAD_X4_STORE(%0)
+        : "=m"(res), "+r"(h), "+r"(blk1), "+r"(r0), "+r"(r1), "+r"(r2), "+r"(r3)
+        : "r"((x86_reg)stride)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+    scores[0] = res[0];
+    scores[1] = res[1];
+    scores[2] = res[2];
+    scores[3] = res[3];
+}
+
+static void sad8_x4_sse2(uint8_t *blk1, uint8_t *const blk2[4],
+                         int stride, int h, int scores[4])
+{
+    DECLARE_ALIGNED(16, int, res)[4];
+    uint8_t *r0 = blk2[0], *r1 = blk2[1], *r2 = blk2[2], *r3 = blk2[3];
+
+    __asm__ volatile(
+        "pxor %%xmm4, %%xmm4            \n\t"
+        "pxor %%xmm5, %%xmm5            \n\t"
+        "pxor %%xmm6, %%xmm6            \n\t"
+        "pxor %%xmm7, %%xmm7            \n\t"
+        ".p2align 4                     \n\t"
+        "1:                             \n\t"
+        "movq   (%2), %%xmm0            \n\t"
+        "movhps (%2, %7), %%xmm0        \n\t"
+        "movq   (%3), %%xmm1            \n\t"
+        "movhps (%3, %7), %%xmm1        \n\t"
+        "movq   (%4), %%xmm2            \n\t"
+        "movhps (%4, %7), %%xmm2        \n\t"
+        "movq   (%5), %%xmm3            \n\t"
+        "movhps (%5, %7), %%xmm3        \n\t"
+        "psadbw %%xmm0, %%xmm1          \n\t"
+        "psadbw %%xmm0, %%xmm2          \n\t"
+        "psadbw %%xmm0, %%xmm3          \n\t"
+        "paddw  %%xmm1, %%xmm4          \n\t"
+        "paddw  %%xmm2, %%xmm5          \n\t"
+        "paddw  %%xmm3, %%xmm6          \n\t"
+        "movq   (%6), %%xmm1            \n\t"
+        "movhps (%6, %7), %%xmm1        \n\t"
+        "psadbw %%xmm0, %%xmm1          \n\t"
+        "paddw  %%xmm1, %%xmm7          \n\t"
+        "lea (%2, %7, 2), %2            \n\t"
+        "lea (%3, %7, 2), %3            \n\t"
+        "lea (%4, %7, 2), %4            \n\t"
+        "lea (%5, %7, 2), %5            \n\t"
+        "lea (%6, %7, 2), %6            \n\t"
+        "sub $2, %1                     \n\t"
+        " jg 1b                         \n\t"
+        SAD_X4_STORE(%0)
+        : "=m"(res), "+r"(h), "+r"(blk1), "+r"(r0), "+r"(r1), "+r"(r2), "+r"(r3)
+        : "r"((x86_reg)stride)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+    scores[0] = res[0];
+    scores[1] = res[1];
+    scores[2] = res[2];
+    scores[3] = res[3];
+}
+#endif /* HAVE_7REGS */
+
 static inline void sad8_x2a_mmxext(uint8_t *blk1, uint8_t *blk2,
                                    int stride, int h)
 {
@@ -468,6 +580,10 @@ void ff_dsputil_init_pix_mmx(DSPContext* c, AVCodecContext *avctx)
     }
     if ((mm_flags & AV_CPU_FLAG_SSE2) && !(mm_flags & AV_CPU_FLAG_3DNOW)) {
         c->sad[0]= sad16_sse2;
+#if HAVE_7REGS
+        c->sad_x4[0] = sad16_x4_sse2;
+        c->sad_x4[1] = sad8_x4_sse2;
+#endif
     }
 #endif /* HAVE_INLINE_ASM */
 }
@@ -0,0 +1,106 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86/asm.h"
+#include "libavutil/x86/cpu.h"
+#include "libavcodec/synth_filter.h"
+
+#if HAVE_SSE_INLINE
+static void synth_filter_sse(FFTContext *imdct,
+                             float *synth_buf_ptr, int *synth_buf_offset,
+                             float synth_buf2[32], const float window[512],
+                             float out[32], const float in[32], float scale)
+{
+    float *synth_buf = synth_buf_ptr + *synth_buf_offset;
+    int i;
+
+    imdct->imdct_half(imdct, synth_buf, in);
+
+    /* 4 outputs of each half at a time, accumulated in the same order as
+     * the C version, the window index wraps around the 512-sample buffer */
+    for (i = 0; i < 16; i += 4) {
+        x86_reg idx = *synth_buf_offset;
+        x86_reg cnt;
+        const float *win = window + i;
+        float *buf2 = synth_buf2 + i;
+        float *dst  = out + i;
+
+        __asm__ volatile (
+            "mov             %5, %1         \n\t"
+            "movups        (%1), %%xmm4     \n\t" // a
+            "movups      64(%1), %%xmm5     \n\t" // b
+            "mov             $8, %1         \n\t"
+            "xorps       %%xmm6, %%xmm6     \n\t" // c
+            "xorps       %%xmm7, %%xmm7     \n\t" // d
+            "1:                             \n\t"
+            "movups     (%4, %0, 4), %%xmm0 \n\t"
+            "movups       (%2), %%xmm1      \n\t"
+            "shufps $0x1b, %%xmm0, %%xmm0   \n\t"
+            "mulps       %%xmm1, %%xmm0     \n\t"
+            "subps       %%xmm0, %%xmm4     \n\t"
+            "movups     (%3, %0, 4), %%xmm0 \n\t"
+            "movups     64(%2), %%xmm1      \n\t"
+            "mulps       %%xmm1, %%xmm0     \n\t"
+            "addps       %%xmm0, %%xmm5     \n\t"
+            "movups   64(%3, %0, 4), %%xmm0 \n\t"
+            "movups    128(%2), %%xmm1      \n\t"
+            "mulps       %%xmm1, %%xmm0     \n\t"
+            "addps       %%xmm0, %%xmm6     \n\t"
+            "movups   64(%4, %0, 4), %%xmm0 \n\t"
+            "movups    192(%2), %%xmm1      \n\t"
+            "shufps $0x1b, %%xmm0, %%xmm0   \n\t"
+            "mulps       %%xmm1, %%xmm0     \n\t"
+            "addps       %%xmm0, %%xmm7     \n\t"
+            "add            $64, %0         \n\t"
+            "and           $511, %0         \n\t"
+            "add           $256, %2         \n\t"
+            "sub             $1, %1         \n\t"
+            "jg              1b             \n\t"
+            "movss           %7, %%xmm0     \n\t"
+            "shufps $0, %%xmm0, %%xmm0      \n\t"
+            "mulps       %%xmm0, %%xmm4     \n\t"
+            "mulps       %%xmm0, %%xmm5     \n\t"
+            "mov             %6, %1         \n\t"
+            "movups      %%xmm4, (%1)       \n\t"
+            "movups      %%xmm5, 64(%1)     \n\t"
+            "mov             %5, %1         \n\t"
+            "movups      %%xmm6, (%1)       \n\t"
+            "movups      %%xmm7, 64(%1)     \n\t"
+            : "+r"(idx), "=&r"(cnt), "+r"(win)
+            : "r"(synth_buf_ptr + i), "r"(synth_buf_ptr + 12 - i),
+              "m"(buf2), "m"(dst), "m"(scale)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm4", "%xmm5",
+                           "%xmm6", "%xmm7",) "memory"
+        );
+    }
+    *synth_buf_offset = (*synth_buf_offset - 32) & 511;
+}
+#endif /* HAVE_SSE_INLINE */
+
+av_cold void ff_synth_filter_init_x86(SynthFilterContext *s)
+{
+#if HAVE_SSE_INLINE
+    int mm_flags = av_get_cpu_flags();
+
+    if (INLINE_SSE(mm_flags))
+        s->synth_filter_float = synth_filter_sse;
+#endif /* HAVE_SSE_INLINE */
+}
@@ -1005,6 +1005,51 @@ typedef struct AVFormatContext {
      */
     int debug;
 #define FF_FDEBUG_TS        0x0001
+
+    /**
+     * Path of a file used to cache the seek index of the input across
+     * sessions. The index is loaded at the end of
+     * avformat_find_stream_info() or on the first seek, extended with the
+     * keyframes read during demuxing and written back when the input is
+     * closed. A file written for an input of a different size or
+     * modification time is ignored. Only used for formats without an index
+     * of their own, which otherwise have to search for the timestamps on
+     * every seek.
+     *
+     * - demuxing: set by the user before avformat_open_input()
+     * - muxing: unused
+     */
+    char *seek_index;
+
+    /**
+     * Number of threads decoding the streams in avformat_find_stream_info().
+     * With more than one, the audio and video streams which need decoding
+     * to find their parameters are decoded in parallel, each until its own
+     * parameters are found. The number of packets read before returning
+     * then depends on the speed of the decoding threads.
+     *
+     * - demuxing: set by the user before avformat_find_stream_info()
+     * - muxing: unused
+     */
+    int probe_threads;
+
+    /**
+     * Maximum wall-clock time, in microseconds, spent reading and decoding
+     * packets in avformat_find_stream_info(). 0 means no limit.
+     *
+     * - demuxing: set by the user before avformat_find_stream_info()
+     * - muxing: unused
+     */
+    int64_t max_probe_time;
+
+    /**
+     * If the file set by seek_index is missing or stale, build the index by
+     * reading the whole input once when it is loaded, without decoding.
+     *
+     * - demuxing: set by the user before avformat_find_stream_info()
+     * - muxing: unused
+     */
+    int seek_index_scan;
     /*****************************************************************
      * All fields below this line are not part of the public API. They
      * may not be used outside of libavformat and can be changed and
@@ -1042,6 +1087,15 @@ typedef struct AVFormatContext {
      */
 #define RAW_PACKET_BUFFER_SIZE 2500000
     int raw_packet_buffer_remaining_size;
+
+    /**
+     * Set once the seek index file was loaded, or found unusable.
+     */
+    int seek_index_loaded;
+    /**
+     * Set when keyframes missing from the seek index file were added.
+     */
+    int seek_index_dirty;
 } AVFormatContext;
 
 typedef struct AVPacketList {
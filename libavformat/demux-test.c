@@ -0,0 +1,98 @@
+/*
+ * Demuxing speed test
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Read all packets of a file with av_read_frame() several times and print
+ * the best packet rate, along with a checksum of the packets, so that the
+ * speed of a demuxer can be compared before and after a change which must
+ * not alter its output.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/adler32.h"
+#include "libavutil/time.h"
+#include "libavformat/avformat.h"
+
+static int read_file(const char *filename, int64_t *nb_packets,
+                     unsigned long *checksum, int64_t *elapsed)
+{
+    AVFormatContext *ic = NULL;
+    AVPacket pkt;
+    int64_t start;
+    int ret;
+
+    if ((ret = avformat_open_input(&ic, filename, NULL, NULL)) < 0)
+        return ret;
+
+    *nb_packets = 0;
+    *checksum   = 1;
+    start = av_gettime();
+    while ((ret = av_read_frame(ic, &pkt)) >= 0) {
+        *checksum = av_adler32_update(*checksum, pkt.data, pkt.size);
+        *checksum = av_adler32_update(*checksum, (uint8_t *)&pkt.pts,
+                                      sizeof(pkt.pts));
+        *checksum = av_adler32_update(*checksum, (uint8_t *)&pkt.dts,
+                                      sizeof(pkt.dts));
+        *checksum = av_adler32_update(*checksum, (uint8_t *)&pkt.flags,
+                                      sizeof(pkt.flags));
+        (*nb_packets)++;
+        av_free_packet(&pkt);
+    }
+    *elapsed = av_gettime() - start;
+
+    avformat_close_input(&ic);
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+int main(int argc, char **argv)
+{
+    int64_t nb_packets = 0, elapsed, best = INT64_MAX;
+    unsigned long checksum = 0;
+    int i, runs = 9;
+
+    if (argc < 2) {
+        printf("usage: %s input_file [runs]\n"
+               "Print the best number of packets per second read from the "
+               "input over the given number of runs (default %d).\n",
+               argv[0], runs);
+        return 1;
+    }
+    if (argc > 2)
+        runs = FFMAX(atoi(argv[2]), 1);
+
+    av_register_all();
+
+    for (i = 0; i < runs; i++) {
+        if (read_file(argv[1], &nb_packets, &checksum, &elapsed) < 0) {
+            fprintf(stderr, "cannot read %s\n", argv[1]);
+            return 1;
+        }
+        best = FFMIN(best, elapsed);
+    }
+
+    printf("packets: %"PRId64" checksum: %08lx\n", nb_packets, checksum);
+    printf("best of %d: %"PRId64" us, %.0f packets/s\n", runs, best,
+           nb_packets * 1000000.0 / FFMAX(best, 1));
+    return 0;
+}
@@ -46,6 +46,7 @@
 typedef struct {
     const AVClass *class; ///< Class for private options.
     int trust_metadata; ///< configure streams according onMetaData
+    int low_latency;    ///< stop probing once the streams are configured
     int wrong_dts; ///< wrong dts due to negative cts
     uint8_t *new_extradata[2];
     int      new_extradata_size[2];
@@ -401,6 +402,16 @@ static int amf_parse_object(AVFormatContext *s, AVStream *astream, AVStream *vst
                 vcodec->bit_rate = num_val * 1024.0;
             else if (!strcmp(key, "audiodatarate") && acodec && 0 <= (int)(num_val * 1024.0))
                 acodec->bit_rate = num_val * 1024.0;
+            else if (!strcmp(key, "framerate") && vstream && flv->low_latency &&
+                     num_val > 0 && num_val < 1000) {
+                /* spares avformat_find_stream_info() measuring it; higher
+                 * values are the time base of the muxer, not a frame rate
+                 * that millisecond timestamps could represent */
+                vstream->avg_frame_rate = av_d2q(num_val, 1000);
+#if FF_API_R_FRAME_RATE
+                vstream->r_frame_rate = vstream->avg_frame_rate;
+#endif
+            }
             else if (!strcmp(key, "datastream")) {
                 AVStream *st = create_stream(s, AVMEDIA_TYPE_DATA);
                 if (!st)
@@ -530,6 +541,27 @@ static int flv_read_close(AVFormatContext *s)
     return 0;
 }
 
+/**
+ * Tell avformat_find_stream_info() that no other stream is expected once
+ * all the streams know their codec and have got their configuration from
+ * the AAC or AVC sequence header, so that it stops as soon as the decoders
+ * are set up instead of probing for new streams.
+ */
+static void flv_check_streams_configured(AVFormatContext *s)
+{
+    int i;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVCodecContext *codec = s->streams[i]->codec;
+        if (codec->codec_id == AV_CODEC_ID_NONE)
+            return;
+        if ((codec->codec_id == AV_CODEC_ID_AAC ||
+             codec->codec_id == AV_CODEC_ID_H264) && !codec->extradata)
+            return;
+    }
+    s->ctx_flags &= ~AVFMTCTX_NOHEADER;
+}
+
 static int flv_get_extradata(AVFormatContext *s, AVStream *st, int size)
 {
     av_free(st->codec->extradata);
@@ -848,6 +880,8 @@ static int flv_read_packet(AVFormatContext *s, AVPacket *pkt)
         pkt->flags |= AV_PKT_FLAG_KEY;
 
 leave:
+    if (flv->low_latency && s->ctx_flags & AVFMTCTX_NOHEADER)
+        flv_check_streams_configured(s);
     avio_skip(s->pb, 4);
     return ret;
 }
@@ -864,6 +898,7 @@ static int flv_read_seek(AVFormatContext *s, int stream_index,
 #define VD AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM
 static const AVOption options[] = {
     { "flv_metadata", "Allocate streams according the onMetaData array",      OFFSET(trust_metadata), AV_OPT_TYPE_INT,    { .i64 = 0 }, 0, 1, VD},
+    { "flv_low_latency", "Stop probing once the streams have been configured", OFFSET(low_latency), AV_OPT_TYPE_INT,   { .i64 = 0 }, 0, 1, VD},
     { NULL }
 };
 
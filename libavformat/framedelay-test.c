@@ -0,0 +1,104 @@
+/*
+ * Decoder delay test
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Decode the first video stream of a file with the given thread count and
+ * AVCodecContext.max_frame_delay, and print the threading type chosen, then
+ * AVFrame.thread_delay and AVFrame.reorder_delay for each returned frame.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+
+int main(int argc, char **argv)
+{
+    AVFormatContext *ic = NULL;
+    AVCodecContext *avctx;
+    AVCodec *codec;
+    AVFrame *frame;
+    AVPacket pkt;
+    int stream, got_frame, packets = 0, frames = 0, ret = 1;
+
+    if (argc < 3) {
+        printf("usage: %s input_file threads [max_frame_delay]\n", argv[0]);
+        return 1;
+    }
+
+    av_register_all();
+
+    if (avformat_open_input(&ic, argv[1], NULL, NULL) < 0 ||
+        avformat_find_stream_info(ic, NULL) < 0) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    stream = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (stream < 0 || !(frame = avcodec_alloc_frame())) {
+        avformat_close_input(&ic);
+        return 1;
+    }
+
+    avctx                  = ic->streams[stream]->codec;
+    avctx->thread_count    = atoi(argv[2]);
+    avctx->max_frame_delay = argc > 3 ? atoi(argv[3]) : -1;
+    if (avcodec_open2(avctx, codec, NULL) < 0)
+        goto end;
+
+    printf("threads: %d, type: %s\n", avctx->thread_count,
+           avctx->active_thread_type & FF_THREAD_FRAME ? "frame" :
+           avctx->active_thread_type & FF_THREAD_SLICE ? "slice" : "none");
+
+    for (;;) {
+        int eof = av_read_frame(ic, &pkt) < 0;
+
+        if (eof) {
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+        } else if (pkt.stream_index != stream) {
+            av_free_packet(&pkt);
+            continue;
+        } else {
+            packets++;
+        }
+
+        if (avcodec_decode_video2(avctx, frame, &got_frame, &pkt) < 0)
+            got_frame = 0;
+        if (got_frame)
+            printf("packet %3d frame %3d thread_delay %d reorder_delay %d\n",
+                   packets, frames++, frame->thread_delay, frame->reorder_delay);
+        if (!eof)
+            av_free_packet(&pkt);
+        else if (!got_frame)
+            break;
+    }
+    printf("packets: %d, frames: %d, has_b_frames: %d\n",
+           packets, frames, avctx->has_b_frames);
+    ret = 0;
+
+end:
+    avcodec_close(avctx);
+    avcodec_free_frame(&frame);
+    avformat_close_input(&ic);
+    return ret;
+}
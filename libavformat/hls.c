@@ -25,6 +25,12 @@
  * http://tools.ietf.org/html/draft-pantos-http-live-streaming
  */
 
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "libavutil/avstring.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
@@ -63,6 +69,18 @@ struct segment {
     uint8_t iv[16];
 };
 
+/*
+ * A segment downloaded into memory by the prefetch thread of a variant.
+ * ret is set to a negative error code if the segment couldn't be fetched,
+ * or to AVERROR_EOF if there are no more segments in the playlist.
+ */
+struct prefetch_buffer {
+    int seq_no;
+    uint8_t *data;
+    int size, pos;
+    int ret;
+};
+
 /*
  * Each variant has its own demuxer. If it currently is active,
  * it has an open AVIOContext too, and potentially an AVPacket
@@ -91,9 +109,23 @@ struct variant {
 
     char key_url[MAX_URL_SIZE];
     uint8_t key[16];
+
+#if HAVE_PTHREADS
+    /* Segments fetched ahead of the reader, kept in a ring buffer of
+     * HLSContext.prefetch entries. The segment list, key and fetch_seq_no
+     * are owned by the prefetch thread while it is running. */
+    pthread_t prefetch_thread;
+    pthread_mutex_t prefetch_mutex;
+    pthread_cond_t prefetch_cond;
+    struct prefetch_buffer *prefetch_bufs;
+    int prefetch_head, prefetch_count;
+    int prefetch_running, prefetch_abort;
+    int fetch_seq_no;
+#endif
 };
 
 typedef struct HLSContext {
+    const AVClass *class;
     int n_variants;
     struct variant **variants;
     int cur_seq_no;
@@ -103,6 +135,7 @@ typedef struct HLSContext {
     int64_t seek_timestamp;
     int seek_flags;
     AVIOInterruptCB *interrupt_callback;
+    int prefetch;
 } HLSContext;
 
 static int read_chomp_line(AVIOContext *s, char *buf, int maxlen)
@@ -122,11 +155,44 @@ static void free_segment_list(struct variant *var)
     var->n_segments = 0;
 }
 
+static void stop_prefetch(struct variant *v);
+
+/* The prefetch thread reloads the playlist of a live variant while it is
+ * running, so finished is only accessed under its lock then. Once the end
+ * of the playlist has been seen, it is never reset. */
+static void set_finished(struct variant *var)
+{
+#if HAVE_PTHREADS
+    if (var->prefetch_running) {
+        pthread_mutex_lock(&var->prefetch_mutex);
+        var->finished = 1;
+        pthread_mutex_unlock(&var->prefetch_mutex);
+        return;
+    }
+#endif
+    var->finished = 1;
+}
+
+static int is_finished(struct variant *var)
+{
+    int finished;
+#if HAVE_PTHREADS
+    if (var->prefetch_running) {
+        pthread_mutex_lock(&var->prefetch_mutex);
+        finished = var->finished;
+        pthread_mutex_unlock(&var->prefetch_mutex);
+        return finished;
+    }
+#endif
+    return var->finished;
+}
+
 static void free_variant_list(HLSContext *c)
 {
     int i;
     for (i = 0; i < c->n_variants; i++) {
         struct variant *var = c->variants[i];
+        stop_prefetch(var);
         free_segment_list(var);
         av_free_packet(&var->pkt);
         av_free(var->pb.buffer);
@@ -199,8 +265,24 @@ static void handle_key_args(struct key_info *info, const char *key,
     }
 }
 
+/*
+ * Playlists, keys and segments are usually fetched from the same few hosts,
+ * so ask the http protocol to keep the connections open for the next ones.
+ */
+static int open_url(URLContext **uc, const char *url, AVIOInterruptCB *int_cb)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_dict_set(&opts, "reuse_connections", "1", 0);
+    ret = ffurl_open(uc, url, AVIO_FLAG_READ, int_cb, &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
 static int parse_playlist(HLSContext *c, const char *url,
-                          struct variant *var, AVIOContext *in)
+                          struct variant *var, AVIOContext *in,
+                          AVIOInterruptCB *int_cb)
 {
     int ret = 0, duration = 0, is_segment = 0, is_variant = 0, bandwidth = 0;
     enum KeyType key_type = KEY_NONE;
@@ -212,9 +294,12 @@ static int parse_playlist(HLSContext *c, const char *url,
     int close_in = 0;
 
     if (!in) {
+        AVDictionary *opts = NULL;
         close_in = 1;
-        if ((ret = avio_open2(&in, url, AVIO_FLAG_READ,
-                              c->interrupt_callback, NULL)) < 0)
+        av_dict_set(&opts, "reuse_connections", "1", 0);
+        ret = avio_open2(&in, url, AVIO_FLAG_READ, int_cb, &opts);
+        av_dict_free(&opts);
+        if (ret < 0)
             return ret;
     }
 
@@ -224,10 +309,8 @@ static int parse_playlist(HLSContext *c, const char *url,
         goto fail;
     }
 
-    if (var) {
+    if (var)
         free_segment_list(var);
-        var->finished = 0;
-    }
     while (!in->eof_reached) {
         read_chomp_line(in, line, sizeof(line));
         if (av_strstart(line, "#EXT-X-STREAM-INF:", &ptr)) {
@@ -269,7 +352,7 @@ static int parse_playlist(HLSContext *c, const char *url,
             var->start_seq_no = atoi(ptr);
         } else if (av_strstart(line, "#EXT-X-ENDLIST", &ptr)) {
             if (var)
-                var->finished = 1;
+                set_finished(var);
         } else if (av_strstart(line, "#EXTINF:", &ptr)) {
             is_segment = 1;
             duration   = atoi(ptr);
@@ -323,19 +406,18 @@ fail:
     return ret;
 }
 
-static int open_input(struct variant *var)
+static int open_input(struct variant *var, int seq_no, URLContext **input,
+                      AVIOInterruptCB *int_cb)
 {
-    struct segment *seg = var->segments[var->cur_seq_no - var->start_seq_no];
+    struct segment *seg = var->segments[seq_no - var->start_seq_no];
     if (seg->key_type == KEY_NONE) {
-        return ffurl_open(&var->input, seg->url, AVIO_FLAG_READ,
-                          &var->parent->interrupt_callback, NULL);
+        return open_url(input, seg->url, int_cb);
     } else if (seg->key_type == KEY_AES_128) {
         char iv[33], key[33], url[MAX_URL_SIZE];
         int ret;
         if (strcmp(seg->key, var->key_url)) {
             URLContext *uc;
-            if (ffurl_open(&uc, seg->key, AVIO_FLAG_READ,
-                           &var->parent->interrupt_callback, NULL) == 0) {
+            if (open_url(&uc, seg->key, int_cb) == 0) {
                 if (ffurl_read_complete(uc, var->key, sizeof(var->key))
                     != sizeof(var->key)) {
                     av_log(NULL, AV_LOG_ERROR, "Unable to read key file %s\n",
@@ -355,14 +437,13 @@ static int open_input(struct variant *var)
             snprintf(url, sizeof(url), "crypto+%s", seg->url);
         else
             snprintf(url, sizeof(url), "crypto:%s", seg->url);
-        if ((ret = ffurl_alloc(&var->input, url, AVIO_FLAG_READ,
-                               &var->parent->interrupt_callback)) < 0)
+        if ((ret = ffurl_alloc(input, url, AVIO_FLAG_READ, int_cb)) < 0)
             return ret;
-        av_opt_set(var->input->priv_data, "key", key, 0);
-        av_opt_set(var->input->priv_data, "iv", iv, 0);
-        if ((ret = ffurl_connect(var->input, NULL)) < 0) {
-            ffurl_close(var->input);
-            var->input = NULL;
+        av_opt_set((*input)->priv_data, "key", key, 0);
+        av_opt_set((*input)->priv_data, "iv", iv, 0);
+        if ((ret = ffurl_connect(*input, NULL)) < 0) {
+            ffurl_close(*input);
+            *input = NULL;
             return ret;
         }
         return 0;
@@ -370,58 +451,62 @@ static int open_input(struct variant *var)
     return AVERROR(ENOSYS);
 }
 
-static int read_data(void *opaque, uint8_t *buf, int buf_size)
+/*
+ * Make sure the segment with sequence number *seq_no is available,
+ * reloading the playlist of a live stream as needed. *seq_no is moved
+ * forward if the segment has already expired from the playlist.
+ */
+static int wait_for_segment(HLSContext *c, struct variant *v, int *seq_no,
+                            AVIOInterruptCB *int_cb)
 {
-    struct variant *v = opaque;
-    HLSContext *c = v->parent->priv_data;
-    int ret, i;
-
-restart:
-    if (!v->input) {
-        /* If this is a live stream and the reload interval has elapsed since
-         * the last playlist reload, reload the variant playlists now. */
-        int64_t reload_interval = v->n_segments > 0 ?
-                                  v->segments[v->n_segments - 1]->duration :
-                                  v->target_duration;
-        reload_interval *= 1000000;
+    int ret;
+    /* If this is a live stream and the reload interval has elapsed since
+     * the last playlist reload, reload the variant playlists now. */
+    int64_t reload_interval = v->n_segments > 0 ?
+                              v->segments[v->n_segments - 1]->duration :
+                              v->target_duration;
+    reload_interval *= 1000000;
 
 reload:
-        if (!v->finished &&
-            av_gettime() - v->last_load_time >= reload_interval) {
-            if ((ret = parse_playlist(c, v->url, v, NULL)) < 0)
-                return ret;
-            /* If we need to reload the playlist again below (if
-             * there's still no more segments), switch to a reload
-             * interval of half the target duration. */
-            reload_interval = v->target_duration * 500000;
-        }
-        if (v->cur_seq_no < v->start_seq_no) {
-            av_log(NULL, AV_LOG_WARNING,
-                   "skipping %d segments ahead, expired from playlists\n",
-                   v->start_seq_no - v->cur_seq_no);
-            v->cur_seq_no = v->start_seq_no;
-        }
-        if (v->cur_seq_no >= v->start_seq_no + v->n_segments) {
-            if (v->finished)
-                return AVERROR_EOF;
-            while (av_gettime() - v->last_load_time < reload_interval) {
-                if (ff_check_interrupt(c->interrupt_callback))
-                    return AVERROR_EXIT;
-                av_usleep(100*1000);
-            }
-            /* Enough time has elapsed since the last reload */
-            goto reload;
-        }
-
-        ret = open_input(v);
-        if (ret < 0)
+    if (!v->finished &&
+        av_gettime() - v->last_load_time >= reload_interval) {
+        if ((ret = parse_playlist(c, v->url, v, NULL, int_cb)) < 0)
             return ret;
+        /* If we need to reload the playlist again below (if
+         * there's still no more segments), switch to a reload
+         * interval of half the target duration. */
+        reload_interval = v->target_duration * 500000;
     }
-    ret = ffurl_read(v->input, buf, buf_size);
-    if (ret > 0)
-        return ret;
-    ffurl_close(v->input);
-    v->input = NULL;
+    if (*seq_no < v->start_seq_no) {
+        av_log(NULL, AV_LOG_WARNING,
+               "skipping %d segments ahead, expired from playlists\n",
+               v->start_seq_no - *seq_no);
+        *seq_no = v->start_seq_no;
+    }
+    if (*seq_no >= v->start_seq_no + v->n_segments) {
+        if (v->finished)
+            return AVERROR_EOF;
+        while (av_gettime() - v->last_load_time < reload_interval) {
+            if (ff_check_interrupt(int_cb))
+                return AVERROR_EXIT;
+            av_usleep(100*1000);
+        }
+        /* Enough time has elapsed since the last reload */
+        goto reload;
+    }
+    return 0;
+}
+
+/*
+ * Called when the reader has consumed all data of the current segment.
+ * Returns AVERROR_EOF if none of the streams of the variant are needed
+ * any longer.
+ */
+static int end_segment(struct variant *v)
+{
+    HLSContext *c = v->parent->priv_data;
+    int i;
+
     v->cur_seq_no++;
 
     c->end_of_segment = 1;
@@ -440,6 +525,248 @@ reload:
                v->index);
         return AVERROR_EOF;
     }
+    return 0;
+}
+
+#if HAVE_PTHREADS
+static int prefetch_interrupt_cb(void *opaque)
+{
+    struct variant *v = opaque;
+    return v->prefetch_abort ||
+           ff_check_interrupt(&v->parent->interrupt_callback);
+}
+
+/*
+ * Download a complete segment into memory. Read errors after the segment
+ * has been opened end the segment, like in the unbuffered read path.
+ */
+static int fetch_segment(struct variant *v, struct prefetch_buffer *buf,
+                         AVIOInterruptCB *int_cb)
+{
+    URLContext *input;
+    int64_t size;
+    int ret, alloc_size;
+
+    if ((ret = open_input(v, buf->seq_no, &input, int_cb)) < 0)
+        return ret;
+
+    size = ffurl_size(input);
+    if (size <= 0 || size >= INT_MAX)
+        size = 0;
+    alloc_size = size ? size : INITIAL_BUFFER_SIZE;
+    if (!(buf->data = av_malloc(alloc_size))) {
+        ffurl_close(input);
+        return AVERROR(ENOMEM);
+    }
+    while (1) {
+        if (buf->size == alloc_size) {
+            uint8_t *data;
+            /* The whole segment has been read if its size was known */
+            if (alloc_size == size) {
+                ret = 0;
+                break;
+            }
+            if (alloc_size > INT_MAX / 2) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            alloc_size *= 2;
+            if (!(data = av_realloc(buf->data, alloc_size))) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            buf->data = data;
+        }
+        ret = ffurl_read(input, buf->data + buf->size, alloc_size - buf->size);
+        if (ret <= 0) {
+            /* Don't hand out a truncated segment if we were told to stop */
+            if (ret == AVERROR_EXIT || ff_check_interrupt(int_cb))
+                ret = AVERROR_EXIT;
+            else
+                ret = 0;
+            break;
+        }
+        buf->size += ret;
+    }
+    ffurl_close(input);
+    if (ret < 0) {
+        av_freep(&buf->data);
+        buf->size = 0;
+    }
+    return ret;
+}
+
+static void *prefetch_thread(void *arg)
+{
+    struct variant *v = arg;
+    HLSContext *c = v->parent->priv_data;
+    AVIOInterruptCB int_cb = { prefetch_interrupt_cb, v };
+
+    pthread_mutex_lock(&v->prefetch_mutex);
+    while (!v->prefetch_abort) {
+        struct prefetch_buffer *buf;
+        int ret;
+
+        if (v->prefetch_count >= c->prefetch) {
+            pthread_cond_wait(&v->prefetch_cond, &v->prefetch_mutex);
+            continue;
+        }
+        /* The reader never touches entries outside of
+         * [prefetch_head, prefetch_head + prefetch_count), so this one
+         * can be filled without holding the lock. */
+        buf = &v->prefetch_bufs[(v->prefetch_head + v->prefetch_count) %
+                                c->prefetch];
+        memset(buf, 0, sizeof(*buf));
+        buf->seq_no = v->fetch_seq_no;
+        pthread_mutex_unlock(&v->prefetch_mutex);
+
+        ret = wait_for_segment(c, v, &buf->seq_no, &int_cb);
+        if (!ret)
+            ret = fetch_segment(v, buf, &int_cb);
+        buf->ret = ret;
+
+        pthread_mutex_lock(&v->prefetch_mutex);
+        if (v->prefetch_abort) {
+            av_freep(&buf->data);
+            break;
+        }
+        v->fetch_seq_no = buf->seq_no + 1;
+        v->prefetch_count++;
+        pthread_cond_broadcast(&v->prefetch_cond);
+        /* Errors and the end of the playlist are left queued for the reader;
+         * nothing more is fetched until the variant is restarted. */
+        if (ret < 0)
+            break;
+    }
+    pthread_mutex_unlock(&v->prefetch_mutex);
+    return NULL;
+}
+
+static int start_prefetch(struct variant *v)
+{
+    HLSContext *c = v->parent->priv_data;
+    int ret;
+
+    if (!(v->prefetch_bufs = av_mallocz(c->prefetch *
+                                        sizeof(*v->prefetch_bufs))))
+        return AVERROR(ENOMEM);
+    v->prefetch_head  = 0;
+    v->prefetch_count = 0;
+    v->prefetch_abort = 0;
+    v->fetch_seq_no   = v->cur_seq_no;
+    pthread_mutex_init(&v->prefetch_mutex, NULL);
+    pthread_cond_init(&v->prefetch_cond, NULL);
+    if ((ret = pthread_create(&v->prefetch_thread, NULL, prefetch_thread, v))) {
+        pthread_cond_destroy(&v->prefetch_cond);
+        pthread_mutex_destroy(&v->prefetch_mutex);
+        av_freep(&v->prefetch_bufs);
+        return AVERROR(ret);
+    }
+    v->prefetch_running = 1;
+    return 0;
+}
+#endif
+
+static void stop_prefetch(struct variant *v)
+{
+#if HAVE_PTHREADS
+    HLSContext *c = v->parent->priv_data;
+    int i;
+
+    if (!v->prefetch_running)
+        return;
+    pthread_mutex_lock(&v->prefetch_mutex);
+    v->prefetch_abort = 1;
+    pthread_cond_broadcast(&v->prefetch_cond);
+    pthread_mutex_unlock(&v->prefetch_mutex);
+    pthread_join(v->prefetch_thread, NULL);
+
+    for (i = 0; i < v->prefetch_count; i++)
+        av_free(v->prefetch_bufs[(v->prefetch_head + i) % c->prefetch].data);
+    av_freep(&v->prefetch_bufs);
+    pthread_cond_destroy(&v->prefetch_cond);
+    pthread_mutex_destroy(&v->prefetch_mutex);
+    v->prefetch_running = 0;
+#endif
+}
+
+#if HAVE_PTHREADS
+static int read_prefetched_data(struct variant *v, uint8_t *buf, int buf_size)
+{
+    HLSContext *c = v->parent->priv_data;
+    struct prefetch_buffer *seg;
+    int ret;
+
+    if (!v->prefetch_running && (ret = start_prefetch(v)) < 0)
+        return ret;
+
+    while (1) {
+        pthread_mutex_lock(&v->prefetch_mutex);
+        while (!v->prefetch_count)
+            pthread_cond_wait(&v->prefetch_cond, &v->prefetch_mutex);
+        seg = &v->prefetch_bufs[v->prefetch_head];
+        pthread_mutex_unlock(&v->prefetch_mutex);
+
+        if (seg->ret < 0) {
+            /* Restart from the failed segment on the next read, so that
+             * transient errors and live playlist ends are retried. */
+            ret           = seg->ret;
+            v->cur_seq_no = seg->seq_no;
+            stop_prefetch(v);
+            return ret;
+        }
+        if (seg->pos < seg->size) {
+            int len = FFMIN(buf_size, seg->size - seg->pos);
+            memcpy(buf, seg->data + seg->pos, len);
+            seg->pos += len;
+            return len;
+        }
+
+        v->cur_seq_no = seg->seq_no;
+        av_freep(&seg->data);
+        pthread_mutex_lock(&v->prefetch_mutex);
+        v->prefetch_head = (v->prefetch_head + 1) % c->prefetch;
+        v->prefetch_count--;
+        pthread_cond_broadcast(&v->prefetch_cond);
+        pthread_mutex_unlock(&v->prefetch_mutex);
+
+        if ((ret = end_segment(v)) < 0) {
+            stop_prefetch(v);
+            return ret;
+        }
+    }
+}
+#endif
+
+static int read_data(void *opaque, uint8_t *buf, int buf_size)
+{
+    struct variant *v = opaque;
+    HLSContext *c = v->parent->priv_data;
+    int ret;
+
+#if HAVE_PTHREADS
+    if (c->prefetch)
+        return read_prefetched_data(v, buf, buf_size);
+#endif
+
+restart:
+    if (!v->input) {
+        if ((ret = wait_for_segment(c, v, &v->cur_seq_no,
+                                    c->interrupt_callback)) < 0)
+            return ret;
+        ret = open_input(v, v->cur_seq_no, &v->input,
+                         &v->parent->interrupt_callback);
+        if (ret < 0)
+            return ret;
+    }
+    ret = ffurl_read(v->input, buf, buf_size);
+    if (ret > 0)
+        return ret;
+    ffurl_close(v->input);
+    v->input = NULL;
+
+    if ((ret = end_segment(v)) < 0)
+        return ret;
     goto restart;
 }
 
@@ -450,7 +777,14 @@ static int hls_read_header(AVFormatContext *s)
 
     c->interrupt_callback = &s->interrupt_callback;
 
-    if ((ret = parse_playlist(c, s->filename, NULL, s->pb)) < 0)
+#if !HAVE_PTHREADS
+    if (c->prefetch)
+        av_log(s, AV_LOG_WARNING,
+               "Segment prefetching requires pthreads, reading synchronously\n");
+#endif
+
+    if ((ret = parse_playlist(c, s->filename, NULL, s->pb,
+                              c->interrupt_callback)) < 0)
         goto fail;
 
     if (c->n_variants == 0) {
@@ -463,7 +797,8 @@ static int hls_read_header(AVFormatContext *s)
     if (c->n_variants > 1 || c->variants[0]->n_segments == 0) {
         for (i = 0; i < c->n_variants; i++) {
             struct variant *v = c->variants[i];
-            if ((ret = parse_playlist(c, v->url, v, NULL)) < 0)
+            if ((ret = parse_playlist(c, v->url, v, NULL,
+                                      c->interrupt_callback)) < 0)
                 goto fail;
         }
     }
@@ -487,9 +822,12 @@ static int hls_read_header(AVFormatContext *s)
     for (i = 0; i < c->n_variants; i++) {
         struct variant *v = c->variants[i];
         AVInputFormat *in_fmt = NULL;
-        char bitrate_str[20];
+        char bitrate_str[20], url[MAX_URL_SIZE];
         if (v->n_segments == 0)
             continue;
+        /* The segment list may be reloaded by the prefetch thread once
+         * reading has started. */
+        av_strlcpy(url, v->segments[0]->url, sizeof(url));
 
         if (!(v->ctx = avformat_alloc_context())) {
             ret = AVERROR(ENOMEM);
@@ -510,8 +848,7 @@ static int hls_read_header(AVFormatContext *s)
         ffio_init_context(&v->pb, v->read_buffer, INITIAL_BUFFER_SIZE, 0, v,
                           read_data, NULL, NULL);
         v->pb.seekable = 0;
-        ret = av_probe_input_buffer(&v->pb, &in_fmt, v->segments[0]->url,
-                                    NULL, 0, 0);
+        ret = av_probe_input_buffer(&v->pb, &in_fmt, url, NULL, 0, 0);
         if (ret < 0) {
             /* Free the ctx - it isn't initialized properly at this point,
              * so avformat_close_input shouldn't be called. If
@@ -522,7 +859,7 @@ static int hls_read_header(AVFormatContext *s)
             goto fail;
         }
         v->ctx->pb       = &v->pb;
-        ret = avformat_open_input(&v->ctx, v->segments[0]->url, in_fmt, NULL);
+        ret = avformat_open_input(&v->ctx, url, in_fmt, NULL);
         if (ret < 0)
             goto fail;
         v->stream_offset = stream_offset;
@@ -571,12 +908,14 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
     for (i = 0; i < c->n_variants; i++) {
         struct variant *v = c->variants[i];
         if (v->cur_needed && !v->needed) {
+            stop_prefetch(v);
             v->needed = 1;
             changed = 1;
             v->cur_seq_no = c->cur_seq_no;
             v->pb.eof_reached = 0;
             av_log(s, AV_LOG_INFO, "Now receiving variant %d\n", i);
         } else if (first && !v->cur_needed && v->needed) {
+            stop_prefetch(v);
             if (v->input)
                 ffurl_close(v->input);
             v->input = NULL;
@@ -673,7 +1012,10 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
     HLSContext *c = s->priv_data;
     int i, j, ret;
 
-    if ((flags & AVSEEK_FLAG_BYTE) || !c->variants[0]->finished)
+    if (flags & AVSEEK_FLAG_BYTE)
+        return AVERROR(ENOSYS);
+
+    if (!is_finished(c->variants[0]))
         return AVERROR(ENOSYS);
 
     c->seek_flags     = flags;
@@ -691,6 +1033,13 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         return AVERROR(EIO);
     }
 
+    /* The prefetch threads own the segment lists while running, and
+     * restart from the new position on the next read. They are only
+     * stopped once the seek goes ahead, so that a refused seek does not
+     * drop the segments that have been fetched already. */
+    for (i = 0; i < c->n_variants; i++)
+        stop_prefetch(c->variants[i]);
+
     ret = AVERROR(EIO);
     for (i = 0; i < c->n_variants; i++) {
         /* Reset reading */
@@ -740,6 +1089,20 @@ static int hls_probe(AVProbeData *p)
     return 0;
 }
 
+#define OFFSET(x) offsetof(HLSContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+static const AVOption options[] = {
+    {"prefetch", "number of segments to download ahead in background threads, 0 to disable", OFFSET(prefetch), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, D},
+    { NULL },
+};
+
+static const AVClass hls_class = {
+    .class_name = "hls demuxer",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 AVInputFormat ff_hls_demuxer = {
     .name           = "hls,applehttp",
     .long_name      = NULL_IF_CONFIG_SMALL("Apple HTTP Live Streaming"),
@@ -749,4 +1112,5 @@ AVInputFormat ff_hls_demuxer = {
     .read_packet    = hls_read_packet,
     .read_close     = hls_close,
     .read_seek      = hls_read_seek,
+    .priv_class     = &hls_class,
 };
@@ -20,49 +20,121 @@
  */
 
 #include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #include "libavutil/mathematics.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/avstring.h"
+#include "libavutil/fifo.h"
 #include "libavutil/opt.h"
 #include "libavutil/log.h"
 
 #include "avformat.h"
 #include "internal.h"
 
+/* packets queued per variant before the muxer waits for its thread */
+#define HLS_QUEUE_SIZE 256
+
 typedef struct ListEntry {
     char  name[1024];
     int   duration;
     struct ListEntry *next;
 } ListEntry;
 
-typedef struct HLSContext {
-    const AVClass *class;  // Class for private options.
+typedef struct HLSVariant {
+    int index;
+    int *stream_map;       // variant stream index for each input stream, or -1
+    int nb_streams;
     unsigned number;
     int64_t sequence;
-    AVOutputFormat *oformat;
     AVFormatContext *avf;
-    float time;            // Set by a private option.
-    int  size;             // Set by a private option.
-    int  wrap;             // Set by a private option.
-    int64_t recording_time;
     int has_video;
-    int64_t start_pts;
+    int width, height;
+    int bandwidth;         // declared by the codec contexts, 0 if unknown
+    int max_bitrate;       // measured over the written segments
     int64_t end_pts;
+    int64_t segment_start; // in AV_TIME_BASE units
+    int64_t last_time;     // end of the last packet, in AV_TIME_BASE units
     int nb_entries;
     ListEntry *list;
     ListEntry *end_list;
     char *basename;
-    AVIOContext *pb;
+    char *playlist;
+#if HAVE_PTHREADS
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    AVFifoBuffer *queue;
+    int finished;
+    int error;
+#endif
+} HLSVariant;
+
+typedef struct HLSContext {
+    const AVClass *class;  // Class for private options.
+    int64_t sequence;
+    AVOutputFormat *oformat;
+    float time;            // Set by a private option.
+    int  size;             // Set by a private option.
+    int  wrap;             // Set by a private option.
+    char *variants_str;    // Set by a private option.
+    int64_t recording_time;
+    int64_t start_time;
+    HLSVariant *variants;
+    int nb_variants;
+    int master_written;
+    int threaded;
+#if HAVE_PTHREADS
+    pthread_mutex_t master_lock; // protects max_bitrate and master_written
+#endif
 } HLSContext;
 
-static int hls_mux_init(AVFormatContext *s)
+/**
+ * Open a playlist for writing. With hls_variants, local files are written
+ * under a temporary name and renamed over the old playlist by
+ * close_playlist(), so that readers never see a partially written one.
+ */
+static int open_playlist(AVFormatContext *s, AVIOContext **pb,
+                         const char *name, char *tmp, int tmp_size)
+{
+    HLSContext *hls = s->priv_data;
+
+    tmp[0] = '\0';
+    if (hls->variants_str && ff_url_local_path(name)) {
+        av_strlcpy(tmp, name, tmp_size);
+        av_strlcat(tmp, ".tmp", tmp_size);
+    }
+
+    return avio_open2(pb, tmp[0] ? tmp : name, AVIO_FLAG_WRITE,
+                      &s->interrupt_callback, NULL);
+}
+
+static int close_playlist(AVFormatContext *s, AVIOContext **pb,
+                          const char *name, const char *tmp)
+{
+    avio_closep(pb);
+    if (tmp[0] && rename(ff_url_local_path(tmp), ff_url_local_path(name)) < 0) {
+        int ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Cannot rename %s to %s\n", tmp, name);
+        return ret;
+    }
+    return 0;
+}
+
+static int hls_mux_init(AVFormatContext *s, HLSVariant *var)
 {
     HLSContext *hls = s->priv_data;
     AVFormatContext *oc;
     int i;
 
-    hls->avf = oc = avformat_alloc_context();
+    var->avf = oc = avformat_alloc_context();
     if (!oc)
         return AVERROR(ENOMEM);
 
@@ -71,6 +143,8 @@ static int hls_mux_init(AVFormatContext *s)
 
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *st;
+        if (var->stream_map[i] < 0)
+            continue;
         if (!(st = avformat_new_stream(oc, NULL)))
             return AVERROR(ENOMEM);
         avcodec_copy_context(st->codec, s->streams[i]->codec);
@@ -80,94 +154,168 @@ static int hls_mux_init(AVFormatContext *s)
     return 0;
 }
 
-static int append_entry(HLSContext *hls, uint64_t duration)
+static int append_entry(HLSContext *hls, HLSVariant *var, uint64_t duration)
 {
     ListEntry *en = av_malloc(sizeof(*en));
 
     if (!en)
         return AVERROR(ENOMEM);
 
-    av_strlcpy(en->name, av_basename(hls->avf->filename), sizeof(en->name));
+    av_strlcpy(en->name, av_basename(var->avf->filename), sizeof(en->name));
 
     en->duration = duration;
     en->next     = NULL;
 
-    if (!hls->list)
-        hls->list = en;
+    if (!var->list)
+        var->list = en;
     else
-        hls->end_list->next = en;
+        var->end_list->next = en;
 
-    hls->end_list = en;
+    var->end_list = en;
 
-    if (hls->nb_entries >= hls->size) {
-        en = hls->list;
-        hls->list = en->next;
+    if (var->nb_entries >= hls->size) {
+        en = var->list;
+        var->list = en->next;
         av_free(en);
     } else
-        hls->nb_entries++;
+        var->nb_entries++;
 
-    hls->sequence++;
+    var->sequence++;
 
     return 0;
 }
 
-static void free_entries(HLSContext *hls)
+static void free_entries(HLSVariant *var)
 {
-    ListEntry *p = hls->list, *en;
+    ListEntry *p = var->list, *en;
 
     while(p) {
         en = p;
         p = p->next;
         av_free(en);
     }
+    var->list = NULL;
 }
 
-static int hls_window(AVFormatContext *s, int last)
+static int hls_window(AVFormatContext *s, HLSVariant *var, int last)
 {
     HLSContext *hls = s->priv_data;
     ListEntry *en;
+    AVIOContext *pb;
+    char tmp[1024];
     int target_duration = 0;
     int ret = 0;
 
-    if ((ret = avio_open2(&hls->pb, s->filename, AVIO_FLAG_WRITE,
-                          &s->interrupt_callback, NULL)) < 0)
-        goto fail;
+    if ((ret = open_playlist(s, &pb, var->playlist, tmp, sizeof(tmp))) < 0)
+        return ret;
 
-    for (en = hls->list; en; en = en->next) {
+    for (en = var->list; en; en = en->next) {
         if (target_duration < en->duration)
             target_duration = en->duration;
     }
 
-    avio_printf(hls->pb, "#EXTM3U\n");
-    avio_printf(hls->pb, "#EXT-X-VERSION:3\n");
-    avio_printf(hls->pb, "#EXT-X-TARGETDURATION:%d\n", target_duration);
-    avio_printf(hls->pb, "#EXT-X-MEDIA-SEQUENCE:%"PRId64"\n",
-                FFMAX(0, hls->sequence - hls->size));
+    avio_printf(pb, "#EXTM3U\n");
+    avio_printf(pb, "#EXT-X-VERSION:3\n");
+    avio_printf(pb, "#EXT-X-TARGETDURATION:%d\n", target_duration);
+    avio_printf(pb, "#EXT-X-MEDIA-SEQUENCE:%"PRId64"\n",
+                FFMAX(0, var->sequence - hls->size));
 
-    for (en = hls->list; en; en = en->next) {
-        avio_printf(hls->pb, "#EXTINF:%d,\n", en->duration);
-        avio_printf(hls->pb, "%s\n", en->name);
+    for (en = var->list; en; en = en->next) {
+        avio_printf(pb, "#EXTINF:%d,\n", en->duration);
+        avio_printf(pb, "%s\n", en->name);
     }
 
     if (last)
-        avio_printf(hls->pb, "#EXT-X-ENDLIST\n");
+        avio_printf(pb, "#EXT-X-ENDLIST\n");
 
-fail:
-    avio_closep(&hls->pb);
+    return close_playlist(s, &pb, var->playlist, tmp);
+}
+
+static int hls_master_playlist(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+    AVIOContext *pb;
+    char tmp[1024];
+    int i, ret;
+
+    if ((ret = open_playlist(s, &pb, s->filename, tmp, sizeof(tmp))) < 0)
+        return ret;
+
+    avio_printf(pb, "#EXTM3U\n");
+    for (i = 0; i < hls->nb_variants; i++) {
+        HLSVariant *var = &hls->variants[i];
+
+        avio_printf(pb, "#EXT-X-STREAM-INF:BANDWIDTH=%d",
+                    var->bandwidth ? var->bandwidth : var->max_bitrate);
+        if (var->width && var->height)
+            avio_printf(pb, ",RESOLUTION=%dx%d", var->width, var->height);
+        avio_printf(pb, "\n%s\n", av_basename(var->playlist));
+    }
+
+    return close_playlist(s, &pb, s->filename, tmp);
+}
+
+/**
+ * Write the master playlist once the bit rate of every variant is known,
+ * either declared by its codecs or measured over its first segment.
+ * Called with master_lock held when the variants are written by threads.
+ */
+static int hls_update_master(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+    int i;
+
+    if (hls->nb_variants < 2 || hls->master_written)
+        return 0;
+    for (i = 0; i < hls->nb_variants; i++)
+        if (!hls->variants[i].bandwidth && !hls->variants[i].max_bitrate)
+            return 0;
+    hls->master_written = 1;
+    return hls_master_playlist(s);
+}
+
+/**
+ * Account the size of the segment ending at end for the peak bit rate of
+ * the variant, and update the master playlist if it was the last one
+ * missing.
+ */
+static int hls_measure_segment(AVFormatContext *s, HLSVariant *var,
+                               int64_t size, int64_t end)
+{
+    HLSContext *hls = s->priv_data;
+    int64_t duration = end - var->segment_start;
+    int ret = 0;
+
+    var->segment_start = end;
+    if (duration <= 0 || hls->nb_variants < 2)
+        return 0;
+
+#if HAVE_PTHREADS
+    if (hls->threaded)
+        pthread_mutex_lock(&hls->master_lock);
+#endif
+    var->max_bitrate = FFMIN(FFMAX(var->max_bitrate,
+                                   av_rescale(size * 8, AV_TIME_BASE, duration)),
+                             INT_MAX);
+    ret = hls_update_master(s);
+#if HAVE_PTHREADS
+    if (hls->threaded)
+        pthread_mutex_unlock(&hls->master_lock);
+#endif
     return ret;
 }
 
-static int hls_start(AVFormatContext *s)
+static int hls_start(AVFormatContext *s, HLSVariant *var)
 {
     HLSContext *c = s->priv_data;
-    AVFormatContext *oc = c->avf;
+    AVFormatContext *oc = var->avf;
     int err = 0;
 
     if (c->wrap)
-        c->number %= c->wrap;
+        var->number %= c->wrap;
 
     if (av_get_frame_filename(oc->filename, sizeof(oc->filename),
-                              c->basename, c->number++) < 0)
+                              var->basename, var->number++) < 0)
         return AVERROR(EINVAL);
 
     if ((err = avio_open2(&oc->pb, oc->filename, AVIO_FLAG_WRITE,
@@ -180,111 +328,428 @@ static int hls_start(AVFormatContext *s)
     return 0;
 }
 
-static int hls_write_header(AVFormatContext *s)
+/**
+ * Parse the hls_variants option, a space separated list of variants each
+ * given as a comma separated list of stream indexes.
+ */
+static int parse_variants(AVFormatContext *s)
 {
     HLSContext *hls = s->priv_data;
-    int ret, i;
-    char *p;
-    const char *pattern = "%d.ts";
-    int basename_size = strlen(s->filename) + strlen(pattern) + 1;
-
-    hls->number      = 0;
+    const char *p = hls->variants_str;
+    int i;
 
-    hls->recording_time = hls->time * AV_TIME_BASE;
-    hls->start_pts      = AV_NOPTS_VALUE;
+    while (p && *p) {
+        HLSVariant *var;
+        void *tmp;
 
-    for (i = 0; i < s->nb_streams; i++)
-        hls->has_video +=
-            s->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO;
+        p += strspn(p, " ");
+        if (!*p)
+            break;
 
-    if (hls->has_video > 1)
-        av_log(s, AV_LOG_WARNING,
-               "More than a single video stream present, "
-               "expect issues decoding it.\n");
+        tmp = av_realloc(hls->variants,
+                         (hls->nb_variants + 1) * sizeof(*hls->variants));
+        if (!tmp)
+            return AVERROR(ENOMEM);
+        hls->variants = tmp;
+        var = &hls->variants[hls->nb_variants];
+        memset(var, 0, sizeof(*var));
+        var->index = hls->nb_variants++;
+        if (!(var->stream_map = av_malloc(s->nb_streams * sizeof(int))))
+            return AVERROR(ENOMEM);
+        for (i = 0; i < s->nb_streams; i++)
+            var->stream_map[i] = -1;
+
+        for (;;) {
+            char *end;
+            long idx = strtol(p, &end, 10);
+
+            if (end == p || idx < 0 || idx >= s->nb_streams) {
+                av_log(s, AV_LOG_ERROR, "Invalid variant list '%s'\n",
+                       hls->variants_str);
+                return AVERROR(EINVAL);
+            }
+            if (var->stream_map[idx] < 0)
+                var->stream_map[idx] = 0;
+            p = end;
+            if (*p != ',')
+                break;
+            p++;
+        }
+    }
 
-    hls->oformat = av_guess_format("mpegts", NULL, NULL);
+    if (!hls->nb_variants) {
+        if (!(hls->variants = av_mallocz(sizeof(*hls->variants))) ||
+            !(hls->variants->stream_map = av_malloc(s->nb_streams * sizeof(int))))
+            return AVERROR(ENOMEM);
+        hls->nb_variants = 1;
+        for (i = 0; i < s->nb_streams; i++)
+            hls->variants->stream_map[i] = 0;
+    }
 
-    if (!hls->oformat) {
-        ret = AVERROR_MUXER_NOT_FOUND;
-        goto fail;
+    for (i = 0; i < s->nb_streams; i++) {
+        int j, used = 0;
+        for (j = 0; j < hls->nb_variants; j++)
+            used |= hls->variants[j].stream_map[i] >= 0;
+        if (!used)
+            av_log(s, AV_LOG_WARNING,
+                   "Stream %d is not part of any variant, dropping it\n", i);
     }
 
-    hls->basename = av_malloc(basename_size);
+    return 0;
+}
 
-    if (!hls->basename) {
-        ret = AVERROR(ENOMEM);
-        goto fail;
+static int hls_variant_init(AVFormatContext *s, HLSVariant *var)
+{
+    HLSContext *hls = s->priv_data;
+    const char *pattern = "%d.ts";
+    char prefix[32] = "";
+    char *p;
+    int basename_size, i, ret;
+
+    var->sequence = hls->sequence;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVCodecContext *codec = s->streams[i]->codec;
+
+        if (var->stream_map[i] < 0)
+            continue;
+        var->stream_map[i] = var->nb_streams++;
+        var->bandwidth    += codec->bit_rate;
+        if (codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (!var->has_video++) {
+                var->width  = codec->width;
+                var->height = codec->height;
+            }
+        }
     }
 
-    strcpy(hls->basename, s->filename);
+    if (var->has_video > 1)
+        av_log(s, AV_LOG_WARNING,
+               "More than a single video stream present, "
+               "expect issues decoding it.\n");
+
+    /* with several variants, the output is the master playlist and each
+     * variant gets its own media playlist and segments */
+    if (hls->nb_variants > 1)
+        snprintf(prefix, sizeof(prefix), "_%d", var->index);
+
+    basename_size = strlen(s->filename) + strlen(prefix) + strlen(pattern) + 2;
+    var->basename = av_malloc(basename_size);
+    var->playlist = av_malloc(basename_size + strlen(".m3u8"));
+    if (!var->basename || !var->playlist)
+        return AVERROR(ENOMEM);
+
+    strcpy(var->basename, s->filename);
 
-    p = strrchr(hls->basename, '.');
+    p = strrchr(var->basename, '.');
 
     if (p)
         *p = '\0';
 
-    av_strlcat(hls->basename, pattern, basename_size);
+    av_strlcat(var->basename, prefix, basename_size);
 
-    if ((ret = hls_mux_init(s)) < 0)
-        goto fail;
+    if (hls->nb_variants > 1) {
+        snprintf(var->playlist, basename_size + strlen(".m3u8"), "%s.m3u8",
+                 var->basename);
+        av_strlcat(var->basename, "_", basename_size);
+    } else
+        strcpy(var->playlist, s->filename);
 
-    if ((ret = hls_start(s)) < 0)
-        goto fail;
+    av_strlcat(var->basename, pattern, basename_size);
+
+    if (!var->bandwidth && hls->nb_variants > 1)
+        av_log(s, AV_LOG_WARNING, "Bit rate of variant %d unknown, the "
+               "master playlist will be written after its first segment\n",
+               var->index);
 
-    if ((ret = avformat_write_header(hls->avf, NULL)) < 0)
+    if ((ret = hls_mux_init(s, var)) < 0)
         return ret;
 
+    if ((ret = hls_start(s, var)) < 0)
+        return ret;
 
-fail:
-    if (ret) {
-        av_free(hls->basename);
-        if (hls->avf)
-            avformat_free_context(hls->avf);
-    }
-    return ret;
+    return avformat_write_header(var->avf, NULL);
 }
 
-static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
+static int hls_variant_write(AVFormatContext *s, HLSVariant *var,
+                             AVPacket *pkt)
 {
     HLSContext *hls = s->priv_data;
-    AVFormatContext *oc = hls->avf;
+    AVFormatContext *oc = var->avf;
     AVStream *st = s->streams[pkt->stream_index];
-    int64_t end_pts = hls->recording_time * hls->number;
+    int64_t end_pts = hls->start_time + hls->recording_time * var->number;
+    int64_t time = av_rescale_q(pkt->pts, st->time_base, AV_TIME_BASE_Q);
+    int is_cut_stream;
     int ret;
 
-    if (hls->start_pts == AV_NOPTS_VALUE) {
-        hls->start_pts = pkt->pts;
-        hls->end_pts   = pkt->pts;
+    if (var->end_pts == AV_NOPTS_VALUE) {
+        var->end_pts       = pkt->pts;
+        var->segment_start = time;
     }
+    var->last_time = FFMAX(var->last_time,
+                           time + av_rescale_q(pkt->duration, st->time_base,
+                                               AV_TIME_BASE_Q));
 
-    if ((hls->has_video && st->codec->codec_type == AVMEDIA_TYPE_VIDEO)      &&
-        av_compare_ts(pkt->pts - hls->start_pts, st->time_base,
+    /* without hls_variants, audio only outputs are not cut, as before */
+    if (var->has_video)
+        is_cut_stream = st->codec->codec_type == AVMEDIA_TYPE_VIDEO;
+    else
+        is_cut_stream = !!hls->variants_str;
+
+    /* segments are cut on the shared time grid, so variants with aligned
+     * key frames get the same segment boundaries */
+    if (is_cut_stream &&
+        av_compare_ts(pkt->pts, st->time_base,
                       end_pts, AV_TIME_BASE_Q) >= 0 &&
         pkt->flags & AV_PKT_FLAG_KEY) {
+        int64_t duration = pkt->pts - var->end_pts;
 
-        ret = append_entry(hls, av_rescale(pkt->pts - hls->end_pts,
-                                           st->time_base.num,
-                                           st->time_base.den));
+        ret = append_entry(hls, var, av_rescale(duration,
+                                                st->time_base.num,
+                                                st->time_base.den));
         if (ret)
             return ret;
 
-        hls->end_pts = pkt->pts;
+        var->end_pts = pkt->pts;
 
         av_write_frame(oc, NULL); /* Flush any buffered data */
+        ret = hls_measure_segment(s, var, avio_tell(oc->pb), time);
         avio_close(oc->pb);
+        if (ret < 0)
+            return ret;
 
-        ret = hls_start(s);
+        ret = hls_start(s, var);
 
         if (ret)
             return ret;
 
-        oc = hls->avf;
+        oc = var->avf;
 
-        if ((ret = hls_window(s, 0)) < 0)
+        if ((ret = hls_window(s, var, 0)) < 0)
             return ret;
     }
 
-    ret = ff_write_chained(oc, pkt->stream_index, pkt, s);
+    return ff_write_chained(oc, var->stream_map[pkt->stream_index], pkt, s);
+}
+
+#if HAVE_PTHREADS
+typedef struct HLSThreadArg {
+    AVFormatContext *s;
+    HLSVariant *var;
+} HLSThreadArg;
+
+static void *hls_variant_thread(void *arg)
+{
+    AVFormatContext *s = ((HLSThreadArg *)arg)->s;
+    HLSVariant *var    = ((HLSThreadArg *)arg)->var;
+    AVPacket pkt;
+    int ret;
+
+    av_free(arg);
+
+    pthread_mutex_lock(&var->lock);
+    for (;;) {
+        while (!av_fifo_size(var->queue) && !var->finished)
+            pthread_cond_wait(&var->cond, &var->lock);
+        if (!av_fifo_size(var->queue))
+            break;
+        av_fifo_generic_read(var->queue, &pkt, sizeof(pkt), NULL);
+        pthread_cond_signal(&var->cond);
+        pthread_mutex_unlock(&var->lock);
+
+        ret = var->error ? 0 : hls_variant_write(s, var, &pkt);
+        av_free_packet(&pkt);
+
+        pthread_mutex_lock(&var->lock);
+        if (ret < 0 && !var->error)
+            var->error = ret;
+    }
+    pthread_mutex_unlock(&var->lock);
+
+    return NULL;
+}
+
+static int hls_start_thread(AVFormatContext *s, HLSVariant *var)
+{
+    HLSThreadArg *arg;
+
+    if (!(var->queue = av_fifo_alloc(HLS_QUEUE_SIZE * sizeof(AVPacket))))
+        return AVERROR(ENOMEM);
+    if (!(arg = av_malloc(sizeof(*arg)))) {
+        av_fifo_free(var->queue);
+        var->queue = NULL;
+        return AVERROR(ENOMEM);
+    }
+    arg->s   = s;
+    arg->var = var;
+
+    pthread_mutex_init(&var->lock, NULL);
+    pthread_cond_init(&var->cond, NULL);
+    if (pthread_create(&var->thread, NULL, hls_variant_thread, arg)) {
+        av_log(s, AV_LOG_ERROR, "pthread_create failed\n");
+        pthread_mutex_destroy(&var->lock);
+        pthread_cond_destroy(&var->cond);
+        av_fifo_free(var->queue);
+        var->queue = NULL;
+        av_free(arg);
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+/**
+ * Wait for the thread to write out everything queued and stop it.
+ */
+static int hls_stop_thread(HLSVariant *var)
+{
+    if (!var->queue)
+        return 0;
+
+    pthread_mutex_lock(&var->lock);
+    var->finished = 1;
+    pthread_cond_signal(&var->cond);
+    pthread_mutex_unlock(&var->lock);
+    pthread_join(var->thread, NULL);
+
+    pthread_mutex_destroy(&var->lock);
+    pthread_cond_destroy(&var->cond);
+    av_fifo_free(var->queue);
+    var->queue = NULL;
+    return var->error;
+}
+
+static int hls_queue_packet(HLSVariant *var, AVPacket *pkt)
+{
+    AVPacket copy = *pkt;
+    int i, ret;
+
+    /* the caller owns pkt, so the thread gets its own copy of the data
+     * and side data */
+    copy.destruct        = NULL;
+    copy.side_data       = NULL;
+    copy.side_data_elems = 0;
+    if ((ret = av_dup_packet(&copy)) < 0)
+        return ret;
+    for (i = 0; i < pkt->side_data_elems; i++) {
+        uint8_t *data = av_packet_new_side_data(&copy, pkt->side_data[i].type,
+                                                pkt->side_data[i].size);
+        if (!data) {
+            av_free_packet(&copy);
+            return AVERROR(ENOMEM);
+        }
+        memcpy(data, pkt->side_data[i].data, pkt->side_data[i].size);
+    }
+
+    pthread_mutex_lock(&var->lock);
+    while (!av_fifo_space(var->queue) && !var->error)
+        pthread_cond_wait(&var->cond, &var->lock);
+    ret = var->error;
+    if (!ret)
+        av_fifo_generic_write(var->queue, &copy, sizeof(copy), NULL);
+    pthread_cond_signal(&var->cond);
+    pthread_mutex_unlock(&var->lock);
+
+    if (ret < 0)
+        av_free_packet(&copy);
+    return ret;
+}
+#endif
+
+static void hls_free_variants(HLSContext *hls)
+{
+    int i;
+
+    for (i = 0; i < hls->nb_variants; i++) {
+        HLSVariant *var = &hls->variants[i];
+
+#if HAVE_PTHREADS
+        hls_stop_thread(var);
+#endif
+        if (var->avf) {
+            avio_close(var->avf->pb);
+            avformat_free_context(var->avf);
+        }
+        free_entries(var);
+        av_free(var->stream_map);
+        av_free(var->basename);
+        av_free(var->playlist);
+    }
+    av_freep(&hls->variants);
+    hls->nb_variants = 0;
+#if HAVE_PTHREADS
+    if (hls->threaded)
+        pthread_mutex_destroy(&hls->master_lock);
+#endif
+    hls->threaded = 0;
+}
+
+static int hls_write_header(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+    int ret, i;
+
+    hls->recording_time = hls->time * AV_TIME_BASE;
+    hls->start_time     = AV_NOPTS_VALUE;
+
+    hls->oformat = av_guess_format("mpegts", NULL, NULL);
+
+    if (!hls->oformat) {
+        ret = AVERROR_MUXER_NOT_FOUND;
+        goto fail;
+    }
+
+    if ((ret = parse_variants(s)) < 0)
+        goto fail;
+
+    for (i = 0; i < hls->nb_variants; i++) {
+        hls->variants[i].end_pts = AV_NOPTS_VALUE;
+        if ((ret = hls_variant_init(s, &hls->variants[i])) < 0)
+            goto fail;
+    }
+
+    if (hls->nb_variants > 1) {
+        if ((ret = hls_update_master(s)) < 0)
+            goto fail;
+#if HAVE_PTHREADS
+        /* each variant writes its segments and playlist from its own
+         * thread, so the I/O of the renditions is done in parallel */
+        pthread_mutex_init(&hls->master_lock, NULL);
+        hls->threaded = 1;
+        for (i = 0; i < hls->nb_variants; i++)
+            if ((ret = hls_start_thread(s, &hls->variants[i])) < 0)
+                goto fail;
+#endif
+    }
+
+fail:
+    if (ret)
+        hls_free_variants(hls);
+    return ret;
+}
+
+static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    HLSContext *hls = s->priv_data;
+    AVStream *st = s->streams[pkt->stream_index];
+    int i, ret = 0;
+
+    if (hls->start_time == AV_NOPTS_VALUE)
+        hls->start_time = av_rescale_q(pkt->pts, st->time_base,
+                                       AV_TIME_BASE_Q);
+
+    for (i = 0; i < hls->nb_variants && ret >= 0; i++) {
+        HLSVariant *var = &hls->variants[i];
+
+        if (var->stream_map[pkt->stream_index] < 0)
+            continue;
+#if HAVE_PTHREADS
+        if (hls->threaded) {
+            ret = hls_queue_packet(var, pkt);
+            continue;
+        }
+#endif
+        ret = hls_variant_write(s, var, pkt);
+    }
 
     return ret;
 }
@@ -292,17 +757,36 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 static int hls_write_trailer(struct AVFormatContext *s)
 {
     HLSContext *hls = s->priv_data;
-    AVFormatContext *oc = hls->avf;
+    int i, ret = 0, update_master = 0;
+
+    for (i = 0; i < hls->nb_variants; i++) {
+        HLSVariant *var = &hls->variants[i];
+        AVFormatContext *oc = var->avf;
+        int err = 0;
+
+#if HAVE_PTHREADS
+        err = hls_stop_thread(var);
+#endif
+        av_write_trailer(oc);
+        /* a variant too short for a complete segment */
+        if (!var->bandwidth && !var->max_bitrate && oc->pb)
+            hls_measure_segment(s, var, avio_tell(oc->pb), var->last_time);
+        avio_closep(&oc->pb);
+        avformat_free_context(oc);
+        var->avf = NULL;
+        if (!err)
+            err = hls_window(s, var, 1);
+        if (!ret)
+            ret = err;
+        update_master |= !var->bandwidth;
+    }
 
-    av_write_trailer(oc);
-    avio_closep(&oc->pb);
-    avformat_free_context(oc);
-    av_free(hls->basename);
-    hls_window(s, 1);
+    /* written with the peak bit rates measured over the whole output */
+    if (hls->nb_variants > 1 && (update_master || !hls->master_written) && !ret)
+        ret = hls_master_playlist(s);
 
-    free_entries(hls);
-    avio_close(hls->pb);
-    return 0;
+    hls_free_variants(hls);
+    return ret;
 }
 
 #define OFFSET(x) offsetof(HLSContext, x)
@@ -312,6 +796,7 @@ static const AVOption options[] = {
     {"hls_time",      "segment length in seconds",               OFFSET(time),    AV_OPT_TYPE_FLOAT,  {.dbl = 2},     0, FLT_MAX, E},
     {"hls_list_size", "maximum number of playlist entries",      OFFSET(size),    AV_OPT_TYPE_INT,    {.i64 = 5},     0, INT_MAX, E},
     {"hls_wrap",      "number after which the index wraps",      OFFSET(wrap),    AV_OPT_TYPE_INT,    {.i64 = 0},     0, INT_MAX, E},
+    {"hls_variants",  "space separated variants, each a comma separated list of stream indexes", OFFSET(variants_str), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, E},
     { NULL },
 };
 
@@ -26,6 +26,7 @@
  */
 
 #include "libavutil/avstring.h"
+#include "libavutil/dict.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "internal.h"
@@ -111,12 +112,16 @@ static int parse_playlist(URLContext *h, const char *url)
 {
     HLSContext *s = h->priv_data;
     AVIOContext *in;
+    AVDictionary *opts = NULL;
     int ret = 0, duration = 0, is_segment = 0, is_variant = 0, bandwidth = 0;
     char line[1024];
     const char *ptr;
 
-    if ((ret = avio_open2(&in, url, AVIO_FLAG_READ,
-                          &h->interrupt_callback, NULL)) < 0)
+    /* Keep the connection open for the segment requests */
+    av_dict_set(&opts, "reuse_connections", "1", 0);
+    ret = avio_open2(&in, url, AVIO_FLAG_READ, &h->interrupt_callback, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
         return ret;
 
     read_chomp_line(in, line, sizeof(line));
@@ -265,6 +270,7 @@ fail:
 static int hls_read(URLContext *h, uint8_t *buf, int size)
 {
     HLSContext *s = h->priv_data;
+    AVDictionary *opts = NULL;
     const char *url;
     int ret;
     int64_t reload_interval;
@@ -314,8 +320,10 @@ retry:
     }
     url = s->segments[s->cur_seq_no - s->start_seq_no]->url,
     av_log(h, AV_LOG_DEBUG, "opening %s\n", url);
+    av_dict_set(&opts, "reuse_connections", "1", 0);
     ret = ffurl_open(&s->seg_hd, url, AVIO_FLAG_READ,
-                     &h->interrupt_callback, NULL);
+                     &h->interrupt_callback, &opts);
+    av_dict_free(&opts);
     if (ret < 0) {
         if (ff_check_interrupt(&h->interrupt_callback))
             return AVERROR_EXIT;
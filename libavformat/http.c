@@ -19,7 +19,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "libavutil/avstring.h"
+#include "libavutil/time.h"
 #include "avformat.h"
 #include "internal.h"
 #include "network.h"
@@ -39,6 +46,13 @@
 #define BUFFER_SIZE MAX_URL_SIZE
 #define MAX_REDIRECTS 8
 
+/* Connections kept open for reuse by later requests to the same host. */
+#define POOL_SIZE 16
+#define POOL_IDLE_TIMEOUT 10000000
+/* Max amount of unread response body discarded to make a connection
+ * reusable instead of closing it. */
+#define MAX_DRAIN_SIZE 65536
+
 typedef struct {
     const AVClass *class;
     URLContext *hd;
@@ -58,6 +72,9 @@ typedef struct {
     int multiple_requests;  /**< A flag which indicates if we use persistent connections. */
     uint8_t *post_data;
     int post_datalen;
+    int reuse_connections;  /**< Take connections from and give them back to the connection pool. */
+    int last_chunk_read;    /**< Set once the terminating chunk of a chunked body has been read. */
+    char pool_key[1024];    /**< Lower protocol URL of hd, empty if it can't be pooled. */
 } HTTPContext;
 
 #define OFFSET(x) offsetof(HTTPContext, x)
@@ -68,6 +85,7 @@ static const AVOption options[] = {
 {"headers", "custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { 0 }, 0, 0, D|E },
 {"multiple_requests", "use persistent connections", OFFSET(multiple_requests), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, D|E },
 {"post_data", "custom HTTP post data", OFFSET(post_data), AV_OPT_TYPE_BINARY, .flags = D|E },
+{"reuse_connections", "reuse idle persistent connections to the same host across requests", OFFSET(reuse_connections), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, D },
 {NULL}
 };
 #define HTTP_CLASS(flavor)\
@@ -84,6 +102,143 @@ HTTP_CLASS(https);
 static int http_connect(URLContext *h, const char *path, const char *local_path,
                         const char *hoststr, const char *auth,
                         const char *proxyauth, int *new_location);
+static int http_read(URLContext *h, uint8_t *buf, int size);
+
+/* The pool is shared by all HTTP contexts of the process. Pooled
+ * connections are only modified while they are in the pool, so a lock
+ * is only needed for the pool array itself. */
+#if HAVE_PTHREADS || !HAVE_THREADS
+typedef struct HTTPPoolEntry {
+    URLContext *hd;
+    char key[1024];
+    int64_t idle_since;
+} HTTPPoolEntry;
+
+static HTTPPoolEntry pool[POOL_SIZE];
+#if HAVE_PTHREADS
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void pool_lock(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&pool_mutex);
+#endif
+}
+
+static void pool_unlock(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_unlock(&pool_mutex);
+#endif
+}
+
+static URLContext *pool_get(const char *key, const AVIOInterruptCB *int_cb)
+{
+    URLContext *hd = NULL;
+    int64_t now = av_gettime();
+    int i;
+
+    pool_lock();
+    for (i = 0; i < POOL_SIZE; i++) {
+        if (!pool[i].hd)
+            continue;
+        if (now - pool[i].idle_since > POOL_IDLE_TIMEOUT) {
+            ffurl_close(pool[i].hd);
+            pool[i].hd = NULL;
+        } else if (!hd && !strcmp(pool[i].key, key)) {
+            hd = pool[i].hd;
+            pool[i].hd = NULL;
+        }
+    }
+    pool_unlock();
+
+    if (hd)
+        hd->interrupt_callback = *int_cb;
+    return hd;
+}
+
+static void pool_put(URLContext *hd, const char *key)
+{
+    int i, slot = 0;
+
+    /* The interrupt callback belongs to the context that used hd last */
+    memset(&hd->interrupt_callback, 0, sizeof(hd->interrupt_callback));
+
+    pool_lock();
+    for (i = 0; i < POOL_SIZE; i++) {
+        if (!pool[i].hd) {
+            slot = i;
+            break;
+        }
+        if (pool[i].idle_since < pool[slot].idle_since)
+            slot = i;
+    }
+    if (pool[slot].hd)
+        ffurl_close(pool[slot].hd);
+    pool[slot].hd         = hd;
+    pool[slot].idle_since = av_gettime();
+    av_strlcpy(pool[slot].key, key, sizeof(pool[slot].key));
+    pool_unlock();
+}
+#else
+/* Pooling across threads needs a lock, only implemented with pthreads. */
+static URLContext *pool_get(const char *key, const AVIOInterruptCB *int_cb)
+{
+    return NULL;
+}
+
+static void pool_put(URLContext *hd, const char *key)
+{
+    ffurl_close(hd);
+}
+#endif
+
+/* return non zero if the whole response body has been read */
+static int http_body_complete(HTTPContext *s)
+{
+    if (s->willclose || s->buf_ptr != s->buf_end)
+        return 0;
+    if (s->chunksize >= 0)
+        return s->last_chunk_read;
+    return s->filesize >= 0 && s->off >= s->filesize;
+}
+
+/**
+ * Discard what is left of the response body if it is small, so that
+ * the connection can be used for another request.
+ *
+ * @return non zero if the connection can be reused
+ */
+static int http_drain_body(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    uint8_t buf[1024];
+    int drained = 0, ret;
+
+    if (s->willclose || (s->chunksize < 0 &&
+        (s->filesize < 0 || s->filesize - s->off > MAX_DRAIN_SIZE)))
+        return 0;
+    while (!http_body_complete(s) && drained < MAX_DRAIN_SIZE) {
+        if ((ret = http_read(h, buf, sizeof(buf))) <= 0)
+            break;
+        drained += ret;
+    }
+    return http_body_complete(s);
+}
+
+/* Give the connection back to the pool if possible, close it otherwise. */
+static void http_release_connection(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+
+    if (s->reuse_connections && s->pool_key[0] &&
+        !(h->flags & AVIO_FLAG_WRITE) && http_drain_body(h))
+        pool_put(s->hd, s->pool_key);
+    else
+        ffurl_close(s->hd);
+    s->hd = NULL;
+}
 
 void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
 {
@@ -103,6 +258,7 @@ static int http_open_cnx(URLContext *h)
     char path1[MAX_URL_SIZE];
     char buf[1024], urlbuf[MAX_URL_SIZE];
     int port, use_proxy, err, location_changed = 0, redirects = 0, attempts = 0;
+    int reused;
     HTTPAuthType cur_auth_type, cur_proxy_auth_type;
     HTTPContext *s = h->priv_data;
 
@@ -144,23 +300,37 @@ static int http_open_cnx(URLContext *h)
 
     ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
 
+    /* TLS connections are not pooled, the interrupt callback of the
+     * nested TCP connection can't be updated. */
+    reused = !!s->hd;
+    if (!s->hd && s->reuse_connections && !strcmp(lower_proto, "tcp"))
+        reused = !!(s->hd = pool_get(buf, &h->interrupt_callback));
     if (!s->hd) {
         err = ffurl_open(&s->hd, buf, AVIO_FLAG_READ_WRITE,
                          &h->interrupt_callback, NULL);
         if (err < 0)
             goto fail;
     }
+    av_strlcpy(s->pool_key, strcmp(lower_proto, "tcp") ? "" : buf,
+               sizeof(s->pool_key));
 
     cur_auth_type = s->auth_state.auth_type;
     cur_proxy_auth_type = s->auth_state.auth_type;
-    if (http_connect(h, path, local_path, hoststr, auth, proxyauth, &location_changed) < 0)
+    s->line_count = 0;
+    if (http_connect(h, path, local_path, hoststr, auth, proxyauth, &location_changed) < 0) {
+        if (reused && !s->line_count) {
+            /* The server closed the idle connection, retry on a new one */
+            ffurl_close(s->hd);
+            s->hd = NULL;
+            goto redo;
+        }
         goto fail;
+    }
     attempts++;
     if (s->http_code == 401) {
         if ((cur_auth_type == HTTP_AUTH_NONE || s->auth_state.stale) &&
             s->auth_state.auth_type != HTTP_AUTH_NONE && attempts < 4) {
-            ffurl_close(s->hd);
-            s->hd = NULL;
+            http_release_connection(h);
             goto redo;
         } else
             goto fail;
@@ -168,8 +338,7 @@ static int http_open_cnx(URLContext *h)
     if (s->http_code == 407) {
         if ((cur_proxy_auth_type == HTTP_AUTH_NONE || s->proxy_auth_state.stale) &&
             s->proxy_auth_state.auth_type != HTTP_AUTH_NONE && attempts < 4) {
-            ffurl_close(s->hd);
-            s->hd = NULL;
+            http_release_connection(h);
             goto redo;
         } else
             goto fail;
@@ -177,8 +346,7 @@ static int http_open_cnx(URLContext *h)
     if ((s->http_code == 301 || s->http_code == 302 || s->http_code == 303 || s->http_code == 307)
         && location_changed == 1) {
         /* url moved, get next */
-        ffurl_close(s->hd);
-        s->hd = NULL;
+        http_release_connection(h);
         if (redirects++ >= MAX_REDIRECTS)
             return AVERROR(EIO);
         /* Restart the authentication process with the new target, which
@@ -283,6 +451,9 @@ static int process_line(URLContext *h, char *line, int line_count,
         while (isspace(*p))
             p++;
         s->http_code = strtol(p, &end, 10);
+        /* HTTP/1.0 servers close the connection after the response */
+        if (av_strstart(line, "HTTP/1.0", NULL))
+            s->willclose = 1;
 
         av_dlog(NULL, "http_code=%d\n", s->http_code);
 
@@ -415,7 +586,7 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
                            "Range: bytes=%"PRId64"-\r\n", s->off);
 
     if (!has_header(s->headers, "\r\nConnection: ")) {
-        if (s->multiple_requests) {
+        if (s->multiple_requests || s->reuse_connections) {
             len += av_strlcpy(headers + len, "Connection: keep-alive\r\n",
                               sizeof(headers) - len);
         } else {
@@ -465,6 +636,7 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
     s->off = 0;
     s->filesize = -1;
     s->willclose = 0;
+    s->last_chunk_read = 0;
     s->end_chunked_post = 0;
     s->end_header = 0;
     if (post && !s->post_data) {
@@ -488,6 +660,10 @@ static int http_buf_read(URLContext *h, uint8_t *buf, int size)
 {
     HTTPContext *s = h->priv_data;
     int len;
+
+    /* A failed seek may leave the context without a connection */
+    if (!s->hd)
+        return AVERROR(EIO);
     /* read bytes from input buffer first */
     len = s->buf_end - s->buf_ptr;
     if (len > 0) {
@@ -514,7 +690,7 @@ static int http_read(URLContext *h, uint8_t *buf, int size)
     int err, new_location;
 
     if (!s->hd)
-        return AVERROR_EOF;
+        return AVERROR(EIO);
 
     if (s->end_chunked_post && !s->end_header) {
         err = http_read_header(h, &new_location);
@@ -523,6 +699,8 @@ static int http_read(URLContext *h, uint8_t *buf, int size)
     }
 
     if (s->chunksize >= 0) {
+        if (s->last_chunk_read)
+            return 0;
         if (!s->chunksize) {
             char line[32];
 
@@ -536,8 +714,15 @@ static int http_read(URLContext *h, uint8_t *buf, int size)
 
                 av_dlog(NULL, "Chunked encoding data size: %"PRId64"'\n", s->chunksize);
 
-                if (!s->chunksize)
+                if (!s->chunksize) {
+                    /* skip the trailer, up to the final empty line */
+                    do {
+                        if ((err = http_get_line(s, line, sizeof(line))) < 0)
+                            return err;
+                    } while (*line);
+                    s->last_chunk_read = 1;
                     return 0;
+                }
                 break;
             }
         }
@@ -600,7 +785,7 @@ static int http_close(URLContext *h)
     }
 
     if (s->hd)
-        ffurl_close(s->hd);
+        http_release_connection(h);
     return ret;
 }
 
@@ -617,23 +802,52 @@ static int64_t http_seek(URLContext *h, int64_t off, int whence)
     else if ((s->filesize == -1 && whence == SEEK_END) || h->is_streamed)
         return -1;
 
-    /* we save the old context in case the seek fails */
-    old_buf_size = s->buf_end - s->buf_ptr;
-    memcpy(old_buf, s->buf_ptr, old_buf_size);
-    s->hd = NULL;
     if (whence == SEEK_CUR)
         off += s->off;
     else if (whence == SEEK_END)
         off += s->filesize;
+
+    /* we save the old context in case the seek fails */
+    old_buf_size = s->buf_end - s->buf_ptr;
+    memcpy(old_buf, s->buf_ptr, old_buf_size);
+
+    /* If the rest of the current response is small enough to be skipped,
+     * send the range request on the same connection. */
+    if (s->reuse_connections && s->chunksize < 0) {
+        int drained = http_drain_body(h);
+        if (drained) {
+            s->off = off;
+            if (http_open_cnx(h) >= 0)
+                return off;
+        }
+        /* Once anything has been drained, the old connection can't be
+         * continued on; get back to old_off on a new one if needed. */
+        if (drained || s->off != old_off) {
+            ffurl_close(s->hd);
+            old_hd = NULL;
+        }
+    }
+
+    s->hd = NULL;
     s->off = off;
 
     /* if it fails, continue on old connection */
     if (http_open_cnx(h) < 0) {
+        s->off = old_off;
+        if (!old_hd) {
+            /* The old connection is gone, reconnect at the old position.
+             * If that fails too, there is no connection left and reads
+             * fail until the next successful seek. */
+            if (http_open_cnx(h) < 0) {
+                s->buf_ptr = s->buf_end = s->buffer;
+                s->off = old_off;
+            }
+            return -1;
+        }
         memcpy(s->buffer, old_buf, old_buf_size);
         s->buf_ptr = s->buffer;
         s->buf_end = s->buffer + old_buf_size;
         s->hd = old_hd;
-        s->off = old_off;
         return -1;
     }
     ffurl_close(old_hd);
@@ -151,6 +151,12 @@ void ff_sdp_write_media(char *buff, int size, AVStream *st, int idx,
 int ff_write_chained(AVFormatContext *dst, int dst_stream, AVPacket *pkt,
                      AVFormatContext *src);
 
+/**
+ * Return the file system path of url if it refers to a local file, so that
+ * it can be renamed or removed, NULL otherwise.
+ */
+const char *ff_url_local_path(const char *url);
+
 /**
  * Get the length in bytes which is needed to store val as v.
  */
@@ -172,16 +172,6 @@ typedef struct {
     AVChapter *chapter;
 } MatroskaChapter;
 
-typedef struct {
-    uint64_t track;
-    uint64_t pos;
-} MatroskaIndexPos;
-
-typedef struct {
-    uint64_t time;
-    EbmlList pos;
-} MatroskaIndex;
-
 typedef struct {
     char *name;
     char *string;
@@ -233,7 +223,6 @@ typedef struct {
     EbmlList tracks;
     EbmlList attachments;
     EbmlList chapters;
-    EbmlList index;
     EbmlList tags;
     EbmlList seekhead;
 
@@ -253,11 +242,22 @@ typedef struct {
 
     /* File has a CUES element, but we defer parsing until it is needed. */
     int cues_parsing_deferred;
+    /* Payload of a CUES element found while parsing the file, if any. */
+    int64_t cues_pos;
+    uint64_t cues_length;
+
+    /* The index covers the whole file, from the cues or a complete scan. */
+    int index_complete;
+    int64_t first_cluster_pos;
 
-    int current_cluster_num_blocks;
     int64_t current_cluster_pos;
     MatroskaCluster current_cluster;
 
+    /* buffer reused for the blocks which are not read straight into
+     * their packets */
+    uint8_t *block_buf;
+    unsigned int block_buf_size;
+
     /* File has SSA subtitles which prevent incremental cluster parsing. */
     int contains_ssa;
 } MatroskaDemuxContext;
@@ -419,24 +419,6 @@ static EbmlSyntax matroska_chapters[] = {
     { 0 }
 };
 
-static EbmlSyntax matroska_index_pos[] = {
-    { MATROSKA_ID_CUETRACK,           EBML_UINT, 0, offsetof(MatroskaIndexPos,track) },
-    { MATROSKA_ID_CUECLUSTERPOSITION, EBML_UINT, 0, offsetof(MatroskaIndexPos,pos)   },
-    { MATROSKA_ID_CUEBLOCKNUMBER,     EBML_NONE },
-    { 0 }
-};
-
-static EbmlSyntax matroska_index_entry[] = {
-    { MATROSKA_ID_CUETIME,            EBML_UINT, 0, offsetof(MatroskaIndex,time) },
-    { MATROSKA_ID_CUETRACKPOSITION,   EBML_NEST, sizeof(MatroskaIndexPos), offsetof(MatroskaIndex,pos), {.n=matroska_index_pos} },
-    { 0 }
-};
-
-static EbmlSyntax matroska_index[] = {
-    { MATROSKA_ID_POINTENTRY,         EBML_NEST, sizeof(MatroskaIndex), offsetof(MatroskaDemuxContext,index), {.n=matroska_index_entry} },
-    { 0 }
-};
-
 static EbmlSyntax matroska_simpletag[] = {
     { MATROSKA_ID_TAGNAME,            EBML_UTF8, 0, offsetof(MatroskaTag,name) },
     { MATROSKA_ID_TAGSTRING,          EBML_UTF8, 0, offsetof(MatroskaTag,string) },
@@ -483,7 +465,7 @@ static EbmlSyntax matroska_segment[] = {
     { MATROSKA_ID_TRACKS,         EBML_NEST, 0, 0, {.n=matroska_tracks     } },
     { MATROSKA_ID_ATTACHMENTS,    EBML_NEST, 0, 0, {.n=matroska_attachments} },
     { MATROSKA_ID_CHAPTERS,       EBML_NEST, 0, 0, {.n=matroska_chapters   } },
-    { MATROSKA_ID_CUES,           EBML_NEST, 0, 0, {.n=matroska_index      } },
+    { MATROSKA_ID_CUES,           EBML_NONE }, // see matroska_parse_cues()
     { MATROSKA_ID_TAGS,           EBML_NEST, 0, 0, {.n=matroska_tags       } },
     { MATROSKA_ID_SEEKHEAD,       EBML_NEST, 0, 0, {.n=matroska_seekhead   } },
     { MATROSKA_ID_CLUSTER,        EBML_STOP },
@@ -524,8 +506,8 @@ static EbmlSyntax matroska_clusters[] = {
 
 static EbmlSyntax matroska_cluster_incremental_parsing[] = {
     { MATROSKA_ID_CLUSTERTIMECODE,EBML_UINT,0, offsetof(MatroskaCluster,timecode) },
-    { MATROSKA_ID_BLOCKGROUP,     EBML_NEST, sizeof(MatroskaBlock), offsetof(MatroskaCluster,blocks), {.n=matroska_blockgroup} },
-    { MATROSKA_ID_SIMPLEBLOCK,    EBML_PASS, sizeof(MatroskaBlock), offsetof(MatroskaCluster,blocks), {.n=matroska_blockgroup} },
+    { MATROSKA_ID_BLOCKGROUP,     EBML_STOP }, // see matroska_read_block()
+    { MATROSKA_ID_SIMPLEBLOCK,    EBML_STOP },
     { MATROSKA_ID_CLUSTERPOSITION,EBML_NONE },
     { MATROSKA_ID_CLUSTERPREVSIZE,EBML_NONE },
     { MATROSKA_ID_INFO,           EBML_NONE },
@@ -887,7 +869,14 @@ static int ebml_parse_elem(MatroskaDemuxContext *matroska,
                      return ebml_parse_nest(matroska, syntax->def.n, data);
     case EBML_PASS:  return ebml_parse_id(matroska, syntax->def.n, id, data);
     case EBML_STOP:  return 1;
-    default:         return avio_skip(pb,length)<0 ? AVERROR(EIO) : 0;
+    default:         if (id == MATROSKA_ID_CUES && !matroska->cues_pos) {
+                         // not listed in the SeekHead, see matroska_parse_cues()
+                         matroska->cues_pos    = avio_tell(pb);
+                         matroska->cues_length = length;
+                         if (!matroska->index_complete)
+                             matroska->cues_parsing_deferred = 1;
+                     }
+                     return avio_skip(pb,length)<0 ? AVERROR(EIO) : 0;
     }
     if (res == AVERROR_INVALIDDATA)
         av_log(matroska->ctx, AV_LOG_ERROR, "Invalid element\n");
@@ -1279,54 +1268,276 @@ static void matroska_execute_seekhead(MatroskaDemuxContext *matroska)
 
     for (i = 0; i < seekhead_list->nb_elem; i++) {
         MatroskaSeekhead *seekhead = seekhead_list->elem;
-        if (seekhead[i].pos <= before_pos)
-            continue;
 
-        // defer cues parsing until we actually need cue data.
+        // defer cues parsing until we actually need cue data, cues before
+        // the clusters are skipped by the header parsing as well
         if (seekhead[i].id == MATROSKA_ID_CUES) {
             matroska->cues_parsing_deferred = 1;
             continue;
         }
 
+        if (seekhead[i].pos <= before_pos)
+            continue;
+
         if (matroska_parse_seekhead_entry(matroska, i) < 0)
             break;
     }
 }
 
+/*
+ * Read the ID and length of the next element.
+ * Returns: < 0 on error
+ */
+static int ebml_read_element(MatroskaDemuxContext *matroska, AVIOContext *pb,
+                             uint32_t *id, uint64_t *length)
+{
+    uint64_t num;
+    int res = ebml_read_num(matroska, pb, 4, &num);
+
+    if (res < 0)
+        return res;
+    *id = num | 1 << 7*res;
+    return ebml_read_length(matroska, pb, length);
+}
+
+#define MAX_CUE_TRACK_POSITIONS 32
+
+/*
+ * Add the positions of a CuePoint to the index of their streams.
+ */
+static int matroska_parse_cue_point(MatroskaDemuxContext *matroska,
+                                    int64_t end, int *index_scale)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    uint64_t time = 0, track[MAX_CUE_TRACK_POSITIONS], pos[MAX_CUE_TRACK_POSITIONS];
+    int i, res, nb_pos = 0, has_time = 0;
+
+    while (avio_tell(pb) < end) {
+        uint64_t length;
+        uint32_t id;
+
+        if ((res = ebml_read_element(matroska, pb, &id, &length)) < 0)
+            return res;
+        if (length > end - avio_tell(pb))
+            return AVERROR_INVALIDDATA;
+
+        if (id == MATROSKA_ID_CUETIME) {
+            if ((res = ebml_read_uint(pb, length, &time)) < 0)
+                return res;
+            has_time = 1;
+        } else if (id == MATROSKA_ID_CUETRACKPOSITION &&
+                   nb_pos < MAX_CUE_TRACK_POSITIONS) {
+            int64_t pos_end = avio_tell(pb) + length;
+
+            track[nb_pos] = pos[nb_pos] = 0;
+            while (avio_tell(pb) < pos_end) {
+                if ((res = ebml_read_element(matroska, pb, &id, &length)) < 0)
+                    return res;
+                if (length > pos_end - avio_tell(pb))
+                    return AVERROR_INVALIDDATA;
+                if (id == MATROSKA_ID_CUETRACK)
+                    res = ebml_read_uint(pb, length, &track[nb_pos]);
+                else if (id == MATROSKA_ID_CUECLUSTERPOSITION)
+                    res = ebml_read_uint(pb, length, &pos[nb_pos]);
+                else
+                    avio_skip(pb, length);
+                if (res < 0)
+                    return res;
+            }
+            nb_pos++;
+        } else
+            avio_skip(pb, length);
+    }
+
+    if (!has_time)
+        return 0;
+
+    if (!*index_scale) {
+        *index_scale = 1;
+        if (time > 1E14/matroska->time_scale) {
+            av_log(matroska->ctx, AV_LOG_WARNING, "Working around broken index.\n");
+            *index_scale = matroska->time_scale;
+        }
+    }
+
+    for (i = 0; i < nb_pos; i++) {
+        MatroskaTrack *mt = matroska_find_track_by_num(matroska, track[i]);
+        if (mt && mt->stream)
+            av_add_index_entry(mt->stream, pos[i] + matroska->segment_start,
+                               time / *index_scale, 0, 0, AVINDEX_KEYFRAME);
+    }
+    return 0;
+}
+
+/*
+ * Read the Cues with the payload at start straight into the stream indexes,
+ * without going through the generic EBML parser, which would allocate every
+ * single element.
+ */
+static void matroska_read_cues(MatroskaDemuxContext *matroska, int64_t start,
+                               uint64_t length)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    int64_t before_pos = avio_tell(pb);
+    int64_t end;
+    uint32_t id;
+    int index_scale = 0;
+
+    if (avio_seek(pb, start, SEEK_SET) != start)
+        goto end;
+
+    end = length == 0xffffffffffffffULL ? INT64_MAX : start + length;
+    while (avio_tell(pb) < end && !pb->eof_reached) {
+        if (ebml_read_element(matroska, pb, &id, &length) < 0 ||
+            length == 0xffffffffffffffULL)
+            break;
+        if (id == MATROSKA_ID_POINTENTRY) {
+            if (matroska_parse_cue_point(matroska, avio_tell(pb) + length,
+                                         &index_scale) < 0)
+                break;
+        } else
+            avio_skip(pb, length);
+    }
+    matroska->index_complete |= index_scale != 0;
+
+end:
+    avio_seek(pb, before_pos, SEEK_SET);
+}
+
 static void matroska_parse_cues(MatroskaDemuxContext *matroska) {
     EbmlList *seekhead_list = &matroska->seekhead;
     MatroskaSeekhead *seekhead = seekhead_list->elem;
-    EbmlList *index_list;
-    MatroskaIndex *index;
-    int index_scale = 1;
-    int i, j;
+    AVIOContext *pb = matroska->ctx->pb;
+    int64_t before_pos = avio_tell(pb);
+    int64_t offset;
+    uint64_t length;
+    uint32_t id;
+    int i;
 
     for (i = 0; i < seekhead_list->nb_elem; i++)
         if (seekhead[i].id == MATROSKA_ID_CUES)
             break;
-    assert(i <= seekhead_list->nb_elem);
-
-    matroska_parse_seekhead_entry(matroska, i);
-
-    index_list = &matroska->index;
-    index = index_list->elem;
-    if (index_list->nb_elem
-        && index[0].time > 1E14/matroska->time_scale) {
-        av_log(matroska->ctx, AV_LOG_WARNING, "Working around broken index.\n");
-        index_scale = matroska->time_scale;
-    }
-    for (i = 0; i < index_list->nb_elem; i++) {
-        EbmlList *pos_list = &index[i].pos;
-        MatroskaIndexPos *pos = pos_list->elem;
-        for (j = 0; j < pos_list->nb_elem; j++) {
-            MatroskaTrack *track = matroska_find_track_by_num(matroska, pos[j].track);
-            if (track && track->stream)
-                av_add_index_entry(track->stream,
-                                   pos[j].pos + matroska->segment_start,
-                                   index[i].time/index_scale, 0, 0,
-                                   AVINDEX_KEYFRAME);
+    if (i == seekhead_list->nb_elem) {
+        if (matroska->cues_pos)
+            matroska_read_cues(matroska, matroska->cues_pos,
+                               matroska->cues_length);
+        return;
+    }
+
+    offset = seekhead[i].pos + matroska->segment_start;
+    if (avio_seek(pb, offset, SEEK_SET) == offset &&
+        ebml_read_element(matroska, pb, &id, &length) >= 0 &&
+        id == MATROSKA_ID_CUES)
+        matroska_read_cues(matroska, avio_tell(pb), length);
+    avio_seek(pb, before_pos, SEEK_SET);
+}
+
+/*
+ * Add the key frames of the block starting at the current position to the
+ * index.
+ */
+static int matroska_index_block(MatroskaDemuxContext *matroska, int64_t end,
+                                int64_t cluster_pos, uint64_t cluster_time,
+                                int is_keyframe)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    MatroskaTrack *track;
+    uint64_t num;
+    int16_t block_time;
+    int res, flags;
+
+    if ((res = ebml_read_num(matroska, pb, 8, &num)) < 0)
+        return res;
+    block_time = avio_rb16(pb);
+    flags      = avio_r8(pb);
+    if (is_keyframe == -1)
+        is_keyframe = flags & 0x80;
+
+    if (is_keyframe && cluster_time != (uint64_t)-1 &&
+        (block_time >= 0 || cluster_time >= -block_time) &&
+        (track = matroska_find_track_by_num(matroska, num)) &&
+        track->stream && track->type != MATROSKA_TRACK_TYPE_SUBTITLE)
+        av_add_index_entry(track->stream, cluster_pos,
+                           cluster_time + block_time, 0, 0, AVINDEX_KEYFRAME);
+
+    return avio_seek(pb, end, SEEK_SET) < 0 ? AVERROR(EIO) : 0;
+}
+
+/*
+ * Index the key frames of the next cluster, or skip the next level 1
+ * element if it is not a cluster. Only the block headers are read.
+ * Returns: < 0 on error or at the end of the file
+ */
+static int matroska_index_cluster(MatroskaDemuxContext *matroska)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    int64_t cluster_pos = avio_tell(pb), end, pos;
+    uint64_t cluster_time = -1, length;
+    uint32_t id;
+    int res;
+
+    if ((res = ebml_read_element(matroska, pb, &id, &length)) < 0)
+        return res;
+    if (id != MATROSKA_ID_CLUSTER) {
+        if (length == 0xffffffffffffffULL)
+            return AVERROR_INVALIDDATA;
+        if (id == MATROSKA_ID_CUES && !matroska->index_complete)
+            matroska_read_cues(matroska, avio_tell(pb), length);
+        return avio_skip(pb, length) < 0 ? AVERROR(EIO) : 0;
+    }
+
+    end = length == 0xffffffffffffffULL ? INT64_MAX : avio_tell(pb) + length;
+    while ((pos = avio_tell(pb)) < end) {
+        if ((res = ebml_read_element(matroska, pb, &id, &length)) < 0)
+            return res;
+        if (id == MATROSKA_ID_CLUSTER) {
+            // end of a cluster of unknown size
+            avio_seek(pb, pos, SEEK_SET);
+            break;
+        }
+        if (length == 0xffffffffffffffULL)
+            return AVERROR_INVALIDDATA;
+
+        switch (id) {
+        case MATROSKA_ID_CLUSTERTIMECODE:
+            res = ebml_read_uint(pb, length, &cluster_time);
+            break;
+        case MATROSKA_ID_SIMPLEBLOCK:
+            res = matroska_index_block(matroska, avio_tell(pb) + length,
+                                       cluster_pos, cluster_time, -1);
+            break;
+        case MATROSKA_ID_BLOCKGROUP: {
+            int64_t group_end = avio_tell(pb) + length, block_pos = -1;
+            int64_t block_end = 0;
+            int is_keyframe = 1;
+
+            while (!res && avio_tell(pb) < group_end) {
+                if ((res = ebml_read_element(matroska, pb, &id, &length)) < 0)
+                    break;
+                if (id == MATROSKA_ID_BLOCK) {
+                    block_pos = avio_tell(pb);
+                    block_end = block_pos + length;
+                } else if (id == MATROSKA_ID_BLOCKREFERENCE)
+                    is_keyframe = 0;
+                if (avio_skip(pb, length) < 0)
+                    res = AVERROR(EIO);
+            }
+            if (!res && block_pos >= 0) {
+                avio_seek(pb, block_pos, SEEK_SET);
+                res = matroska_index_block(matroska, block_end, cluster_pos,
+                                           cluster_time, is_keyframe);
+                avio_seek(pb, group_end, SEEK_SET);
+            }
+            break;
+        }
+        default:
+            if (avio_skip(pb, length) < 0)
+                res = AVERROR(EIO);
         }
+        if (res < 0)
+            return res;
     }
+    return pb->eof_reached ? AVERROR_EOF : 0;
 }
 
 static int matroska_aac_profile(char *codec_id)
@@ -1391,6 +1602,9 @@ static int matroska_read_header(AVFormatContext *s)
     /* The next thing is a segment. */
     if ((res = ebml_parse(matroska, matroska_segments, matroska)) < 0)
         return res;
+    matroska->first_cluster_pos = avio_tell(matroska->ctx->pb);
+    if (matroska->current_id == MATROSKA_ID_CLUSTER)
+        matroska->first_cluster_pos -= 4;  /* sizeof the ID which was already read */
     matroska_execute_seekhead(matroska);
 
     if (!matroska->time_scale)
@@ -1928,6 +2142,43 @@ static int matroska_parse_rm_audio(MatroskaDemuxContext *matroska,
 
     return 0;
 }
+static int matroska_queue_frame(MatroskaDemuxContext *matroska,
+                                MatroskaTrack *track, AVPacket *pkt,
+                                uint64_t timecode, uint64_t duration,
+                                int64_t pos, int is_keyframe)
+{
+    AVStream *st = track->stream;
+
+    pkt->flags = is_keyframe;
+    pkt->stream_index = st->index;
+
+    if (track->ms_compat)
+        pkt->dts = timecode;
+    else
+        pkt->pts = timecode;
+    pkt->pos = pos;
+    if (st->codec->codec_id == AV_CODEC_ID_TEXT)
+        pkt->convergence_duration = duration;
+    else if (track->type != MATROSKA_TRACK_TYPE_SUBTITLE)
+        pkt->duration = duration;
+
+    if (st->codec->codec_id == AV_CODEC_ID_SSA)
+        matroska_fix_ass_packet(matroska, pkt, duration);
+
+    if (matroska->prev_pkt &&
+        timecode != AV_NOPTS_VALUE &&
+        matroska->prev_pkt->pts == timecode &&
+        matroska->prev_pkt->stream_index == st->index &&
+        st->codec->codec_id == AV_CODEC_ID_SSA)
+        matroska_merge_packets(matroska->prev_pkt, pkt);
+    else {
+        dynarray_add(&matroska->packets,&matroska->num_packets,pkt);
+        matroska->prev_pkt = pkt;
+    }
+
+    return 0;
+}
+
 static int matroska_parse_frame(MatroskaDemuxContext *matroska,
                                 MatroskaTrack *track,
                                 AVStream *st,
@@ -1967,49 +2218,29 @@ static int matroska_parse_frame(MatroskaDemuxContext *matroska,
     if (pkt_data != data)
         av_free(pkt_data);
 
-    pkt->flags = is_keyframe;
-    pkt->stream_index = st->index;
-
-    if (track->ms_compat)
-        pkt->dts = timecode;
-    else
-        pkt->pts = timecode;
-    pkt->pos = pos;
-    if (st->codec->codec_id == AV_CODEC_ID_TEXT)
-        pkt->convergence_duration = duration;
-    else if (track->type != MATROSKA_TRACK_TYPE_SUBTITLE)
-        pkt->duration = duration;
-
-    if (st->codec->codec_id == AV_CODEC_ID_SSA)
-        matroska_fix_ass_packet(matroska, pkt, duration);
-
-    if (matroska->prev_pkt &&
-        timecode != AV_NOPTS_VALUE &&
-        matroska->prev_pkt->pts == timecode &&
-        matroska->prev_pkt->stream_index == st->index &&
-        st->codec->codec_id == AV_CODEC_ID_SSA)
-        matroska_merge_packets(matroska->prev_pkt, pkt);
-    else {
-        dynarray_add(&matroska->packets,&matroska->num_packets,pkt);
-        matroska->prev_pkt = pkt;
-    }
-
-    return 0;
+    return matroska_queue_frame(matroska, track, pkt, timecode, duration,
+                                pos, is_keyframe);
 }
 
-static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
-                                int size, int64_t pos, uint64_t cluster_time,
-                                uint64_t block_duration, int is_keyframe,
-                                int64_t cluster_pos)
+/*
+ * Parse the header of a block: find its track, compute its timecode and
+ * whether it is a key frame, and update the index and the seeking state.
+ * Only the header has to be available in data, size is the whole block size.
+ * Returns: the header size if the frames of the block are to be output,
+ * 0 if they are skipped, < 0 on error
+ */
+static int matroska_parse_block_header(MatroskaDemuxContext *matroska,
+                                       uint8_t *data, int size,
+                                       uint64_t cluster_time, int64_t cluster_pos,
+                                       MatroskaTrack **track_ret,
+                                       uint64_t *timecode_ret,
+                                       int *is_keyframe, int *flags)
 {
     uint64_t timecode = AV_NOPTS_VALUE;
     MatroskaTrack *track;
-    int res = 0;
-    AVStream *st;
     int16_t block_time;
-    uint32_t *lace_size = NULL;
-    int n, flags, laces = 0;
-    uint64_t num, duration;
+    uint64_t num;
+    int n;
 
     if ((n = matroska_ebmlnum_uint(matroska, data, size, &num)) < 0) {
         av_log(matroska->ctx, AV_LOG_ERROR, "EBML block data error\n");
@@ -2025,33 +2256,47 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
         return AVERROR_INVALIDDATA;
     } else if (size <= 3)
         return 0;
-    st = track->stream;
-    if (st->discard >= AVDISCARD_ALL)
-        return res;
+    if (track->stream->discard >= AVDISCARD_ALL)
+        return 0;
 
     block_time = AV_RB16(data);
-    data += 2;
-    flags = *data++;
-    size -= 3;
-    if (is_keyframe == -1)
-        is_keyframe = flags & 0x80 ? AV_PKT_FLAG_KEY : 0;
+    *flags = data[2];
+    if (*is_keyframe == -1)
+        *is_keyframe = *flags & 0x80 ? AV_PKT_FLAG_KEY : 0;
 
     if (cluster_time != (uint64_t)-1
         && (block_time >= 0 || cluster_time >= -block_time)) {
         timecode = cluster_time + block_time;
         if (track->type == MATROSKA_TRACK_TYPE_SUBTITLE
             && timecode < track->end_timecode)
-            is_keyframe = 0;  /* overlapping subtitles are not key frame */
-        if (is_keyframe)
-            av_add_index_entry(st, cluster_pos, timecode, 0,0,AVINDEX_KEYFRAME);
+            *is_keyframe = 0;  /* overlapping subtitles are not key frame */
+        if (*is_keyframe)
+            av_add_index_entry(track->stream, cluster_pos, timecode,
+                               0, 0, AVINDEX_KEYFRAME);
     }
 
     if (matroska->skip_to_keyframe && track->type != MATROSKA_TRACK_TYPE_SUBTITLE) {
-        if (!is_keyframe || timecode < matroska->skip_to_timecode)
-            return res;
+        if (!*is_keyframe || timecode < matroska->skip_to_timecode)
+            return 0;
         matroska->skip_to_keyframe = 0;
     }
 
+    *track_ret    = track;
+    *timecode_ret = timecode;
+    return n + 3;
+}
+
+static int matroska_parse_block_frames(MatroskaDemuxContext *matroska,
+                                       MatroskaTrack *track, uint8_t *data,
+                                       int size, int flags, int64_t pos,
+                                       uint64_t timecode,
+                                       uint64_t block_duration, int is_keyframe)
+{
+    AVStream *st = track->stream;
+    uint32_t *lace_size = NULL;
+    int n, res, laces = 0;
+    uint64_t duration;
+
     res = matroska_parse_laces(matroska, &data, size, (flags & 0x06) >> 1,
                                &lace_size, &laces);
 
@@ -2104,21 +2349,171 @@ end:
     return res;
 }
 
+static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
+                                int size, int64_t pos, uint64_t cluster_time,
+                                uint64_t block_duration, int is_keyframe,
+                                int64_t cluster_pos)
+{
+    uint64_t timecode;
+    MatroskaTrack *track;
+    int res, flags;
+
+    res = matroska_parse_block_header(matroska, data, size, cluster_time,
+                                      cluster_pos, &track, &timecode,
+                                      &is_keyframe, &flags);
+    if (res <= 0)
+        return res;
+
+    return matroska_parse_block_frames(matroska, track, data + res, size - res,
+                                       flags, pos, timecode, block_duration,
+                                       is_keyframe);
+}
+
+/*
+ * Read a SimpleBlock of the given size. Blocks holding a single frame
+ * which needs no further processing are read straight into their packet,
+ * the others are read into a buffer which is reused for all the blocks.
+ */
+static int matroska_read_simple_block(MatroskaDemuxContext *matroska,
+                                      int size)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    int64_t pos = avio_tell(pb);
+    MatroskaTrackEncoding *encodings;
+    MatroskaTrack *track;
+    uint64_t timecode, duration;
+    uint8_t *data;
+    int header_size, res, flags, is_keyframe = -1;
+    AVPacket *pkt;
+
+    av_fast_malloc(&matroska->block_buf, &matroska->block_buf_size, size);
+    if (!(data = matroska->block_buf))
+        return AVERROR(ENOMEM);
+
+    /* the track number, whose first byte gives its length, the timecode
+     * and the flags */
+    data[0] = avio_r8(pb);
+    header_size = FFMIN(size, 8 - av_log2(data[0] ? data[0] : 1) + 3);
+    if (avio_read(pb, data + 1, header_size - 1) != header_size - 1)
+        return AVERROR(EIO);
+
+    res = matroska_parse_block_header(matroska, data, size,
+                                      matroska->current_cluster.timecode,
+                                      matroska->current_cluster_pos,
+                                      &track, &timecode, &is_keyframe, &flags);
+    if (res <= 0) {
+        if (avio_skip(pb, size - header_size) < 0)
+            return AVERROR(EIO);
+        return res;
+    }
+
+    encodings = track->encodings.elem;
+    if (flags & 0x06 || (encodings && encodings->scope & 1) ||
+        track->audio.sub_packet_size ||
+        track->stream->codec->codec_id == AV_CODEC_ID_PRORES) {
+        if (avio_read(pb, data + res, size - res) != size - res)
+            return AVERROR(EIO);
+        return matroska_parse_block_frames(matroska, track, data + res,
+                                           size - res, flags, pos, timecode,
+                                           AV_NOPTS_VALUE, is_keyframe);
+    }
+
+    if (!(pkt = av_mallocz(sizeof(AVPacket))))
+        return AVERROR(ENOMEM);
+    if (av_new_packet(pkt, size - res) < 0) {
+        av_free(pkt);
+        return AVERROR(ENOMEM);
+    }
+    if (avio_read(pb, pkt->data, pkt->size) != pkt->size) {
+        av_free_packet(pkt);
+        av_free(pkt);
+        return AVERROR(EIO);
+    }
+
+    duration = track->default_duration / matroska->time_scale;
+    if (timecode != AV_NOPTS_VALUE)
+        track->end_timecode = FFMAX(track->end_timecode, timecode + duration);
+
+    return matroska_queue_frame(matroska, track, pkt, timecode, duration,
+                                pos, is_keyframe);
+}
+
+/*
+ * Read the SimpleBlock or BlockGroup whose ID was just read, without
+ * going through the generic EBML parser.
+ */
+static int matroska_read_block(MatroskaDemuxContext *matroska)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    uint64_t length, duration = AV_NOPTS_VALUE, reference = 0;
+    uint32_t id = matroska->current_id;
+    int64_t end, pos = 0;
+    int res, size = 0;
+
+    matroska->current_id = 0;
+    if ((res = ebml_read_length(matroska, pb, &length)) < 0)
+        return res;
+    // max. 256 MB, as for any binary data
+    if (length > 0x10000000) {
+        av_log(matroska->ctx, AV_LOG_ERROR,
+               "Invalid length 0x%"PRIx64" for block\n", length);
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (id == MATROSKA_ID_SIMPLEBLOCK)
+        return length ? matroska_read_simple_block(matroska, length) : 0;
+
+    end = avio_tell(pb) + length;
+    while (avio_tell(pb) < end) {
+        if ((res = ebml_read_element(matroska, pb, &id, &length)) < 0)
+            return res;
+        if (length > end - avio_tell(pb))
+            return AVERROR_INVALIDDATA;
+
+        switch (id) {
+        case MATROSKA_ID_BLOCK:
+            av_fast_malloc(&matroska->block_buf, &matroska->block_buf_size,
+                           length);
+            if (!matroska->block_buf)
+                return AVERROR(ENOMEM);
+            pos  = avio_tell(pb);
+            size = length;
+            if (avio_read(pb, matroska->block_buf, size) != size)
+                return AVERROR(EIO);
+            break;
+        case MATROSKA_ID_BLOCKDURATION:
+            res = ebml_read_uint(pb, length, &duration);
+            break;
+        case MATROSKA_ID_BLOCKREFERENCE:
+            res = ebml_read_uint(pb, length, &reference);
+            break;
+        default:
+            if (avio_skip(pb, length) < 0)
+                return AVERROR(EIO);
+        }
+        if (res < 0)
+            return res;
+    }
+
+    if (!size)
+        return 0;
+    return matroska_parse_block(matroska, matroska->block_buf, size, pos,
+                                matroska->current_cluster.timecode,
+                                duration, !reference,
+                                matroska->current_cluster_pos);
+}
+
 static int matroska_parse_cluster_incremental(MatroskaDemuxContext *matroska)
 {
-    EbmlList *blocks_list;
-    MatroskaBlock *blocks;
-    int i, res;
+    int res;
     res = ebml_parse(matroska,
                      matroska_cluster_incremental_parsing,
                      &matroska->current_cluster);
-    if (res == 1) {
+    if (res == 1 && matroska->current_id == MATROSKA_ID_CLUSTER) {
         /* New Cluster */
         if (matroska->current_cluster_pos)
             ebml_level_end(matroska);
-        ebml_free(matroska_cluster, &matroska->current_cluster);
         memset(&matroska->current_cluster, 0, sizeof(MatroskaCluster));
-        matroska->current_cluster_num_blocks = 0;
         matroska->current_cluster_pos = avio_tell(matroska->ctx->pb);
         matroska->prev_pkt = NULL;
         /* sizeof the ID which was already read */
@@ -2127,33 +2522,11 @@ static int matroska_parse_cluster_incremental(MatroskaDemuxContext *matroska)
         res = ebml_parse(matroska,
                          matroska_clusters_incremental,
                          &matroska->current_cluster);
-        /* Try parsing the block again. */
-        if (res == 1)
-            res = ebml_parse(matroska,
-                             matroska_cluster_incremental_parsing,
-                             &matroska->current_cluster);
     }
 
-    if (!res &&
-        matroska->current_cluster_num_blocks <
-            matroska->current_cluster.blocks.nb_elem) {
-        blocks_list = &matroska->current_cluster.blocks;
-        blocks = blocks_list->elem;
-
-        matroska->current_cluster_num_blocks = blocks_list->nb_elem;
-        i = blocks_list->nb_elem - 1;
-        if (blocks[i].bin.size > 0 && blocks[i].bin.data) {
-            int is_keyframe = blocks[i].non_simple ? !blocks[i].reference : -1;
-            if (!blocks[i].non_simple)
-                blocks[i].duration = AV_NOPTS_VALUE;
-            res = matroska_parse_block(matroska,
-                                       blocks[i].bin.data, blocks[i].bin.size,
-                                       blocks[i].bin.pos,
-                                       matroska->current_cluster.timecode,
-                                       blocks[i].duration, is_keyframe,
-                                       matroska->current_cluster_pos);
-        }
-    }
+    /* The cluster parsing stopped on a block. */
+    if (res == 1)
+        res = matroska_read_block(matroska);
 
     if (res < 0)  matroska->done = 1;
     return res;
@@ -2216,6 +2589,9 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
     MatroskaDemuxContext *matroska = s->priv_data;
     MatroskaTrack *tracks = matroska->tracks.elem;
     AVStream *st = s->streams[stream_index];
+    int64_t before_pos = avio_tell(s->pb);
+    uint32_t before_id = matroska->current_id;
+    int before_done = matroska->done;
     int i, index, index_sub, index_min;
 
     /* Parse the CUES now since we need the index data to seek. */
@@ -2224,24 +2600,41 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
         matroska->cues_parsing_deferred = 0;
     }
 
+    /* Without cues, index the clusters up to the target by only reading
+     * the block headers. */
+    if (!matroska->index_complete && s->pb->seekable &&
+        (!st->nb_index_entries ||
+         st->index_entries[st->nb_index_entries-1].timestamp < timestamp)) {
+        avio_seek(s->pb, st->nb_index_entries ?
+                  st->index_entries[st->nb_index_entries-1].pos :
+                  matroska->first_cluster_pos, SEEK_SET);
+        while (!st->nb_index_entries ||
+               st->index_entries[st->nb_index_entries-1].timestamp < timestamp) {
+            if (matroska_index_cluster(matroska) < 0) {
+                matroska->index_complete = 1;
+                break;
+            }
+        }
+    }
+
     if (!st->nb_index_entries)
-        return 0;
+        goto fail;
     timestamp = FFMAX(timestamp, st->index_entries[0].timestamp);
 
     if ((index = av_index_search_timestamp(st, timestamp, flags)) < 0) {
         avio_seek(s->pb, st->index_entries[st->nb_index_entries-1].pos, SEEK_SET);
-        matroska->current_id = 0;
         while ((index = av_index_search_timestamp(st, timestamp, flags)) < 0) {
-            matroska_clear_queue(matroska);
-            if (matroska_parse_cluster(matroska) < 0)
+            if (matroska_index_cluster(matroska) < 0) {
+                matroska->done = 1;
                 break;
+            }
         }
     }
 
-    matroska_clear_queue(matroska);
     if (index < 0)
-        return 0;
+        goto fail;
 
+    matroska_clear_queue(matroska);
     index_min = index;
     for (i=0; i < matroska->tracks.nb_elem; i++) {
         tracks[i].audio.pkt_cnt = 0;
@@ -2265,6 +2658,14 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
     matroska->done = 0;
     ff_update_cur_dts(s, st, st->index_entries[index].timestamp);
     return 0;
+
+fail:
+    /* the scans moved the file position, continue where the reading was,
+     * with the packets that were already queued */
+    avio_seek(s->pb, before_pos, SEEK_SET);
+    matroska->current_id = before_id;
+    matroska->done       = before_done;
+    return 0;
 }
 
 static int matroska_read_close(AVFormatContext *s)
@@ -2278,7 +2679,7 @@ static int matroska_read_close(AVFormatContext *s)
     for (n=0; n < matroska->tracks.nb_elem; n++)
         if (tracks[n].type == MATROSKA_TRACK_TYPE_AUDIO)
             av_free(tracks[n].audio.buf);
-    ebml_free(matroska_cluster, &matroska->current_cluster);
+    av_free(matroska->block_buf);
     ebml_free(matroska_segment, matroska);
 
     return 0;
@@ -35,6 +35,7 @@
 #include "libavutil/lfg.h"
 #include "libavutil/dict.h"
 #include "libavutil/avstring.h"
+#include "libavutil/opt.h"
 #include "libavcodec/xiph.h"
 #include "libavcodec/mpeg4audio.h"
 
@@ -67,6 +68,9 @@ typedef struct {
     int64_t         segment_offset;
     mkv_cuepoint    *entries;
     int             num_entries;
+    unsigned int    entries_size;       ///< allocated size of entries in bytes
+    int             stride;             ///< one cue point is kept per stride keyframes
+    int             skipped;            ///< keyframes since the last kept cue point
 } mkv_cues;
 
 typedef struct {
@@ -77,8 +81,9 @@ typedef struct {
 #define MODE_WEBM       0x02
 
 typedef struct MatroskaMuxContext {
+    const AVClass   *class;
     int             mode;
-    AVIOContext   *dyn_bc;
+    AVIOContext     *dyn_bc;            ///< the current cluster, written out once complete
     ebml_master     segment;
     int64_t         segment_offset;
     ebml_master     cluster;
@@ -94,6 +99,9 @@ typedef struct MatroskaMuxContext {
     AVPacket        cur_audio_pkt;
 
     int have_attachments;
+
+    int             reserve_cues_space;
+    int64_t         cues_pos;           ///< file offset of the space reserved for the cues
 } MatroskaMuxContext;
 
 
@@ -108,6 +116,10 @@ typedef struct MatroskaMuxContext {
 /** per-cuepoint - 2 1-byte EBML IDs, 2 1-byte EBML sizes, 8-byte uint max */
 #define MAX_CUEPOINT_SIZE(num_tracks) 12 + MAX_CUETRACKPOS_SIZE*num_tracks
 
+/** cue points kept in memory at most, when there are more every other
+ * one is dropped and only every 2nd, 4th... keyframe gets one from then on */
+#define MAX_CUEPOINTS (1 << 16)
+
 
 static int ebml_id_size(unsigned int id)
 {
@@ -361,6 +373,7 @@ static mkv_cues * mkv_start_cues(int64_t segment_offset)
         return NULL;
 
     cues->segment_offset = segment_offset;
+    cues->stride         = 1;
     return cues;
 }
 
@@ -371,7 +384,19 @@ static int mkv_add_cuepoint(mkv_cues *cues, int stream, int64_t ts, int64_t clus
     if (ts < 0)
         return 0;
 
-    entries = av_realloc(entries, (cues->num_entries + 1) * sizeof(mkv_cuepoint));
+    if (++cues->skipped < cues->stride)
+        return 0;
+    cues->skipped = 0;
+    if (cues->num_entries == MAX_CUEPOINTS) {
+        int i;
+        for (i = 0; i < MAX_CUEPOINTS / 2; i++)
+            entries[i] = entries[2 * i];
+        cues->num_entries = MAX_CUEPOINTS / 2;
+        cues->stride     *= 2;
+    }
+
+    entries = av_fast_realloc(entries, &cues->entries_size,
+                              (cues->num_entries + 1) * sizeof(mkv_cuepoint));
     if (entries == NULL)
         return AVERROR(ENOMEM);
 
@@ -963,6 +988,14 @@ static int mkv_write_header(AVFormatContext *s)
     if (!s->pb->seekable)
         mkv_write_seekhead(pb, mkv->main_seekhead);
 
+    if (s->pb->seekable && mkv->reserve_cues_space) {
+        // the cues are written here by the trailer if they fit
+        mkv->cues_pos = avio_tell(pb);
+        if (mkv->reserve_cues_space == 1)
+            mkv->reserve_cues_space++;
+        put_ebml_void(pb, mkv->reserve_cues_space);
+    }
+
     mkv->cues = mkv_start_cues(mkv->segment_offset);
     if (mkv->cues == NULL)
         return AVERROR(ENOMEM);
@@ -1144,11 +1177,13 @@ static int mkv_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
         return AVERROR(EINVAL);
     }
 
-    if (!s->pb->seekable) {
-        if (!mkv->dyn_bc)
-            avio_open_dyn_buf(&mkv->dyn_bc);
-        pb = mkv->dyn_bc;
+    // each cluster is assembled in memory and written out in one go
+    if (!mkv->dyn_bc) {
+        ret = avio_open_dyn_buf(&mkv->dyn_bc);
+        if (ret < 0)
+            return ret;
     }
+    pb = mkv->dyn_bc;
 
     if (!mkv->cluster_pos) {
         mkv->cluster_pos = avio_tell(s->pb);
@@ -1171,7 +1206,8 @@ static int mkv_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
         end_ebml_master(pb, blockgroup);
     }
 
-    if (codec->codec_type == AVMEDIA_TYPE_VIDEO && keyframe) {
+    // the cues are only written to seekable output, don't keep them otherwise
+    if (codec->codec_type == AVMEDIA_TYPE_VIDEO && keyframe && s->pb->seekable) {
         ret = mkv_add_cuepoint(mkv->cues, pkt->stream_index, ts, mkv->cluster_pos);
         if (ret < 0) return ret;
     }
@@ -1196,11 +1232,11 @@ static int mkv_copy_packet(MatroskaMuxContext *mkv, const AVPacket *pkt)
 static int mkv_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MatroskaMuxContext *mkv = s->priv_data;
-    AVIOContext *pb = s->pb->seekable ? s->pb : mkv->dyn_bc;
+    AVIOContext *pb = mkv->dyn_bc;
     AVCodecContext *codec = s->streams[pkt->stream_index]->codec;
     int ret, keyframe = !!(pkt->flags & AV_PKT_FLAG_KEY);
     int64_t ts = mkv->tracks[pkt->stream_index].write_dts ? pkt->dts : pkt->pts;
-    int cluster_size = avio_tell(pb) - (s->pb->seekable ? mkv->cluster_pos : 0);
+    int cluster_size = pb ? avio_tell(pb) : 0;
 
     // start a new cluster every 5 MB or 5 sec, or 32k / 1 sec for streaming or
     // after 4k and on a keyframe
@@ -1209,11 +1245,10 @@ static int mkv_write_packet(AVFormatContext *s, AVPacket *pkt)
          ||                      cluster_size > 5*1024*1024 || ts > mkv->cluster_pts + 5000
          || (codec->codec_type == AVMEDIA_TYPE_VIDEO && keyframe && cluster_size > 4*1024))) {
         av_log(s, AV_LOG_DEBUG, "Starting new cluster at offset %" PRIu64
-               " bytes, pts %" PRIu64 "\n", avio_tell(pb), ts);
+               " bytes, pts %" PRIu64 "\n", avio_tell(s->pb) + cluster_size, ts);
         end_ebml_master(pb, mkv->cluster);
         mkv->cluster_pos = 0;
-        if (mkv->dyn_bc)
-            mkv_flush_dynbuf(s);
+        mkv_flush_dynbuf(s);
     }
 
     // check if we have an audio packet cached
@@ -1235,6 +1270,44 @@ static int mkv_write_packet(AVFormatContext *s, AVPacket *pkt)
     return ret;
 }
 
+/**
+ * Write the cues to the space reserved for them in the header, or at the
+ * current position if they do not fit.
+ */
+static int mkv_write_reserved_cues(AVFormatContext *s, int64_t *cuespos)
+{
+    MatroskaMuxContext *mkv = s->priv_data;
+    AVIOContext *pb = s->pb, *dyn_cp;
+    int64_t currentpos = avio_tell(pb);
+    uint8_t *buf;
+    int size, ret;
+
+    if ((ret = avio_open_dyn_buf(&dyn_cp)) < 0)
+        return ret;
+    mkv_write_cues(dyn_cp, mkv->cues, s->nb_streams);
+    size = avio_close_dyn_buf(dyn_cp, &buf);
+
+    // the rest of the reserved space must be filled with a void element,
+    // which takes at least 2 bytes
+    if (size == mkv->reserve_cues_space || size + 2 <= mkv->reserve_cues_space) {
+        *cuespos = mkv->cues_pos;
+        avio_seek(pb, mkv->cues_pos, SEEK_SET);
+        avio_write(pb, buf, size);
+        if (size < mkv->reserve_cues_space)
+            put_ebml_void(pb, mkv->reserve_cues_space - size);
+        avio_seek(pb, currentpos, SEEK_SET);
+    } else {
+        av_log(s, AV_LOG_WARNING, "Insufficient space reserved for the cues "
+               "(%d < %d bytes), writing them at the end of the file\n",
+               mkv->reserve_cues_space, size);
+        *cuespos = currentpos;
+        avio_write(pb, buf, size);
+    }
+    av_free(buf);
+
+    return 0;
+}
+
 static int mkv_write_trailer(AVFormatContext *s)
 {
     MatroskaMuxContext *mkv = s->priv_data;
@@ -1255,13 +1328,15 @@ static int mkv_write_trailer(AVFormatContext *s)
     if (mkv->dyn_bc) {
         end_ebml_master(mkv->dyn_bc, mkv->cluster);
         mkv_flush_dynbuf(s);
-    } else if (mkv->cluster_pos) {
-        end_ebml_master(pb, mkv->cluster);
     }
 
     if (pb->seekable) {
         if (mkv->cues->num_entries) {
-            cuespos = mkv_write_cues(pb, mkv->cues, s->nb_streams);
+            if (mkv->reserve_cues_space) {
+                ret = mkv_write_reserved_cues(s, &cuespos);
+                if (ret < 0) return ret;
+            } else
+                cuespos = mkv_write_cues(pb, mkv->cues, s->nb_streams);
 
             ret = mkv_add_seekhead_entry(mkv->main_seekhead, MATROSKA_ID_CUES, cuespos);
             if (ret < 0) return ret;
@@ -1303,7 +1378,23 @@ static int mkv_query_codec(enum AVCodecID codec_id, int std_compliance)
     return 0;
 }
 
+#define OFFSET(x) offsetof(MatroskaMuxContext, x)
+#define FLAGS AV_OPT_FLAG_ENCODING_PARAM
+static const AVOption options[] = {
+    { "reserve_index_space", "Reserve a given amount of space (in bytes) at the beginning of the file for the index (cues).", OFFSET(reserve_cues_space), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, FLAGS },
+    { NULL },
+};
+
+#define MATROSKA_CLASS(flavor)                          \
+static const AVClass flavor ## _class = {               \
+    .class_name = #flavor " muxer",                     \
+    .item_name  = av_default_item_name,                 \
+    .option     = options,                              \
+    .version    = LIBAVUTIL_VERSION_INT,                \
+};
+
 #if CONFIG_MATROSKA_MUXER
+MATROSKA_CLASS(matroska)
 AVOutputFormat ff_matroska_muxer = {
     .name              = "matroska",
     .long_name         = NULL_IF_CONFIG_SMALL("Matroska"),
@@ -1324,10 +1415,12 @@ AVOutputFormat ff_matroska_muxer = {
     },
     .subtitle_codec    = AV_CODEC_ID_SSA,
     .query_codec       = mkv_query_codec,
+    .priv_class        = &matroska_class,
 };
 #endif
 
 #if CONFIG_WEBM_MUXER
+MATROSKA_CLASS(webm)
 AVOutputFormat ff_webm_muxer = {
     .name              = "webm",
     .long_name         = NULL_IF_CONFIG_SMALL("WebM"),
@@ -1341,10 +1434,12 @@ AVOutputFormat ff_webm_muxer = {
     .write_trailer     = mkv_write_trailer,
     .flags             = AVFMT_GLOBALHEADER | AVFMT_VARIABLE_FPS |
                          AVFMT_TS_NONSTRICT,
+    .priv_class        = &webm_class,
 };
 #endif
 
 #if CONFIG_MATROSKA_AUDIO_MUXER
+MATROSKA_CLASS(matroska_audio)
 AVOutputFormat ff_matroska_audio_muxer = {
     .name              = "matroska",
     .long_name         = NULL_IF_CONFIG_SMALL("Matroska"),
@@ -1359,5 +1454,6 @@ AVOutputFormat ff_matroska_audio_muxer = {
     .write_trailer     = mkv_write_trailer,
     .flags             = AVFMT_GLOBALHEADER | AVFMT_TS_NONSTRICT,
     .codec_tag         = (const AVCodecTag* const []){ ff_codec_wav_tags, 0 },
+    .priv_class        = &matroska_audio_class,
 };
 #endif
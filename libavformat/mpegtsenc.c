@@ -36,11 +36,18 @@
 /*********************************************/
 /* mpegts section writer */
 
+/* a section is at most 1024 bytes, plus the pointer field */
+#define SECTION_MAX_PACKETS ((1024 + 1 + TS_PACKET_SIZE - 5) / (TS_PACKET_SIZE - 4))
+
 typedef struct MpegTSSection {
     int pid;
     int cc;
     void (*write_packet)(struct MpegTSSection *s, const uint8_t *packet);
     void *opaque;
+    /* the tables do not change once written, so their packets are kept
+     * and only the continuity counter is updated when retransmitting */
+    uint8_t packets[SECTION_MAX_PACKETS * TS_PACKET_SIZE];
+    int nb_packets;
 } MpegTSSection;
 
 typedef struct MpegTSService {
@@ -81,6 +88,11 @@ typedef struct MpegTSWrite {
 #define MPEGTS_FLAG_REEMIT_PAT_PMT  0x01
 #define MPEGTS_FLAG_AAC_LATM        0x02
     int flags;
+
+    /* packets are gathered here and written at once */
+#define TS_BUFFERED_PACKETS 64
+    uint8_t packet_buf[TS_BUFFERED_PACKETS * TS_PACKET_SIZE];
+    int nb_buffered_packets;
 } MpegTSWrite;
 
 /* a PES packet header is generated every DEFAULT_PES_HEADER_FREQ packets */
@@ -122,11 +134,24 @@ static const AVClass mpegts_muxer_class = {
     .version        = LIBAVUTIL_VERSION_INT,
 };
 
+static void mpegts_send_section(MpegTSSection *s)
+{
+    uint8_t *packet = s->packets;
+    int i;
+
+    for (i = 0; i < s->nb_packets; i++) {
+        s->cc = (s->cc + 1) & 0xf;
+        packet[3] = 0x10 | s->cc;
+        s->write_packet(s, packet);
+        packet += TS_PACKET_SIZE;
+    }
+}
+
 /* NOTE: 4 bytes must be left at the end for the crc32 */
 static void mpegts_write_section(MpegTSSection *s, uint8_t *buf, int len)
 {
     unsigned int crc;
-    unsigned char packet[TS_PACKET_SIZE];
+    unsigned char *packet;
     const unsigned char *buf_ptr;
     unsigned char *q;
     int first, b, len1, left;
@@ -137,10 +162,12 @@ static void mpegts_write_section(MpegTSSection *s, uint8_t *buf, int len)
     buf[len - 2] = (crc >> 8) & 0xff;
     buf[len - 1] = (crc) & 0xff;
 
-    /* send each packet */
+    /* build each packet, the continuity counter is set when sending */
     buf_ptr = buf;
+    s->nb_packets = 0;
     while (len > 0) {
         first = (buf == buf_ptr);
+        packet = s->packets + s->nb_packets++ * TS_PACKET_SIZE;
         q = packet;
         *q++ = 0x47;
         b = (s->pid >> 8);
@@ -148,8 +175,7 @@ static void mpegts_write_section(MpegTSSection *s, uint8_t *buf, int len)
             b |= 0x40;
         *q++ = b;
         *q++ = s->pid;
-        s->cc = (s->cc + 1) & 0xf;
-        *q++ = 0x10 | s->cc;
+        *q++ = 0x10;
         if (first)
             *q++ = 0; /* 0 offset */
         len1 = TS_PACKET_SIZE - (q - packet);
@@ -162,11 +188,10 @@ static void mpegts_write_section(MpegTSSection *s, uint8_t *buf, int len)
         if (left > 0)
             memset(q, 0xff, left);
 
-        s->write_packet(s, packet);
-
         buf_ptr += len1;
         len -= len1;
     }
+    mpegts_send_section(s);
 }
 
 static inline void put16(uint8_t **q_ptr, int val)
@@ -227,6 +252,14 @@ typedef struct MpegTSWriteStream {
     int payload_flags;
     uint8_t *payload;
     AVFormatContext *amux;
+
+    /* PES header fields, fixed for the stream */
+    int stream_id;
+    int private_code;
+    int pes_flags;
+    /* reused for the H.264 payloads needing an access unit delimiter */
+    uint8_t *aud_buf;
+    unsigned int aud_buf_size;
 } MpegTSWriteStream;
 
 static void mpegts_write_pat(AVFormatContext *s)
@@ -454,10 +487,40 @@ static MpegTSService *mpegts_add_service(MpegTSWrite *ts,
     return service;
 }
 
+/* Return the buffer for the next packet, to be committed with
+ * commit_ts_packet() once filled. */
+static uint8_t *get_ts_packet(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+
+    if (ts->nb_buffered_packets == TS_BUFFERED_PACKETS) {
+        avio_write(s->pb, ts->packet_buf, sizeof(ts->packet_buf));
+        ts->nb_buffered_packets = 0;
+    }
+    return ts->packet_buf + ts->nb_buffered_packets * TS_PACKET_SIZE;
+}
+
+static void commit_ts_packet(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+    ts->nb_buffered_packets++;
+}
+
+static void flush_ts_packets(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+
+    avio_write(s->pb, ts->packet_buf,
+               ts->nb_buffered_packets * TS_PACKET_SIZE);
+    ts->nb_buffered_packets = 0;
+    avio_flush(s->pb);
+}
+
 static void section_write_packet(MpegTSSection *s, const uint8_t *packet)
 {
     AVFormatContext *ctx = s->opaque;
-    avio_write(ctx->pb, packet, TS_PACKET_SIZE);
+    memcpy(get_ts_packet(ctx), packet, TS_PACKET_SIZE);
+    commit_ts_packet(ctx);
 }
 
 static int mpegts_write_header(AVFormatContext *s)
@@ -550,6 +613,25 @@ static int mpegts_write_header(AVFormatContext *s)
         ts_st->payload_dts = AV_NOPTS_VALUE;
         ts_st->first_pts_check = 1;
         ts_st->cc = 15;
+        if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (st->codec->codec_id == AV_CODEC_ID_DIRAC)
+                ts_st->stream_id = 0xfd;
+            else
+                ts_st->stream_id = 0xe0;
+        } else if (st->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
+                   (st->codec->codec_id == AV_CODEC_ID_MP2 ||
+                    st->codec->codec_id == AV_CODEC_ID_MP3 ||
+                    st->codec->codec_id == AV_CODEC_ID_AAC)) {
+            ts_st->stream_id = 0xc0;
+        } else {
+            ts_st->stream_id = 0xbd;
+            if (st->codec->codec_type == AVMEDIA_TYPE_SUBTITLE)
+                ts_st->private_code = 0x20;
+        }
+        ts_st->pes_flags = 0x80;
+        /* data alignment indicator is required for subtitle data */
+        if (st->codec->codec_type == AVMEDIA_TYPE_SUBTITLE)
+            ts_st->pes_flags |= 0x04;
         /* update PCR pid by using the first video stream */
         if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
             service->pcr_pid == 0x1fff) {
@@ -632,7 +714,7 @@ static int mpegts_write_header(AVFormatContext *s)
            service->pcr_packet_period,
            ts->sdt_packet_period, ts->pat_packet_period);
 
-    avio_flush(s->pb);
+    flush_ts_packets(s);
 
     return 0;
 
@@ -662,20 +744,30 @@ static void retransmit_si_info(AVFormatContext *s)
 
     if (++ts->sdt_packet_count == ts->sdt_packet_period) {
         ts->sdt_packet_count = 0;
-        mpegts_write_sdt(s);
+        if (ts->sdt.nb_packets)
+            mpegts_send_section(&ts->sdt);
+        else
+            mpegts_write_sdt(s);
     }
     if (++ts->pat_packet_count == ts->pat_packet_period) {
         ts->pat_packet_count = 0;
-        mpegts_write_pat(s);
+        if (ts->pat.nb_packets)
+            mpegts_send_section(&ts->pat);
+        else
+            mpegts_write_pat(s);
         for(i = 0; i < ts->nb_services; i++) {
-            mpegts_write_pmt(s, ts->services[i]);
+            if (ts->services[i]->pmt.nb_packets)
+                mpegts_send_section(&ts->services[i]->pmt);
+            else
+                mpegts_write_pmt(s, ts->services[i]);
         }
     }
 }
 
 static int64_t get_pcr(const MpegTSWrite *ts, AVIOContext *pb)
 {
-    return av_rescale(avio_tell(pb) + 11, 8 * PCR_TIME_BASE, ts->mux_rate) +
+    int64_t pos = avio_tell(pb) + ts->nb_buffered_packets * TS_PACKET_SIZE;
+    return av_rescale(pos + 11, 8 * PCR_TIME_BASE, ts->mux_rate) +
            ts->first_pcr;
 }
 
@@ -697,7 +789,7 @@ static int write_pcr_bits(uint8_t *buf, int64_t pcr)
 static void mpegts_insert_null_packet(AVFormatContext *s)
 {
     uint8_t *q;
-    uint8_t buf[TS_PACKET_SIZE];
+    uint8_t *buf = get_ts_packet(s);
 
     q = buf;
     *q++ = 0x47;
@@ -705,7 +797,7 @@ static void mpegts_insert_null_packet(AVFormatContext *s)
     *q++ = 0xff;
     *q++ = 0x10;
     memset(q, 0x0FF, TS_PACKET_SIZE - (q - buf));
-    avio_write(s->pb, buf, TS_PACKET_SIZE);
+    commit_ts_packet(s);
 }
 
 /* Write a single transport stream packet with a PCR and no payload */
@@ -714,7 +806,7 @@ static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
     MpegTSWrite *ts = s->priv_data;
     MpegTSWriteStream *ts_st = st->priv_data;
     uint8_t *q;
-    uint8_t buf[TS_PACKET_SIZE];
+    uint8_t *buf = get_ts_packet(s);
 
     q = buf;
     *q++ = 0x47;
@@ -730,7 +822,7 @@ static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
 
     /* stuffing bytes */
     memset(q, 0xFF, TS_PACKET_SIZE - (q - buf));
-    avio_write(s->pb, buf, TS_PACKET_SIZE);
+    commit_ts_packet(s);
 }
 
 static void write_pts(uint8_t *q, int fourbits, int64_t pts)
@@ -791,9 +883,9 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
 {
     MpegTSWriteStream *ts_st = st->priv_data;
     MpegTSWrite *ts = s->priv_data;
-    uint8_t buf[TS_PACKET_SIZE];
+    uint8_t *buf;
     uint8_t *q;
-    int val, is_start, len, header_len, write_pcr, private_code, flags;
+    int val, is_start, len, header_len, write_pcr, flags;
     int afc_len, stuffing_len;
     int64_t pcr = -1; /* avoid warning */
     int64_t delay = av_rescale(s->max_delay, 90000, AV_TIME_BASE);
@@ -824,6 +916,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         }
 
         /* prepare packet header */
+        buf = get_ts_packet(s);
         q = buf;
         *q++ = 0x47;
         val = (ts_st->pid >> 8);
@@ -859,23 +952,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
             *q++ = 0x00;
             *q++ = 0x00;
             *q++ = 0x01;
-            private_code = 0;
-            if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
-                if (st->codec->codec_id == AV_CODEC_ID_DIRAC) {
-                    *q++ = 0xfd;
-                } else
-                    *q++ = 0xe0;
-            } else if (st->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
-                       (st->codec->codec_id == AV_CODEC_ID_MP2 ||
-                        st->codec->codec_id == AV_CODEC_ID_MP3 ||
-                        st->codec->codec_id == AV_CODEC_ID_AAC)) {
-                *q++ = 0xc0;
-            } else {
-                *q++ = 0xbd;
-                if (st->codec->codec_type == AVMEDIA_TYPE_SUBTITLE) {
-                    private_code = 0x20;
-                }
-            }
+            *q++ = ts_st->stream_id;
             header_len = 0;
             flags = 0;
             if (pts != AV_NOPTS_VALUE) {
@@ -886,8 +963,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
                 header_len += 5;
                 flags |= 0x40;
             }
-            if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
-                st->codec->codec_id == AV_CODEC_ID_DIRAC) {
+            if (ts_st->stream_id == 0xfd) {
                 /* set PES_extension_flag */
                 pes_extension = 1;
                 flags |= 0x01;
@@ -900,17 +976,13 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
                 header_len += 3;
             }
             len = payload_size + header_len + 3;
-            if (private_code != 0)
+            if (ts_st->private_code != 0)
                 len++;
             if (len > 0xffff)
                 len = 0;
             *q++ = len >> 8;
             *q++ = len;
-            val = 0x80;
-            /* data alignment indicator is required for subtitle data */
-            if (st->codec->codec_type == AVMEDIA_TYPE_SUBTITLE)
-                val |= 0x04;
-            *q++ = val;
+            *q++ = ts_st->pes_flags;
             *q++ = flags;
             *q++ = header_len;
             if (pts != AV_NOPTS_VALUE) {
@@ -921,7 +993,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
                 write_pts(q, 1, dts);
                 q += 5;
             }
-            if (pes_extension && st->codec->codec_id == AV_CODEC_ID_DIRAC) {
+            if (pes_extension) {
                 flags = 0x01;  /* set PES_extension_flag_2 */
                 *q++ = flags;
                 *q++ = 0x80 | 0x01;  /* marker bit + extension length */
@@ -931,8 +1003,8 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
                 */
                 *q++ = 0x00 | 0x60;
             }
-            if (private_code != 0)
-                *q++ = private_code;
+            if (ts_st->private_code != 0)
+                *q++ = ts_st->private_code;
             is_start = 0;
         }
         /* header size */
@@ -966,9 +1038,9 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         memcpy(buf + TS_PACKET_SIZE - len, payload, len);
         payload += len;
         payload_size -= len;
-        avio_write(s->pb, buf, TS_PACKET_SIZE);
+        commit_ts_packet(s);
     }
-    avio_flush(s->pb);
+    flush_ts_packets(s);
 }
 
 static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
@@ -1022,14 +1094,15 @@ static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
                  (state & 0x1f) != 5 && (state & 0x1f) != 1);
 
         if ((state & 0x1f) != 9) { // AUD NAL
-            data = av_malloc(pkt->size+6);
-            if (!data)
+            av_fast_malloc(&ts_st->aud_buf, &ts_st->aud_buf_size,
+                           pkt->size + 6);
+            if (!ts_st->aud_buf)
                 return AVERROR(ENOMEM);
-            memcpy(data+6, pkt->data, pkt->size);
-            AV_WB32(data, 0x00000001);
-            data[4] = 0x09;
-            data[5] = 0xf0; // any slice type (0xe) + rbsp stop one bit
-            buf  = data;
+            memcpy(ts_st->aud_buf + 6, pkt->data, pkt->size);
+            AV_WB32(ts_st->aud_buf, 0x00000001);
+            ts_st->aud_buf[4] = 0x09;
+            ts_st->aud_buf[5] = 0xf0; // any slice type (0xe) + rbsp stop one bit
+            buf  = ts_st->aud_buf;
             size = pkt->size+6;
         }
     } else if (st->codec->codec_id == AV_CODEC_ID_AAC) {
@@ -1118,7 +1191,7 @@ static void mpegts_write_flush(AVFormatContext *s)
             ts_st->payload_size = 0;
         }
     }
-    avio_flush(s->pb);
+    flush_ts_packets(s);
 }
 
 static int mpegts_write_packet(AVFormatContext *s, AVPacket *pkt)
@@ -1143,6 +1216,7 @@ static int mpegts_write_end(AVFormatContext *s)
         AVStream *st = s->streams[i];
         MpegTSWriteStream *ts_st = st->priv_data;
         av_freep(&ts_st->payload);
+        av_freep(&ts_st->aud_buf);
         if (ts_st->amux) {
             avformat_free_context(ts_st->amux);
             ts_st->amux = NULL;
@@ -48,6 +48,10 @@ static const AVOption options[]={
 {"fdebug", "print specific debug info", OFFSET(debug), AV_OPT_TYPE_FLAGS, {.i64 = DEFAULT }, 0, INT_MAX, E|D, "fdebug"},
 {"ts", NULL, 0, AV_OPT_TYPE_CONST, {.i64 = FF_FDEBUG_TS }, INT_MIN, INT_MAX, E|D, "fdebug"},
 {"max_delay", "maximum muxing or demuxing delay in microseconds", OFFSET(max_delay), AV_OPT_TYPE_INT, {.i64 = -1 }, -1, INT_MAX, E|D},
+{"seek_index", "file caching the seek index across sessions", OFFSET(seek_index), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, D},
+{"probe_threads", "number of threads decoding streams to probe them", OFFSET(probe_threads), AV_OPT_TYPE_INT, {.i64 = 1 }, 1, INT_MAX, D},
+{"probetime", "maximum number of microseconds spent probing, 0 for no limit", OFFSET(max_probe_time), AV_OPT_TYPE_INT64, {.i64 = 0 }, 0, INT64_MAX, D},
+{"seek_index_scan", "build a missing seek index by reading the whole input", OFFSET(seek_index_scan), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, 1, D},
 {"fpsprobesize", "number of frames used to probe fps", OFFSET(fps_probe_size), AV_OPT_TYPE_INT, {.i64 = -1}, -1, INT_MAX-1, D},
 /* this is a crutch for avconv, since it cannot deal with identically named options in different contexts.
  * to be removed when avconv is fixed */
@@ -140,8 +140,10 @@ int ff_rtmp_packet_read(URLContext *h, RTMPPacket *p,
     return ff_rtmp_packet_read_internal(h, p, chunk_size, prev_pkt, hdr);
 }
 
-int ff_rtmp_packet_read_internal(URLContext *h, RTMPPacket *p, int chunk_size,
-                                 RTMPPacket *prev_pkt, uint8_t hdr)
+static int rtmp_packet_read(URLContext *h, RTMPPacket *p, int chunk_size,
+                            RTMPPacket *prev_pkt, uint8_t hdr,
+                            uint8_t **data_buf, unsigned int *data_buf_size,
+                            int head, int tail)
 {
 
     uint8_t t, buf[16];
@@ -198,8 +200,17 @@ int ff_rtmp_packet_read_internal(URLContext *h, RTMPPacket *p, int chunk_size,
     if (hdr != RTMP_PS_TWELVEBYTES)
         timestamp += prev_pkt[channel_id].timestamp;
 
-    if ((ret = ff_rtmp_packet_create(p, channel_id, type, timestamp,
-                                     data_size)) < 0)
+    if (data_buf) {
+        av_fast_malloc(data_buf, data_buf_size, head + data_size + tail);
+        if (!*data_buf)
+            return AVERROR(ENOMEM);
+        if ((ret = ff_rtmp_packet_create(p, channel_id, type, timestamp,
+                                         0)) < 0)
+            return ret;
+        p->data      = *data_buf + head;
+        p->data_size = data_size;
+    } else if ((ret = ff_rtmp_packet_create(p, channel_id, type, timestamp,
+                                            data_size)) < 0)
         return ret;
     p->extra = extra;
     // save history
@@ -212,7 +223,8 @@ int ff_rtmp_packet_read_internal(URLContext *h, RTMPPacket *p, int chunk_size,
     while (data_size > 0) {
         int toread = FFMIN(data_size, chunk_size);
         if (ffurl_read_complete(h, p->data + offset, toread) != toread) {
-            ff_rtmp_packet_destroy(p);
+            if (!data_buf)
+                ff_rtmp_packet_destroy(p);
             return AVERROR(EIO);
         }
         data_size -= chunk_size;
@@ -220,7 +232,8 @@ int ff_rtmp_packet_read_internal(URLContext *h, RTMPPacket *p, int chunk_size,
         size      += chunk_size;
         if (data_size > 0) {
             if ((ret = ffurl_read_complete(h, &t, 1)) < 0) { // marker
-                ff_rtmp_packet_destroy(p);
+                if (!data_buf)
+                    ff_rtmp_packet_destroy(p);
                 return ret;
             }
             size++;
@@ -231,6 +244,25 @@ int ff_rtmp_packet_read_internal(URLContext *h, RTMPPacket *p, int chunk_size,
     return size;
 }
 
+int ff_rtmp_packet_read_internal(URLContext *h, RTMPPacket *p, int chunk_size,
+                                 RTMPPacket *prev_pkt, uint8_t hdr)
+{
+    return rtmp_packet_read(h, p, chunk_size, prev_pkt, hdr, NULL, NULL, 0, 0);
+}
+
+int ff_rtmp_packet_read_buf(URLContext *h, RTMPPacket *p, int chunk_size,
+                            RTMPPacket *prev_pkt, uint8_t **buf,
+                            unsigned int *buf_size, int head, int tail)
+{
+    uint8_t hdr;
+
+    if (ffurl_read(h, &hdr, 1) != 1)
+        return AVERROR(EIO);
+
+    return rtmp_packet_read(h, p, chunk_size, prev_pkt, hdr,
+                            buf, buf_size, head, tail);
+}
+
 int ff_rtmp_packet_write(URLContext *h, RTMPPacket *pkt,
                          int chunk_size, RTMPPacket *prev_pkt)
 {
@@ -130,6 +130,26 @@ int ff_rtmp_packet_read(URLContext *h, RTMPPacket *p,
 int ff_rtmp_packet_read_internal(URLContext *h, RTMPPacket *p, int chunk_size,
                                  RTMPPacket *prev_pkt, uint8_t c);
 
+/**
+ * Read RTMP packet sent by the server into a buffer owned by the caller,
+ * instead of allocating a new one for each packet. The packet must not be
+ * freed with ff_rtmp_packet_destroy().
+ *
+ * @param h          reader context
+ * @param p          packet, its data points into the buffer
+ * @param chunk_size current chunk size
+ * @param prev_pkt   previously read packet headers for all channels
+ *                   (may be needed for restoring incomplete packet header)
+ * @param buf        buffer, reallocated if it is too small
+ * @param buf_size   allocated size of the buffer
+ * @param head       number of bytes to leave free before the payload
+ * @param tail       number of bytes to leave free after the payload
+ * @return number of bytes read on success, negative value otherwise
+ */
+int ff_rtmp_packet_read_buf(URLContext *h, RTMPPacket *p, int chunk_size,
+                            RTMPPacket *prev_pkt, uint8_t **buf,
+                            unsigned int *buf_size, int head, int tail);
+
 /**
  * Send RTMP packet to the server.
  *
@@ -89,6 +89,9 @@ typedef struct RTMPContext {
     uint8_t*      flv_data;                   ///< buffer with data for demuxer
     int           flv_size;                   ///< current buffer size
     int           flv_off;                    ///< number of bytes read from current buffer
+    unsigned int  flv_alloc_size;             ///< allocated size of the buffer with data for demuxer
+    uint8_t*      in_data;                    ///< buffer incoming packets are read into
+    unsigned int  in_alloc_size;              ///< allocated size of the buffer for incoming packets
     int           flv_nb_packets;             ///< number of flv packets published
     RTMPPacket    out_pkt;                    ///< rtmp packet, created from flv a/v or metadata (for output)
     uint32_t      client_report_size;         ///< number of bytes after which client should report to server
@@ -2043,7 +2046,7 @@ static int handle_notify(URLContext *s, RTMPPacket *pkt) {
             rt->flv_off  = 0;
         }
 
-        cp = av_realloc(rt->flv_data, rt->flv_size);
+        cp = av_fast_realloc(rt->flv_data, &rt->flv_alloc_size, rt->flv_size);
         if (!cp)
             return AVERROR(ENOMEM);
         rt->flv_data = cp;
@@ -2136,8 +2139,12 @@ static int get_packet(URLContext *s, int for_header)
 
     for (;;) {
         RTMPPacket rpkt = { 0 };
-        if ((ret = ff_rtmp_packet_read(rt->stream, &rpkt,
-                                       rt->in_chunk_size, rt->prev_pkt[0])) <= 0) {
+        /* The payload is read after room for the FLV tag header, so that
+         * the buffer can be handed over to the FLV demuxer as it is. */
+        if ((ret = ff_rtmp_packet_read_buf(rt->stream, &rpkt,
+                                           rt->in_chunk_size, rt->prev_pkt[0],
+                                           &rt->in_data, &rt->in_alloc_size,
+                                           11, 4)) <= 0) {
             if (ret == 0) {
                 return AVERROR(EAGAIN);
             } else {
@@ -2153,48 +2160,38 @@ static int get_packet(URLContext *s, int for_header)
         }
 
         ret = rtmp_parse_result(s, rt, &rpkt);
-        if (ret < 0) {//serious error in current packet
-            ff_rtmp_packet_destroy(&rpkt);
+        if (ret < 0) //serious error in current packet
             return ret;
-        }
-        if (rt->do_reconnect && for_header) {
-            ff_rtmp_packet_destroy(&rpkt);
+        if (rt->do_reconnect && for_header)
             return 0;
-        }
-        if (rt->state == STATE_STOPPED) {
-            ff_rtmp_packet_destroy(&rpkt);
+        if (rt->state == STATE_STOPPED)
             return AVERROR_EOF;
-        }
         if (for_header && (rt->state == STATE_PLAYING    ||
                            rt->state == STATE_PUBLISHING ||
-                           rt->state == STATE_RECEIVING)) {
-            ff_rtmp_packet_destroy(&rpkt);
+                           rt->state == STATE_RECEIVING))
             return 0;
-        }
-        if (!rpkt.data_size || !rt->is_input) {
-            ff_rtmp_packet_destroy(&rpkt);
+        if (!rpkt.data_size || !rt->is_input)
             continue;
-        }
         if (rpkt.type == RTMP_PT_VIDEO || rpkt.type == RTMP_PT_AUDIO ||
            (rpkt.type == RTMP_PT_NOTIFY && !memcmp("\002\000\012onMetaData", rpkt.data, 13))) {
             ts = rpkt.timestamp;
 
-            // generate packet header and put data into buffer for FLV demuxer
-            rt->flv_off  = 0;
-            rt->flv_size = rpkt.data_size + 15;
-            rt->flv_data = p = av_realloc(rt->flv_data, rt->flv_size);
+            // generate packet header around the data for FLV demuxer
+            p = rt->in_data;
             bytestream_put_byte(&p, rpkt.type);
             bytestream_put_be24(&p, rpkt.data_size);
             bytestream_put_be24(&p, ts);
             bytestream_put_byte(&p, ts >> 24);
             bytestream_put_be24(&p, 0);
-            bytestream_put_buffer(&p, rpkt.data, rpkt.data_size);
+            p += rpkt.data_size;
             bytestream_put_be32(&p, 0);
-            ff_rtmp_packet_destroy(&rpkt);
+            rt->flv_off  = 0;
+            rt->flv_size = rpkt.data_size + 15;
+            FFSWAP(uint8_t *,    rt->flv_data,       rt->in_data);
+            FFSWAP(unsigned int, rt->flv_alloc_size, rt->in_alloc_size);
             return 0;
         } else if (rpkt.type == RTMP_PT_NOTIFY) {
             ret = handle_notify(s, &rpkt);
-            ff_rtmp_packet_destroy(&rpkt);
             if (ret) {
                 av_log(s, AV_LOG_ERROR, "Handle notify error\n");
                 return ret;
@@ -2202,9 +2199,6 @@ static int get_packet(URLContext *s, int for_header)
             return 0;
         } else if (rpkt.type == RTMP_PT_METADATA) {
             // we got raw FLV data, make it available for FLV demuxer
-            rt->flv_off  = 0;
-            rt->flv_size = rpkt.data_size;
-            rt->flv_data = av_realloc(rt->flv_data, rt->flv_size);
             /* rewrite timestamps */
             next = rpkt.data;
             ts = rpkt.timestamp;
@@ -2222,11 +2216,12 @@ static int get_packet(URLContext *s, int for_header)
                 bytestream_put_byte(&p, ts >> 24);
                 next += data_size + 3 + 4;
             }
-            memcpy(rt->flv_data, rpkt.data, rpkt.data_size);
-            ff_rtmp_packet_destroy(&rpkt);
+            rt->flv_off  = rpkt.data - rt->in_data;
+            rt->flv_size = rt->flv_off + rpkt.data_size;
+            FFSWAP(uint8_t *,    rt->flv_data,       rt->in_data);
+            FFSWAP(unsigned int, rt->flv_alloc_size, rt->in_alloc_size);
             return 0;
         }
-        ff_rtmp_packet_destroy(&rpkt);
     }
 }
 
@@ -2247,6 +2242,7 @@ static int rtmp_close(URLContext *h)
 
     free_tracked_methods(rt);
     av_freep(&rt->flv_data);
+    av_freep(&rt->in_data);
     ffurl_close(rt->stream);
     return ret;
 }
@@ -2466,7 +2462,8 @@ reconnect:
     if (rt->is_input) {
         // generate FLV header for demuxer
         rt->flv_size = 13;
-        rt->flv_data = av_realloc(rt->flv_data, rt->flv_size);
+        rt->flv_data = av_fast_realloc(rt->flv_data, &rt->flv_alloc_size,
+                                       rt->flv_size);
         rt->flv_off  = 0;
         memcpy(rt->flv_data, "FLV\1\5\0\0\0\011\0\0\0\0", rt->flv_size);
     } else {
@@ -120,6 +120,8 @@ static void build_udp_url(char *buf, int buf_size,
  *         'localrtcpport=n'  : set the local rtcp port to n
  *         'pkt_size=n'       : set max packet size
  *         'connect=0/1'      : do a connect() on the UDP socket
+ *         'bitrate=n'        : pace the outgoing RTP packets at n bits/s
+ *         'burst_bits=n'     : allow bursts of n bits when pacing
  * deprecated option:
  *         'localport=n'      : set the local port to n
  *
@@ -135,6 +137,7 @@ static int rtp_open(URLContext *h, const char *uri, int flags)
     int rtp_port, rtcp_port,
         ttl, connect,
         local_rtp_port, local_rtcp_port, max_packet_size;
+    int64_t bitrate = 0, burst_bits = 0;
     char hostname[256];
     char buf[1024];
     char path[1024];
@@ -173,11 +176,23 @@ static int rtp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "connect", p)) {
             connect = strtol(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "bitrate", p)) {
+            bitrate = strtoll(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "burst_bits", p)) {
+            burst_bits = strtoll(buf, NULL, 10);
+        }
     }
 
     build_udp_url(buf, sizeof(buf),
                   hostname, rtp_port, local_rtp_port, ttl, max_packet_size,
                   connect);
+    /* only the media packets are paced, not RTCP */
+    if (bitrate > 0 && !(flags & AVIO_FLAG_READ)) {
+        url_add_option(buf, sizeof(buf), "bitrate=%"PRId64, bitrate);
+        if (burst_bits > 0)
+            url_add_option(buf, sizeof(buf), "burst_bits=%"PRId64, burst_bits);
+    }
     if (ffurl_open(&s->rtp_hd, buf, flags, &h->interrupt_callback, NULL) < 0)
         goto fail;
     if (local_rtp_port>=0 && local_rtcp_port<0)
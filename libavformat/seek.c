@@ -20,10 +20,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <sys/stat.h>
+
 #include "seek.h"
+#include "libavutil/avstring.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/mem.h"
 #include "internal.h"
+#include "os_support.h"
 
 // NOTE: implementation should be moved here in another patch, to keep patches
 // separated.
@@ -507,3 +511,147 @@ void ff_free_parser_state(AVFormatContext *s, AVParserState *state)
     av_free(state->stream_states);
     av_free(state);
 }
+
+#define SEEK_INDEX_TAG     MKBETAG('L', 'S', 'I', 'X')
+#define SEEK_INDEX_VERSION 2
+
+int ff_seek_index_enabled(AVFormatContext *s)
+{
+    return s->seek_index && s->iformat && s->pb &&
+           !(s->iformat->flags & AVFMT_NOFILE) &&
+           (s->iformat->flags & AVFMT_GENERIC_INDEX ||
+            s->iformat->read_timestamp);
+}
+
+/**
+ * Modification time of a local input, 0 if it is unknown.
+ */
+static int64_t input_mtime(AVFormatContext *s)
+{
+    const char *filename = s->filename;
+    struct stat st;
+
+    av_strstart(filename, "file:", &filename);
+    if (strstr(filename, "://") || stat(filename, &st) < 0)
+        return 0;
+    return st.st_mtime;
+}
+
+int ff_seek_index_read(AVFormatContext *s)
+{
+    AVIOContext *pb;
+    char name[32];
+    int64_t size = avio_size(s->pb), start;
+    int i, j, pass, nb_streams, nb_read = 0, ret;
+
+    if (size <= 0)
+        return AVERROR(ENOSYS);
+    if ((ret = avio_open2(&pb, s->seek_index, AVIO_FLAG_READ,
+                          &s->interrupt_callback, NULL)) < 0)
+        return ret;
+
+    if (avio_rb32(pb) != SEEK_INDEX_TAG ||
+        avio_rb32(pb) != SEEK_INDEX_VERSION ||
+        avio_rb64(pb) != size ||
+        avio_rb64(pb) != input_mtime(s))
+        goto stale;
+    avio_get_str(pb, INT_MAX, name, sizeof(name));
+    if (strcmp(name, s->iformat->name))
+        goto stale;
+    start = avio_tell(pb);
+
+    /* The whole file is checked in the first pass, so that nothing from a
+     * damaged or truncated one ends up in the index. */
+    for (pass = 0; pass < 2; pass++) {
+        if (avio_seek(pb, start, SEEK_SET) < 0)
+            goto stale;
+        if (pass)
+            s->seek_index_dirty = 0;
+        nb_streams = avio_rb32(pb);
+        if (nb_streams < 0 || nb_streams > s->nb_streams)
+            goto stale;
+        for (i = 0; i < nb_streams; i++) {
+            AVStream *st   = s->streams[i];
+            int codec_id   = avio_rb32(pb);
+            int tb_num     = avio_rb32(pb);
+            int tb_den     = avio_rb32(pb);
+            int nb_entries = avio_rb32(pb);
+
+            if (nb_entries < 0 || pb->eof_reached)
+                goto stale;
+            if (st->codec->codec_id != codec_id ||
+                st->time_base.num != tb_num || st->time_base.den != tb_den) {
+                avio_skip(pb, 16LL * nb_entries);
+                continue;
+            }
+            for (j = 0; j < nb_entries; j++) {
+                int64_t pos       = avio_rb64(pb);
+                int64_t timestamp = avio_rb64(pb);
+                if (pos < 0 || pos >= size || pb->eof_reached)
+                    goto stale;
+                if (pass)
+                    av_add_index_entry(st, pos, timestamp, 0, 0,
+                                       AVINDEX_KEYFRAME);
+            }
+            if (pass) {
+                nb_read += nb_entries;
+                /* keyframes demuxed before loading which the file does
+                 * not know */
+                if (st->nb_index_entries > nb_entries)
+                    s->seek_index_dirty = 1;
+            }
+        }
+    }
+    for (; i < s->nb_streams; i++)
+        if (s->streams[i]->nb_index_entries)
+            s->seek_index_dirty = 1;
+    av_log(s, AV_LOG_VERBOSE, "Loaded %d index entries from '%s'\n",
+           nb_read, s->seek_index);
+    avio_close(pb);
+    return 0;
+
+stale:
+    av_log(s, AV_LOG_VERBOSE, "Ignoring stale seek index '%s'\n",
+           s->seek_index);
+    avio_close(pb);
+    return AVERROR_INVALIDDATA;
+}
+
+void ff_seek_index_write(AVFormatContext *s)
+{
+    AVIOContext *pb;
+    int64_t size = avio_size(s->pb);
+    int i, j;
+
+    /* nothing was learned since the index was loaded */
+    if (size <= 0 || !s->seek_index_dirty)
+        return;
+
+    if (avio_open2(&pb, s->seek_index, AVIO_FLAG_WRITE,
+                   &s->interrupt_callback, NULL) < 0) {
+        av_log(s, AV_LOG_WARNING, "Could not write seek index '%s'\n",
+               s->seek_index);
+        return;
+    }
+
+    avio_wb32(pb, SEEK_INDEX_TAG);
+    avio_wb32(pb, SEEK_INDEX_VERSION);
+    avio_wb64(pb, size);
+    avio_wb64(pb, input_mtime(s));
+    avio_put_str(pb, s->iformat->name);
+    avio_wb32(pb, s->nb_streams);
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+
+        avio_wb32(pb, st->codec->codec_id);
+        avio_wb32(pb, st->time_base.num);
+        avio_wb32(pb, st->time_base.den);
+        avio_wb32(pb, st->nb_index_entries);
+        for (j = 0; j < st->nb_index_entries; j++) {
+            avio_wb64(pb, st->index_entries[j].pos);
+            avio_wb64(pb, st->index_entries[j].timestamp);
+        }
+    }
+    avio_close(pb);
+    s->seek_index_dirty = 0;
+}
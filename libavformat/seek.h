@@ -120,4 +120,24 @@ void ff_restore_parser_state(AVFormatContext *s, AVParserState *state);
  */
 void ff_free_parser_state(AVFormatContext *s, AVParserState *state);
 
+/**
+ * Check whether the keyframes of the input are cached in the file set by
+ * AVFormatContext.seek_index. Formats with an index of their own ignore it.
+ */
+int ff_seek_index_enabled(AVFormatContext *s);
+
+/**
+ * Add the index entries cached in the seek index file to the streams.
+ *
+ * @return 0 on success, a negative error code if the file is missing or was
+ *         written for an input of a different size or modification time
+ */
+int ff_seek_index_read(AVFormatContext *s);
+
+/**
+ * Write the index entries of the streams to the seek index file, if new
+ * entries were added since it was read.
+ */
+void ff_seek_index_write(AVFormatContext *s);
+
 #endif /* AVFORMAT_SEEK_H */
@@ -19,7 +19,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
 #include <float.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #include "avformat.h"
 #include "internal.h"
@@ -27,12 +34,25 @@
 #include "libavutil/log.h"
 #include "libavutil/opt.h"
 #include "libavutil/avstring.h"
+#include "libavutil/fifo.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/mathematics.h"
 
+/**
+ * A segment the muxer is done with, waiting to be finalised.
+ */
+typedef struct SegmentJob {
+    AVFormatContext *oc;   /**< muxer of the segment, if not reused */
+    AVIOContext *pb;       /**< output of the segment otherwise */
+    int write_trailer;
+    char filename[1024];
+} SegmentJob;
+
 typedef struct {
     const AVClass *class;  /**< Class for private options. */
     int number;
+    int nb_started;        /**< number of segments started */
+    int nb_done;           /**< number of segments completely written */
     AVOutputFormat *oformat;
     AVFormatContext *avf;
     char *format;          /**< Set by a private option. */
@@ -43,10 +63,25 @@ typedef struct {
     int  wrap;             /**< Set by a private option. */
     int  individual_header_trailer; /**< Set by a private option. */
     int  write_header_trailer; /**< Set by a private option. */
+    int  queue_size;       /**< Set by a private option. */
     int64_t offset_time;
     int64_t recording_time;
     int has_video;
     AVIOContext *pb;
+#if HAVE_PTHREADS
+    /* background I/O, accessed under lock */
+    pthread_t io_thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    AVFifoBuffer *jobs;
+    int io_finished;
+    int io_error;
+    char next_filename[1024];
+    int next_pending;      /**< next_filename is to be opened */
+    int next_ready;        /**< the open of next_filename completed */
+    AVIOContext *next_pb;
+    int next_ret;
+#endif
 } SegmentContext;
 
 enum {
@@ -92,10 +127,10 @@ static int segment_hls_window(AVFormatContext *s, int last)
     avio_printf(seg->pb, "#EXT-X-VERSION:3\n");
     avio_printf(seg->pb, "#EXT-X-TARGETDURATION:%d\n", (int)seg->time);
     avio_printf(seg->pb, "#EXT-X-MEDIA-SEQUENCE:%d\n",
-                FFMAX(0, seg->number - seg->size));
+                FFMAX(0, seg->nb_done - seg->size));
 
-    for (i = FFMAX(0, seg->number - seg->size);
-         i < seg->number; i++) {
+    for (i = FFMAX(0, seg->nb_done - seg->size);
+         i < seg->nb_done; i++) {
         avio_printf(seg->pb, "#EXTINF:%d,\n", (int)seg->time);
         av_get_frame_filename(buf, sizeof(buf), s->filename, i);
         avio_printf(seg->pb, "%s\n", buf);
@@ -108,30 +143,258 @@ fail:
     return ret;
 }
 
+/**
+ * Add a completely written segment to the list.
+ */
+static int segment_publish(AVFormatContext *s, const char *filename, int last)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret = 0;
+
+    seg->nb_done++;
+
+    if (!seg->list)
+        return 0;
+
+    if (seg->list_type == LIST_HLS)
+        return segment_hls_window(s, last);
+
+    avio_printf(seg->pb, "%s\n", filename);
+    avio_flush(seg->pb);
+    if (!last && seg->size && !(seg->nb_done % seg->size)) {
+        avio_closep(&seg->pb);
+        ret = avio_open2(&seg->pb, seg->list, AVIO_FLAG_WRITE,
+                         &s->interrupt_callback, NULL);
+    }
+    return ret;
+}
+
+static int segment_finish(AVFormatContext *s, SegmentJob *job)
+{
+    if (job->oc) {
+        av_write_frame(job->oc, NULL); /* Flush any buffered data (fragmented mp4) */
+        if (job->write_trailer)
+            av_write_trailer(job->oc);
+        avio_close(job->oc->pb);
+        avformat_free_context(job->oc);
+    } else
+        avio_close(job->pb);
+
+    return segment_publish(s, job->filename, 0);
+}
+
+static int segment_next_filename(AVFormatContext *s, char *buf, int buf_size)
+{
+    SegmentContext *c = s->priv_data;
+
+    if (c->wrap)
+        c->number %= c->wrap;
+
+    if (av_get_frame_filename(buf, buf_size, s->filename, c->number++) < 0)
+        return AVERROR(EINVAL);
+    return 0;
+}
+
+#if HAVE_PTHREADS
+/**
+ * Finalise the segments and open the next one in the background, so that
+ * a slow trailer write or close does not stall the muxing.
+ */
+static void *segment_io_thread(void *arg)
+{
+    AVFormatContext *s = arg;
+    SegmentContext *seg = s->priv_data;
+    SegmentJob job;
+    int ret;
+
+    pthread_mutex_lock(&seg->lock);
+    for (;;) {
+        while (!seg->next_pending && !av_fifo_size(seg->jobs) &&
+               !seg->io_finished)
+            pthread_cond_wait(&seg->cond, &seg->lock);
+
+        if (seg->next_pending) {
+            AVIOContext *pb = NULL;
+            pthread_mutex_unlock(&seg->lock);
+            ret = avio_open2(&pb, seg->next_filename, AVIO_FLAG_WRITE,
+                             &s->interrupt_callback, NULL);
+            pthread_mutex_lock(&seg->lock);
+            seg->next_pb      = pb;
+            seg->next_ret     = ret;
+            seg->next_pending = 0;
+            seg->next_ready   = 1;
+            pthread_cond_broadcast(&seg->cond);
+        } else if (av_fifo_size(seg->jobs)) {
+            av_fifo_generic_read(seg->jobs, &job, sizeof(job), NULL);
+            pthread_cond_broadcast(&seg->cond);
+            pthread_mutex_unlock(&seg->lock);
+            ret = segment_finish(s, &job);
+            pthread_mutex_lock(&seg->lock);
+            if (ret < 0 && !seg->io_error)
+                seg->io_error = ret;
+        } else
+            break;
+    }
+    pthread_mutex_unlock(&seg->lock);
+
+    return NULL;
+}
+
+/**
+ * Have the I/O thread open the segment after the current one.
+ */
+static int segment_request_next(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret;
+
+    pthread_mutex_lock(&seg->lock);
+    ret = segment_next_filename(s, seg->next_filename,
+                                sizeof(seg->next_filename));
+    if (!ret) {
+        seg->next_pending = 1;
+        seg->next_ready   = 0;
+        pthread_cond_broadcast(&seg->cond);
+    }
+    pthread_mutex_unlock(&seg->lock);
+    return ret;
+}
+
+static int segment_start_io_thread(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+
+    if (!(seg->jobs = av_fifo_alloc(seg->queue_size * sizeof(SegmentJob))))
+        return AVERROR(ENOMEM);
+
+    pthread_mutex_init(&seg->lock, NULL);
+    pthread_cond_init(&seg->cond, NULL);
+    if (pthread_create(&seg->io_thread, NULL, segment_io_thread, s)) {
+        av_log(s, AV_LOG_ERROR, "pthread_create failed\n");
+        pthread_mutex_destroy(&seg->lock);
+        pthread_cond_destroy(&seg->cond);
+        av_fifo_free(seg->jobs);
+        seg->jobs = NULL;
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+/**
+ * Wait for the pending segments to be finalised and stop the I/O thread.
+ */
+static int segment_stop_io_thread(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    const char *path;
+
+    if (!seg->jobs)
+        return 0;
+
+    pthread_mutex_lock(&seg->lock);
+    seg->io_finished = 1;
+    pthread_cond_broadcast(&seg->cond);
+    pthread_mutex_unlock(&seg->lock);
+    pthread_join(seg->io_thread, NULL);
+
+    /* the segment opened in advance is not going to be used */
+    if (seg->next_pb) {
+        avio_closep(&seg->next_pb);
+        if ((path = ff_url_local_path(seg->next_filename)))
+            unlink(path);
+    }
+
+    pthread_mutex_destroy(&seg->lock);
+    pthread_cond_destroy(&seg->cond);
+    av_fifo_free(seg->jobs);
+    seg->jobs = NULL;
+    return seg->io_error;
+}
+#endif
+
+/**
+ * Hand the current segment over to be finalised.
+ */
+static int segment_end(AVFormatContext *s, int write_trailer)
+{
+    SegmentContext *seg = s->priv_data;
+    AVFormatContext *oc = seg->avf;
+    SegmentJob job = { 0 };
+    int ret = 0;
+
+    av_strlcpy(job.filename, oc->filename, sizeof(job.filename));
+    job.write_trailer = write_trailer;
+    if (write_trailer) {
+        /* a new muxer is created for the next segment */
+        job.oc   = oc;
+        seg->avf = NULL;
+    } else {
+        av_write_frame(oc, NULL); /* Flush any buffered data (fragmented mp4) */
+        job.pb  = oc->pb;
+        oc->pb  = NULL;
+    }
+
+#if HAVE_PTHREADS
+    if (seg->jobs) {
+        pthread_mutex_lock(&seg->lock);
+        while (!av_fifo_space(seg->jobs) && !seg->io_error)
+            pthread_cond_wait(&seg->cond, &seg->lock);
+        if (!(ret = seg->io_error)) {
+            av_fifo_generic_write(seg->jobs, &job, sizeof(job), NULL);
+            pthread_cond_broadcast(&seg->cond);
+        }
+        pthread_mutex_unlock(&seg->lock);
+        if (ret < 0) {
+            if (job.oc) {
+                avio_close(job.oc->pb);
+                avformat_free_context(job.oc);
+            } else
+                avio_close(job.pb);
+        }
+        return ret;
+    }
+#endif
+
+    return segment_finish(s, &job);
+}
+
 static int segment_start(AVFormatContext *s, int write_header)
 {
     SegmentContext *c = s->priv_data;
-    AVFormatContext *oc = c->avf;
+    AVFormatContext *oc;
     int err = 0;
 
     if (write_header) {
-        avformat_free_context(oc);
-        c->avf = NULL;
         if ((err = segment_mux_init(s)) < 0)
             return err;
-        oc = c->avf;
     }
+    oc = c->avf;
+
+#if HAVE_PTHREADS
+    if (c->jobs) {
+        pthread_mutex_lock(&c->lock);
+        while (!c->next_ready)
+            pthread_cond_wait(&c->cond, &c->lock);
+        av_strlcpy(oc->filename, c->next_filename, sizeof(oc->filename));
+        oc->pb     = c->next_pb;
+        err        = c->next_ret;
+        c->next_pb = NULL;
+        pthread_mutex_unlock(&c->lock);
+        if (err < 0 || (err = segment_request_next(s)) < 0)
+            return err;
+    } else
+#endif
+    {
+        if ((err = segment_next_filename(s, oc->filename,
+                                         sizeof(oc->filename))) < 0)
+            return err;
 
-    if (c->wrap)
-        c->number %= c->wrap;
-
-    if (av_get_frame_filename(oc->filename, sizeof(oc->filename),
-                              s->filename, c->number++) < 0)
-        return AVERROR(EINVAL);
+        if ((err = avio_open2(&oc->pb, oc->filename, AVIO_FLAG_WRITE,
+                              &s->interrupt_callback, NULL)) < 0)
+            return err;
+    }
 
-    if ((err = avio_open2(&oc->pb, oc->filename, AVIO_FLAG_WRITE,
-                          &s->interrupt_callback, NULL)) < 0)
-        return err;
+    c->nb_started++;
 
     if (oc->oformat->priv_class && oc->priv_data)
         av_opt_set(oc->priv_data, "resend_headers", "1", 0); /* mpegts specific */
@@ -144,18 +407,6 @@ static int segment_start(AVFormatContext *s, int write_header)
     return 0;
 }
 
-static int segment_end(AVFormatContext *oc, int write_trailer)
-{
-    int ret = 0;
-
-    av_write_frame(oc, NULL); /* Flush any buffered data (fragmented mp4) */
-    if (write_trailer)
-        av_write_trailer(oc);
-    avio_close(oc->pb);
-
-    return ret;
-}
-
 static int open_null_ctx(AVIOContext **ctx)
 {
     int buf_size = 32768;
@@ -224,6 +475,7 @@ static int seg_write_header(AVFormatContext *s)
         ret = AVERROR(EINVAL);
         goto fail;
     }
+    seg->nb_started = 1;
 
     if (seg->write_header_trailer) {
         if ((ret = avio_open2(&oc->pb, oc->filename, AVIO_FLAG_WRITE,
@@ -246,18 +498,23 @@ static int seg_write_header(AVFormatContext *s)
             goto fail;
     }
 
-    if (seg->list) {
-        if (seg->list_type == LIST_HLS) {
-            if ((ret = segment_hls_window(s, 0)) < 0)
-                goto fail;
-        } else {
-            avio_printf(seg->pb, "%s\n", oc->filename);
-            avio_flush(seg->pb);
-        }
+#if HAVE_PTHREADS
+    /* opening the next segment in advance leaves an empty file behind if it
+     * is not used, which can only be removed for local files; with
+     * segment_wrap it would truncate a file that may still be listed or
+     * waiting to be finalised */
+    if (seg->queue_size && !seg->wrap && ff_url_local_path(s->filename)) {
+        if ((ret = segment_start_io_thread(s)) < 0 ||
+            (ret = segment_request_next(s)) < 0)
+            goto fail;
     }
+#endif
 
 fail:
     if (ret) {
+#if HAVE_PTHREADS
+        segment_stop_io_thread(s);
+#endif
         if (seg->list)
             avio_close(seg->pb);
         if (seg->avf)
@@ -271,7 +528,10 @@ static int seg_write_packet(AVFormatContext *s, AVPacket *pkt)
     SegmentContext *seg = s->priv_data;
     AVFormatContext *oc = seg->avf;
     AVStream *st = s->streams[pkt->stream_index];
-    int64_t end_pts = seg->recording_time * seg->number;
+    /* the file index, as if the segments were opened when cut */
+    int64_t end_pts = seg->recording_time *
+                      (seg->wrap ? (seg->nb_started - 1) % seg->wrap + 1
+                                 : seg->nb_started);
     int ret;
 
     if ((seg->has_video && st->codec->codec_type == AVMEDIA_TYPE_VIDEO) &&
@@ -282,7 +542,7 @@ static int seg_write_packet(AVFormatContext *s, AVPacket *pkt)
         av_log(s, AV_LOG_DEBUG, "Next segment starts at %d %"PRId64"\n",
                pkt->stream_index, pkt->pts);
 
-        ret = segment_end(oc, seg->individual_header_trailer);
+        ret = segment_end(s, seg->individual_header_trailer);
 
         if (!ret)
             ret = segment_start(s, seg->individual_header_trailer);
@@ -291,31 +551,22 @@ static int seg_write_packet(AVFormatContext *s, AVPacket *pkt)
             goto fail;
 
         oc = seg->avf;
-
-        if (seg->list) {
-            if (seg->list_type == LIST_HLS) {
-                if ((ret = segment_hls_window(s, 0)) < 0)
-                    goto fail;
-            } else {
-                avio_printf(seg->pb, "%s\n", oc->filename);
-                avio_flush(seg->pb);
-                if (seg->size && !(seg->number % seg->size)) {
-                    avio_closep(&seg->pb);
-                    if ((ret = avio_open2(&seg->pb, seg->list, AVIO_FLAG_WRITE,
-                                          &s->interrupt_callback, NULL)) < 0)
-                        goto fail;
-                }
-            }
-        }
     }
 
     ret = ff_write_chained(oc, pkt->stream_index, pkt, s);
 
 fail:
     if (ret < 0) {
+#if HAVE_PTHREADS
+        segment_stop_io_thread(s);
+#endif
         if (seg->list)
-            avio_close(seg->pb);
-        avformat_free_context(oc);
+            avio_closep(&seg->pb);
+        if (seg->avf) {
+            avio_close(seg->avf->pb);
+            avformat_free_context(seg->avf);
+            seg->avf = NULL;
+        }
     }
 
     return ret;
@@ -325,28 +576,38 @@ static int seg_write_trailer(struct AVFormatContext *s)
 {
     SegmentContext *seg = s->priv_data;
     AVFormatContext *oc = seg->avf;
-    int ret;
+    int ret = 0;
+
+    if (!oc)
+        return AVERROR(EINVAL);
+
+#if HAVE_PTHREADS
+    if ((ret = segment_stop_io_thread(s)) < 0)
+        goto fail;
+#endif
+
+    av_write_frame(oc, NULL); /* Flush any buffered data (fragmented mp4) */
     if (!seg->write_header_trailer) {
-        if ((ret = segment_end(oc, 0)) < 0)
-            goto fail;
+        avio_closep(&oc->pb);
         open_null_ctx(&oc->pb);
         ret = av_write_trailer(oc);
         close_null_ctx(oc->pb);
+        oc->pb = NULL;
     } else {
-        ret = segment_end(oc, 1);
+        ret = av_write_trailer(oc);
+        avio_closep(&oc->pb);
     }
 
     if (ret < 0)
         goto fail;
 
-    if (seg->list && seg->list_type == LIST_HLS) {
-        if ((ret = segment_hls_window(s, 1) < 0))
-            goto fail;
-    }
+    ret = segment_publish(s, oc->filename, 1);
 
 fail:
+    avio_close(oc->pb);
     avio_close(seg->pb);
     avformat_free_context(oc);
+    seg->avf = NULL;
     return ret;
 }
 
@@ -363,6 +624,7 @@ static const AVOption options[] = {
     { "segment_wrap",      "number after which the index wraps",      OFFSET(wrap),    AV_OPT_TYPE_INT,    {.i64 = 0},     0, INT_MAX, E },
     { "individual_header_trailer", "write header/trailer to each segment", OFFSET(individual_header_trailer), AV_OPT_TYPE_INT, {.i64 = 1}, 0, 1, E },
     { "write_header_trailer", "write a header to the first segment and a trailer to the last one", OFFSET(write_header_trailer), AV_OPT_TYPE_INT, {.i64 = 1}, 0, 1, E },
+    { "segment_queue_size", "maximum number of segments being finalised in the background", OFFSET(queue_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1024, E },
     { NULL },
 };
 
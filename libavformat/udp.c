@@ -25,22 +25,32 @@
  */
 
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "avio_internal.h"
+#include "libavutil/fifo.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/avstring.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
 #include "internal.h"
 #include "network.h"
 #include "os_support.h"
 #include "url.h"
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #ifndef IPV6_ADD_MEMBERSHIP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
 #define IPV6_DROP_MEMBERSHIP IPV6_LEAVE_GROUP
 #endif
 
 typedef struct {
+    const AVClass *class;
     int udp_fd;
     int ttl;
     int buffer_size;
@@ -50,10 +60,46 @@ typedef struct {
     struct sockaddr_storage dest_addr;
     int dest_addr_len;
     int is_connected;
+
+    /* Circular buffer filled by a receiving thread, or drained by a
+     * sending thread */
+    int circular_buffer_size;
+    int overrun_nonfatal;
+    int64_t bitrate;
+    int64_t burst_bits;
+    int packets_dropped;
+    int fifo_high_water;
+#if HAVE_PTHREADS
+    AVFifoBuffer *fifo;
+    uint8_t *batch_buf;
+    int circular_buffer_error;
+    int exit_thread;
+    int thread_started;
+    pthread_t circular_buffer_thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
 } UDPContext;
 
+#define OFFSET(x) offsetof(UDPContext, x)
+/* statistics of the circular buffer, read only: reset when opening */
+static const AVOption options[] = {
+{"packets_dropped", "number of incoming packets dropped because the circular buffer was full", OFFSET(packets_dropped), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, 0 },
+{"fifo_high_water", "highest number of bytes used in the circular buffer", OFFSET(fifo_high_water), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, 0 },
+{NULL}
+};
+
+static const AVClass udp_context_class = {
+    .class_name     = "udp",
+    .item_name      = av_default_item_name,
+    .option         = options,
+    .version        = LIBAVUTIL_VERSION_INT,
+};
+
 #define UDP_TX_BUF_SIZE 32768
 #define UDP_MAX_PKT_SIZE 65536
+#define UDP_BATCH 16
+#define UDP_TX_FIFO_SIZE (4096 * 188)
 
 static void log_net_error(void *ctx, int level, const char* prefix)
 {
@@ -378,6 +424,259 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+#if HAVE_PTHREADS
+/**
+ * Receive up to UDP_BATCH datagrams at once into s->batch_buf.
+ * @return the number of datagrams received or a negative error code
+ */
+static int udp_recv_batch(URLContext *h, int *lens)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+#if HAVE_RECVMMSG
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+    int i;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < UDP_BATCH; i++) {
+        iov[i].iov_base = s->batch_buf + i * h->max_packet_size;
+        iov[i].iov_len  = h->max_packet_size;
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    ret = recvmmsg(s->udp_fd, msgs, UDP_BATCH, 0, NULL);
+    if (ret >= 0 || errno != ENOSYS) {
+        if (ret < 0)
+            return ff_neterrno();
+        for (i = 0; i < ret; i++)
+            lens[i] = msgs[i].msg_len;
+        return ret;
+    }
+#endif
+    ret = recv(s->udp_fd, s->batch_buf, h->max_packet_size, 0);
+    if (ret < 0)
+        return ff_neterrno();
+    lens[0] = ret;
+    return 1;
+}
+
+static void *circular_buffer_task(void *arg)
+{
+    URLContext *h = arg;
+    UDPContext *s = h->priv_data;
+    int lens[UDP_BATCH];
+    int i, n, exit_thread, overrun = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&s->mutex);
+        exit_thread = s->exit_thread;
+        pthread_mutex_unlock(&s->mutex);
+        if (exit_thread)
+            break;
+
+        n = ff_network_wait_fd(s->udp_fd, 0);
+        if (n >= 0)
+            n = udp_recv_batch(h, lens);
+        if (n == AVERROR(EAGAIN) || n == AVERROR(EINTR))
+            continue;
+
+        pthread_mutex_lock(&s->mutex);
+        if (n < 0) {
+            s->circular_buffer_error = n;
+            pthread_cond_signal(&s->cond);
+            pthread_mutex_unlock(&s->mutex);
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            uint8_t *data = s->batch_buf + i * h->max_packet_size;
+            uint8_t hdr[4];
+
+            if (av_fifo_space(s->fifo) < lens[i] + 4) {
+                s->packets_dropped++;
+                if (!s->overrun_nonfatal) {
+                    av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                           "Increase fifo_size or set overrun_nonfatal to "
+                           "drop packets instead.\n");
+                    s->circular_buffer_error = AVERROR(EIO);
+                    break;
+                }
+                if (!overrun)
+                    av_log(h, AV_LOG_WARNING, "Circular buffer overrun, "
+                           "%d packets dropped so far\n", s->packets_dropped);
+                overrun = 1;
+                continue;
+            }
+            overrun = 0;
+            AV_WL32(hdr, lens[i]);
+            av_fifo_generic_write(s->fifo, hdr, 4, NULL);
+            av_fifo_generic_write(s->fifo, data, lens[i], NULL);
+        }
+        s->fifo_high_water = FFMAX(s->fifo_high_water, av_fifo_size(s->fifo));
+        pthread_cond_signal(&s->cond);
+        exit_thread = s->circular_buffer_error;
+        pthread_mutex_unlock(&s->mutex);
+        if (exit_thread)
+            break;
+    }
+    return NULL;
+}
+
+/**
+ * Send the n datagrams stored in s->batch_buf.
+ * @return 0 or a negative error code
+ */
+static int udp_send_batch(URLContext *h, const int *lens, int n)
+{
+    UDPContext *s = h->priv_data;
+    int i = 0, ret;
+#if HAVE_SENDMMSG
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = s->batch_buf + i * h->max_packet_size;
+        iov[i].iov_len  = lens[i];
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (!s->is_connected) {
+            msgs[i].msg_hdr.msg_name    = &s->dest_addr;
+            msgs[i].msg_hdr.msg_namelen = s->dest_addr_len;
+        }
+    }
+    for (i = 0; i < n; i += ret) {
+        ret = sendmmsg(s->udp_fd, msgs + i, n - i, 0);
+        if (ret < 0) {
+            if (errno == ENOSYS && !i)
+                break;
+            return ff_neterrno();
+        }
+    }
+    if (i == n)
+        return 0;
+#endif
+    for (i = 0; i < n; i++) {
+        uint8_t *data = s->batch_buf + i * h->max_packet_size;
+
+        if (!s->is_connected)
+            ret = sendto(s->udp_fd, data, lens[i], 0,
+                         (struct sockaddr *) &s->dest_addr,
+                         s->dest_addr_len);
+        else
+            ret = send(s->udp_fd, data, lens[i], 0);
+        if (ret < 0)
+            return ff_neterrno();
+    }
+    return 0;
+}
+
+static void *circular_buffer_task_tx(void *arg)
+{
+    URLContext *h = arg;
+    UDPContext *s = h->priv_data;
+    int lens[UDP_BATCH];
+    int64_t tokens = s->burst_bits, last = av_gettime();
+    int n, ret = 0;
+
+    pthread_mutex_lock(&s->mutex);
+    for (;;) {
+        int64_t delay = 0;
+
+        while (!av_fifo_size(s->fifo) && !s->exit_thread)
+            pthread_cond_wait(&s->cond, &s->mutex);
+        /* the queued datagrams are still sent when closing */
+        if (!av_fifo_size(s->fifo))
+            break;
+
+        if (s->bitrate) {
+            int64_t now = av_gettime();
+            tokens = FFMIN(s->burst_bits,
+                           tokens + (now - last) * s->bitrate / 1000000);
+            last   = now;
+        }
+        n = 0;
+        while (n < UDP_BATCH && av_fifo_size(s->fifo)) {
+            uint8_t hdr[4];
+            int i, len;
+
+            for (i = 0; i < 4; i++)
+                hdr[i] = *av_fifo_peek2(s->fifo, i);
+            len = AV_RL32(hdr);
+            /* an oversized datagram is let through when the bucket is full */
+            if (s->bitrate && tokens < 8 * len && tokens < s->burst_bits) {
+                /* at least 1, the batch would be empty otherwise */
+                if (!n)
+                    delay = FFMAX((8 * len - tokens) * 1000000 / s->bitrate, 1);
+                break;
+            }
+            tokens -= 8 * len;
+            av_fifo_drain(s->fifo, 4);
+            av_fifo_generic_read(s->fifo, s->batch_buf + n * h->max_packet_size,
+                                 len, NULL);
+            lens[n++] = len;
+        }
+        if (n)
+            pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->mutex);
+
+        if (delay)
+            av_usleep(delay);
+        else
+            ret = udp_send_batch(h, lens, n);
+
+        pthread_mutex_lock(&s->mutex);
+        if (ret < 0) {
+            s->circular_buffer_error = ret;
+            pthread_cond_signal(&s->cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+}
+
+/**
+ * Wait until the other end of the circular buffer signals a change,
+ * or for 100 ms at most, so that the caller can check the interrupt
+ * callback. Must be called with s->mutex locked.
+ */
+static int udp_wait_circular_buffer(UDPContext *s)
+{
+    int64_t t = av_gettime() + 100000;
+    struct timespec tv = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+
+    return pthread_cond_timedwait(&s->cond, &s->mutex, &tv) ?
+           AVERROR(EAGAIN) : 0;
+}
+
+static int udp_start_circular_buffer(URLContext *h, void *(*task)(void *))
+{
+    UDPContext *s = h->priv_data;
+
+    s->fifo      = av_fifo_alloc(s->circular_buffer_size);
+    s->batch_buf = av_malloc(UDP_BATCH * h->max_packet_size);
+    if (!s->fifo || !s->batch_buf)
+        goto fail;
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->circular_buffer_thread, NULL, task, h)) {
+        av_log(h, AV_LOG_ERROR, "pthread_create failed\n");
+        pthread_mutex_destroy(&s->mutex);
+        pthread_cond_destroy(&s->cond);
+        goto fail;
+    }
+    s->thread_started = 1;
+    return 0;
+fail:
+    av_fifo_free(s->fifo);
+    av_freep(&s->batch_buf);
+    s->fifo = NULL;
+    return AVERROR(ENOMEM);
+}
+#endif
+
 /* put it in UDP context */
 /* return non zero if error */
 static int udp_open(URLContext *h, const char *uri, int flags)
@@ -401,6 +700,8 @@ static int udp_open(URLContext *h, const char *uri, int flags)
 
     s->ttl = 16;
     s->buffer_size = is_output ? UDP_TX_BUF_SIZE : UDP_MAX_PKT_SIZE;
+    s->packets_dropped = 0;
+    s->fifo_high_water = 0;
 
     p = strchr(uri, '?');
     if (p) {
@@ -430,6 +731,19 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "localaddr", p)) {
             av_strlcpy(localaddr, buf, sizeof(localaddr));
         }
+        if (av_find_info_tag(buf, sizeof(buf), "fifo_size", p)) {
+            /* in units of 188 byte MPEG-TS packets */
+            s->circular_buffer_size = strtol(buf, NULL, 10) * 188;
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "overrun_nonfatal", p)) {
+            s->overrun_nonfatal = strtol(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "bitrate", p)) {
+            s->bitrate = strtoll(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "burst_bits", p)) {
+            s->burst_bits = strtoll(buf, NULL, 10);
+        }
         if (av_find_info_tag(buf, sizeof(buf), "sources", p))
             include = 1;
         if (include || av_find_info_tag(buf, sizeof(buf), "block", p)) {
@@ -552,6 +866,34 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         av_free(sources[i]);
 
     s->udp_fd = udp_fd;
+
+    if (is_output && (s->bitrate > 0 || s->circular_buffer_size > 0)) {
+        if (!s->circular_buffer_size)
+            s->circular_buffer_size = UDP_TX_FIFO_SIZE;
+        s->circular_buffer_size = FFMAX(s->circular_buffer_size,
+                                        h->max_packet_size + 4);
+        if (!s->burst_bits)
+            s->burst_bits = 8LL * UDP_BATCH * h->max_packet_size;
+#if HAVE_PTHREADS
+        if (udp_start_circular_buffer(h, circular_buffer_task_tx) < 0) {
+            closesocket(udp_fd);
+            return AVERROR(ENOMEM);
+        }
+#else
+        av_log(h, AV_LOG_WARNING, "fifo_size and bitrate are not supported "
+               "without threads, ignoring\n");
+#endif
+    } else if (!is_output && s->circular_buffer_size > 0) {
+#if HAVE_PTHREADS
+        if (udp_start_circular_buffer(h, circular_buffer_task) < 0) {
+            closesocket(udp_fd);
+            return AVERROR(ENOMEM);
+        }
+#else
+        av_log(h, AV_LOG_WARNING,
+               "fifo_size is not supported without threads, ignoring\n");
+#endif
+    }
     return 0;
  fail:
     if (udp_fd >= 0)
@@ -566,6 +908,39 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     UDPContext *s = h->priv_data;
     int ret;
 
+#if HAVE_PTHREADS
+    if (s->fifo) {
+        pthread_mutex_lock(&s->mutex);
+        for (;;) {
+            if (av_fifo_size(s->fifo)) {
+                uint8_t hdr[4];
+                int len;
+
+                av_fifo_generic_read(s->fifo, hdr, 4, NULL);
+                len = ret = AV_RL32(hdr);
+                if (ret > size) {
+                    av_log(h, AV_LOG_WARNING, "Part of datagram lost due "
+                           "to insufficient buffer size\n");
+                    ret = size;
+                }
+                av_fifo_generic_read(s->fifo, buf, ret, NULL);
+                av_fifo_drain(s->fifo, len - ret);
+                break;
+            } else if (s->circular_buffer_error) {
+                ret = s->circular_buffer_error;
+                break;
+            } else if (h->flags & AVIO_FLAG_NONBLOCK) {
+                ret = AVERROR(EAGAIN);
+                break;
+            } else if ((ret = udp_wait_circular_buffer(s)) < 0) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&s->mutex);
+        return ret;
+    }
+#endif
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 0);
         if (ret < 0)
@@ -575,11 +950,56 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     return ret < 0 ? ff_neterrno() : ret;
 }
 
+#if HAVE_PTHREADS
+static int fifo_copy_from(void *opaque, void *dst, int size)
+{
+    const uint8_t **src = opaque;
+
+    memcpy(dst, *src, size);
+    *src += size;
+    return size;
+}
+#endif
+
 static int udp_write(URLContext *h, const uint8_t *buf, int size)
 {
     UDPContext *s = h->priv_data;
     int ret;
 
+#if HAVE_PTHREADS
+    if (s->fifo) {
+        uint8_t hdr[4];
+
+        /* the sending thread reads the datagrams into max_packet_size slots */
+        if (size > h->max_packet_size)
+            return AVERROR(EINVAL);
+
+        pthread_mutex_lock(&s->mutex);
+        while (!s->circular_buffer_error &&
+               av_fifo_space(s->fifo) < size + 4) {
+            if (h->flags & AVIO_FLAG_NONBLOCK)
+                ret = AVERROR(EAGAIN);
+            else
+                ret = udp_wait_circular_buffer(s);
+            if (ret < 0) {
+                pthread_mutex_unlock(&s->mutex);
+                return ret;
+            }
+        }
+        if (s->circular_buffer_error) {
+            ret = s->circular_buffer_error;
+        } else {
+            AV_WL32(hdr, size);
+            av_fifo_generic_write(s->fifo, hdr, 4, NULL);
+            av_fifo_generic_write(s->fifo, &buf, size, fifo_copy_from);
+            pthread_cond_signal(&s->cond);
+            ret = size;
+        }
+        pthread_mutex_unlock(&s->mutex);
+        return ret;
+    }
+#endif
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 1);
         if (ret < 0)
@@ -600,6 +1020,24 @@ static int udp_close(URLContext *h)
 {
     UDPContext *s = h->priv_data;
 
+#if HAVE_PTHREADS
+    if (s->thread_started) {
+        pthread_mutex_lock(&s->mutex);
+        s->exit_thread = 1;
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->mutex);
+        pthread_join(s->circular_buffer_thread, NULL);
+        pthread_mutex_destroy(&s->mutex);
+        pthread_cond_destroy(&s->cond);
+        if (h->flags & AVIO_FLAG_READ)
+            av_log(h, s->packets_dropped ? AV_LOG_WARNING : AV_LOG_VERBOSE,
+                   "%d packets dropped, circular buffer high water mark "
+                   "%d of %d bytes\n", s->packets_dropped,
+                   s->fifo_high_water, s->circular_buffer_size);
+    }
+    av_fifo_free(s->fifo);
+    av_freep(&s->batch_buf);
+#endif
     if (s->is_multicast && (h->flags & AVIO_FLAG_READ))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr);
     closesocket(s->udp_fd);
@@ -614,5 +1052,6 @@ URLProtocol ff_udp_protocol = {
     .url_close           = udp_close,
     .url_get_file_handle = udp_get_file_handle,
     .priv_data_size      = sizeof(UDPContext),
+    .priv_data_class     = &udp_context_class,
     .flags               = URL_PROTOCOL_FLAG_NETWORK,
 };
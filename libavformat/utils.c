@@ -38,11 +38,16 @@
 #include "libavutil/time.h"
 #include "riff.h"
 #include "audiointerleave.h"
+#include "os_support.h"
+#include "seek.h"
 #include "url.h"
 #include <stdarg.h>
 #if CONFIG_NETWORK
 #include "network.h"
 #endif
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #undef NDEBUG
 #include <assert.h>
@@ -1000,6 +1005,18 @@ static void free_packet_buffer(AVPacketList **pkt_buf, AVPacketList **pkt_buf_en
     *pkt_buf_end = NULL;
 }
 
+static void add_keyframe_index_entry(AVFormatContext *s, AVStream *st,
+                                     int64_t pos, int64_t dts)
+{
+    int nb_entries;
+
+    ff_reduce_index(s, st->index);
+    nb_entries = st->nb_index_entries;
+    av_add_index_entry(st, pos, dts, 0, 0, AVINDEX_KEYFRAME);
+    if (st->nb_index_entries > nb_entries)
+        s->seek_index_dirty = 1;
+}
+
 /**
  * Parse a packet, add all split parts to parse_queue
  *
@@ -1068,9 +1085,12 @@ static int parse_packet(AVFormatContext *s, AVPacket *pkt, int stream_index)
 
         if ((s->iformat->flags & AVFMT_GENERIC_INDEX) &&
             out_pkt.flags & AV_PKT_FLAG_KEY) {
-            ff_reduce_index(s, st->index);
-            av_add_index_entry(st, st->parser->frame_offset, out_pkt.dts,
-                               0, 0, AVINDEX_KEYFRAME);
+            add_keyframe_index_entry(s, st, st->parser->frame_offset,
+                                     out_pkt.dts);
+        } else if (ff_seek_index_enabled(s) && out_pkt.flags & AV_PKT_FLAG_KEY &&
+                   out_pkt.pos >= 0 && out_pkt.dts != AV_NOPTS_VALUE) {
+            /* the parser offsets only match the file for raw streams */
+            add_keyframe_index_entry(s, st, out_pkt.pos, out_pkt.dts);
         }
 
         if (out_pkt.data == pkt->data && out_pkt.size == pkt->size) {
@@ -1176,11 +1196,10 @@ static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
             /* no parsing needed: we just output the packet as is */
             *pkt = cur_pkt;
             compute_pkt_fields(s, st, NULL, pkt);
-            if ((s->iformat->flags & AVFMT_GENERIC_INDEX) &&
-                (pkt->flags & AV_PKT_FLAG_KEY) && pkt->dts != AV_NOPTS_VALUE) {
-                ff_reduce_index(s, st->index);
-                av_add_index_entry(st, pkt->pos, pkt->dts, 0, 0, AVINDEX_KEYFRAME);
-            }
+            if (((s->iformat->flags & AVFMT_GENERIC_INDEX) ||
+                 (ff_seek_index_enabled(s) && pkt->pos >= 0)) &&
+                (pkt->flags & AV_PKT_FLAG_KEY) && pkt->dts != AV_NOPTS_VALUE)
+                add_keyframe_index_entry(s, st, pkt->pos, pkt->dts);
             got_packet = 1;
         } else if (st->discard < AVDISCARD_ALL) {
             if ((ret = parse_packet(s, &cur_pkt, cur_pkt.stream_index)) < 0)
@@ -1686,6 +1705,65 @@ static int seek_frame_generic(AVFormatContext *s,
     return 0;
 }
 
+/**
+ * Fill the index by demuxing the whole input, without decoding it.
+ */
+static void seek_index_scan(AVFormatContext *s)
+{
+    AVParserState *state;
+    AVPacket pkt;
+
+    if (!s->pb->seekable || !(state = ff_store_parser_state(s)))
+        return;
+    av_log(s, AV_LOG_VERBOSE, "Scanning the input for keyframes\n");
+    if (avio_seek(s->pb, s->data_offset, SEEK_SET) >= 0)
+        while (read_frame_internal(s, &pkt) >= 0)
+            av_free_packet(&pkt);
+    ff_restore_parser_state(s, state);
+}
+
+/**
+ * Load the seek index file once the streams are known.
+ */
+static void seek_index_load(AVFormatContext *s)
+{
+    if (s->seek_index_loaded)
+        return;
+    s->seek_index_loaded = 1;
+    if (ff_seek_index_read(s) < 0 && s->seek_index_scan)
+        seek_index_scan(s);
+}
+
+/* The cached index may have holes where the input was never read, only
+ * trust it when the keyframes around the target are close to each other. */
+#define SEEK_INDEX_MAX_GAP (10 * AV_TIME_BASE)
+
+static int seek_frame_index(AVFormatContext *s,
+                            int stream_index, int64_t timestamp, int flags)
+{
+    AVStream *st = s->streams[stream_index];
+    AVIndexEntry *ie;
+    int64_t ret, max_gap;
+    int before, after;
+
+    before = av_index_search_timestamp(st, timestamp, flags | AVSEEK_FLAG_BACKWARD);
+    after  = av_index_search_timestamp(st, timestamp, flags & ~AVSEEK_FLAG_BACKWARD);
+    if (before < 0 || after < 0)
+        return -1;
+    max_gap = av_rescale_q(SEEK_INDEX_MAX_GAP, AV_TIME_BASE_Q, st->time_base);
+    if (st->index_entries[after].timestamp -
+        st->index_entries[before].timestamp > max_gap)
+        return -1;
+
+    ie = &st->index_entries[flags & AVSEEK_FLAG_BACKWARD ? before : after];
+    ff_read_frame_flush(s);
+    if ((ret = avio_seek(s->pb, ie->pos, SEEK_SET)) < 0)
+        return ret;
+    ff_update_cur_dts(s, st, ie->timestamp);
+
+    return 0;
+}
+
 static int seek_frame_internal(AVFormatContext *s, int stream_index,
                                int64_t timestamp, int flags)
 {
@@ -1709,6 +1787,12 @@ static int seek_frame_internal(AVFormatContext *s, int stream_index,
         timestamp = av_rescale(timestamp, st->time_base.den, AV_TIME_BASE * (int64_t)st->time_base.num);
     }
 
+    if (ff_seek_index_enabled(s)) {
+        seek_index_load(s);
+        if (seek_frame_index(s, stream_index, timestamp, flags) >= 0)
+            return 0;
+    }
+
     /* first, we try the format specific seek */
     if (s->iformat->read_seek) {
         ff_read_frame_flush(s);
@@ -2009,9 +2093,8 @@ static void estimate_timings(AVFormatContext *ic, int64_t old_offset)
     }
 }
 
-static int has_codec_parameters(AVStream *st)
+static int has_codec_parameters(AVStream *st, AVCodecContext *avctx)
 {
-    AVCodecContext *avctx = st->codec;
     int val;
     switch (avctx->codec_type) {
     case AVMEDIA_TYPE_AUDIO:
@@ -2031,14 +2114,24 @@ static int has_codec_parameters(AVStream *st)
     return avctx->codec_id != AV_CODEC_ID_NONE && val != 0;
 }
 
-static int has_decode_delay_been_guessed(AVStream *st)
+static int has_decode_delay_been_guessed(AVCodecContext *avctx,
+                                         int nb_decoded_frames)
 {
-    return st->codec->codec_id != AV_CODEC_ID_H264 ||
-        st->info->nb_decoded_frames >= 6;
+    return avctx->codec_id != AV_CODEC_ID_H264 || nb_decoded_frames >= 6;
 }
 
-/* returns 1 or 0 if or if not decoded data was returned, or a negative error */
-static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **options)
+/**
+ * Decode avpkt until the codec parameters are known.
+ *
+ * st->info->found_decoder is only updated when avctx is not open yet, which
+ * is never the case for the private contexts of the probing workers.
+ *
+ * @param nb_decoded_frames incremented for each decoded frame
+ * @return 1 or 0 if or if not decoded data was returned, or a negative error
+ */
+static int try_decode_frame(AVStream *st, AVCodecContext *avctx,
+                            int *nb_decoded_frames, AVPacket *avpkt,
+                            int nb_frames, AVDictionary **options)
 {
     const AVCodec *codec;
     int got_picture = 1, ret = 0;
@@ -2048,11 +2141,11 @@ static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **option
     if (!frame)
         return AVERROR(ENOMEM);
 
-    if (!avcodec_is_open(st->codec) && !st->info->found_decoder) {
+    if (!avcodec_is_open(avctx) && !st->info->found_decoder) {
         AVDictionary *thread_opt = NULL;
 
-        codec = st->codec->codec ? st->codec->codec :
-                                   avcodec_find_decoder(st->codec->codec_id);
+        codec = avctx->codec ? avctx->codec :
+                               avcodec_find_decoder(avctx->codec_id);
 
         if (!codec) {
             st->info->found_decoder = -1;
@@ -2063,7 +2156,7 @@ static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **option
         /* force thread count to 1 since the h264 decoder will not extract SPS
          *  and PPS to extradata during multi-threaded decoding */
         av_dict_set(options ? options : &thread_opt, "threads", "1", 0);
-        ret = avcodec_open2(st->codec, codec, options ? options : &thread_opt);
+        ret = avcodec_open2(avctx, codec, options ? options : &thread_opt);
         if (!options)
             av_dict_free(&thread_opt);
         if (ret < 0) {
@@ -2081,25 +2174,25 @@ static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **option
 
     while ((pkt.size > 0 || (!pkt.data && got_picture)) &&
            ret >= 0 &&
-           (!has_codec_parameters(st)         ||
-           !has_decode_delay_been_guessed(st) ||
-           (!st->codec_info_nb_frames && st->codec->codec->capabilities & CODEC_CAP_CHANNEL_CONF))) {
+           (!has_codec_parameters(st, avctx)         ||
+           !has_decode_delay_been_guessed(avctx, *nb_decoded_frames) ||
+           (!nb_frames && avctx->codec->capabilities & CODEC_CAP_CHANNEL_CONF))) {
         got_picture = 0;
         avcodec_get_frame_defaults(frame);
-        switch(st->codec->codec_type) {
+        switch(avctx->codec_type) {
         case AVMEDIA_TYPE_VIDEO:
-            ret = avcodec_decode_video2(st->codec, frame,
+            ret = avcodec_decode_video2(avctx, frame,
                                         &got_picture, &pkt);
             break;
         case AVMEDIA_TYPE_AUDIO:
-            ret = avcodec_decode_audio4(st->codec, frame, &got_picture, &pkt);
+            ret = avcodec_decode_audio4(avctx, frame, &got_picture, &pkt);
             break;
         default:
             break;
         }
         if (ret >= 0) {
             if (got_picture)
-                st->info->nb_decoded_frames++;
+                (*nb_decoded_frames)++;
             pkt.data += ret;
             pkt.size -= ret;
             ret       = got_picture;
@@ -2231,13 +2324,438 @@ static int tb_unreliable(AVCodecContext *c){
     return 0;
 }
 
+#if HAVE_PTHREADS
+/**
+ * Streams decoded by the probing workers. Each stream is decoded with a
+ * private copy of its codec context by a single worker, so the demuxer and
+ * the parsers can keep updating AVStream.codec from the calling thread.
+ */
+typedef struct ProbeStream {
+    AVStream *st;
+    AVCodecContext *avctx;      ///< private codec context, decoded by the worker
+    struct ProbeWorker *worker;
+    int has_params;
+    int done;                   ///< parameters found, no more packets needed
+    int flush_ret;              ///< result of flushing the decoder at EOF
+    int nb_decoded_frames;      ///< only accessed by the worker until joined
+    enum AVCodecID codec_id;    ///< of st->codec when the worker was created
+} ProbeStream;
+
+typedef struct ProbeJob {
+    ProbeStream *ps;
+    AVPacket pkt;               ///< an empty packet flushes the decoder
+    int free_pkt;
+    int nb_frames;
+    struct ProbeJob *next;
+} ProbeJob;
+
+typedef struct ProbeWorker {
+    pthread_t thread;
+    pthread_cond_t cond;
+    ProbeJob *jobs, *jobs_end;
+    struct ProbeContext *pc;
+} ProbeWorker;
+
+typedef struct ProbeContext {
+    pthread_mutex_t mutex;
+    ProbeWorker **workers;
+    int nb_workers;
+    int next_worker;
+    ProbeStream **streams;      ///< indexed by stream, NULL if decoded serially
+    int nb_streams;
+    int finish;                 ///< no more jobs will be queued
+    int abort;                  ///< drop the queued jobs
+} ProbeContext;
+
+static void *probe_worker(void *arg)
+{
+    ProbeWorker *w  = arg;
+    ProbeContext *pc = w->pc;
+    ProbeJob *job;
+
+    pthread_mutex_lock(&pc->mutex);
+    for (;;) {
+        ProbeStream *ps;
+        int ret, has_params, done;
+
+        while (!w->jobs && !pc->finish)
+            pthread_cond_wait(&w->cond, &pc->mutex);
+        if (!(job = w->jobs))
+            break;
+        if (!(w->jobs = job->next))
+            w->jobs_end = NULL;
+
+        ps = job->ps;
+        if (!ps->done && !pc->abort) {
+            pthread_mutex_unlock(&pc->mutex);
+            do {
+                ret = try_decode_frame(ps->st, ps->avctx,
+                                       &ps->nb_decoded_frames, &job->pkt,
+                                       job->nb_frames, NULL);
+            } while (!job->pkt.data && ret > 0 &&
+                     !has_codec_parameters(ps->st, ps->avctx));
+            has_params = has_codec_parameters(ps->st, ps->avctx);
+            done       = has_params &&
+                         has_decode_delay_been_guessed(ps->avctx,
+                                                       ps->nb_decoded_frames);
+            pthread_mutex_lock(&pc->mutex);
+            ps->has_params = has_params;
+            ps->done       = done;
+            if (!job->pkt.data)
+                ps->flush_ret = ret;
+        }
+        if (job->free_pkt)
+            av_free_packet(&job->pkt);
+        av_free(job);
+    }
+    pthread_mutex_unlock(&pc->mutex);
+    return NULL;
+}
+
+static void probe_init(ProbeContext *pc)
+{
+    memset(pc, 0, sizeof(*pc));
+    pthread_mutex_init(&pc->mutex, NULL);
+}
+
+static int probe_queue_job(ProbeContext *pc, ProbeStream *ps, AVPacket *pkt,
+                           int nb_frames, int copy)
+{
+    ProbeWorker *w = ps->worker;
+    ProbeJob *job  = av_mallocz(sizeof(*job));
+    int ret;
+
+    if (!job)
+        return AVERROR(ENOMEM);
+    job->ps        = ps;
+    job->nb_frames = nb_frames;
+    if (pkt) {
+        job->pkt = *pkt;
+        /* packets not kept in the packet buffer may point to data owned
+         * by the parser, which is overwritten by the next packet */
+        if (copy && !pkt->destruct) {
+            if ((ret = av_dup_packet(&job->pkt)) < 0) {
+                av_free(job);
+                return ret;
+            }
+            job->free_pkt = 1;
+        }
+    } else {
+        av_init_packet(&job->pkt);
+        job->pkt.data = NULL;
+        job->pkt.size = 0;
+    }
+
+    pthread_mutex_lock(&pc->mutex);
+    if (w->jobs_end)
+        w->jobs_end->next = job;
+    else
+        w->jobs = job;
+    w->jobs_end = job;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&pc->mutex);
+    return 0;
+}
+
+static void probe_free_stream_context(AVCodecContext **pavctx)
+{
+    AVCodecContext *avctx = *pavctx;
+
+    if (!avctx)
+        return;
+    avcodec_close(avctx);
+    av_freep(&avctx->extradata);
+    av_freep(&avctx->intra_matrix);
+    av_freep(&avctx->inter_matrix);
+    av_freep(&avctx->rc_override);
+    av_freep(&avctx->rc_eq);
+    av_freep(pavctx);
+}
+
+/**
+ * Get the worker decoding st, handing it over to one if it is an audio or
+ * video stream that has not been decoded yet.
+ *
+ * @return the stream state or NULL if st is decoded by the calling thread
+ */
+static ProbeStream *probe_get_stream(AVFormatContext *ic, ProbeContext *pc,
+                                     AVStream *st, AVDictionary **options)
+{
+    ProbeStream *ps = NULL;
+    ProbeWorker *w;
+    const AVCodec *codec;
+    AVDictionary *thread_opt = NULL;
+
+    if (ic->probe_threads <= 1)
+        return NULL;
+    if (st->index < pc->nb_streams && pc->streams[st->index])
+        return pc->streams[st->index];
+    if ((st->codec->codec_type != AVMEDIA_TYPE_VIDEO &&
+         st->codec->codec_type != AVMEDIA_TYPE_AUDIO) ||
+        st->info->found_decoder || st->codec_info_nb_frames)
+        return NULL;
+    codec = st->codec->codec ? st->codec->codec :
+                               avcodec_find_decoder(st->codec->codec_id);
+    if (!codec)
+        return NULL;
+
+    if (st->index >= pc->nb_streams) {
+        ProbeStream **streams = av_realloc(pc->streams, (st->index + 1) *
+                                           sizeof(*pc->streams));
+        if (!streams)
+            return NULL;
+        memset(streams + pc->nb_streams, 0,
+               (st->index + 1 - pc->nb_streams) * sizeof(*streams));
+        pc->streams    = streams;
+        pc->nb_streams = st->index + 1;
+    }
+
+    if (!(ps = av_mallocz(sizeof(*ps))) ||
+        !(ps->avctx = avcodec_alloc_context3(NULL)) ||
+        avcodec_copy_context(ps->avctx, st->codec) < 0)
+        goto fail;
+
+    /* the decoders are opened here since avcodec_open2() must not be
+     * called concurrently without a lock manager */
+    av_dict_set(options ? options : &thread_opt, "threads", "1", 0);
+    if (avcodec_open2(ps->avctx, codec, options ? options : &thread_opt) < 0) {
+        av_dict_free(&thread_opt);
+        goto fail;
+    }
+    av_dict_free(&thread_opt);
+
+    if (pc->nb_workers < ic->probe_threads) {
+        ProbeWorker **workers = av_realloc(pc->workers, (pc->nb_workers + 1) *
+                                           sizeof(*pc->workers));
+        if (!workers)
+            goto fail;
+        pc->workers = workers;
+        if (!(w = av_mallocz(sizeof(*w))))
+            goto fail;
+        w->pc = pc;
+        pthread_cond_init(&w->cond, NULL);
+        if (pthread_create(&w->thread, NULL, probe_worker, w)) {
+            pthread_cond_destroy(&w->cond);
+            av_free(w);
+            if (!pc->nb_workers)
+                goto fail;
+        } else {
+            pc->workers[pc->nb_workers++] = w;
+        }
+    }
+    ps->worker   = pc->workers[pc->next_worker++ % pc->nb_workers];
+    ps->st       = st;
+    ps->codec_id = st->codec->codec_id;
+    st->info->found_decoder = 1;
+    pc->streams[st->index]  = ps;
+    return ps;
+
+fail:
+    if (ps)
+        probe_free_stream_context(&ps->avctx);
+    av_free(ps);
+    return NULL;
+}
+
+/**
+ * Decode pkt in a worker thread if st is probed by one.
+ *
+ * @return 1 if the packet was queued, 0 if it should be decoded serially,
+ *         a negative error code otherwise
+ */
+static int probe_decode_packet(AVFormatContext *ic, ProbeContext *pc,
+                               AVStream *st, AVPacket *pkt,
+                               AVDictionary **options)
+{
+    ProbeStream *ps = probe_get_stream(ic, pc, st, options);
+    int done, ret;
+
+    if (!ps)
+        return 0;
+    pthread_mutex_lock(&pc->mutex);
+    done = ps->done;
+    pthread_mutex_unlock(&pc->mutex);
+    if (done)
+        return 1;
+    ret = probe_queue_job(pc, ps, pkt, st->codec_info_nb_frames,
+                          ic->flags & AVFMT_FLAG_NOBUFFER);
+    return ret < 0 ? ret : 1;
+}
+
+static int probe_has_parameters(ProbeContext *pc, AVStream *st)
+{
+    ProbeStream *ps = st->index < pc->nb_streams ? pc->streams[st->index] : NULL;
+    int has_params;
+
+    if (!ps || !ps->avctx)
+        return has_codec_parameters(st, st->codec);
+    pthread_mutex_lock(&pc->mutex);
+    has_params = ps->has_params;
+    pthread_mutex_unlock(&pc->mutex);
+    return has_params;
+}
+
+/**
+ * Check whether the decoder of a stream has been flushed by a worker.
+ */
+static int probe_stream_flushed(ProbeContext *pc, AVStream *st, int *err)
+{
+    ProbeStream *ps = st->index < pc->nb_streams ? pc->streams[st->index] : NULL;
+
+    if (!ps)
+        return 0;
+    *err = ps->flush_ret;
+    return 1;
+}
+
+static void probe_copy_parameters(ProbeStream *ps)
+{
+    AVCodecContext *dst = ps->st->codec, *src = ps->avctx;
+
+    /* changed by the decoder, e.g. for a different layer of MPEG audio */
+    if (src->codec_id != ps->codec_id)
+        dst->codec_id = src->codec_id;
+    /* set by the decoder, unless the parser already split it out */
+    if (src->extradata_size && !dst->extradata) {
+        dst->extradata = av_mallocz(src->extradata_size +
+                                    FF_INPUT_BUFFER_PADDING_SIZE);
+        if (dst->extradata) {
+            memcpy(dst->extradata, src->extradata, src->extradata_size);
+            dst->extradata_size = src->extradata_size;
+        }
+    }
+
+    switch (src->codec_type) {
+    case AVMEDIA_TYPE_VIDEO:
+        dst->width                  = src->width;
+        dst->height                 = src->height;
+        dst->coded_width            = src->coded_width;
+        dst->coded_height           = src->coded_height;
+        dst->pix_fmt                = src->pix_fmt;
+        dst->sample_aspect_ratio    = src->sample_aspect_ratio;
+        dst->has_b_frames           = src->has_b_frames;
+        dst->time_base              = src->time_base;
+        dst->ticks_per_frame        = src->ticks_per_frame;
+        dst->refs                   = src->refs;
+        dst->field_order            = src->field_order;
+        dst->color_range            = src->color_range;
+        dst->color_primaries        = src->color_primaries;
+        dst->color_trc              = src->color_trc;
+        dst->colorspace             = src->colorspace;
+        dst->chroma_sample_location = src->chroma_sample_location;
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        dst->sample_fmt             = src->sample_fmt;
+        dst->sample_rate            = src->sample_rate;
+        dst->channels               = src->channels;
+        dst->channel_layout         = src->channel_layout;
+        dst->frame_size             = src->frame_size;
+        dst->block_align            = src->block_align;
+        dst->audio_service_type     = src->audio_service_type;
+        break;
+    default:
+        break;
+    }
+    dst->bit_rate                   = src->bit_rate;
+    dst->profile                    = src->profile;
+    dst->level                      = src->level;
+    dst->bits_per_raw_sample        = src->bits_per_raw_sample;
+}
+
+/**
+ * Stop the workers and export what they found to the stream codec contexts.
+ *
+ * @param flush flush the decoders before stopping
+ * @param abort drop the packets still queued
+ */
+static void probe_finish(ProbeContext *pc, int flush, int abort)
+{
+    int i;
+
+    for (i = 0; flush && i < pc->nb_streams; i++)
+        if (pc->streams[i] && pc->streams[i]->avctx)
+            probe_queue_job(pc, pc->streams[i], NULL, 0, 0);
+
+    pthread_mutex_lock(&pc->mutex);
+    pc->finish = 1;
+    pc->abort  = abort;
+    for (i = 0; i < pc->nb_workers; i++)
+        pthread_cond_signal(&pc->workers[i]->cond);
+    pthread_mutex_unlock(&pc->mutex);
+
+    for (i = 0; i < pc->nb_workers; i++) {
+        pthread_join(pc->workers[i]->thread, NULL);
+        pthread_cond_destroy(&pc->workers[i]->cond);
+        av_freep(&pc->workers[i]);
+    }
+    av_freep(&pc->workers);
+    pc->nb_workers = 0;
+
+    for (i = 0; i < pc->nb_streams; i++) {
+        ProbeStream *ps = pc->streams[i];
+        if (!ps || !ps->avctx)
+            continue;
+        probe_copy_parameters(ps);
+        ps->st->info->nb_decoded_frames = ps->nb_decoded_frames;
+        probe_free_stream_context(&ps->avctx);
+    }
+}
+
+static void probe_uninit(ProbeContext *pc)
+{
+    int i;
+
+    probe_finish(pc, 0, 1);
+    for (i = 0; i < pc->nb_streams; i++)
+        av_freep(&pc->streams[i]);
+    av_freep(&pc->streams);
+    pthread_mutex_destroy(&pc->mutex);
+}
+#else
+typedef struct ProbeContext {
+    int unused;
+} ProbeContext;
+
+static void probe_init(ProbeContext *pc)
+{
+}
+
+static int probe_decode_packet(AVFormatContext *ic, ProbeContext *pc,
+                               AVStream *st, AVPacket *pkt,
+                               AVDictionary **options)
+{
+    return 0;
+}
+
+static int probe_has_parameters(ProbeContext *pc, AVStream *st)
+{
+    return has_codec_parameters(st, st->codec);
+}
+
+static int probe_stream_flushed(ProbeContext *pc, AVStream *st, int *err)
+{
+    return 0;
+}
+
+static void probe_finish(ProbeContext *pc, int flush, int abort)
+{
+}
+
+static void probe_uninit(ProbeContext *pc)
+{
+}
+#endif
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     int i, count, ret, read_size, j;
     AVStream *st;
     AVPacket pkt1, *pkt;
     int64_t old_offset = avio_tell(ic->pb);
+    int64_t start_time = av_gettime();
     int orig_nb_streams = ic->nb_streams;        // new streams might appear, no options for those
+    int timed_out = 0;
+    ProbeContext pc;
 
     for(i=0;i<ic->nb_streams;i++) {
         const AVCodec *codec;
@@ -2265,7 +2783,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                               : &thread_opt);
 
         //try to just open decoders, in case this is enough to get parameters
-        if (!has_codec_parameters(st)) {
+        if (!has_codec_parameters(st, st->codec)) {
             if (codec && !st->codec->codec)
                 avcodec_open2(st->codec, codec, options ? &options[i]
                               : &thread_opt);
@@ -2282,6 +2800,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         ic->streams[i]->info->fps_last_dts  = AV_NOPTS_VALUE;
     }
 
+    probe_init(&pc);
     count = 0;
     read_size = 0;
     for(;;) {
@@ -2296,7 +2815,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             int fps_analyze_framecount = 20;
 
             st = ic->streams[i];
-            if (!has_codec_parameters(st))
+            if (!probe_has_parameters(&pc, st))
                 break;
             /* if the timebase is coarse (like the usual millisecond precision
                of mkv), we need to analyze more frames to reliably arrive at
@@ -2334,6 +2853,14 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             av_log(ic, AV_LOG_DEBUG, "Probe buffer size limit %d reached\n", ic->probesize);
             break;
         }
+        if (ic->max_probe_time > 0 &&
+            av_gettime() - start_time >= ic->max_probe_time) {
+            ret = count;
+            timed_out = 1;
+            av_log(ic, AV_LOG_DEBUG, "Probe time limit %"PRId64" reached\n",
+                   ic->max_probe_time);
+            break;
+        }
 
         /* NOTE: a new stream can be added there if no header in file
            (AVFMTCTX_NOHEADER) */
@@ -2347,23 +2874,29 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             int err = 0;
             av_init_packet(&empty_pkt);
 
+            probe_finish(&pc, 1, 0);
+
             ret = -1; /* we could not have all the codec parameters before EOF */
             for(i=0;i<ic->nb_streams;i++) {
                 st = ic->streams[i];
 
                 /* flush the decoders */
-                if (st->info->found_decoder == 1) {
+                if (st->info->found_decoder == 1 &&
+                    !probe_stream_flushed(&pc, st, &err)) {
                     do {
-                        err = try_decode_frame(st, &empty_pkt,
+                        err = try_decode_frame(st, st->codec,
+                                               &st->info->nb_decoded_frames,
+                                               &empty_pkt,
+                                               st->codec_info_nb_frames,
                                                (options && i < orig_nb_streams) ?
                                                &options[i] : NULL);
-                    } while (err > 0 && !has_codec_parameters(st));
+                    } while (err > 0 && !has_codec_parameters(st, st->codec));
                 }
 
                 if (err < 0) {
                     av_log(ic, AV_LOG_WARNING,
                            "decoding for stream %d failed\n", st->index);
-                } else if (!has_codec_parameters(st)) {
+                } else if (!has_codec_parameters(st, st->codec)) {
                     char buf[256];
                     avcodec_string(buf, sizeof(buf), st->codec, 0);
                     av_log(ic, AV_LOG_WARNING,
@@ -2456,8 +2989,10 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             if (i > 0 && i < FF_MAX_EXTRADATA_SIZE) {
                 st->codec->extradata_size= i;
                 st->codec->extradata= av_malloc(st->codec->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE);
-                if (!st->codec->extradata)
-                    return AVERROR(ENOMEM);
+                if (!st->codec->extradata) {
+                    ret = AVERROR(ENOMEM);
+                    goto find_stream_info_err;
+                }
                 memcpy(st->codec->extradata, pkt->data, st->codec->extradata_size);
                 memset(st->codec->extradata + i, 0, FF_INPUT_BUFFER_PADDING_SIZE);
             }
@@ -2471,13 +3006,26 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
            If CODEC_CAP_CHANNEL_CONF is set this will force decoding of at
            least one frame of codec data, this makes sure the codec initializes
            the channel configuration and does not only trust the values from the container.
+
+           With probe_threads > 1, audio and video streams are decoded by
+           worker threads instead, until their parameters are found.
         */
-        try_decode_frame(st, pkt, (options && i < orig_nb_streams ) ? &options[i] : NULL);
+        ret = probe_decode_packet(ic, &pc, st, pkt,
+                                  (options && st->index < orig_nb_streams) ?
+                                  &options[st->index] : NULL);
+        if (ret < 0)
+            goto find_stream_info_err;
+        if (!ret)
+            try_decode_frame(st, st->codec, &st->info->nb_decoded_frames,
+                             pkt, st->codec_info_nb_frames,
+                             (options && i < orig_nb_streams ) ? &options[i] : NULL);
 
         st->codec_info_nb_frames++;
         count++;
     }
 
+    probe_finish(&pc, 0, timed_out);
+
     // close codecs which were opened in try_decode_frame()
     for(i=0;i<ic->nb_streams;i++) {
         st = ic->streams[i];
@@ -2561,11 +3109,14 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     compute_chapters_end(ic);
 
  find_stream_info_err:
+    probe_uninit(&pc);
     for (i=0; i < ic->nb_streams; i++) {
         if (ic->streams[i]->codec)
             ic->streams[i]->codec->thread_count = 0;
         av_freep(&ic->streams[i]->info);
     }
+    if (ret >= 0 && ff_seek_index_enabled(ic))
+        seek_index_load(ic);
     return ret;
 }
 
@@ -2714,6 +3265,13 @@ void avformat_close_input(AVFormatContext **ps)
 
     flush_packet_queue(s);
 
+    if (ff_seek_index_enabled(s) && s->seek_index_dirty) {
+        /* merge with the keyframes cached by earlier sessions */
+        if (!s->seek_index_loaded)
+            ff_seek_index_read(s);
+        ff_seek_index_write(s);
+    }
+
     if (s->iformat) {
         if (s->iformat->read_close)
             s->iformat->read_close(s);
@@ -3353,6 +3911,17 @@ int ff_write_chained(AVFormatContext *dst, int dst_stream, AVPacket *pkt,
     return av_write_frame(dst, &local_pkt);
 }
 
+const char *ff_url_local_path(const char *url)
+{
+    const char *path;
+
+    if (av_strstart(url, "file:", &path))
+        return path;
+    if (!strchr(url, ':') || is_dos_path(url))
+        return url;
+    return NULL;
+}
+
 void ff_parse_key_value(const char *str, ff_parse_key_val_cb callback_get_buf,
                         void *context)
 {
@@ -44,7 +44,7 @@
         "cpuid                       \n\t"                      \
         "xchg   %%"REG_b", %%"REG_S                             \
         : "=a" (eax), "=S" (ebx), "=c" (ecx), "=d" (edx)        \
-        : "0" (index))
+        : "0" (index), "2" (0))
 
 #define xgetbv(index, eax, edx)                                 \
     __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c" (index))
@@ -133,6 +133,15 @@ int ff_get_cpu_flags_x86(void)
             if ((eax & 0x6) == 0x6)
                 rval |= AV_CPU_FLAG_AVX;
         }
+#if HAVE_AVX2
+        /* AVX2 uses the same YMM state, so it also needs the OS support
+         * checked above. */
+        if (max_std_level >= 7 && rval & AV_CPU_FLAG_AVX) {
+            cpuid(7, eax, ebx, ecx, edx);
+            if (ebx & 0x00000020)
+                rval |= AV_CPU_FLAG_AVX2;
+        }
+#endif /* HAVE_AVX2 */
 #endif /* HAVE_AVX */
 #endif /* HAVE_SSE */
     }
@@ -40,6 +40,7 @@
 #define EXTERNAL_SSE42(flags)       CPUEXT(flags, _EXTERNAL, SSE42)
 #define EXTERNAL_AVX(flags)         CPUEXT(flags, _EXTERNAL, AVX)
 #define EXTERNAL_FMA4(flags)        CPUEXT(flags, _EXTERNAL, FMA4)
+#define EXTERNAL_AVX2(flags)        CPUEXT(flags, _EXTERNAL, AVX2)
 
 #define INLINE_AMD3DNOW(flags)      CPUEXT(flags, _INLINE, AMD3DNOW)
 #define INLINE_AMD3DNOWEXT(flags)   CPUEXT(flags, _INLINE, AMD3DNOWEXT)
@@ -53,6 +54,7 @@
 #define INLINE_SSE42(flags)         CPUEXT(flags, _INLINE, SSE42)
 #define INLINE_AVX(flags)           CPUEXT(flags, _INLINE, AVX)
 #define INLINE_FMA4(flags)          CPUEXT(flags, _INLINE, FMA4)
+#define INLINE_AVX2(flags)          CPUEXT(flags, _INLINE, AVX2)
 
 void ff_cpu_cpuid(int index, int *eax, int *ebx, int *ecx, int *edx);
 void ff_cpu_xgetbv(int op, int *eax, int *edx);
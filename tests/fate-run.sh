@@ -117,6 +117,15 @@ enc_dec_pcm(){
     avconv -f $out_fmt -i ${encfile} -c:a pcm_${pcm_fmt} -f ${dec_fmt} -
 }
 
+seek_index(){
+    index="${outdir}/${test}.idx"
+    cleanfiles=$index
+    index=$(target_path ${index})
+    rm -f ${index}
+    run "$@" seek_index ${index} seek_index_scan 1 || return
+    run "$@" seek_index ${index}
+}
+
 FLAGS="-flags +bitexact -sws_flags +accurate_rnd+bitexact"
 DEC_OPTS="-threads $threads -idct simple $FLAGS"
 ENC_OPTS="-threads 1        -idct simple -dct fastint"
@@ -8,6 +8,7 @@ FATE_LAVF-$(call ENCDEC,  DPX,                   IMAGE2)             += dpx
 FATE_LAVF-$(call ENCDEC2, DVVIDEO,    PCM_S16LE, AVI)                += dv_fmt
 FATE_LAVF-$(call ENCDEC2, MPEG1VIDEO, MP2,       FFM)                += ffm
 FATE_LAVF-$(call ENCDEC,  FLV,                   FLV)                += flv_fmt
+FATE_LAVF-$(call ENCDEC2, FLV,        ADPCM_SWF, FLV)                += flv_low_latency
 FATE_LAVF-$(call ENCDEC,  GIF,                   IMAGE2)             += gif
 FATE_LAVF-$(call ENCDEC2, MPEG2VIDEO, PCM_S16LE, GXF)                += gxf
 FATE_LAVF-$(call ENCDEC,  MJPEG,                 IMAGE2)             += jpg
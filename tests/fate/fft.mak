@@ -38,5 +38,14 @@ $(FATE_FFT_FIXED): libavcodec/fft-fixed-test$(EXESUF)
 $(FATE_FFT_FIXED): CMD = run libavcodec/fft-fixed-test $(CPUFLAGS:%=-c%) $(ARGS)
 $(FATE_FFT_FIXED): REF = /dev/null
 
-FATE-$(call ALLYES, AVCODEC FFT) += $(FATE_FFT) $(FATE_FFT_FIXED)
-fate-fft: $(FATE_FFT) $(FATE_FFT_FIXED)
+# every transform type, forward and inverse, at every size in one run
+FATE_FFT_ALL = fate-fft-all fate-fft-fixed-all
+
+fate-fft-all:       libavcodec/fft-test$(EXESUF)
+fate-fft-all:       CMD = run libavcodec/fft-test $(CPUFLAGS:%=-c%) -a -n12
+fate-fft-fixed-all: libavcodec/fft-fixed-test$(EXESUF)
+fate-fft-fixed-all: CMD = run libavcodec/fft-fixed-test $(CPUFLAGS:%=-c%) -a -n12
+$(FATE_FFT_ALL): REF = /dev/null
+
+FATE-$(call ALLYES, AVCODEC FFT) += $(FATE_FFT) $(FATE_FFT_FIXED) $(FATE_FFT_ALL)
+fate-fft: $(FATE_FFT) $(FATE_FFT_FIXED) $(FATE_FFT_ALL)
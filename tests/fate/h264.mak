@@ -175,7 +175,15 @@ FATE_H264  := $(FATE_H264:%=fate-h264-conformance-%)                    \
               fate-h264-extreme-plane-pred                              \
               fate-h264-lossless                                        \
 
+# single slice progressive streams, deblocked in a wavefront by the slice threads
+FATE_H264_SLICE_THREADS = caba3_sva_b                                    \
+                          frext-hpcv_brcm_a                              \
+                          sva_ba1_b                                      \
+
+FATE_H264_SLICE_THREADS := $(FATE_H264_SLICE_THREADS:%=fate-h264-slice-threads-%)
+
 FATE_H264-$(call DEMDEC, H264, H264) += $(FATE_H264)
+FATE_H264-$(call DEMDEC, H264, H264) += $(FATE_H264_SLICE_THREADS)
 FATE_H264-$(call DEMDEC,  MOV, H264) += fate-h264-interlace-crop
 FATE_H264-$(call ALLYES, MOV_DEMUXER H264_MP4TOANNEXB_BSF) += fate-h264-bsf-mp4toannexb
 
@@ -356,6 +364,14 @@ fate-h264-conformance-sva_nl1_b:                  CMD = framecrc -i $(SAMPLES)/h
 fate-h264-conformance-sva_nl2_e:                  CMD = framecrc -i $(SAMPLES)/h264-conformance/SVA_NL2_E.264
 
 fate-h264-bsf-mp4toannexb:                        CMD = md5 -i $(SAMPLES)/h264/interlaced_crop.mp4 -vcodec copy -bsf h264_mp4toannexb -f h264
+fate-h264-slice-threads-caba3_sva_b:              CMD = framecrc -i $(SAMPLES)/h264-conformance/CABA3_SVA_B.264
+fate-h264-slice-threads-frext-hpcv_brcm_a:        CMD = framecrc -i $(SAMPLES)/h264-conformance/FRext/HPCV_BRCM_A.264
+fate-h264-slice-threads-sva_ba1_b:                CMD = framecrc -i $(SAMPLES)/h264-conformance/SVA_BA1_B.264
+
+$(FATE_H264_SLICE_THREADS): THREADS = 4
+$(FATE_H264_SLICE_THREADS): THREAD_TYPE = slice
+$(FATE_H264_SLICE_THREADS): REF = $(SRC_PATH)/tests/ref/fate/$(@:fate-h264-slice-threads-%=h264-conformance-%)
+
 fate-h264-extreme-plane-pred:                     CMD = framemd5 -i $(SAMPLES)/h264/extreme-plane-pred.h264
 fate-h264-interlace-crop:                         CMD = framecrc -i $(SAMPLES)/h264/interlaced_crop.mp4 -vframes 3
 fate-h264-lossless:                               CMD = framecrc -i $(SAMPLES)/h264/lossless.h264
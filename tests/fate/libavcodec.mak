@@ -1,3 +1,15 @@
+FATE_LIBAVCODEC-$(call ALLYES, AAC_DECODER DCA_DECODER) += fate-audiodsp
+fate-audiodsp: libavcodec/audiodsp-test$(EXESUF)
+fate-audiodsp: CMD = run libavcodec/audiodsp-test
+
+FATE_LIBAVCODEC-$(CONFIG_H264_DECODER) += fate-cabac
+fate-cabac: libavcodec/cabac-test$(EXESUF)
+fate-cabac: CMD = run libavcodec/cabac-test
+
+FATE_LIBAVCODEC-yes += fate-get_bits
+fate-get_bits: libavcodec/get_bits-test$(EXESUF)
+fate-get_bits: CMD = run libavcodec/get_bits-test
+
 FATE_LIBAVCODEC-$(CONFIG_GOLOMB) += fate-golomb
 fate-golomb: libavcodec/golomb-test$(EXESUF)
 fate-golomb: CMD = run libavcodec/golomb-test
@@ -13,6 +25,14 @@ FATE_LIBAVCODEC-yes += fate-iirfilter
 fate-iirfilter: libavcodec/iirfilter-test$(EXESUF)
 fate-iirfilter: CMD = run libavcodec/iirfilter-test
 
+FATE_LIBAVCODEC-yes += fate-motion
+fate-motion: libavcodec/motion-test$(EXESUF)
+fate-motion: CMD = run libavcodec/motion-test
+
+FATE_LIBAVCODEC-yes += fate-put_bits
+fate-put_bits: libavcodec/put_bits-test$(EXESUF)
+fate-put_bits: CMD = run libavcodec/put_bits-test
+
 FATE_LIBAVCODEC-$(CONFIG_RANGECODER) += fate-rangecoder
 fate-rangecoder: libavcodec/rangecoder-test$(EXESUF)
 fate-rangecoder: CMD = run libavcodec/rangecoder-test
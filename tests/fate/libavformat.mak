@@ -6,5 +6,26 @@ FATE_LIBAVFORMAT += fate-url
 fate-url: libavformat/url-test$(EXESUF)
 fate-url: CMD = run libavformat/url-test
 
+# AVFrame.thread_delay and reorder_delay with and without a max_frame_delay
+FATE_FRAMEDELAY_MPEG4-$(HAVE_PTHREADS) += fate-framedelay-mpeg4-threads \
+                                          fate-framedelay-mpeg4-delay-1
+FATE_FRAMEDELAY_MPEG4 = fate-framedelay-mpeg4 $(FATE_FRAMEDELAY_MPEG4-yes)
+$(FATE_FRAMEDELAY_MPEG4): fate-vsynth2-mpeg4-adap
+$(FATE_FRAMEDELAY_MPEG4): SRC = $(TARGET_PATH)/tests/data/fate/vsynth2-mpeg4-adap.avi
+fate-framedelay-mpeg4:         ARGS = 1
+fate-framedelay-mpeg4-threads: ARGS = 3
+fate-framedelay-mpeg4-delay-1: ARGS = 3 1
+FATE_FRAMEDELAY-$(call ENCDEC, MPEG4, AVI) += $(FATE_FRAMEDELAY_MPEG4)
+
+FATE_FRAMEDELAY_MPEG2-$(HAVE_PTHREADS) += fate-framedelay-mpeg2-delay-1
+fate-framedelay-mpeg2-delay-1: fate-vsynth2-mpeg2-thread
+fate-framedelay-mpeg2-delay-1: SRC = $(TARGET_PATH)/tests/data/fate/vsynth2-mpeg2-thread.mpeg2video
+fate-framedelay-mpeg2-delay-1: ARGS = 4 1
+FATE_FRAMEDELAY-$(call ENCDEC, MPEG2VIDEO, MPEG2VIDEO MPEGVIDEO) += $(FATE_FRAMEDELAY_MPEG2-yes)
+
+$(FATE_FRAMEDELAY-yes): libavformat/framedelay-test$(EXESUF)
+$(FATE_FRAMEDELAY-yes): CMD = run libavformat/framedelay-test$(EXESUF) $(SRC) $(ARGS)
+FATE_LIBAVFORMAT += $(FATE_FRAMEDELAY-yes)
+
 FATE-$(CONFIG_AVFORMAT) += $(FATE_LIBAVFORMAT)
 fate-libavformat: $(FATE_LIBAVFORMAT)
@@ -16,3 +16,15 @@ fate-probe-format: $(FATE_PROBE_FORMAT)
 $(FATE_PROBE_FORMAT): avprobe$(EXESUF)
 $(FATE_PROBE_FORMAT): CMP = oneline
 fate-probe-format-%: CMD = probefmt $(SAMPLES)/probe-format/$(@:fate-probe-format-%=%)
+
+# stream parameters found by decoding in the probing threads, the same as
+# without them
+
+FATE_PROBE_THREADS-$(call ENCDEC2, MPEG2VIDEO, MP2, MPEGTS) += fate-probe-threads-ts
+fate-probe-threads-ts: fate-lavf-ts
+fate-probe-threads-ts: CMD = run avprobe -v 0 -probe_threads 4 -show_streams $(TARGET_PATH)/tests/data/lavf/lavf.ts
+
+$(FATE_PROBE_THREADS-yes): avprobe$(EXESUF)
+
+FATE_AVCONV-$(CONFIG_AVPROBE) += $(FATE_PROBE_THREADS-yes)
+fate-probe-threads: $(FATE_PROBE_THREADS-yes)
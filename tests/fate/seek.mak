@@ -123,6 +123,7 @@ fate-seek-vsynth2-mpeg2-thread-ivlc: SRC = fate/vsynth2-mpeg2-thread-ivlc.mpeg2v
 fate-seek-vsynth2-mpeg4:             SRC = fate/vsynth2-mpeg4.mp4
 fate-seek-vsynth2-mpeg4-adap:        SRC = fate/vsynth2-mpeg4-adap.avi
 fate-seek-vsynth2-mpeg4-adv:         SRC = fate/vsynth2-mpeg4-adv.avi
+fate-seek-vsynth2-mpeg4-coarse-me:   SRC = fate/vsynth2-mpeg4-coarse-me.avi
 fate-seek-vsynth2-mpeg4-error:       SRC = fate/vsynth2-mpeg4-error.avi
 fate-seek-vsynth2-mpeg4-nr:          SRC = fate/vsynth2-mpeg4-nr.avi
 fate-seek-vsynth2-mpeg4-qpel:        SRC = fate/vsynth2-mpeg4-qpel.avi
@@ -225,5 +226,17 @@ $(FATE_SEEK): CMD = run libavformat/seek-test$(EXESUF) $(TARGET_PATH)/tests/data
 $(FATE_SEEK): fate-seek-%: fate-%
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
-fate-seek:     $(FATE_SEEK)
+# the seek index cache, built by scanning the file and then reused
+
+FATE_SEEK_INDEX-$(call ENCDEC2, MPEG1VIDEO, MP2, MPEG1SYSTEM MPEGPS) += mpg
+
+fate-seek-index-mpg: SRC = lavf/lavf.mpg
+
+FATE_SEEK_INDEX = $(FATE_SEEK_INDEX-yes:%=fate-seek-index-%)
+
+$(FATE_SEEK_INDEX): libavformat/seek-test$(EXESUF)
+$(FATE_SEEK_INDEX): CMD = seek_index libavformat/seek-test$(EXESUF) $(TARGET_PATH)/tests/data/$(SRC)
+$(FATE_SEEK_INDEX): fate-seek-index-%: fate-lavf-%
+
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_INDEX)
+fate-seek:     $(FATE_SEEK) $(FATE_SEEK_INDEX)
@@ -103,7 +103,11 @@ FATE_MPEG2 = mpeg2                                                      \
              mpeg2-ilace                                                \
              mpeg2-ivlc-qprd                                            \
              mpeg2-thread                                               \
-             mpeg2-thread-ivlc
+             mpeg2-thread-ivlc                                          \
+             mpeg2-thread-rows
+
+FATE_MPEG2-$(HAVE_PTHREADS) += mpeg2-lookahead
+FATE_MPEG2 += $(FATE_MPEG2-yes)
 
 FATE_VCODEC-$(call ENCDEC, MPEG2VIDEO, MPEG2VIDEO MPEGVIDEO) += $(FATE_MPEG2)
 
@@ -121,6 +125,8 @@ fate-vsynth%-mpeg2-422:          ENCOPTS = -vb 1000k                    \
                                            -pix_fmt yuv422p
 fate-vsynth%-mpeg2-idct-int:     ENCOPTS = -qscale 10 -idct int -dct int
 fate-vsynth%-mpeg2-ilace:        ENCOPTS = -qscale 10 -flags +ildct+ilme
+fate-vsynth%-mpeg2-lookahead:    ENCOPTS = -qscale 10 -bf 3 -b_strategy 2 \
+                                           -lookahead 2
 fate-vsynth%-mpeg2-ivlc-qprd:    ENCOPTS = -vb 500k                     \
                                            -bf 2                        \
                                            -trellis 1                   \
@@ -133,10 +139,13 @@ fate-vsynth%-mpeg2-thread:       ENCOPTS = -qscale 10 -bf 2 -flags +ildct+ilme \
                                            -threads 2 -slices 2
 fate-vsynth%-mpeg2-thread-ivlc:  ENCOPTS = -qscale 10 -bf 2 -flags +ildct+ilme \
                                            -intra_vlc 1 -threads 2 -slices 2
+fate-vsynth%-mpeg2-thread-rows:  ENCOPTS = -qscale 10 -bf 2 -flags +ildct+ilme \
+                                           -threads 4 -slices 1
 
 FATE_MPEG4_MP4 = mpeg4
 FATE_MPEG4_AVI = mpeg4-rc                                               \
                  mpeg4-adv                                              \
+                 mpeg4-coarse-me                                        \
                  mpeg4-qprd                                             \
                  mpeg4-adap                                             \
                  mpeg4-qpel                                             \
@@ -158,6 +167,9 @@ fate-vsynth%-mpeg4-adv:          ENCOPTS = -qscale 9 -flags +mv4+aic       \
                                            -data_partitioning 1 -trellis 1 \
                                            -mbd bits -ps 200
 
+fate-vsynth%-mpeg4-coarse-me:    ENCOPTS = -qscale 8 -bf 1 -flags +mv4 \
+                                           -mpv_flags +coarse_me
+
 fate-vsynth%-mpeg4-error:        ENCOPTS = -qscale 7 -flags +mv4+aic    \
                                            -data_partitioning 1 -mbd rd \
                                            -ps 250 -error 10
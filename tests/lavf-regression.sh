@@ -86,6 +86,12 @@ if [ -n "$do_flv_fmt" ] ; then
 do_lavf flv "" "-an"
 fi
 
+if [ -n "$do_flv_low_latency" ] ; then
+file=${outfile}lavf_low_latency.flv
+do_avconv $file $DEC_OPTS -f image2 -vcodec pgmyuv -i $raw_src $DEC_OPTS -ar 44100 -f s16le -i $pcm_src $ENC_OPTS -t 1 -qscale:v 10 -acodec adpcm_swf
+do_avconv_crc $file $DEC_OPTS -flv_low_latency 1 -i $target_path/$file
+fi
+
 if [ -n "$do_mov" ] ; then
 do_lavf mov "" "-acodec pcm_alaw -c:v mpeg4"
 fi